@@ -120,6 +120,10 @@ static void *mttcg_cpu_thread_fn(void *arg)
         }
 
         qatomic_mb_set(&cpu->exit_request, 0);
+        if (cpu_clock_skip_idle && all_cpu_threads_idle()) {
+            /* Let the main loop skip to the next timer */
+            qemu_notify_event();
+        }
         qemu_wait_io_event(cpu);
     } while (!cpu->unplug || cpu_can_run(cpu));
 
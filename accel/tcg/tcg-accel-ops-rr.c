@@ -252,7 +252,8 @@ static void *rr_cpu_thread_fn(void *arg)
             qatomic_mb_set(&cpu->exit_request, 0);
         }
 
-        if (icount_enabled() && all_cpu_threads_idle()) {
+        if ((icount_enabled() || cpu_clock_skip_idle) &&
+            all_cpu_threads_idle()) {
             /*
              * When all cpus are sleeping (e.g in WFI), to avoid a deadlock
              * in the main_loop, wake it up in order to start the warp timer.
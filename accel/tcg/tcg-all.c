@@ -41,6 +41,7 @@ struct TCGState {
     AccelState parent_obj;
 
     bool mttcg_enabled;
+    bool sleep_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
 };
@@ -98,6 +99,7 @@ static void tcg_accel_instance_init(Object *obj)
     TCGState *s = TCG_STATE(obj);
 
     s->mttcg_enabled = default_mttcg_enabled();
+    s->sleep_enabled = true;
 
     /* If debugging enabled, default "auto on", otherwise off. */
 #if defined(CONFIG_DEBUG_TCG) && !defined(CONFIG_USER_ONLY)
@@ -120,6 +122,9 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+#ifndef CONFIG_USER_ONLY
+    cpu_clock_skip_idle = !s->sleep_enabled;
+#endif
 
     page_init();
     tb_htable_init();
@@ -207,6 +212,23 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_sleep(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->sleep_enabled;
+}
+
+static void tcg_set_sleep(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    if (!value && icount_enabled()) {
+        error_setg(errp, "Use -icount sleep=off when icount is enabled");
+        return;
+    }
+    s->sleep_enabled = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -228,6 +250,11 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_bool(oc, "sleep",
+        tcg_get_sleep, tcg_set_sleep);
+    object_class_property_set_description(oc, "sleep",
+        "Wait in real time for the timers when all vCPUs are idle");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -111,6 +111,97 @@ qcrypto_gcrypt_hash_bytesv(QCryptoHashAlgorithm alg,
 }
 
 
+static QCryptoHash *
+qcrypto_gcrypt_hash_new(QCryptoHashAlgorithm alg, Error **errp)
+{
+    QCryptoHash *hash;
+    gcry_md_hd_t md;
+    int ret;
+
+    if (!qcrypto_hash_supports(alg)) {
+        error_setg(errp,
+                   "Unknown hash algorithm %d",
+                   alg);
+        return NULL;
+    }
+
+    ret = gcry_md_open(&md, qcrypto_hash_alg_map[alg], 0);
+    if (ret < 0) {
+        error_setg(errp,
+                   "Unable to initialize hash algorithm: %s",
+                   gcry_strerror(ret));
+        return NULL;
+    }
+
+    hash = g_new0(QCryptoHash, 1);
+    hash->alg = alg;
+    hash->opaque = md;
+    return hash;
+}
+
+static int
+qcrypto_gcrypt_hash_update(QCryptoHash *hash,
+                           const struct iovec *iov,
+                           size_t niov,
+                           Error **errp)
+{
+    gcry_md_hd_t md = hash->opaque;
+    size_t i;
+
+    for (i = 0; i < niov; i++) {
+        gcry_md_write(md, iov[i].iov_base, iov[i].iov_len);
+    }
+    return 0;
+}
+
+static int
+qcrypto_gcrypt_hash_finalize(QCryptoHash *hash,
+                             uint8_t **result,
+                             size_t *resultlen,
+                             Error **errp)
+{
+    gcry_md_hd_t md = hash->opaque;
+    unsigned char *digest;
+    int ret;
+
+    ret = gcry_md_get_algo_dlen(qcrypto_hash_alg_map[hash->alg]);
+    if (ret <= 0) {
+        error_setg(errp,
+                   "Unable to get hash length: %s",
+                   gcry_strerror(ret));
+        return -1;
+    }
+    if (*resultlen == 0) {
+        *resultlen = ret;
+        *result = g_new0(uint8_t, *resultlen);
+    } else if (*resultlen != ret) {
+        error_setg(errp,
+                   "Result buffer size %zu is smaller than hash %d",
+                   *resultlen, ret);
+        return -1;
+    }
+
+    digest = gcry_md_read(md, 0);
+    if (!digest) {
+        error_setg(errp,
+                   "No digest produced");
+        return -1;
+    }
+    memcpy(*result, digest, *resultlen);
+    return 0;
+}
+
+static void qcrypto_gcrypt_hash_free(QCryptoHash *hash)
+{
+    gcry_md_close(hash->opaque);
+    g_free(hash);
+}
+
+
 QCryptoHashDriver qcrypto_hash_lib_driver = {
     .hash_bytesv = qcrypto_gcrypt_hash_bytesv,
+    .hash_new = qcrypto_gcrypt_hash_new,
+    .hash_update = qcrypto_gcrypt_hash_update,
+    .hash_finalize = qcrypto_gcrypt_hash_finalize,
+    .hash_free = qcrypto_gcrypt_hash_free,
 };
@@ -95,6 +95,76 @@ qcrypto_glib_hash_bytesv(QCryptoHashAlgorithm alg,
 }
 
 
+static QCryptoHash *
+qcrypto_glib_hash_new(QCryptoHashAlgorithm alg, Error **errp)
+{
+    QCryptoHash *hash;
+
+    if (!qcrypto_hash_supports(alg)) {
+        error_setg(errp,
+                   "Unknown hash algorithm %d",
+                   alg);
+        return NULL;
+    }
+
+    hash = g_new0(QCryptoHash, 1);
+    hash->alg = alg;
+    hash->opaque = g_checksum_new(qcrypto_hash_alg_map[alg]);
+    return hash;
+}
+
+static int
+qcrypto_glib_hash_update(QCryptoHash *hash,
+                         const struct iovec *iov,
+                         size_t niov,
+                         Error **errp)
+{
+    size_t i;
+
+    for (i = 0; i < niov; i++) {
+        g_checksum_update(hash->opaque, iov[i].iov_base, iov[i].iov_len);
+    }
+    return 0;
+}
+
+static int
+qcrypto_glib_hash_finalize(QCryptoHash *hash,
+                           uint8_t **result,
+                           size_t *resultlen,
+                           Error **errp)
+{
+    int ret = g_checksum_type_get_length(qcrypto_hash_alg_map[hash->alg]);
+
+    if (ret < 0) {
+        error_setg(errp, "%s",
+                   "Unable to get hash length");
+        return -1;
+    }
+    if (*resultlen == 0) {
+        *resultlen = ret;
+        *result = g_new0(uint8_t, *resultlen);
+    } else if (*resultlen != ret) {
+        error_setg(errp,
+                   "Result buffer size %zu is smaller than hash %d",
+                   *resultlen, ret);
+        return -1;
+    }
+
+    g_checksum_get_digest(hash->opaque, *result, resultlen);
+    return 0;
+}
+
+static void qcrypto_glib_hash_free(QCryptoHash *hash)
+{
+    g_checksum_free(hash->opaque);
+    g_free(hash);
+}
+
+
 QCryptoHashDriver qcrypto_hash_lib_driver = {
     .hash_bytesv = qcrypto_glib_hash_bytesv,
+    .hash_new = qcrypto_glib_hash_new,
+    .hash_update = qcrypto_glib_hash_update,
+    .hash_finalize = qcrypto_glib_hash_finalize,
+    .hash_free = qcrypto_glib_hash_free,
 };
@@ -156,6 +156,84 @@ qcrypto_nettle_hash_bytesv(QCryptoHashAlgorithm alg,
 }
 
 
+static QCryptoHash *
+qcrypto_nettle_hash_new(QCryptoHashAlgorithm alg, Error **errp)
+{
+    QCryptoHash *hash;
+    union qcrypto_hash_ctx *ctx;
+
+    if (!qcrypto_hash_supports(alg)) {
+        error_setg(errp,
+                   "Unknown hash algorithm %d",
+                   alg);
+        return NULL;
+    }
+
+    ctx = g_new(union qcrypto_hash_ctx, 1);
+    qcrypto_hash_alg_map[alg].init(ctx);
+
+    hash = g_new0(QCryptoHash, 1);
+    hash->alg = alg;
+    hash->opaque = ctx;
+    return hash;
+}
+
+static int
+qcrypto_nettle_hash_update(QCryptoHash *hash,
+                           const struct iovec *iov,
+                           size_t niov,
+                           Error **errp)
+{
+    size_t i;
+
+    for (i = 0; i < niov; i++) {
+        /* Avoid writing more than UINT_MAX bytes at a time, see above */
+        size_t len = iov[i].iov_len;
+        uint8_t *base = iov[i].iov_base;
+        while (len) {
+            size_t shortlen = MIN(len, UINT_MAX);
+            qcrypto_hash_alg_map[hash->alg].write(hash->opaque, shortlen,
+                                                  base);
+            len -= shortlen;
+            base += shortlen;
+        }
+    }
+    return 0;
+}
+
+static int
+qcrypto_nettle_hash_finalize(QCryptoHash *hash,
+                             uint8_t **result,
+                             size_t *resultlen,
+                             Error **errp)
+{
+    size_t len = qcrypto_hash_alg_map[hash->alg].len;
+
+    if (*resultlen == 0) {
+        *resultlen = len;
+        *result = g_new0(uint8_t, *resultlen);
+    } else if (*resultlen != len) {
+        error_setg(errp,
+                   "Result buffer size %zu is smaller than hash %zu",
+                   *resultlen, len);
+        return -1;
+    }
+
+    qcrypto_hash_alg_map[hash->alg].result(hash->opaque, *resultlen, *result);
+    return 0;
+}
+
+static void qcrypto_nettle_hash_free(QCryptoHash *hash)
+{
+    g_free(hash->opaque);
+    g_free(hash);
+}
+
+
 QCryptoHashDriver qcrypto_hash_lib_driver = {
     .hash_bytesv = qcrypto_nettle_hash_bytesv,
+    .hash_new = qcrypto_nettle_hash_new,
+    .hash_update = qcrypto_nettle_hash_update,
+    .hash_finalize = qcrypto_nettle_hash_finalize,
+    .hash_free = qcrypto_nettle_hash_free,
 };
@@ -11,9 +11,11 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "hw/arm/boot.h"
 #include "hw/arm/aspeed.h"
 #include "hw/arm/aspeed_soc.h"
+#include "hw/block/flash.h"
 #include "hw/i2c/i2c_mux_pca954x.h"
 #include "hw/i2c/smbus_eeprom.h"
 #include "hw/misc/pca9552.h"
@@ -44,6 +46,7 @@ struct AspeedMachineState {
     MemoryRegion max_ram;
     MemoryRegion *boot_rom;
     bool mmio_exec;
+    bool shared_boot_rom;
     char *fmc_model;
     char *spi_model;
 };
@@ -291,13 +294,18 @@ static void write_boot_rom(void *opaque)
     address_space_write_rom(as, 0, MEMTXATTRS_UNSPECIFIED, storage, rom_size);
 }
 
-static void aspeed_board_init_flashes(AspeedSMCState *s, const char *flashtype,
-                                      unsigned int count, int unit0)
+/*
+ * Returns the flash device of the first CS line, if any
+ */
+static DeviceState *aspeed_board_init_flashes(AspeedSMCState *s,
+                                              const char *flashtype,
+                                              unsigned int count, int unit0)
 {
+    DeviceState *flash0 = NULL;
     int i;
 
     if (!flashtype) {
-        return;
+        return NULL;
     }
 
     for (i = 0; i < count; ++i) {
@@ -326,7 +334,13 @@ static void aspeed_board_init_flashes(AspeedSMCState *s, const char *flashtype,
 
         cs_line = qdev_get_gpio_in_named(dev, SSI_GPIO_CS, 0);
         sysbus_connect_irq(SYS_BUS_DEVICE(s), i + 1, cs_line);
+
+        if (!flash0) {
+            flash0 = dev;
+        }
     }
+
+    return flash0;
 }
 
 static void sdhci_attach_drive(SDHCIState *sdhci, DriveInfo *dinfo)
@@ -350,6 +364,7 @@ static void aspeed_machine_init(MachineState *machine)
     AspeedMachineClass *amc = ASPEED_MACHINE_GET_CLASS(machine);
     AspeedSoCClass *sc;
     DriveInfo *drive0 = drive_get(IF_MTD, 0, 0);
+    DeviceState *boot_flash;
     ram_addr_t max_ram_size;
     int i;
     NICInfo *nd = &nd_table[0];
@@ -382,6 +397,8 @@ static void aspeed_machine_init(MachineState *machine)
                             &error_abort);
     object_property_set_link(OBJECT(&bmc->soc), "dram",
                              OBJECT(machine->ram), &error_abort);
+    object_property_set_link(OBJECT(&bmc->soc), "memory",
+                             OBJECT(get_system_memory()), &error_abort);
     if (machine->kernel_filename) {
         /*
          * When booting with a -kernel command line there is no u-boot
@@ -423,7 +440,7 @@ static void aspeed_machine_init(MachineState *machine)
                           "max_ram", max_ram_size  - machine->ram_size);
     memory_region_add_subregion(&bmc->ram_container, machine->ram_size, &bmc->max_ram);
 
-    aspeed_board_init_flashes(&bmc->soc.fmc,
+    boot_flash = aspeed_board_init_flashes(&bmc->soc.fmc,
                               bmc->fmc_model ? bmc->fmc_model : amc->fmc_model,
                               amc->num_cs, 0);
     aspeed_board_init_flashes(&bmc->soc.spi[0],
@@ -447,6 +464,20 @@ static void aspeed_machine_init(MachineState *machine)
                                      &fl->mmio, 0, size);
             memory_region_add_subregion(get_system_memory(), FIRMWARE_ADDR,
                                         bmc->boot_rom);
+        } else if (bmc->shared_boot_rom && boot_flash) {
+            MemoryRegion *storage = m25p80_get_storage(boot_flash);
+
+            /*
+             * Map the flash storage directly. It is a ROM device: guest
+             * writes are dropped and the flash model keeps translated
+             * code coherent when the flash is programmed. There is no
+             * copy to refresh on reset.
+             */
+            memory_region_init_alias(bmc->boot_rom, NULL, "aspeed.boot_rom",
+                                     storage, 0,
+                                     MIN(size, memory_region_size(storage)));
+            memory_region_add_subregion(get_system_memory(), FIRMWARE_ADDR,
+                                        bmc->boot_rom);
         } else {
             memory_region_init_ram(bmc->boot_rom, NULL, "aspeed.boot_rom",
                                    size, &error_abort);
@@ -1035,9 +1066,9 @@ static void fby35_i2c_init(AspeedMachineState *bmc)
     at24c_eeprom_init(i2c[11], 0x54, fby35_fruid_bmc, sizeof(fby35_fruid_bmc), false);
 
     /*
-     * TODO: There is a multi-master i2c connection to an AST1030 MiniBMC on
+     * There is a multi-master i2c connection to an AST1030 MiniBMC on
      * buses 0, 1, 2, 3, and 9. Source address 0x10, target address 0x20 on
-     * each.
+     * each. It is modelled by the fby35 machine.
      */
 }
 
@@ -1047,9 +1078,12 @@ static void create_unimplemented_i2c_device(I2CBus *bus, uint8_t addr)
     aspeed_eeprom_init(bus, addr, 64 * KiB);
 }
 
-static void oby35_cl_i2c_init(AspeedMachineState *bmc)
+/*
+ * The BIC buses with placeholders at 0x20 stand in for the IPMB link to the
+ * BMC. @ipmb_bus is left alone when the link is modelled (see fby35 below).
+ */
+static void oby35_cl_soc_i2c_init(AspeedSoCState *soc, int ipmb_bus)
 {
-    AspeedSoCState *soc = &bmc->soc;
     I2CBus *i2c[16];
 
     for (int i = 0; i < 16; i++) {
@@ -1059,14 +1093,20 @@ static void oby35_cl_i2c_init(AspeedMachineState *bmc)
     create_unimplemented_i2c_device(i2c[1], 0x71);
     create_unimplemented_i2c_device(i2c[2], 0x16);
     create_unimplemented_i2c_device(i2c[2], 0x10);
-    create_unimplemented_i2c_device(i2c[6], 0x20);
-    create_unimplemented_i2c_device(i2c[7], 0x20);
-    create_unimplemented_i2c_device(i2c[8], 0x20);
+    for (int i = 6; i <= 8; i++) {
+        if (i != ipmb_bus) {
+            create_unimplemented_i2c_device(i2c[i], 0x20);
+        }
+    }
 }
 
-static void oby35_bb_i2c_init(AspeedMachineState *bmc)
+static void oby35_cl_i2c_init(AspeedMachineState *bmc)
+{
+    oby35_cl_soc_i2c_init(&bmc->soc, -1);
+}
+
+static void oby35_bb_soc_i2c_init(AspeedSoCState *soc, int ipmb_bus)
 {
-    AspeedSoCState *soc = &bmc->soc;
     I2CBus *i2c[16];
 
     for (int i = 0; i < 16; i++) {
@@ -1078,8 +1118,16 @@ static void oby35_bb_i2c_init(AspeedMachineState *bmc)
     /* FIXME: This is supposed to be an ltc4282 */
     i2c_slave_create_simple(i2c[1], "adm1272", 0x44);
 
-    create_unimplemented_i2c_device(i2c[6], 0x20);
-    create_unimplemented_i2c_device(i2c[7], 0x20);
+    for (int i = 6; i <= 7; i++) {
+        if (i != ipmb_bus) {
+            create_unimplemented_i2c_device(i2c[i], 0x20);
+        }
+    }
+}
+
+static void oby35_bb_i2c_init(AspeedMachineState *bmc)
+{
+    oby35_bb_soc_i2c_init(&bmc->soc, -1);
 }
 
 static bool aspeed_get_mmio_exec(Object *obj, Error **errp)
@@ -1092,9 +1140,20 @@ static void aspeed_set_mmio_exec(Object *obj, bool value, Error **errp)
     ASPEED_MACHINE(obj)->mmio_exec = value;
 }
 
+static bool aspeed_get_shared_boot_rom(Object *obj, Error **errp)
+{
+    return ASPEED_MACHINE(obj)->shared_boot_rom;
+}
+
+static void aspeed_set_shared_boot_rom(Object *obj, bool value, Error **errp)
+{
+    ASPEED_MACHINE(obj)->shared_boot_rom = value;
+}
+
 static void aspeed_machine_instance_init(Object *obj)
 {
     ASPEED_MACHINE(obj)->mmio_exec = false;
+    ASPEED_MACHINE(obj)->shared_boot_rom = false;
 }
 
 static char *aspeed_get_fmc_model(Object *obj, Error **errp)
@@ -1133,6 +1192,13 @@ static void aspeed_machine_class_props_init(ObjectClass *oc)
     object_class_property_set_description(oc, "execute-in-place",
                            "boot directly from CE0 flash device");
 
+    object_class_property_add_bool(oc, "shared-boot-rom",
+                                   aspeed_get_shared_boot_rom,
+                                   aspeed_set_shared_boot_rom);
+    object_class_property_set_description(oc, "shared-boot-rom",
+                           "map the CE0 flash contents as boot ROM "
+                           "instead of copying them");
+
     object_class_property_add_str(oc, "fmc-model", aspeed_get_fmc_model,
                                    aspeed_set_fmc_model);
     object_class_property_set_description(oc, "fmc-model",
@@ -1431,11 +1497,8 @@ static void fby35_reset(MachineState *state)
 
     qemu_devices_reset();
 
-    /* Board ID */
-    object_property_set_bool(OBJECT(gpio), "gpioV4", true, &error_fatal);
-    object_property_set_bool(OBJECT(gpio), "gpioV5", true, &error_fatal);
-    object_property_set_bool(OBJECT(gpio), "gpioV6", true, &error_fatal);
-    object_property_set_bool(OBJECT(gpio), "gpioV7", false, &error_fatal);
+    /* Board ID: GPIOV4-V6 high, GPIOV7 low (set 5 holds groups U-X) */
+    aspeed_gpio_set_set(gpio, 5, 0xf << 12, 0x7 << 12);
 }
 
 static void aspeed_machine_fby35_class_init(ObjectClass *oc, void *data)
@@ -1468,6 +1531,8 @@ static void aspeed_minibmc_machine_init(MachineState *machine)
 
     object_initialize_child(OBJECT(machine), "soc", &bmc->soc, amc->soc_name);
     qdev_connect_clock_in(DEVICE(&bmc->soc), "sysclk", sysclk);
+    object_property_set_link(OBJECT(&bmc->soc), "memory",
+                             OBJECT(get_system_memory()), &error_abort);
 
     qdev_prop_set_uint32(DEVICE(&bmc->soc), "uart-default",
                          amc->uart_default);
@@ -1514,6 +1579,209 @@ static void aspeed_minibmc_machine_ast1030_evb_class_init(ObjectClass *oc,
     amc->macs_mask = 0;
 }
 
+/*
+ * fby35 with its bridge ICs: the BMC and up to FBY35_MAX_SLOTS CraterLake
+ * BICs plus the BaseBoard BIC in a single process. Each BIC has an address
+ * space of its own, and the IPMB buses between the BMC and the BICs are
+ * linked directly with a pair of i2c-netdev2 devices. With MTTCG, every
+ * SoC runs in its own vCPU thread.
+ *
+ * The BIC UARTs use the serial backends following the ones of the BMC, and
+ * their flashes the MTD drives following the ones of the BMC.
+ */
+#define TYPE_FBY35_MACHINE MACHINE_TYPE_NAME("fby35")
+OBJECT_DECLARE_SIMPLE_TYPE(Fby35MachineState, FBY35_MACHINE)
+
+#define FBY35_MAX_SLOTS  4
+#define FBY35_NUM_BICS   (FBY35_MAX_SLOTS + 1)
+#define FBY35_BMC_IPMB_ADDR 0x10
+#define FBY35_BIC_IPMB_ADDR 0x20
+
+struct Fby35MachineState {
+    AspeedMachineState parent_obj;
+
+    uint32_t slots;
+    char *cl_kernel;
+    char *bb_kernel;
+    Clock *bic_sysclk;
+    MemoryRegion bic_memory[FBY35_NUM_BICS];
+    AspeedSoCState bic[FBY35_NUM_BICS];
+};
+
+typedef struct Fby35BIC {
+    const char *name;
+    bool baseboard;
+    int bmc_bus;
+    int bic_bus;
+} Fby35BIC;
+
+static const Fby35BIC fby35_bics[FBY35_NUM_BICS] = {
+    { "bb",    true,  9, 6 },
+    { "slot1", false, 0, 6 },
+    { "slot2", false, 1, 6 },
+    { "slot3", false, 2, 6 },
+    { "slot4", false, 3, 6 },
+};
+
+static void fby35_ipmb_link(I2CBus *bmc_bus, I2CBus *bic_bus)
+{
+    DeviceState *bmc_end = qdev_new("i2c-netdev2");
+    DeviceState *bic_end = qdev_new("i2c-netdev2");
+
+    /* Each end answers for the controller on the other side */
+    qdev_prop_set_uint8(bmc_end, "address", FBY35_BIC_IPMB_ADDR);
+    qdev_prop_set_uint8(bic_end, "address", FBY35_BMC_IPMB_ADDR);
+    qdev_prop_set_bit(bmc_end, "batch", true);
+    qdev_prop_set_bit(bic_end, "batch", true);
+    object_property_set_link(OBJECT(bmc_end), "peer", OBJECT(bic_end),
+                             &error_abort);
+    object_property_set_link(OBJECT(bic_end), "peer", OBJECT(bmc_end),
+                             &error_abort);
+
+    i2c_slave_realize_and_unref(I2C_SLAVE(bmc_end), bmc_bus, &error_fatal);
+    i2c_slave_realize_and_unref(I2C_SLAVE(bic_end), bic_bus, &error_fatal);
+}
+
+static void fby35_bic_init(Fby35MachineState *s, int n, uint32_t serial_base,
+                           int mtd_base)
+{
+    AspeedMachineState *bmc = ASPEED_MACHINE(s);
+    const Fby35BIC *info = &fby35_bics[n];
+    AspeedSoCState *bic = &s->bic[n];
+    g_autofree char *name = g_strdup_printf("bic-%s", info->name);
+    g_autofree char *sram_name = g_strdup_printf("aspeed.sram.%s", name);
+
+    memory_region_init(&s->bic_memory[n], OBJECT(s), name, 4 * GiB);
+
+    object_initialize_child(OBJECT(s), name, bic, "ast1030-a1");
+    qdev_connect_clock_in(DEVICE(bic), "sysclk", s->bic_sysclk);
+    object_property_set_link(OBJECT(bic), "memory",
+                             OBJECT(&s->bic_memory[n]), &error_abort);
+    qdev_prop_set_uint32(DEVICE(bic), "uart-default", ASPEED_DEV_UART5);
+    qdev_prop_set_uint32(DEVICE(bic), "serial-base", serial_base);
+    /* The BMC SoC keeps the "aspeed.sram" RAMBlock of fby35-bmc */
+    qdev_prop_set_string(DEVICE(bic), "sram-name", sram_name);
+    qdev_realize(DEVICE(bic), NULL, &error_abort);
+
+    aspeed_board_init_flashes(&bic->fmc, "sst25vf032b", 2, mtd_base);
+    aspeed_board_init_flashes(&bic->spi[0], "sst25vf032b", 2, mtd_base + 2);
+    aspeed_board_init_flashes(&bic->spi[1], "sst25vf032b", 2, mtd_base + 4);
+
+    if (info->baseboard) {
+        oby35_bb_soc_i2c_init(bic, info->bic_bus);
+    } else {
+        oby35_cl_soc_i2c_init(bic, info->bic_bus);
+
+        /* The host CPU of the slot */
+        qdev_realize_and_unref(qdev_new("peci-cpu"), BUS(bic->peci.bus),
+                               &error_fatal);
+    }
+
+    fby35_ipmb_link(aspeed_i2c_get_bus(&bmc->soc.i2c, info->bmc_bus),
+                    aspeed_i2c_get_bus(&bic->i2c, info->bic_bus));
+
+    armv7m_load_kernel(bic->armv7m.cpu,
+                       info->baseboard ? s->bb_kernel : s->cl_kernel,
+                       AST1030_INTERNAL_FLASH_SIZE);
+}
+
+static void fby35_machine_init(MachineState *machine)
+{
+    Fby35MachineState *s = FBY35_MACHINE(machine);
+    AspeedMachineClass *amc = ASPEED_MACHINE_GET_CLASS(machine);
+    AspeedSoCClass *sc;
+    uint32_t serial_base;
+    int mtd_base;
+
+    if (s->slots > FBY35_MAX_SLOTS) {
+        error_report("fby35 supports at most %d slots", FBY35_MAX_SLOTS);
+        exit(1);
+    }
+
+    aspeed_machine_init(machine);
+
+    sc = ASPEED_SOC_GET_CLASS(&ASPEED_MACHINE(s)->soc);
+    serial_base = sc->uarts_num;
+    mtd_base = amc->num_cs + 1;
+
+    s->bic_sysclk = clock_new(OBJECT(machine), "bic-sysclk");
+    clock_set_hz(s->bic_sysclk, SYSCLK_FRQ);
+
+    for (int i = 0; i <= s->slots; i++) {
+        fby35_bic_init(s, i, serial_base, mtd_base);
+        serial_base += ASPEED_SOC_GET_CLASS(&s->bic[i])->uarts_num;
+        mtd_base += 3 * 2;
+    }
+}
+
+static void fby35_machine_instance_init(Object *obj)
+{
+    FBY35_MACHINE(obj)->slots = 1;
+}
+
+static void fby35_get_slots(Object *obj, Visitor *v, const char *name,
+                            void *opaque, Error **errp)
+{
+    visit_type_uint32(v, name, &FBY35_MACHINE(obj)->slots, errp);
+}
+
+static void fby35_set_slots(Object *obj, Visitor *v, const char *name,
+                            void *opaque, Error **errp)
+{
+    visit_type_uint32(v, name, &FBY35_MACHINE(obj)->slots, errp);
+}
+
+static char *fby35_get_cl_kernel(Object *obj, Error **errp)
+{
+    return g_strdup(FBY35_MACHINE(obj)->cl_kernel);
+}
+
+static void fby35_set_cl_kernel(Object *obj, const char *value, Error **errp)
+{
+    Fby35MachineState *s = FBY35_MACHINE(obj);
+
+    g_free(s->cl_kernel);
+    s->cl_kernel = g_strdup(value);
+}
+
+static char *fby35_get_bb_kernel(Object *obj, Error **errp)
+{
+    return g_strdup(FBY35_MACHINE(obj)->bb_kernel);
+}
+
+static void fby35_set_bb_kernel(Object *obj, const char *value, Error **errp)
+{
+    Fby35MachineState *s = FBY35_MACHINE(obj);
+
+    g_free(s->bb_kernel);
+    s->bb_kernel = g_strdup(value);
+}
+
+static void fby35_machine_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+    AspeedMachineClass *amc = ASPEED_MACHINE_CLASS(oc);
+
+    mc->desc = "Facebook fby35 BMC with its bridge ICs (Cortex-A7, Cortex-M4)";
+    mc->init = fby35_machine_init;
+    /* The TCG contexts are sized by max_cpus, count in the BICs */
+    mc->default_cpus = mc->min_cpus = mc->max_cpus =
+        aspeed_soc_num_cpus(amc->soc_name) + FBY35_NUM_BICS;
+
+    object_class_property_add(oc, "slots", "uint32", fby35_get_slots,
+                              fby35_set_slots, NULL, NULL);
+    object_class_property_set_description(oc, "slots",
+                                          "Number of CraterLake BICs");
+    object_class_property_add_str(oc, "cl-kernel", fby35_get_cl_kernel,
+                                  fby35_set_cl_kernel);
+    object_class_property_set_description(oc, "cl-kernel",
+                                          "Firmware image of the CraterLake BICs");
+    object_class_property_add_str(oc, "bb-kernel", fby35_get_bb_kernel,
+                                  fby35_set_bb_kernel);
+    object_class_property_set_description(oc, "bb-kernel",
+                                          "Firmware image of the BaseBoard BIC");
+}
+
 static const TypeInfo aspeed_machine_types[] = {
     {
         .name          = MACHINE_TYPE_NAME("palmetto-bmc"),
@@ -1575,6 +1843,12 @@ static const TypeInfo aspeed_machine_types[] = {
         .name          = MACHINE_TYPE_NAME("fby35-bmc"),
         .parent        = MACHINE_TYPE_NAME("ast2600-evb"),
         .class_init    = aspeed_machine_fby35_class_init,
+    }, {
+        .name          = TYPE_FBY35_MACHINE,
+        .parent        = MACHINE_TYPE_NAME("fby35-bmc"),
+        .instance_size = sizeof(Fby35MachineState),
+        .instance_init = fby35_machine_instance_init,
+        .class_init    = fby35_machine_class_init,
     }, {
         .name           = MACHINE_TYPE_NAME("ast1030-evb"),
         .parent         = TYPE_ASPEED_MACHINE,
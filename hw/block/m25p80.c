@@ -24,15 +24,19 @@
 #include "qemu/osdep.h"
 #include "qemu/units.h"
 #include "sysemu/block-backend.h"
+#include "exec/memory.h"
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
 #include "hw/ssi/ssi.h"
 #include "hw/irq.h"
+#include "hw/block/flash.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "sysemu/runstate.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
 #include "trace.h"
@@ -444,15 +448,24 @@ typedef enum {
 
 #define M25P80_INTERNAL_DATA_BUFFER_SZ 16
 
+/* Granularity of the on-demand loading of the storage */
+#define M25P80_LOAD_CHUNK_SZ (64 * KiB)
+
 struct Flash {
     SSIPeripheral parent_obj;
 
     BlockBackend *blk;
 
+    MemoryRegion mem;
     uint8_t *storage;
     uint32_t size;
     int page_size;
 
+    /* Chunks of the storage not loaded yet. NULL when all are */
+    bool lazy;
+    unsigned long *unloaded;
+    uint32_t nr_unloaded;
+
     uint8_t state;
     uint8_t data[M25P80_INTERNAL_DATA_BUFFER_SZ];
     uint32_t len;
@@ -490,6 +503,14 @@ struct Flash {
 
     int64_t dirty_page;
 
+    /* Write-back of the modified pages to the backing store */
+    uint32_t wb_delay;
+    unsigned long *wb_dirty;
+    bool wb_erase;
+    QEMUTimer *wb_timer;
+    uint32_t wb_inflight;
+    int64_t wb_start;
+
     const FlashPartInfo *pi;
 
 };
@@ -499,7 +520,6 @@ struct M25P80Class {
     FlashPartInfo *pi;
 };
 
-#define TYPE_M25P80 "m25p80-generic"
 OBJECT_DECLARE_TYPE(Flash, M25P80Class, M25P80)
 
 static inline Manufacturer get_man(Flash *s)
@@ -534,6 +554,90 @@ static void blk_sync_complete(void *opaque, int ret)
      */
 }
 
+typedef struct FlashWriteBack {
+    Flash *s;
+    QEMUIOVector qiov;
+} FlashWriteBack;
+
+static void flash_writeback_complete(void *opaque, int ret)
+{
+    FlashWriteBack *wb = opaque;
+    Flash *s = wb->s;
+
+    qemu_iovec_destroy(&wb->qiov);
+    g_free(wb);
+
+    if (!--s->wb_inflight) {
+        trace_m25p80_writeback_done(s,
+            (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - s->wb_start) / SCALE_US);
+    }
+}
+
+/*
+ * Write the dirty pages back to the backing store, merging adjacent
+ * pages in a single request.
+ */
+static void flash_writeback_flush(Flash *s)
+{
+    unsigned long npages = s->size / s->pi->page_size;
+    unsigned long start, end;
+    uint32_t pages = 0;
+    uint32_t writes = 0;
+
+    if (!s->wb_dirty) {
+        return;
+    }
+
+    timer_del(s->wb_timer);
+    s->wb_erase = false;
+
+    if (!s->wb_inflight) {
+        s->wb_start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
+
+    start = find_first_bit(s->wb_dirty, npages);
+    while (start < npages) {
+        FlashWriteBack *wb = g_new(FlashWriteBack, 1);
+
+        end = find_next_zero_bit(s->wb_dirty, npages, start);
+        bitmap_clear(s->wb_dirty, start, end - start);
+
+        wb->s = s;
+        qemu_iovec_init(&wb->qiov, 1);
+        qemu_iovec_add(&wb->qiov, s->storage + start * s->pi->page_size,
+                       (end - start) * s->pi->page_size);
+        s->wb_inflight++;
+        blk_aio_pwritev(s->blk, start * s->pi->page_size, &wb->qiov, 0,
+                        flash_writeback_complete, wb);
+
+        pages += end - start;
+        writes++;
+        start = find_next_bit(s->wb_dirty, npages, end);
+    }
+
+    if (writes) {
+        trace_m25p80_writeback_flush(s, pages, writes);
+    }
+}
+
+static void flash_writeback_mark(Flash *s, int64_t off, int64_t len)
+{
+    unsigned long first = off / s->pi->page_size;
+    unsigned long last = DIV_ROUND_UP(off + len, s->pi->page_size);
+
+    bitmap_set(s->wb_dirty, first, last - first);
+
+    if (!timer_pending(s->wb_timer)) {
+        timer_mod(s->wb_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + s->wb_delay);
+    }
+}
+
+static void flash_writeback_timer(void *opaque)
+{
+    flash_writeback_flush(opaque);
+}
+
 static void flash_sync_page(Flash *s, int page)
 {
     QEMUIOVector *iov;
@@ -542,6 +646,11 @@ static void flash_sync_page(Flash *s, int page)
         return;
     }
 
+    if (s->wb_dirty) {
+        flash_writeback_mark(s, page * s->pi->page_size, s->pi->page_size);
+        return;
+    }
+
     iov = g_new(QEMUIOVector, 1);
     qemu_iovec_init(iov, 1);
     qemu_iovec_add(iov, s->storage + page * s->pi->page_size,
@@ -559,12 +668,85 @@ static inline void flash_sync_area(Flash *s, int64_t off, int64_t len)
     }
 
     assert(!(len % BDRV_SECTOR_SIZE));
+
+    if (s->wb_dirty) {
+        flash_writeback_mark(s, off, len);
+        s->wb_erase = true;
+        return;
+    }
+
     iov = g_new(QEMUIOVector, 1);
     qemu_iovec_init(iov, 1);
     qemu_iovec_add(iov, s->storage + off, len);
     blk_aio_pwritev(s->blk, off, iov, 0, blk_sync_complete, iov);
 }
 
+/*
+ * Keep translated code coherent when the storage is mapped by a SPI
+ * controller
+ */
+static void flash_storage_flush(Flash *s, uint32_t off, uint32_t len)
+{
+    if (memory_region_is_romd(&s->mem)) {
+        memory_region_flush_rom_device(&s->mem, off, len);
+    }
+}
+
+static void flash_load_chunk(Flash *s, uint32_t chunk, bool fill)
+{
+    uint32_t off = chunk * M25P80_LOAD_CHUNK_SZ;
+    uint32_t len = MIN(M25P80_LOAD_CHUNK_SZ, s->size - off);
+
+    trace_m25p80_load(s, off, len, fill);
+
+    if (fill && s->blk) {
+        if (blk_pread(s->blk, off, s->storage + off, len) != len) {
+            error_report("m25p80: failed to load flash contents at 0x%x", off);
+            memset(s->storage + off, 0xFF, len);
+        }
+    } else if (fill) {
+        memset(s->storage + off, 0xFF, len);
+    }
+
+    clear_bit(chunk, s->unloaded);
+    if (!--s->nr_unloaded) {
+        g_free(s->unloaded);
+        s->unloaded = NULL;
+        /* All loaded. The storage can now be mapped as RAM */
+        memory_region_rom_device_set_romd(&s->mem, true);
+    }
+}
+
+/*
+ * Load the chunks of the storage covering the [off, off + len[ range
+ * on first access. If @overwrite is set, the range is about to be
+ * entirely rewritten and only the chunks partially covered are read.
+ */
+static void flash_load_range(Flash *s, uint32_t off, uint32_t len,
+                             bool overwrite)
+{
+    uint32_t first = off / M25P80_LOAD_CHUNK_SZ;
+    uint32_t last = (off + len - 1) / M25P80_LOAD_CHUNK_SZ;
+    uint32_t chunk;
+
+    for (chunk = first; chunk <= last && s->unloaded; chunk++) {
+        uint32_t start = chunk * M25P80_LOAD_CHUNK_SZ;
+        uint32_t end = MIN(start + M25P80_LOAD_CHUNK_SZ, s->size);
+
+        if (test_bit(chunk, s->unloaded)) {
+            flash_load_chunk(s, chunk,
+                             !overwrite || start < off || end > off + len);
+        }
+    }
+}
+
+static inline void flash_load(Flash *s, uint32_t off, uint32_t len)
+{
+    if (unlikely(s->unloaded)) {
+        flash_load_range(s, off, len, false);
+    }
+}
+
 static void flash_erase(Flash *s, int offset, FlashCMD cmd)
 {
     uint32_t len;
@@ -613,7 +795,11 @@ static void flash_erase(Flash *s, int offset, FlashCMD cmd)
         qemu_log_mask(LOG_GUEST_ERROR, "M25P80: erase with write protect!\n");
         return;
     }
+    if (unlikely(s->unloaded)) {
+        flash_load_range(s, offset, len, true);
+    }
     memset(s->storage + offset, 0xff, len);
+    flash_storage_flush(s, offset, len);
     flash_sync_area(s, offset, len);
 }
 
@@ -629,7 +815,10 @@ static inline
 void flash_write8(Flash *s, uint32_t addr, uint8_t data)
 {
     uint32_t page = addr / s->pi->page_size;
-    uint8_t prev = s->storage[s->cur_addr];
+    uint8_t prev;
+
+    flash_load(s, s->cur_addr, 1);
+    prev = s->storage[s->cur_addr];
 
     if (!s->write_enable) {
         qemu_log_mask(LOG_GUEST_ERROR, "M25P80: write with write protect!\n");
@@ -668,19 +857,20 @@ void flash_write8(Flash *s, uint32_t addr, uint8_t data)
     } else {
         s->storage[s->cur_addr] &= data;
     }
+    flash_storage_flush(s, s->cur_addr, 1);
 
     flash_sync_dirty(s, page);
     s->dirty_page = page;
 }
 
-static inline int get_addr_length(Flash *s)
+static inline int get_cmd_addr_length(Flash *s, uint8_t cmd)
 {
    /* check if eeprom is in use */
     if (s->pi->flags == EEPROM) {
         return 2;
     }
 
-   switch (s->cmd_in_progress) {
+   switch (cmd) {
    case PP4:
    case PP4_4:
    case QPP_4:
@@ -699,6 +889,11 @@ static inline int get_addr_length(Flash *s)
    }
 }
 
+static inline int get_addr_length(Flash *s)
+{
+    return get_cmd_addr_length(s, s->cmd_in_progress);
+}
+
 static void complete_collecting_data(Flash *s)
 {
     int i, n;
@@ -938,33 +1133,27 @@ static uint8_t numonyx_extract_cfg_num_dummies(Flash *s)
     return num_dummies;
 }
 
-static void decode_fast_read_cmd(Flash *s)
+static uint8_t fast_read_num_dummies(Flash *s)
 {
-    s->needed_bytes = get_addr_length(s);
     switch (get_man(s)) {
     /* Dummy cycles - modeled with bytes writes instead of bits */
     case MAN_SST:
-        s->needed_bytes += 1;
-        break;
+        return 1;
     case MAN_WINBOND:
-        s->needed_bytes += 8;
-        break;
+        return 8;
     case MAN_NUMONYX:
-        s->needed_bytes += numonyx_extract_cfg_num_dummies(s);
-        break;
+        return numonyx_extract_cfg_num_dummies(s);
     case MAN_MACRONIX:
         if (extract32(s->volatile_cfg, 6, 2) == 1) {
-            s->needed_bytes += 6;
+            return 6;
         } else {
-            s->needed_bytes += 8;
+            return 8;
         }
-        break;
     case MAN_SPANSION:
-        s->needed_bytes += extract32(s->spansion_cr2v,
-                                    SPANSION_DUMMY_CLK_POS,
-                                    SPANSION_DUMMY_CLK_LEN
-                                    );
-        break;
+        return extract32(s->spansion_cr2v,
+                         SPANSION_DUMMY_CLK_POS,
+                         SPANSION_DUMMY_CLK_LEN
+                         );
     case MAN_ISSI:
         /*
          * The Fast Read instruction code is followed by address bytes and
@@ -976,11 +1165,15 @@ static void decode_fast_read_cmd(Flash *s)
          * QPI (Quad Peripheral Interface) mode has different default value
          * of dummy cycles, but this is unsupported at the time being.
          */
-        s->needed_bytes += 1;
-        break;
+        return 1;
     default:
-        break;
+        return 0;
     }
+}
+
+static void decode_fast_read_cmd(Flash *s)
+{
+    s->needed_bytes = get_addr_length(s) + fast_read_num_dummies(s);
     s->pos = 0;
     s->len = 0;
     s->state = STATE_COLLECTING_DATA;
@@ -1456,6 +1649,9 @@ static int m25p80_cs(SSIPeripheral *ss, bool select)
         s->pos = 0;
         s->state = STATE_IDLE;
         flash_sync_dirty(s, -1);
+        if (s->wb_erase) {
+            flash_writeback_flush(s);
+        }
         s->data_read_loop = false;
     }
 
@@ -1492,6 +1688,7 @@ static uint32_t m25p80_transfer8(SSIPeripheral *ss, uint32_t tx)
         break;
 
     case STATE_READ:
+        flash_load(s, s->cur_addr, 1);
         r = s->storage[s->cur_addr];
         trace_m25p80_read_byte(s, s->cur_addr, (uint8_t)r);
         s->cur_addr = (s->cur_addr + 1) & (s->size - 1);
@@ -1569,6 +1766,38 @@ static uint32_t m25p80_transfer8_ex(SSIPeripheral *ss, uint32_t tx)
     return r;
 }
 
+/*
+ * Data phases of the read commands are copied from the storage in one
+ * go. Everything else goes through the per byte state machine.
+ */
+static void m25p80_transfer_buf(SSIPeripheral *ss, const uint8_t *tx,
+                                uint8_t *rx, uint32_t len)
+{
+    Flash *s = M25P80(ss);
+    uint32_t i = 0;
+
+    while (i < len) {
+        if (s->state == STATE_READ) {
+            uint32_t n = MIN(len - i, s->size - s->cur_addr);
+
+            if (rx) {
+                flash_load(s, s->cur_addr, n);
+                memcpy(rx + i, s->storage + s->cur_addr, n);
+            }
+            trace_m25p80_read_buf(s, s->cur_addr, n);
+            s->cur_addr = (s->cur_addr + n) & (s->size - 1);
+            i += n;
+        } else {
+            uint8_t r = m25p80_transfer8_ex(ss, tx ? tx[i] : 0);
+
+            if (rx) {
+                rx[i] = r;
+            }
+            i++;
+        }
+    }
+}
+
 static void m25p80_write_protect_pin_irq_handler(void *opaque, int n, int level)
 {
     Flash *s = M25P80(opaque);
@@ -1577,8 +1806,101 @@ static void m25p80_write_protect_pin_irq_handler(void *opaque, int n, int level)
     s->wp_level = !!level;
 }
 
+/*
+ * The storage is only accessed through the memory API when a SPI
+ * controller maps it directly in its flash window for reads. Writes
+ * must use the SPI commands. Until the storage is fully loaded, the
+ * ROM device is kept in MMIO mode to load the chunks on demand.
+ */
+static uint64_t m25p80_storage_read(void *opaque, hwaddr addr, unsigned size)
+{
+    Flash *s = M25P80(opaque);
+
+    flash_load(s, addr, size);
+    return ldn_le_p(s->storage + addr, size);
+}
+
+static void m25p80_storage_write(void *opaque, hwaddr addr, uint64_t val,
+                                 unsigned size)
+{
+    qemu_log_mask(LOG_GUEST_ERROR, "M25P80: direct write of 0x%" PRIx64
+                  " @0x%" HWADDR_PRIx " ignored\n", val, addr);
+}
+
+static const MemoryRegionOps m25p80_storage_ops = {
+    .read = m25p80_storage_read,
+    .write = m25p80_storage_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 8,
+    },
+};
+
+MemoryRegion *m25p80_get_read_region(DeviceState *dev, uint8_t cmd,
+                                     int nbytes)
+{
+    Flash *s = M25P80(dev);
+    int needed;
+
+    if (s->pi->flags & EEPROM) {
+        return NULL;
+    }
+
+    switch (cmd) {
+    case READ:
+    case READ4:
+        if (get_man(s) == MAN_NUMONYX && numonyx_mode(s) != MODE_STD) {
+            return NULL;
+        }
+        needed = get_cmd_addr_length(s, cmd);
+        break;
+    case FAST_READ:
+    case FAST_READ4:
+        needed = get_cmd_addr_length(s, cmd) + fast_read_num_dummies(s);
+        break;
+    default:
+        return NULL;
+    }
+
+    if (nbytes != needed) {
+        return NULL;
+    }
+
+    /* The extended address register offsets 3 bytes addresses */
+    if (get_cmd_addr_length(s, cmd) == 3 && ((s->ear << 24) & (s->size - 1))) {
+        return NULL;
+    }
+
+    return &s->mem;
+}
+
+MemoryRegion *m25p80_get_storage(DeviceState *dev)
+{
+    Flash *s = M25P80(dev);
+
+    /*
+     * Code only runs at full speed from a ROMD region. Load the chunks
+     * not accessed yet, the storage then switches to ROMD mode.
+     */
+    flash_load(s, 0, s->size);
+    return &s->mem;
+}
+
+static void m25p80_vm_state_change(void *opaque, bool running,
+                                   RunState state)
+{
+    Flash *s = M25P80(opaque);
+
+    if (!running) {
+        flash_sync_dirty(s, -1);
+        flash_writeback_flush(s);
+    }
+}
+
 static void m25p80_realize(SSIPeripheral *ss, Error **errp)
 {
+    ERRP_GUARD();
     Flash *s = M25P80(ss);
     M25P80Class *mc = M25P80_GET_CLASS(s);
     int ret;
@@ -1588,6 +1910,30 @@ static void m25p80_realize(SSIPeripheral *ss, Error **errp)
     s->size = s->pi->sector_size * s->pi->n_sectors;
     s->dirty_page = -1;
 
+    /*
+     * The storage is a ROM device so that SPI controllers can map it
+     * for reads. It is not migrated, the backing store is.
+     */
+    memory_region_init_rom_device_nomigrate(&s->mem, OBJECT(s),
+                                            &m25p80_storage_ops, s,
+                                            "m25p80.storage", s->size, errp);
+    if (*errp) {
+        return;
+    }
+    s->storage = memory_region_get_ram_ptr(&s->mem);
+
+    if (s->lazy) {
+        /*
+         * Contents are loaded from the backing store on first
+         * access. The untouched parts of the storage are never
+         * allocated.
+         */
+        s->nr_unloaded = DIV_ROUND_UP(s->size, M25P80_LOAD_CHUNK_SZ);
+        s->unloaded = bitmap_new(s->nr_unloaded);
+        bitmap_set(s->unloaded, 0, s->nr_unloaded);
+        memory_region_rom_device_set_romd(&s->mem, false);
+    }
+
     if (s->blk) {
         uint64_t perm = BLK_PERM_CONSISTENT_READ |
                         (blk_supports_write_perm(s->blk) ? BLK_PERM_WRITE : 0);
@@ -1597,16 +1943,24 @@ static void m25p80_realize(SSIPeripheral *ss, Error **errp)
         }
 
         trace_m25p80_binding(s);
-        s->storage = blk_blockalign(s->blk, s->size);
 
-        if (blk_pread(s->blk, 0, s->storage, s->size) != s->size) {
+        if (!s->lazy &&
+            blk_pread(s->blk, 0, s->storage, s->size) != s->size) {
             error_setg(errp, "failed to read the initial flash content");
             return;
         }
+
+        if (s->wb_delay) {
+            s->wb_dirty = bitmap_new(s->size / s->pi->page_size);
+            s->wb_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                       flash_writeback_timer, s);
+            qemu_add_vm_change_state_handler(m25p80_vm_state_change, s);
+        }
     } else {
         trace_m25p80_binding_no_bdrv(s);
-        s->storage = blk_blockalign(NULL, s->size);
-        memset(s->storage, 0xFF, s->size);
+        if (!s->lazy) {
+            memset(s->storage, 0xFF, s->size);
+        }
     }
 
     qdev_init_gpio_in_named(DEVICE(s),
@@ -1631,6 +1985,7 @@ static void m25p80_reset(DeviceState *d)
 static int m25p80_pre_save(void *opaque)
 {
     flash_sync_dirty((Flash *)opaque, -1);
+    flash_writeback_flush((Flash *)opaque);
 
     return 0;
 }
@@ -1644,6 +1999,9 @@ static Property m25p80_properties[] = {
     DEFINE_PROP_UINT8("spansion-cr3nv", Flash, spansion_cr3nv, 0x2),
     DEFINE_PROP_UINT8("spansion-cr4nv", Flash, spansion_cr4nv, 0x10),
     DEFINE_PROP_DRIVE("drive", Flash, blk),
+    DEFINE_PROP_BOOL("lazy", Flash, lazy, false),
+    /* Delay in ms of the write-back of modified pages. 0 writes through */
+    DEFINE_PROP_UINT32("writeback-delay", Flash, wb_delay, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -1747,6 +2105,7 @@ static void m25p80_class_init(ObjectClass *klass, void *data)
 
     k->realize = m25p80_realize;
     k->transfer = m25p80_transfer8_ex;
+    k->transfer_buf = m25p80_transfer_buf;
     k->set_cs = m25p80_cs;
     k->cs_polarity = SSI_CS_LOW;
     dc->vmsd = &vmstate_m25p80;
@@ -31,6 +31,7 @@
 #include "chardev/char-serial.h"
 #include "qapi/error.h"
 #include "qemu/timer.h"
+#include "sysemu/replay.h"
 #include "sysemu/reset.h"
 #include "sysemu/runstate.h"
 #include "qemu/error-report.h"
@@ -229,6 +230,71 @@ static gboolean serial_watch_cb(void *do_not_use, GIOCondition cond,
     return FALSE;
 }
 
+/*
+ * In batch mode, the transmitted bytes are gathered and written to the
+ * chardev from a bottom half, instead of with one write per byte. The
+ * line status and the interrupts seen by the guest are unchanged.
+ */
+static void serial_tx_batch_flush(SerialState *s);
+
+static gboolean serial_tx_batch_watch_cb(void *do_not_use, GIOCondition cond,
+                                         void *opaque)
+{
+    SerialState *s = opaque;
+    s->tx_batch_watch = 0;
+    serial_tx_batch_flush(s);
+    return FALSE;
+}
+
+static void serial_tx_batch_flush(SerialState *s)
+{
+    int rc;
+
+    if (!s->tx_batch_len || s->tx_batch_watch) {
+        return;
+    }
+
+    rc = qemu_chr_fe_write(&s->chr, s->tx_batch_buf, s->tx_batch_len);
+    if (rc < 0 && errno != EAGAIN) {
+        /* The unbatched path drops the bytes too */
+        s->tx_batch_len = 0;
+        return;
+    }
+
+    if (rc > 0) {
+        s->tx_batch_len -= rc;
+        memmove(s->tx_batch_buf, s->tx_batch_buf + rc, s->tx_batch_len);
+    }
+
+    if (s->tx_batch_len) {
+        s->tx_batch_watch = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                                  serial_tx_batch_watch_cb, s);
+        if (!s->tx_batch_watch) {
+            s->tx_batch_len = 0;
+        }
+    }
+}
+
+static void serial_tx_batch_bh(void *opaque)
+{
+    serial_tx_batch_flush(opaque);
+}
+
+/* Returns false when the bytes cannot be taken yet */
+static bool serial_tx_batch_queue(SerialState *s, uint8_t ch)
+{
+    if (s->tx_batch_len == SERIAL_TX_BATCH_SIZE) {
+        serial_tx_batch_flush(s);
+        if (s->tx_batch_len == SERIAL_TX_BATCH_SIZE) {
+            return false;
+        }
+    }
+
+    s->tx_batch_buf[s->tx_batch_len++] = ch;
+    qemu_bh_schedule(s->tx_batch_bh);
+    return true;
+}
+
 static void serial_xmit(SerialState *s)
 {
     do {
@@ -256,11 +322,17 @@ static void serial_xmit(SerialState *s)
             /* in loopback mode, say that we just received a char */
             serial_receive1(s, &s->tsr, 1);
         } else {
-            int rc = qemu_chr_fe_write(&s->chr, &s->tsr, 1);
+            bool busy;
+
+            if (s->tx_batch) {
+                busy = !serial_tx_batch_queue(s, s->tsr);
+            } else {
+                int rc = qemu_chr_fe_write(&s->chr, &s->tsr, 1);
+
+                busy = rc == 0 || (rc == -1 && errno == EAGAIN);
+            }
 
-            if ((rc == 0 ||
-                 (rc == -1 && errno == EAGAIN)) &&
-                s->tsr_retry < MAX_XMIT_RETRY) {
+            if (busy && s->tsr_retry < MAX_XMIT_RETRY) {
                 assert(s->watch_tag == 0);
                 s->watch_tag =
                     qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
@@ -633,6 +705,11 @@ static int serial_pre_save(void *opaque)
     SerialState *s = opaque;
     s->fcr_vmstate = s->fcr;
 
+    /* The batched bytes are already out for the guest */
+    if (s->tx_batch) {
+        serial_tx_batch_flush(s);
+    }
+
     return 0;
 }
 
@@ -916,6 +993,12 @@ static int serial_be_change(void *opaque)
                                              serial_watch_cb, s);
     }
 
+    if (s->tx_batch_watch > 0) {
+        g_source_remove(s->tx_batch_watch);
+        s->tx_batch_watch = 0;
+        serial_tx_batch_flush(s);
+    }
+
     return 0;
 }
 
@@ -928,6 +1011,15 @@ static void serial_realize(DeviceState *dev, Error **errp)
     s->fifo_timeout_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, (QEMUTimerCB *) fifo_timeout_int, s);
     qemu_register_reset(serial_reset, s);
 
+    /* The chardev writes must stay in step with the guest for replay */
+    if (replay_mode != REPLAY_MODE_NONE) {
+        s->tx_batch = false;
+    }
+    if (s->tx_batch) {
+        s->tx_batch_buf = g_malloc(SERIAL_TX_BATCH_SIZE);
+    }
+    s->tx_batch_bh = qemu_bh_new(serial_tx_batch_bh, s);
+
     qemu_chr_fe_set_handlers(&s->chr, serial_can_receive1, serial_receive1,
                              serial_event, serial_be_change, s, NULL, true);
     fifo8_create(&s->recv_fifo, UART_FIFO_LENGTH);
@@ -939,6 +1031,15 @@ static void serial_unrealize(DeviceState *dev)
 {
     SerialState *s = SERIAL(dev);
 
+    if (s->tx_batch_watch > 0) {
+        g_source_remove(s->tx_batch_watch);
+    }
+    if (s->tx_batch_len) {
+        qemu_chr_fe_write(&s->chr, s->tx_batch_buf, s->tx_batch_len);
+    }
+    qemu_bh_delete(s->tx_batch_bh);
+    g_free(s->tx_batch_buf);
+
     qemu_chr_fe_deinit(&s->chr, false);
 
     timer_free(s->modem_status_poll);
@@ -972,6 +1073,7 @@ static Property serial_properties[] = {
     DEFINE_PROP_CHR("chardev", SerialState, chr),
     DEFINE_PROP_UINT32("baudbase", SerialState, baudbase, 115200),
     DEFINE_PROP_BOOL("wakeup", SerialState, wakeup, false),
+    DEFINE_PROP_BOOL("tx-batch", SerialState, tx_batch, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -14,7 +14,9 @@
 #include "qapi/error.h"
 #include "qapi/visitor.h"
 #include "hw/irq.h"
+#include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
+#include "qapi/qapi-events-machine.h"
 
 #define GPIOS_PER_GROUP 8
 
@@ -250,6 +252,7 @@ static void aspeed_gpio_update(AspeedGPIOState *s, GPIOSets *regs,
     uint32_t direction = regs->direction;
     uint32_t old = regs->data_value;
     uint32_t new = value;
+    uint32_t changed = 0;
     uint32_t diff;
     int gpio;
 
@@ -280,6 +283,7 @@ static void aspeed_gpio_update(AspeedGPIOState *s, GPIOSets *regs,
                 /* ...trigger the line-state IRQ */
                 ptrdiff_t set = aspeed_gpio_set_idx(s, regs);
                 qemu_set_irq(s->gpios[set][gpio], !!(new & mask));
+                changed |= mask;
             } else {
                 /* ...otherwise if we meet the line's current IRQ policy... */
                 if (aspeed_evaluate_irq(regs, old & mask, gpio)) {
@@ -289,6 +293,14 @@ static void aspeed_gpio_update(AspeedGPIOState *s, GPIOSets *regs,
             }
         }
     }
+
+    /* Report the output edges of the whole set with a single event */
+    if (s->events && changed) {
+        g_autofree char *path = object_get_canonical_path(OBJECT(s));
+
+        qapi_event_send_gpio_output_change(path, aspeed_gpio_set_idx(s, regs),
+                                           regs->data_value, changed);
+    }
     qemu_set_irq(s->irq, !!(s->pending));
 }
 
@@ -318,6 +330,29 @@ static void aspeed_gpio_set_pin_level(AspeedGPIOState *s, uint32_t set_idx,
     aspeed_gpio_update(s, &s->sets[set_idx], value);
 }
 
+uint32_t aspeed_gpio_get_set(AspeedGPIOState *s, uint32_t set_idx)
+{
+    assert(set_idx < ASPEED_GPIO_GET_CLASS(s)->nr_gpio_sets);
+
+    return s->sets[set_idx].data_value;
+}
+
+void aspeed_gpio_set_set(AspeedGPIOState *s, uint32_t set_idx, uint32_t mask,
+                         uint32_t value)
+{
+    AspeedGPIOClass *agc = ASPEED_GPIO_GET_CLASS(s);
+    const GPIOSetProperties *props;
+    GPIOSets *set;
+
+    assert(set_idx < agc->nr_gpio_sets);
+    props = &agc->props[set_idx];
+    set = &s->sets[set_idx];
+
+    /* Only the pins which have a "gpio<Group><n>" property can be set */
+    mask &= props->input | props->output;
+    aspeed_gpio_update(s, set, (set->data_value & ~mask) | (value & mask));
+}
+
 /*
  *  | src_1 | src_2 |  source     |
  *  |-----------------------------|
@@ -758,6 +793,31 @@ static void aspeed_gpio_set_pin(Object *obj, Visitor *v, const char *name,
     aspeed_gpio_set_pin_level(s, set_idx, pin, level);
 }
 
+static void aspeed_gpio_get_set_prop(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    AspeedGPIOState *s = ASPEED_GPIO(obj);
+    uint32_t set_idx = GPOINTER_TO_UINT(opaque);
+    uint32_t value = aspeed_gpio_get_set(s, set_idx);
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void aspeed_gpio_set_set_prop(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    AspeedGPIOState *s = ASPEED_GPIO(obj);
+    uint32_t set_idx = GPOINTER_TO_UINT(opaque);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    aspeed_gpio_set_set(s, set_idx, UINT32_MAX, value);
+}
+
 /****************** Setup functions ******************/
 static const GPIOSetProperties ast2400_set_props[ASPEED_GPIO_MAX_NR_SETS] = {
     [0] = {0xffffffff,  0xffffffff,  {"A", "B", "C", "D"} },
@@ -859,6 +919,15 @@ static void aspeed_gpio_init(Object *obj)
             g_free(name);
         }
     }
+
+    /* Whole sets, one bit per pin */
+    for (int i = 0; i < agc->nr_gpio_sets; i++) {
+        char *name = g_strdup_printf("gpio-set%d", i);
+        object_property_add(obj, name, "uint32", aspeed_gpio_get_set_prop,
+                            aspeed_gpio_set_set_prop, NULL,
+                            GUINT_TO_POINTER(i));
+        g_free(name);
+    }
 }
 
 static const VMStateDescription vmstate_gpio_regs = {
@@ -897,6 +966,11 @@ static const VMStateDescription vmstate_aspeed_gpio = {
    }
 };
 
+static Property aspeed_gpio_properties[] = {
+    DEFINE_PROP_BOOL("events", AspeedGPIOState, events, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void aspeed_gpio_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -905,6 +979,7 @@ static void aspeed_gpio_class_init(ObjectClass *klass, void *data)
     dc->reset = aspeed_gpio_reset;
     dc->desc = "Aspeed GPIO Controller";
     dc->vmsd = &vmstate_aspeed_gpio;
+    device_class_set_props(dc, aspeed_gpio_properties);
 }
 
 static void aspeed_gpio_ast2400_class_init(ObjectClass *klass, void *data)
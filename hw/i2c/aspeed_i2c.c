@@ -146,6 +146,7 @@
 #define   I2CD_BYTE_BUF_RX_MASK            0xff
 #define I2CD_DMA_ADDR           0x24       /* DMA Buffer Address */
 #define I2CD_DMA_LEN            0x28       /* DMA Transfer Length < 4KB */
+#define   ASPEED_I2C_DMA_SIZE              0x1000
 
 /* New register mode */
 #define I2CC_M_S_FUNC_CTRL_REG  0x00
@@ -491,23 +492,83 @@ static int aspeed_i2c_dma_read(AspeedI2CBus *bus, uint8_t *data)
     return 0;
 }
 
-static int aspeed_i2c_dma_write(AspeedI2CBus *bus, uint8_t *data)
+/*
+ * The DMA length comes from the guest or from the migration stream,
+ * don't trust it to fit in the bounce buffer.
+ */
+static uint32_t aspeed_i2c_dma_len(AspeedI2CBus *bus, const char *func)
+{
+    if (bus->dma_len > ASPEED_I2C_DMA_SIZE) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: invalid DMA length %u\n",
+                      func, bus->dma_len);
+        return ASPEED_I2C_DMA_SIZE;
+    }
+    return bus->dma_len;
+}
+
+/*
+ * Move the whole DMA buffer to the slave in one go: a single DRAM
+ * read for the command and a single block transfer on the bus.
+ */
+static int aspeed_i2c_dma_send(AspeedI2CBus *bus)
 {
+    AspeedI2CState *s = bus->controller;
+    uint8_t buf[ASPEED_I2C_DMA_SIZE];
+    uint32_t len = aspeed_i2c_dma_len(bus, __func__);
     MemTxResult result;
+    int acked, count, i;
+
+    result = address_space_read(&s->dram_as, bus->dma_addr,
+                                MEMTXATTRS_UNSPECIFIED, buf, len);
+    if (result != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: DRAM read failed @%08x\n",
+                      __func__, bus->dma_addr);
+        return -1;
+    }
+
+    acked = i2c_send_buf(bus->bus, buf, len);
+
+    /* The NAKed byte has been consumed too */
+    count = MIN(acked + 1, len);
+    if (trace_event_get_state_backends(TRACE_ASPEED_I2C_BUS_SEND)) {
+        for (i = 0; i < count; i++) {
+            trace_aspeed_i2c_bus_send("DMA", i + 1, len, buf[i]);
+        }
+    }
+
+    bus->dma_addr += count;
+    bus->dma_len -= count;
+    bus->dma_len_tx += count;
+    return acked < len ? -1 : 0;
+}
+
+static int aspeed_i2c_dma_recv(AspeedI2CBus *bus)
+{
     AspeedI2CState *s = bus->controller;
+    uint8_t buf[ASPEED_I2C_DMA_SIZE];
+    uint32_t len = aspeed_i2c_dma_len(bus, __func__);
+    MemTxResult result;
+    int i;
 
-    result = address_space_write(&s->dram_as, bus->dma_addr,
-                                 MEMTXATTRS_UNSPECIFIED, data, 1);
+    i2c_recv_buf(bus->bus, buf, len);
+
+    if (trace_event_get_state_backends(TRACE_ASPEED_I2C_BUS_RECV)) {
+        for (i = 0; i < len; i++) {
+            trace_aspeed_i2c_bus_recv("DMA", i + 1, len, buf[i]);
+        }
+    }
 
+    result = address_space_write(&s->dram_as, bus->dma_addr,
+                                 MEMTXATTRS_UNSPECIFIED, buf, len);
     if (result != MEMTX_OK) {
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: DRAM read failed @%08x\n",
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: DRAM write failed @%08x\n",
                       __func__, bus->dma_addr);
         return -1;
     }
 
-    bus->dma_addr++;
-    bus->dma_len--;
-    bus->dma_len_rx++;
+    bus->dma_addr += len;
+    bus->dma_len = 0;
+    bus->dma_len_rx += len;
     return 0;
 }
 
@@ -518,28 +579,24 @@ static int aspeed_i2c_bus_send(AspeedI2CBus *bus, uint8_t pool_start)
     int i;
 
     if (bus->cmd & I2CD_TX_BUFF_ENABLE) {
-        for (i = pool_start; i < I2CD_POOL_TX_COUNT(bus->pool_ctrl); i++) {
-            uint8_t *pool_base = aic->bus_pool_base(bus);
+        uint8_t *pool_base = aic->bus_pool_base(bus);
+        int count = I2CD_POOL_TX_COUNT(bus->pool_ctrl) - pool_start;
+        int acked = 0;
 
-            trace_aspeed_i2c_bus_send("BUF", i + 1,
-                                      I2CD_POOL_TX_COUNT(bus->pool_ctrl),
-                                      pool_base[i]);
-            ret = i2c_send(bus->bus, pool_base[i]);
-            if (ret) {
-                break;
+        if (count > 0) {
+            acked = i2c_send_buf(bus->bus, &pool_base[pool_start], count);
+            ret = acked < count ? -1 : 0;
+        }
+        if (trace_event_get_state_backends(TRACE_ASPEED_I2C_BUS_SEND)) {
+            for (i = pool_start; i < pool_start + MIN(acked + 1, count); i++) {
+                trace_aspeed_i2c_bus_send("BUF", i + 1,
+                                          I2CD_POOL_TX_COUNT(bus->pool_ctrl),
+                                          pool_base[i]);
             }
         }
         bus->cmd &= ~I2CD_TX_BUFF_ENABLE;
     } else if (bus->cmd & I2CD_TX_DMA_ENABLE) {
-        while (bus->dma_len) {
-            uint8_t data;
-            aspeed_i2c_dma_read(bus, &data);
-            trace_aspeed_i2c_bus_send("DMA", bus->dma_len, bus->dma_len, data);
-            ret = i2c_send(bus->bus, data);
-            if (ret) {
-                break;
-            }
-        }
+        ret = aspeed_i2c_dma_send(bus);
         bus->cmd &= ~I2CD_TX_DMA_ENABLE;
     } else {
         trace_aspeed_i2c_bus_send("BYTE", pool_start, 1, bus->buf);
@@ -559,11 +616,14 @@ static void aspeed_i2c_bus_recv(AspeedI2CBus *bus)
     if (bus->cmd & I2CD_RX_BUFF_ENABLE) {
         uint8_t *pool_base = aic->bus_pool_base(bus);
 
-        for (i = 0; i < I2CD_POOL_RX_SIZE(bus->pool_ctrl); i++) {
-            pool_base[i] = i2c_recv(bus->bus);
-            trace_aspeed_i2c_bus_recv("BUF", i + 1,
-                                      I2CD_POOL_RX_SIZE(bus->pool_ctrl),
-                                      pool_base[i]);
+        i = I2CD_POOL_RX_SIZE(bus->pool_ctrl);
+        i2c_recv_buf(bus->bus, pool_base, i);
+        if (trace_event_get_state_backends(TRACE_ASPEED_I2C_BUS_RECV)) {
+            int j;
+
+            for (j = 0; j < i; j++) {
+                trace_aspeed_i2c_bus_recv("BUF", j + 1, i, pool_base[j]);
+            }
         }
 
         /* Update RX count */
@@ -571,23 +631,7 @@ static void aspeed_i2c_bus_recv(AspeedI2CBus *bus)
         bus->pool_ctrl |= (i & 0xff) << 24;
         bus->cmd &= ~I2CD_RX_BUFF_ENABLE;
     } else if (bus->cmd & I2CD_RX_DMA_ENABLE) {
-        uint8_t data;
-
-        while (bus->dma_len) {
-            MemTxResult result;
-
-            data = i2c_recv(bus->bus);
-            trace_aspeed_i2c_bus_recv("DMA", bus->dma_len, bus->dma_len, data);
-            result = address_space_write(&s->dram_as, bus->dma_addr,
-                                         MEMTXATTRS_UNSPECIFIED, &data, 1);
-            if (result != MEMTX_OK) {
-                qemu_log_mask(LOG_GUEST_ERROR, "%s: DRAM write failed @%08x\n",
-                              __func__, bus->dma_addr);
-                return;
-            }
-            bus->dma_addr++;
-            bus->dma_len--;
-        }
+        aspeed_i2c_dma_recv(bus);
         bus->cmd &= ~I2CD_RX_DMA_ENABLE;
     } else {
         data = i2c_recv(bus->bus);
@@ -722,16 +766,7 @@ static void aspeed_i2c_bus_handle_cmd_new(AspeedI2CBus *bus, uint64_t value)
     if (bus->cmd & I2CM_TX_CMD) {
         /* Send through DMA */
         if (bus->cmd & I2CM_TX_DMA_EN) {
-            while (bus->dma_len) {
-                uint8_t data;
-                int ret;
-                aspeed_i2c_dma_read(bus, &data);
-                trace_aspeed_i2c_bus_send("DMA", bus->dma_len, bus->dma_len, data);
-                ret = i2c_send(bus->bus, data);
-                if (ret) {
-                    break;
-                }
-            }
+            aspeed_i2c_dma_send(bus);
             bus->intr_status |= I2CM_TX_ACK;
             cmd_done |= I2CM_TX_DMA_EN;
         } else {
@@ -752,13 +787,7 @@ static void aspeed_i2c_bus_handle_cmd_new(AspeedI2CBus *bus, uint64_t value)
         }
         if (bus->cmd & I2CM_RX_DMA_EN) {
             /* Write to DMA */
-            while (bus->dma_len) {
-                uint8_t data;
-                data = i2c_recv(bus->bus);
-                if (aspeed_i2c_dma_write(bus, &data)) {
-                    break;
-                }
-            }
+            aspeed_i2c_dma_recv(bus);
             cmd_done |= I2CM_RX_DMA_EN;
         }
         aspeed_i2c_set_state(bus, I2CM_PKT_OP_SM_RXD);
@@ -293,6 +293,53 @@ uint8_t i2c_recv(I2CBus *bus)
     return data;
 }
 
+int i2c_send_buf(I2CBus *bus, const uint8_t *buf, int len)
+{
+    I2CSlaveClass *sc;
+    I2CSlave *s;
+    int i;
+
+    /* Broadcasts go through the per-byte path to reach every slave */
+    if (!QLIST_EMPTY(&bus->current_devs) && !bus->broadcast) {
+        s = QLIST_FIRST(&bus->current_devs)->elt;
+        sc = I2C_SLAVE_GET_CLASS(s);
+        if (sc->send_buf) {
+            i = sc->send_buf(s, buf, len);
+            trace_i2c_send_buf(s->address, len, i);
+            return i;
+        }
+    }
+
+    for (i = 0; i < len; i++) {
+        if (i2c_send(bus, buf[i])) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+void i2c_recv_buf(I2CBus *bus, uint8_t *buf, int len)
+{
+    I2CSlaveClass *sc;
+    I2CSlave *s;
+    int i;
+
+    if (!QLIST_EMPTY(&bus->current_devs) && !bus->broadcast) {
+        s = QLIST_FIRST(&bus->current_devs)->elt;
+        sc = I2C_SLAVE_GET_CLASS(s);
+        if (sc->recv_buf) {
+            sc->recv_buf(s, buf, len);
+            trace_i2c_recv_buf(s->address, len);
+            return;
+        }
+    }
+
+    for (i = 0; i < len; i++) {
+        buf[i] = i2c_recv(bus);
+    }
+}
+
 void i2c_nack(I2CBus *bus)
 {
     I2CSlaveClass *sc;
@@ -1017,6 +1017,23 @@ passthough:
     return ret;
 }
 
+/*
+ * The first byte dispatches the command, which usually queues the whole
+ * answer in out_buf. Drain it in one go instead of popping byte by byte.
+ */
+static void pmbus_receive_buf(SMBusDevice *smd, uint8_t *buf, int len)
+{
+    PMBusDevice *pmdev = PMBUS_DEVICE(smd);
+    int i = 0;
+
+    while (i < len) {
+        buf[i++] = pmbus_receive_byte(smd);
+        while (i < len && pmdev->out_buf_len != 0) {
+            buf[i++] = pmdev->out_buf[--pmdev->out_buf_len];
+        }
+    }
+}
+
 /*
  * PMBus clear faults command applies to all status registers, existing faults
  * should separately get re-asserted.
@@ -1678,6 +1695,7 @@ static void pmbus_device_class_init(ObjectClass *klass, void *data)
     k->quick_cmd = pmbus_quick_cmd;
     k->write_data = pmbus_write_data;
     k->receive_byte = pmbus_receive_byte;
+    k->receive_buf = pmbus_receive_buf;
 }
 
 static const TypeInfo pmbus_device_type_info = {
@@ -171,6 +171,23 @@ static uint8_t smbus_i2c_recv(I2CSlave *s)
     return ret;
 }
 
+static void smbus_i2c_recv_buf(I2CSlave *s, uint8_t *buf, int len)
+{
+    SMBusDevice *dev = SMBUS_DEVICE(s);
+    SMBusDeviceClass *sc = SMBUS_DEVICE_GET_CLASS(dev);
+    int i;
+
+    if (dev->mode == SMBUS_READ_DATA && sc->receive_buf) {
+        sc->receive_buf(dev, buf, len);
+        DPRINTF("Read block of %d bytes\n", len);
+        return;
+    }
+
+    for (i = 0; i < len; i++) {
+        buf[i] = smbus_i2c_recv(s);
+    }
+}
+
 static int smbus_i2c_send(I2CSlave *s, uint8_t data)
 {
     SMBusDevice *dev = SMBUS_DEVICE(s);
@@ -199,6 +216,7 @@ static void smbus_device_class_init(ObjectClass *klass, void *data)
 
     sc->event = smbus_i2c_event;
     sc->recv = smbus_i2c_recv;
+    sc->recv_buf = smbus_i2c_recv_buf;
     sc->send = smbus_i2c_send;
 }
 
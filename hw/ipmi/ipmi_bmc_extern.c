@@ -28,46 +28,26 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
 #include "qemu/module.h"
 #include "qapi/error.h"
 #include "qemu/timer.h"
 #include "chardev/char-fe.h"
 #include "hw/ipmi/ipmi.h"
+#include "hw/ipmi/ipmi_extern.h"
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
 #include "migration/vmstate.h"
 #include "qom/object.h"
 
-#define VM_MSG_CHAR        0xA0 /* Marks end of message */
-#define VM_CMD_CHAR        0xA1 /* Marks end of a command */
-#define VM_ESCAPE_CHAR     0xAA /* Set bit 4 from the next byte to 0 */
-
-#define VM_PROTOCOL_VERSION        1
-#define VM_CMD_VERSION             0xff /* A version number byte follows */
-#define VM_CMD_NOATTN              0x00
-#define VM_CMD_ATTN                0x01
-#define VM_CMD_ATTN_IRQ            0x02
-#define VM_CMD_POWEROFF            0x03
-#define VM_CMD_RESET               0x04
-#define VM_CMD_ENABLE_IRQ          0x05 /* Enable/disable the messaging irq */
-#define VM_CMD_DISABLE_IRQ         0x06
-#define VM_CMD_SEND_NMI            0x07
-#define VM_CMD_CAPABILITIES        0x08
-#define   VM_CAPABILITIES_POWER    0x01
-#define   VM_CAPABILITIES_RESET    0x02
-#define   VM_CAPABILITIES_IRQ      0x04
-#define   VM_CAPABILITIES_NMI      0x08
-#define   VM_CAPABILITIES_ATTN     0x10
-#define   VM_CAPABILITIES_GRACEFUL_SHUTDOWN 0x20
-#define VM_CMD_GRACEFUL_SHUTDOWN   0x09
-
 #define TYPE_IPMI_BMC_EXTERN "ipmi-bmc-extern"
 OBJECT_DECLARE_SIMPLE_TYPE(IPMIBmcExtern, IPMI_BMC_EXTERN)
 struct IPMIBmcExtern {
     IPMIBmc parent;
 
     CharBackend chr;
+    bool framed;
 
     bool connected;
 
@@ -75,10 +55,13 @@ struct IPMIBmcExtern {
     unsigned int inpos;
     bool in_escape;
     bool in_too_many;
+    uint8_t inhdr[IPMI_EXTERN_FRAME_HDR_SIZE];
     bool waiting_rsp;
     bool sending_cmd;
 
     unsigned char outbuf[(MAX_IPMI_MSG_SIZE + 2) * 2 + 1];
+    /* Message id, netfn and command of the request waiting a response */
+    uint8_t req_hdr[3];
     unsigned int outpos;
     unsigned int outlen;
 
@@ -99,6 +82,58 @@ ipmb_checksum(const unsigned char *data, int size, unsigned char start)
         return csum;
 }
 
+static void addchar(IPMIBmcExtern *ibe, unsigned char ch)
+{
+    switch (ch) {
+    case VM_MSG_CHAR:
+    case VM_CMD_CHAR:
+    case VM_ESCAPE_CHAR:
+        ibe->outbuf[ibe->outlen] = VM_ESCAPE_CHAR;
+        ibe->outlen++;
+        ch |= 0x10;
+        /* fall through */
+    default:
+        ibe->outbuf[ibe->outlen] = ch;
+        ibe->outlen++;
+    }
+}
+
+static void add_frame(IPMIBmcExtern *ibe, uint8_t type, uint8_t msg_id,
+                      const uint8_t *data, unsigned int len)
+{
+    uint8_t *frame = ibe->outbuf + ibe->outlen;
+
+    frame[0] = type;
+    frame[1] = msg_id;
+    stw_le_p(&frame[2], len);
+    memcpy(&frame[IPMI_EXTERN_FRAME_HDR_SIZE], data, len);
+    ibe->outlen += IPMI_EXTERN_FRAME_HDR_SIZE + len;
+}
+
+static void add_cmd(IPMIBmcExtern *ibe, uint8_t hw_op, const uint8_t *arg,
+                    unsigned int arg_len)
+{
+    unsigned int i;
+
+    if (ibe->framed) {
+        uint8_t buf[2] = { hw_op };
+
+        assert(arg_len <= 1);
+        if (arg_len) {
+            buf[1] = arg[0];
+        }
+        add_frame(ibe, IPMI_EXTERN_FRAME_CMD, 0, buf, 1 + arg_len);
+        return;
+    }
+
+    addchar(ibe, hw_op);
+    for (i = 0; i < arg_len; i++) {
+        addchar(ibe, arg[i]);
+    }
+    ibe->outbuf[ibe->outlen] = VM_CMD_CHAR;
+    ibe->outlen++;
+}
+
 static void continue_send(IPMIBmcExtern *ibe)
 {
     int ret;
@@ -127,10 +162,9 @@ static void continue_send(IPMIBmcExtern *ibe)
     check_reset:
         if (ibe->connected && ibe->send_reset) {
             /* Send the reset */
-            ibe->outbuf[0] = VM_CMD_RESET;
-            ibe->outbuf[1] = VM_CMD_CHAR;
-            ibe->outlen = 2;
+            ibe->outlen = 0;
             ibe->outpos = 0;
+            add_cmd(ibe, VM_CMD_RESET, NULL, 0);
             ibe->send_reset = false;
             ibe->sending_cmd = true;
             goto send;
@@ -155,32 +189,16 @@ static void extern_timeout(void *opaque)
             IPMIInterfaceClass *k = IPMI_INTERFACE_GET_CLASS(s);
             /* The message response timed out, return an error. */
             ibe->waiting_rsp = false;
-            ibe->inbuf[1] = ibe->outbuf[1] | 0x04;
-            ibe->inbuf[2] = ibe->outbuf[2];
+            ibe->inbuf[1] = ibe->req_hdr[1] | 0x04;
+            ibe->inbuf[2] = ibe->req_hdr[2];
             ibe->inbuf[3] = IPMI_CC_TIMEOUT;
-            k->handle_rsp(s, ibe->outbuf[0], ibe->inbuf + 1, 3);
+            k->handle_rsp(s, ibe->req_hdr[0], ibe->inbuf + 1, 3);
         } else {
             continue_send(ibe);
         }
     }
 }
 
-static void addchar(IPMIBmcExtern *ibe, unsigned char ch)
-{
-    switch (ch) {
-    case VM_MSG_CHAR:
-    case VM_CMD_CHAR:
-    case VM_ESCAPE_CHAR:
-        ibe->outbuf[ibe->outlen] = VM_ESCAPE_CHAR;
-        ibe->outlen++;
-        ch |= 0x10;
-        /* fall through */
-    default:
-        ibe->outbuf[ibe->outlen] = ch;
-        ibe->outlen++;
-    }
-}
-
 static void ipmi_bmc_extern_handle_command(IPMIBmc *b,
                                        uint8_t *cmd, unsigned int cmd_len,
                                        unsigned int max_cmd_len,
@@ -217,6 +235,16 @@ static void ipmi_bmc_extern_handle_command(IPMIBmc *b,
         goto out;
     }
 
+    ibe->req_hdr[0] = msg_id;
+    ibe->req_hdr[1] = cmd[0];
+    ibe->req_hdr[2] = cmd[1];
+
+    if (ibe->framed) {
+        add_frame(ibe, IPMI_EXTERN_FRAME_MSG, msg_id, cmd, cmd_len);
+        continue_send(ibe);
+        goto out;
+    }
+
     addchar(ibe, msg_id);
     for (i = 0; i < cmd_len; i++) {
         addchar(ibe, cmd[i]);
@@ -282,10 +310,17 @@ static void handle_hw_op(IPMIBmcExtern *ibe, unsigned char hw_op)
     }
 }
 
-static void handle_msg(IPMIBmcExtern *ibe)
+static void deliver_rsp(IPMIBmcExtern *ibe, unsigned int len)
 {
     IPMIInterfaceClass *k = IPMI_INTERFACE_GET_CLASS(ibe->parent.intf);
 
+    timer_del(ibe->extern_timer);
+    ibe->waiting_rsp = false;
+    k->handle_rsp(ibe->parent.intf, ibe->inbuf[0], ibe->inbuf + 1, len);
+}
+
+static void handle_msg(IPMIBmcExtern *ibe)
+{
     if (ibe->in_escape) {
         ipmi_debug("msg escape not ended\n");
         return;
@@ -304,9 +339,7 @@ static void handle_msg(IPMIBmcExtern *ibe)
         ibe->inpos--; /* Remove checkum */
     }
 
-    timer_del(ibe->extern_timer);
-    ibe->waiting_rsp = false;
-    k->handle_rsp(ibe->parent.intf, ibe->inbuf[0], ibe->inbuf + 1, ibe->inpos - 1);
+    deliver_rsp(ibe, ibe->inpos - 1);
 }
 
 static int can_receive(void *opaque)
@@ -314,12 +347,78 @@ static int can_receive(void *opaque)
     return 1;
 }
 
+static void handle_frame(IPMIBmcExtern *ibe)
+{
+    unsigned int len = lduw_le_p(&ibe->inhdr[2]);
+
+    switch (ibe->inhdr[0]) {
+    case IPMI_EXTERN_FRAME_MSG:
+        if (len < 3) {
+            ipmi_debug("msg too short\n");
+            return;
+        }
+        ibe->inbuf[0] = ibe->inhdr[1];
+        if (len > MAX_IPMI_MSG_SIZE) {
+            ibe->inbuf[3] = IPMI_CC_REQUEST_DATA_TRUNCATED;
+            len = 3;
+        }
+        deliver_rsp(ibe, len);
+        break;
+
+    case IPMI_EXTERN_FRAME_CMD:
+        if (len) {
+            handle_hw_op(ibe, ibe->inbuf[1]);
+        }
+        break;
+
+    default:
+        ipmi_debug("unknown frame type 0x%x\n", ibe->inhdr[0]);
+        break;
+    }
+}
+
+static void receive_framed(IPMIBmcExtern *ibe, const uint8_t *buf, int size)
+{
+    while (size > 0) {
+        unsigned int len, off, n;
+
+        if (ibe->inpos < IPMI_EXTERN_FRAME_HDR_SIZE) {
+            n = MIN(size, IPMI_EXTERN_FRAME_HDR_SIZE - ibe->inpos);
+            memcpy(&ibe->inhdr[ibe->inpos], buf, n);
+        } else {
+            len = lduw_le_p(&ibe->inhdr[2]);
+            off = ibe->inpos - IPMI_EXTERN_FRAME_HDR_SIZE;
+            n = MIN(size, len - off);
+            /* Anything past the longest message is dropped */
+            if (off < MAX_IPMI_MSG_SIZE) {
+                memcpy(&ibe->inbuf[1 + off], buf,
+                       MIN(n, MAX_IPMI_MSG_SIZE - off));
+            }
+        }
+        buf += n;
+        size -= n;
+        ibe->inpos += n;
+
+        if (ibe->inpos >= IPMI_EXTERN_FRAME_HDR_SIZE &&
+            ibe->inpos == IPMI_EXTERN_FRAME_HDR_SIZE +
+                          lduw_le_p(&ibe->inhdr[2])) {
+            handle_frame(ibe);
+            ibe->inpos = 0;
+        }
+    }
+}
+
 static void receive(void *opaque, const uint8_t *buf, int size)
 {
     IPMIBmcExtern *ibe = opaque;
     int i;
     unsigned char hw_op;
 
+    if (ibe->framed) {
+        receive_framed(ibe, buf, size);
+        return;
+    }
+
     for (i = 0; i < size; i++) {
         unsigned char ch = buf[i];
 
@@ -392,11 +491,9 @@ static void chr_event(void *opaque, QEMUChrEvent event)
         ibe->connected = true;
         ibe->outpos = 0;
         ibe->outlen = 0;
-        addchar(ibe, VM_CMD_VERSION);
-        addchar(ibe, VM_PROTOCOL_VERSION);
-        ibe->outbuf[ibe->outlen] = VM_CMD_CHAR;
-        ibe->outlen++;
-        addchar(ibe, VM_CMD_CAPABILITIES);
+        ibe->inpos = 0;
+        v = VM_PROTOCOL_VERSION;
+        add_cmd(ibe, VM_CMD_VERSION, &v, 1);
         v = VM_CAPABILITIES_IRQ | VM_CAPABILITIES_ATTN;
         if (k->do_hw_op(ibe->parent.intf, IPMI_POWEROFF_CHASSIS, 1) == 0) {
             v |= VM_CAPABILITIES_POWER;
@@ -411,9 +508,7 @@ static void chr_event(void *opaque, QEMUChrEvent event)
         if (k->do_hw_op(ibe->parent.intf, IPMI_SEND_NMI, 1) == 0) {
             v |= VM_CAPABILITIES_NMI;
         }
-        addchar(ibe, v);
-        ibe->outbuf[ibe->outlen] = VM_CMD_CHAR;
-        ibe->outlen++;
+        add_cmd(ibe, VM_CMD_CAPABILITIES, &v, 1);
         ibe->sending_cmd = false;
         continue_send(ibe);
         break;
@@ -430,10 +525,10 @@ static void chr_event(void *opaque, QEMUChrEvent event)
         k->set_atn(s, 0, 0);
         if (ibe->waiting_rsp) {
             ibe->waiting_rsp = false;
-            ibe->inbuf[1] = ibe->outbuf[1] | 0x04;
-            ibe->inbuf[2] = ibe->outbuf[2];
+            ibe->inbuf[1] = ibe->req_hdr[1] | 0x04;
+            ibe->inbuf[2] = ibe->req_hdr[2];
             ibe->inbuf[3] = IPMI_CC_BMC_INIT_IN_PROGRESS;
-            k->handle_rsp(s, ibe->outbuf[0], ibe->inbuf + 1, 3);
+            k->handle_rsp(s, ibe->req_hdr[0], ibe->inbuf + 1, 3);
         }
         break;
 
@@ -479,10 +574,10 @@ static int ipmi_bmc_extern_post_migrate(void *opaque, int version_id)
         IPMIInterfaceClass *iic = IPMI_INTERFACE_GET_CLASS(ii);
 
         ibe->waiting_rsp = false;
-        ibe->inbuf[1] = ibe->outbuf[1] | 0x04;
-        ibe->inbuf[2] = ibe->outbuf[2];
+        ibe->inbuf[1] = ibe->req_hdr[1] | 0x04;
+        ibe->inbuf[2] = ibe->req_hdr[2];
         ibe->inbuf[3] = IPMI_CC_BMC_INIT_IN_PROGRESS;
-        iic->handle_rsp(ii, ibe->outbuf[0], ibe->inbuf + 1, 3);
+        iic->handle_rsp(ii, ibe->req_hdr[0], ibe->inbuf + 1, 3);
     }
     return 0;
 }
@@ -516,6 +611,7 @@ static void ipmi_bmc_extern_finalize(Object *obj)
 
 static Property ipmi_bmc_extern_properties[] = {
     DEFINE_PROP_CHR("chardev", IPMIBmcExtern, chr),
+    DEFINE_PROP_BOOL("framed", IPMIBmcExtern, framed, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
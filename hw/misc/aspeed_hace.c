@@ -13,14 +13,20 @@
 #include "qemu/error-report.h"
 #include "hw/misc/aspeed_hace.h"
 #include "qapi/error.h"
+#include "migration/blocker.h"
 #include "migration/vmstate.h"
 #include "crypto/hash.h"
 #include "hw/qdev-properties.h"
 #include "hw/irq.h"
+#include "block/aio.h"
+#include "block/aio-wait.h"
+#include "block/thread-pool.h"
+#include "sysemu/runstate.h"
 
 #define R_CRYPT_CMD     (0x10 / 4)
 
 #define R_STATUS        (0x1c / 4)
+#define HASH_BUSY       BIT(0)
 #define HASH_IRQ        BIT(9)
 #define CRYPT_IRQ       BIT(12)
 #define TAG_IRQ         BIT(15)
@@ -107,6 +113,10 @@ static bool has_padding(AspeedHACEState *s, struct iovec *iov,
                         hwaddr req_len, uint32_t *total_msg_len,
                         uint32_t *pad_offset)
 {
+    if (req_len < 8) {
+        return false;
+    }
+
     *total_msg_len = (uint32_t)(ldq_be_p(iov->iov_base + req_len - 8) / 8);
     /*
      * SG_LIST_LEN_LAST asserted in the request length doesn't mean it is the
@@ -123,6 +133,10 @@ static bool has_padding(AspeedHACEState *s, struct iovec *iov,
     if (*total_msg_len <= s->total_req_len) {
         uint32_t padding_size = s->total_req_len - *total_msg_len;
         uint8_t *padding = iov->iov_base;
+
+        if (padding_size > req_len) {
+            return false;
+        }
         *pad_offset = req_len - padding_size;
         if (padding[*pad_offset] == 0x80) {
             return true;
@@ -132,66 +146,165 @@ static bool has_padding(AspeedHACEState *s, struct iovec *iov,
     return false;
 }
 
-static int reconstruct_iov(AspeedHACEState *s, struct iovec *iov, int id,
-                           uint32_t *pad_offset)
+/*
+ * A hash request runs on the thread pool. The guest buffers are mapped
+ * when the command is written and are unmapped on completion.
+ *
+ * In accumulative mode, each request adds its data to a hash context
+ * kept across requests. The guest pads the message itself: the request
+ * holding the padding is the last one and the digest is only computed
+ * then, without the padding.
+ */
+typedef struct AspeedHACEJob {
+    AspeedHACEState *s;
+    int algo;
+    struct iovec iov[ASPEED_HACE_MAX_SG];
+    int niov;
+    hwaddr map_len[ASPEED_HACE_MAX_SG];
+    int nmap;
+    QCryptoHash *ctx;
+    bool final;
+    bool free_ctx;
+    bool failed;
+    uint32_t dest;
+    bool irq_en;
+    bool cancelled;
+    uint8_t *digest;
+    size_t digest_len;
+} AspeedHACEJob;
+
+/*
+ * The context of an accumulation lives in the crypto backend and can't be
+ * migrated, so migration is blocked until the final request.
+ */
+static void aspeed_hace_acc_start(AspeedHACEState *s, int algo)
 {
-    int i, iov_count;
-    if (*pad_offset != 0) {
-        s->iov_cache[s->iov_count].iov_base = iov[id].iov_base;
-        s->iov_cache[s->iov_count].iov_len = *pad_offset;
-        ++s->iov_count;
+    if (migrate_add_blocker(s->migration_blocker, NULL) < 0) {
+        return;
     }
-    for (i = 0; i < s->iov_count; i++) {
-        iov[i].iov_base = s->iov_cache[i].iov_base;
-        iov[i].iov_len = s->iov_cache[i].iov_len;
+
+    s->hash_ctx = qcrypto_hash_new(algo, NULL);
+    s->total_req_len = 0;
+    if (!s->hash_ctx) {
+        migrate_del_blocker(s->migration_blocker);
+    }
+}
+
+/* The context is now owned by the caller */
+static void aspeed_hace_acc_end(AspeedHACEState *s)
+{
+    if (s->hash_ctx) {
+        migrate_del_blocker(s->migration_blocker);
     }
-    iov_count = s->iov_count;
-    s->iov_count = 0;
+    s->hash_ctx = NULL;
     s->total_req_len = 0;
-    return iov_count;
 }
 
-/**
- * Generate iov for accumulative mode.
- *
- * @param s             aspeed hace state object
- * @param iov           iov of the current request
- * @param id            index of the current iov
- * @param req_len       length of the current request
- *
- * @return count of iov
- */
-static int gen_acc_mode_iov(AspeedHACEState *s, struct iovec *iov, int id,
-                            hwaddr *req_len)
+static int aspeed_hace_hash_worker(void *opaque)
 {
-    uint32_t pad_offset;
-    uint32_t total_msg_len;
-    s->total_req_len += *req_len;
+    AspeedHACEJob *job = opaque;
 
-    if (has_padding(s, &iov[id], *req_len, &total_msg_len, &pad_offset)) {
-        if (s->iov_count) {
-            return reconstruct_iov(s, iov, id, &pad_offset);
+    if (job->failed) {
+        return -1;
+    }
+
+    if (!job->ctx) {
+        return qcrypto_hash_bytesv(job->algo, job->iov, job->niov,
+                                   &job->digest, &job->digest_len, NULL);
+    }
+
+    if (qcrypto_hash_updatev(job->ctx, job->iov, job->niov, NULL) < 0) {
+        return -1;
+    }
+    if (job->final) {
+        return qcrypto_hash_finalize_bytes(job->ctx, &job->digest,
+                                           &job->digest_len, NULL);
+    }
+    return 0;
+}
+
+static void aspeed_hace_hash_done(void *opaque, int ret)
+{
+    AspeedHACEJob *job = opaque;
+    AspeedHACEState *s = job->s;
+    int i;
+
+    if (job->cancelled) {
+        /* The engine was reset, drop the result */
+    } else if (ret < 0) {
+        if (!job->failed) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: qcrypto failed\n", __func__);
         }
+    } else if (job->digest &&
+               address_space_write(&s->dram_as, job->dest,
+                                   MEMTXATTRS_UNSPECIFIED,
+                                   job->digest, job->digest_len)) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "aspeed_hace: address space write failed\n");
+    }
 
-        *req_len -= s->total_req_len - total_msg_len;
-        s->total_req_len = 0;
-        iov[id].iov_len = *req_len;
-    } else {
-        s->iov_cache[s->iov_count].iov_base = iov->iov_base;
-        s->iov_cache[s->iov_count].iov_len = *req_len;
-        ++s->iov_count;
+    for (i = job->nmap; i > 0; i--) {
+        address_space_unmap(&s->dram_as, job->iov[i - 1].iov_base,
+                            job->map_len[i - 1], false, job->map_len[i - 1]);
     }
 
-    return id + 1;
+    if (job->free_ctx) {
+        qcrypto_hash_free(job->ctx);
+    }
+
+    if (!job->cancelled) {
+        if (ret < 0 && job->ctx && job->ctx == s->hash_ctx) {
+            /* The accumulated digest is lost, start over */
+            qcrypto_hash_free(s->hash_ctx);
+            aspeed_hace_acc_end(s);
+        }
+
+        s->hash_job = NULL;
+        s->regs[R_STATUS] &= ~HASH_BUSY;
+
+        /*
+         * Set status bits to indicate completion. Testing shows hardware
+         * sets these irrespective of HASH_IRQ_EN.
+         */
+        if (ret >= 0) {
+            s->regs[R_STATUS] |= HASH_IRQ;
+        }
+        if (job->irq_en) {
+            qemu_irq_raise(s->irq);
+        }
+        aio_wait_kick();
+    }
+
+    g_free(job->digest);
+    g_free(job);
+}
+
+static bool aspeed_hace_map(AspeedHACEState *s, AspeedHACEJob *job,
+                            uint32_t addr, hwaddr len)
+{
+    hwaddr plen = len;
+    void *ptr;
+
+    ptr = address_space_map(&s->dram_as, addr, &plen, false,
+                            MEMTXATTRS_UNSPECIFIED);
+    if (!ptr) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "aspeed_hace: can't map 0x%08x len 0x%" HWADDR_PRIx
+                      "\n", addr, len);
+        return false;
+    }
+
+    job->iov[job->nmap].iov_base = ptr;
+    job->iov[job->nmap].iov_len = plen;
+    job->map_len[job->nmap] = plen;
+    job->nmap++;
+    return true;
 }
 
 static void do_hash_operation(AspeedHACEState *s, int algo, bool sg_mode,
-                              bool acc_mode)
+                              bool acc_mode, bool irq_en)
 {
-    struct iovec iov[ASPEED_HACE_MAX_SG];
-    g_autofree uint8_t *digest_buf;
-    size_t digest_len = 0;
-    int niov = 0;
+    AspeedHACEJob *job = g_new0(AspeedHACEJob, 1);
     int i;
 
     if (sg_mode) {
@@ -199,7 +312,6 @@ static void do_hash_operation(AspeedHACEState *s, int algo, bool sg_mode,
 
         for (i = 0; !(len & SG_LIST_LEN_LAST); i++) {
             uint32_t addr, src;
-            hwaddr plen;
 
             if (i == ASPEED_HACE_MAX_SG) {
                 qemu_log_mask(LOG_GUEST_ERROR,
@@ -216,69 +328,64 @@ static void do_hash_operation(AspeedHACEState *s, int algo, bool sg_mode,
                                         MEMTXATTRS_UNSPECIFIED, NULL);
             addr &= SG_LIST_ADDR_MASK;
 
-            plen = len & SG_LIST_LEN_MASK;
-            iov[i].iov_base = address_space_map(&s->dram_as, addr, &plen, false,
-                                                MEMTXATTRS_UNSPECIFIED);
-
-            if (acc_mode) {
-                niov = gen_acc_mode_iov(s, iov, i, &plen);
-
-            } else {
-                iov[i].iov_len = plen;
+            if (!aspeed_hace_map(s, job, addr, len & SG_LIST_LEN_MASK)) {
+                break;
             }
         }
     } else {
-        hwaddr len = s->regs[R_HASH_SRC_LEN];
-
-        iov[0].iov_len = len;
-        iov[0].iov_base = address_space_map(&s->dram_as, s->regs[R_HASH_SRC],
-                                            &len, false,
-                                            MEMTXATTRS_UNSPECIFIED);
-        i = 1;
-
-        if (s->iov_count) {
-            /*
-             * In aspeed sdk kernel driver, sg_mode is disabled in hash_final().
-             * Thus if we received a request with sg_mode disabled, it is
-             * required to check whether cache is empty. If no, we should
-             * combine cached iov and the current iov.
-             */
+        aspeed_hace_map(s, job, s->regs[R_HASH_SRC], s->regs[R_HASH_SRC_LEN]);
+
+        /*
+         * In aspeed sdk kernel driver, sg_mode is disabled in hash_final().
+         * Thus if we received a request with sg_mode disabled, it is
+         * required to check whether an accumulation is in progress.
+         */
+        acc_mode = s->hash_ctx != NULL;
+    }
+    job->niov = job->nmap;
+
+    if (acc_mode) {
+        if (!s->hash_ctx) {
+            aspeed_hace_acc_start(s, algo);
+        }
+
+        for (i = 0; i < job->nmap; i++) {
             uint32_t total_msg_len;
             uint32_t pad_offset;
-            s->total_req_len += len;
-            if (has_padding(s, iov, len, &total_msg_len, &pad_offset)) {
-                niov = reconstruct_iov(s, iov, 0, &pad_offset);
+
+            s->total_req_len += job->iov[i].iov_len;
+            if (has_padding(s, &job->iov[i], job->iov[i].iov_len,
+                            &total_msg_len, &pad_offset)) {
+                job->iov[i].iov_len = pad_offset;
+                job->niov = i + 1;
+                job->final = true;
+                break;
             }
         }
-    }
-
-    if (niov) {
-        i = niov;
-    }
 
-    if (qcrypto_hash_bytesv(algo, iov, i, &digest_buf, &digest_len, NULL) < 0) {
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: qcrypto failed\n", __func__);
-        return;
-    }
+        job->ctx = s->hash_ctx;
+        if (job->final) {
+            job->free_ctx = true;
+            aspeed_hace_acc_end(s);
+        }
 
-    if (address_space_write(&s->dram_as, s->regs[R_HASH_DEST],
-                            MEMTXATTRS_UNSPECIFIED,
-                            digest_buf, digest_len)) {
-        qemu_log_mask(LOG_GUEST_ERROR,
-                      "aspeed_hace: address space write failed\n");
+        if (!job->ctx) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: can't create hash context\n", __func__);
+            job->failed = true;
+        }
     }
 
-    for (; i > 0; i--) {
-        address_space_unmap(&s->dram_as, iov[i - 1].iov_base,
-                            iov[i - 1].iov_len, false,
-                            iov[i - 1].iov_len);
-    }
+    job->s = s;
+    job->algo = algo;
+    job->dest = s->regs[R_HASH_DEST];
+    job->irq_en = irq_en;
 
-    /*
-     * Set status bits to indicate completion. Testing shows hardware sets
-     * these irrespective of HASH_IRQ_EN.
-     */
-    s->regs[R_STATUS] |= HASH_IRQ;
+    s->hash_job = job;
+    s->regs[R_STATUS] |= HASH_BUSY;
+    thread_pool_submit_aio(aio_get_thread_pool(qemu_get_aio_context()),
+                           aspeed_hace_hash_worker, job,
+                           aspeed_hace_hash_done, job);
 }
 
 static uint64_t aspeed_hace_read(void *opaque, hwaddr addr, unsigned int size)
@@ -314,6 +421,7 @@ static void aspeed_hace_write(void *opaque, hwaddr addr, uint64_t data,
 
     switch (addr) {
     case R_STATUS:
+        data = (data & ~HASH_BUSY) | (s->regs[addr] & HASH_BUSY);
         if (data & HASH_IRQ) {
             data &= ~HASH_IRQ;
 
@@ -338,6 +446,12 @@ static void aspeed_hace_write(void *opaque, hwaddr addr, uint64_t data,
         int algo;
         data &= ahc->hash_mask;
 
+        if (s->hash_job) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: hash engine is busy\n",
+                          __func__);
+            return;
+        }
+
         if ((data & HASH_HMAC_MASK)) {
             qemu_log_mask(LOG_UNIMP,
                           "%s: HMAC engine command mode %"PRIx64" not implemented",
@@ -356,11 +470,8 @@ static void aspeed_hace_write(void *opaque, hwaddr addr, uint64_t data,
                 break;
         }
         do_hash_operation(s, algo, data & HASH_SG_EN,
-                ((data & HASH_HMAC_MASK) == HASH_DIGEST_ACCUM));
-
-        if (data & HASH_IRQ_EN) {
-            qemu_irq_raise(s->irq);
-        }
+                ((data & HASH_HMAC_MASK) == HASH_DIGEST_ACCUM),
+                data & HASH_IRQ_EN);
         break;
     }
     case R_CRYPT_CMD:
@@ -388,9 +499,33 @@ static void aspeed_hace_reset(DeviceState *dev)
 {
     struct AspeedHACEState *s = ASPEED_HACE(dev);
 
+    if (s->hash_job) {
+        /* The pending request may still be using the context */
+        s->hash_job->cancelled = true;
+        if (s->hash_job->ctx == s->hash_ctx) {
+            s->hash_job->free_ctx = true;
+            aspeed_hace_acc_end(s);
+        }
+        s->hash_job = NULL;
+    }
+    qcrypto_hash_free(s->hash_ctx);
+    aspeed_hace_acc_end(s);
+
     memset(s->regs, 0, sizeof(s->regs));
-    s->iov_count = 0;
-    s->total_req_len = 0;
+}
+
+/*
+ * Hash requests complete before the VM stops so that migration and
+ * snapshots never see a busy engine.
+ */
+static void aspeed_hace_vm_state_change(void *opaque, bool running,
+                                        RunState state)
+{
+    AspeedHACEState *s = opaque;
+
+    if (!running) {
+        AIO_WAIT_WHILE(NULL, s->hash_job);
+    }
 }
 
 static void aspeed_hace_realize(DeviceState *dev, Error **errp)
@@ -409,6 +544,9 @@ static void aspeed_hace_realize(DeviceState *dev, Error **errp)
     }
 
     address_space_init(&s->dram_as, s->dram_mr, "dram");
+    error_setg(&s->migration_blocker,
+               "%s: a hash accumulation is in progress", TYPE_ASPEED_HACE);
+    qemu_add_vm_change_state_handler(aspeed_hace_vm_state_change, s);
 
     sysbus_init_mmio(sbd, &s->iomem);
 }
@@ -427,7 +565,7 @@ static const VMStateDescription vmstate_aspeed_hace = {
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, AspeedHACEState, ASPEED_HACE_NR_REGS),
         VMSTATE_UINT32(total_req_len, AspeedHACEState),
-        VMSTATE_UINT32(iov_count, AspeedHACEState),
+        VMSTATE_UNUSED(4),
         VMSTATE_END_OF_LIST(),
     }
 };
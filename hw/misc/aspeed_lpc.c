@@ -8,6 +8,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
 #include "hw/misc/aspeed_lpc.h"
@@ -15,7 +16,9 @@
 #include "qapi/visitor.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
 #include "migration/vmstate.h"
+#include "trace.h"
 
 #define TO_REG(offset) ((offset) >> 2)
 
@@ -40,7 +43,10 @@
 #define STR1                 TO_REG(0x3C)
 #define   STR_OBF            BIT(0)
 #define   STR_IBF            BIT(1)
+#define   STR_SMS_ATN        BIT(2)
 #define   STR_CMD_DATA       BIT(3)
+#define   STR_STATE_SHIFT    6
+#define   STR_STATE_LEN      2
 #define STR2                 TO_REG(0x40)
 #define STR3                 TO_REG(0x44)
 #define HICR5                TO_REG(0x80)
@@ -54,6 +60,23 @@
 #define ODR4                 TO_REG(0x118)
 #define STR4                 TO_REG(0x11C)
 
+/* KCS interface states and control codes, set by the BMC in STR */
+#define KCS_STATE_IDLE       0
+#define KCS_STATE_READ       1
+#define KCS_STATE_WRITE      2
+#define KCS_STATE_ERROR      3
+
+#define KCS_CMD_WRITE_START  0x61
+#define KCS_CMD_WRITE_END    0x62
+#define KCS_CMD_READ_BYTE    0x68
+
+enum aspeed_kcs_bridge_phase {
+    KCS_BRIDGE_IDLE,
+    KCS_BRIDGE_WRITE,
+    KCS_BRIDGE_WRITE_END,
+    KCS_BRIDGE_READ,
+};
+
 enum aspeed_kcs_channel_id {
     kcs_channel_1 = 0,
     kcs_channel_2,
@@ -261,6 +284,244 @@ aspeed_kcs_channel_ibf_irq_enabled(AspeedLPCState *s,
     }
 }
 
+static void aspeed_kcs_raise_ibf(AspeedLPCState *s,
+                                 const struct aspeed_kcs_channel *channel)
+{
+    s->regs[channel->str] |= STR_IBF;
+    if (aspeed_kcs_channel_ibf_irq_enabled(s, channel)) {
+        enum aspeed_lpc_subdevice subdev;
+
+        subdev = aspeed_kcs_subdevice_map[channel->id];
+        qemu_irq_raise(s->subdevice_irqs[subdev]);
+    }
+}
+
+static void aspeed_kcs_bridge_send(AspeedKCSBridge *b, uint8_t type,
+                                   uint8_t msg_id, const uint8_t *data,
+                                   unsigned int len)
+{
+    uint8_t frame[IPMI_EXTERN_FRAME_HDR_SIZE + MAX_IPMI_MSG_SIZE];
+
+    frame[0] = type;
+    frame[1] = msg_id;
+    stw_le_p(&frame[2], len);
+    memcpy(&frame[IPMI_EXTERN_FRAME_HDR_SIZE], data, len);
+    qemu_chr_fe_write_all(&b->chr, frame, IPMI_EXTERN_FRAME_HDR_SIZE + len);
+}
+
+static void aspeed_kcs_bridge_respond(AspeedLPCState *s,
+                                      const struct aspeed_kcs_channel *channel)
+{
+    AspeedKCSBridge *b = &s->kcs[channel->id];
+
+    trace_aspeed_kcs_bridge_response(channel->id + 1, b->msg_id, b->rsp_len);
+
+    b->phase = KCS_BRIDGE_IDLE;
+    aspeed_kcs_bridge_send(b, IPMI_EXTERN_FRAME_MSG, b->msg_id, b->rsp,
+                           b->rsp_len);
+}
+
+static void aspeed_kcs_bridge_error(AspeedLPCState *s,
+                                    const struct aspeed_kcs_channel *channel,
+                                    uint8_t cc)
+{
+    AspeedKCSBridge *b = &s->kcs[channel->id];
+
+    b->rsp[0] = b->req[0] | 0x04;
+    b->rsp[1] = b->req[1];
+    b->rsp[2] = cc;
+    b->rsp_len = 3;
+    aspeed_kcs_bridge_respond(s, channel);
+}
+
+/* Write a data byte or a control code to the input register */
+static void aspeed_kcs_bridge_write(AspeedLPCState *s,
+                                    const struct aspeed_kcs_channel *channel,
+                                    uint8_t val, bool cmd)
+{
+    s->regs[channel->idr] = val;
+    if (cmd) {
+        s->regs[channel->str] |= STR_CMD_DATA;
+    } else {
+        s->regs[channel->str] &= ~STR_CMD_DATA;
+    }
+    aspeed_kcs_raise_ibf(s, channel);
+}
+
+/*
+ * Run the next step of the transfer, as a host driver would once the BMC
+ * has consumed the previous byte and answered in the output register.
+ */
+static void aspeed_kcs_bridge_update(AspeedLPCState *s,
+                                     const struct aspeed_kcs_channel *channel)
+{
+    AspeedKCSBridge *b = &s->kcs[channel->id];
+    uint32_t str = s->regs[channel->str];
+    uint8_t state = extract32(str, STR_STATE_SHIFT, STR_STATE_LEN);
+
+    if (b->phase == KCS_BRIDGE_IDLE || (str & STR_IBF) || !(str & STR_OBF)) {
+        return;
+    }
+
+    /* Reading the output register clears OBF */
+    s->regs[channel->str] &= ~STR_OBF;
+
+    switch (b->phase) {
+    case KCS_BRIDGE_WRITE:
+        if (state != KCS_STATE_WRITE) {
+            break;
+        }
+        if (b->req_len - b->req_pos > 1) {
+            aspeed_kcs_bridge_write(s, channel, b->req[b->req_pos++], false);
+        } else {
+            b->phase = KCS_BRIDGE_WRITE_END;
+            aspeed_kcs_bridge_write(s, channel, KCS_CMD_WRITE_END, true);
+        }
+        return;
+
+    case KCS_BRIDGE_WRITE_END:
+        if (state != KCS_STATE_WRITE) {
+            break;
+        }
+        b->phase = KCS_BRIDGE_READ;
+        aspeed_kcs_bridge_write(s, channel, b->req[b->req_pos++], false);
+        return;
+
+    case KCS_BRIDGE_READ:
+        if (state == KCS_STATE_READ) {
+            if (b->rsp_len < sizeof(b->rsp)) {
+                b->rsp[b->rsp_len++] = s->regs[channel->odr];
+            }
+            aspeed_kcs_bridge_write(s, channel, KCS_CMD_READ_BYTE, false);
+            return;
+        }
+        if (state != KCS_STATE_IDLE) {
+            break;
+        }
+        /* The byte read in the idle state is a dummy */
+        if (b->rsp_len < 3) {
+            aspeed_kcs_bridge_error(s, channel, IPMI_CC_UNSPECIFIED);
+        } else {
+            aspeed_kcs_bridge_respond(s, channel);
+        }
+        return;
+    }
+
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: KCS%d transfer failed in state %d\n",
+                  __func__, channel->id + 1, state);
+    aspeed_kcs_bridge_error(s, channel, IPMI_CC_UNSPECIFIED);
+}
+
+static void aspeed_kcs_bridge_request(AspeedLPCState *s,
+                                      const struct aspeed_kcs_channel *channel,
+                                      uint8_t msg_id, unsigned int len)
+{
+    AspeedKCSBridge *b = &s->kcs[channel->id];
+
+    trace_aspeed_kcs_bridge_request(channel->id + 1, msg_id, len);
+
+    if (len < 2) {
+        return;
+    }
+
+    if (b->phase != KCS_BRIDGE_IDLE) {
+        uint8_t rsp[3] = { b->inbuf[0] | 0x04, b->inbuf[1], IPMI_CC_NODE_BUSY };
+
+        aspeed_kcs_bridge_send(b, IPMI_EXTERN_FRAME_MSG, msg_id, rsp,
+                               sizeof(rsp));
+        return;
+    }
+
+    b->msg_id = msg_id;
+    b->req_len = MIN(len, sizeof(b->req));
+    b->req_pos = 0;
+    b->rsp_len = 0;
+    memcpy(b->req, b->inbuf, b->req_len);
+
+    if (len > sizeof(b->req)) {
+        aspeed_kcs_bridge_error(s, channel, IPMI_CC_REQUEST_DATA_TRUNCATED);
+        return;
+    }
+
+    if (!aspeed_kcs_channel_enabled(s, channel)) {
+        aspeed_kcs_bridge_error(s, channel, IPMI_CC_BMC_INIT_IN_PROGRESS);
+        return;
+    }
+
+    b->phase = KCS_BRIDGE_WRITE;
+    aspeed_kcs_bridge_write(s, channel, KCS_CMD_WRITE_START, true);
+}
+
+static void aspeed_kcs_bridge_frame(AspeedLPCState *s,
+                                    const struct aspeed_kcs_channel *channel)
+{
+    AspeedKCSBridge *b = &s->kcs[channel->id];
+    unsigned int len = lduw_le_p(&b->inhdr[2]);
+
+    switch (b->inhdr[0]) {
+    case IPMI_EXTERN_FRAME_MSG:
+        aspeed_kcs_bridge_request(s, channel, b->inhdr[1], len);
+        break;
+    case IPMI_EXTERN_FRAME_CMD:
+        /* A host reset drops the transfer, the BMC recovers on the next */
+        if (len && b->inbuf[0] == VM_CMD_RESET) {
+            b->phase = KCS_BRIDGE_IDLE;
+        }
+        break;
+    }
+}
+
+static int aspeed_kcs_bridge_can_receive(void *opaque)
+{
+    return MAX_IPMI_MSG_SIZE;
+}
+
+static void aspeed_kcs_bridge_receive(void *opaque, const uint8_t *buf,
+                                      int size)
+{
+    AspeedKCSBridge *b = opaque;
+    const struct aspeed_kcs_channel *channel = &aspeed_kcs_channel_map[b->id];
+
+    while (size > 0) {
+        unsigned int n, off;
+
+        if (b->inpos < IPMI_EXTERN_FRAME_HDR_SIZE) {
+            n = MIN(size, IPMI_EXTERN_FRAME_HDR_SIZE - b->inpos);
+            memcpy(&b->inhdr[b->inpos], buf, n);
+        } else {
+            off = b->inpos - IPMI_EXTERN_FRAME_HDR_SIZE;
+            n = MIN(size, lduw_le_p(&b->inhdr[2]) - off);
+            if (off < sizeof(b->inbuf)) {
+                memcpy(&b->inbuf[off], buf, MIN(n, sizeof(b->inbuf) - off));
+            }
+        }
+        buf += n;
+        size -= n;
+        b->inpos += n;
+
+        if (b->inpos >= IPMI_EXTERN_FRAME_HDR_SIZE &&
+            b->inpos == IPMI_EXTERN_FRAME_HDR_SIZE + lduw_le_p(&b->inhdr[2])) {
+            aspeed_kcs_bridge_frame(b->lpc, channel);
+            b->inpos = 0;
+        }
+    }
+}
+
+static void aspeed_kcs_bridge_event(void *opaque, QEMUChrEvent event)
+{
+    AspeedKCSBridge *b = opaque;
+
+    switch (event) {
+    case CHR_EVENT_OPENED:
+    case CHR_EVENT_CLOSED:
+        b->phase = KCS_BRIDGE_IDLE;
+        b->inpos = 0;
+        break;
+    default:
+        break;
+    }
+}
+
 static void aspeed_kcs_set_register_property(Object *obj,
                                              Visitor *v,
                                              const char *name,
@@ -285,13 +546,7 @@ static void aspeed_kcs_set_register_property(Object *obj,
     }
 
     if (!strncmp("idr", name, 3)) {
-        s->regs[data->chan->str] |= STR_IBF;
-        if (aspeed_kcs_channel_ibf_irq_enabled(s, data->chan)) {
-            enum aspeed_lpc_subdevice subdev;
-
-            subdev = aspeed_kcs_subdevice_map[data->chan->id];
-            qemu_irq_raise(s->subdevice_irqs[subdev]);
-        }
+        aspeed_kcs_raise_ibf(s, data->chan);
     }
 }
 
@@ -312,6 +567,7 @@ static uint64_t aspeed_lpc_read(void *opaque, hwaddr offset, unsigned size)
 {
     AspeedLPCState *s = ASPEED_LPC(opaque);
     int reg = TO_REG(offset);
+    uint32_t val;
 
     if (reg >= ARRAY_SIZE(s->regs)) {
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -320,6 +576,8 @@ static uint64_t aspeed_lpc_read(void *opaque, hwaddr offset, unsigned size)
         return 0;
     }
 
+    val = s->regs[reg];
+
     switch (reg) {
     case IDR1:
     case IDR2:
@@ -337,19 +595,21 @@ static uint64_t aspeed_lpc_read(void *opaque, hwaddr offset, unsigned size)
         }
 
         s->regs[channel->str] &= ~STR_IBF;
+        aspeed_kcs_bridge_update(s, channel);
         break;
     }
     default:
         break;
     }
 
-    return s->regs[reg];
+    return val;
 }
 
 static void aspeed_lpc_write(void *opaque, hwaddr offset, uint64_t data,
                              unsigned int size)
 {
     AspeedLPCState *s = ASPEED_LPC(opaque);
+    const struct aspeed_kcs_channel *channel;
     int reg = TO_REG(offset);
 
     if (reg >= ARRAY_SIZE(s->regs)) {
@@ -365,7 +625,23 @@ static void aspeed_lpc_write(void *opaque, hwaddr offset, uint64_t data,
     case ODR2:
     case ODR3:
     case ODR4:
-        s->regs[aspeed_kcs_get_channel_by_register(reg)->str] |= STR_OBF;
+        channel = aspeed_kcs_get_channel_by_register(reg);
+        s->regs[channel->str] |= STR_OBF;
+        s->regs[reg] = data;
+        aspeed_kcs_bridge_update(s, channel);
+        return;
+    case STR1:
+    case STR2:
+    case STR3:
+    case STR4:
+        /* Tell the host when the BMC has a message for it */
+        if ((s->regs[reg] ^ data) & STR_SMS_ATN) {
+            uint8_t hw_op = data & STR_SMS_ATN ? VM_CMD_ATTN : VM_CMD_NOATTN;
+
+            channel = aspeed_kcs_get_channel_by_register(reg);
+            aspeed_kcs_bridge_send(&s->kcs[channel->id], IPMI_EXTERN_FRAME_CMD,
+                                   0, &hw_op, 1);
+        }
         break;
     default:
         break;
@@ -387,6 +663,15 @@ static const MemoryRegionOps aspeed_lpc_ops = {
 static void aspeed_lpc_reset(DeviceState *dev)
 {
     struct AspeedLPCState *s = ASPEED_LPC(dev);
+    int i;
+
+    /* The BMC firmware starts over, fail the transfers in flight */
+    for (i = 0; i < ASPEED_KCS_NR_CHANNELS; i++) {
+        if (s->kcs[i].phase != KCS_BRIDGE_IDLE) {
+            aspeed_kcs_bridge_error(s, &aspeed_kcs_channel_map[i],
+                                    IPMI_CC_BMC_INIT_IN_PROGRESS);
+        }
+    }
 
     s->subdevice_irqs_pending = 0;
 
@@ -399,6 +684,7 @@ static void aspeed_lpc_realize(DeviceState *dev, Error **errp)
 {
     AspeedLPCState *s = ASPEED_LPC(dev);
     SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    int i;
 
     sysbus_init_irq(sbd, &s->irq);
     sysbus_init_irq(sbd, &s->subdevice_irqs[aspeed_lpc_kcs_1]);
@@ -413,6 +699,19 @@ static void aspeed_lpc_realize(DeviceState *dev, Error **errp)
     sysbus_init_mmio(sbd, &s->iomem);
 
     qdev_init_gpio_in(dev, aspeed_lpc_set_irq, ASPEED_LPC_NR_SUBDEVS);
+
+    for (i = 0; i < ASPEED_KCS_NR_CHANNELS; i++) {
+        AspeedKCSBridge *b = &s->kcs[i];
+
+        b->lpc = s;
+        b->id = i;
+        if (qemu_chr_fe_backend_connected(&b->chr)) {
+            qemu_chr_fe_set_handlers(&b->chr, aspeed_kcs_bridge_can_receive,
+                                     aspeed_kcs_bridge_receive,
+                                     aspeed_kcs_bridge_event, NULL, b, NULL,
+                                     true);
+        }
+    }
 }
 
 static void aspeed_lpc_init(Object *obj)
@@ -456,6 +755,10 @@ static const VMStateDescription vmstate_aspeed_lpc = {
 
 static Property aspeed_lpc_properties[] = {
     DEFINE_PROP_UINT32("hicr7", AspeedLPCState, hicr7, 0),
+    DEFINE_PROP_CHR("kcs1-chardev", AspeedLPCState, kcs[0].chr),
+    DEFINE_PROP_CHR("kcs2-chardev", AspeedLPCState, kcs[1].chr),
+    DEFINE_PROP_CHR("kcs3-chardev", AspeedLPCState, kcs[2].chr),
+    DEFINE_PROP_CHR("kcs4-chardev", AspeedLPCState, kcs[3].chr),
     DEFINE_PROP_END_OF_LIST(),
 };
 
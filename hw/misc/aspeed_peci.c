@@ -8,9 +8,15 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
 #include "qemu/log.h"
 #include "hw/irq.h"
 #include "hw/misc/aspeed_peci.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "trace.h"
 
 #define U(x) (x##U)
 #define GENMASK(h, l) \
@@ -101,15 +107,149 @@
 #define ASPEED_PECI_RD_DATA7 (0x5c / 4)
 #define   ASPEED_PECI_DATA_BUF_SIZE_MAX 32
 
-/** PECI read/write supported responses */
-#define PECI_CC_RSP_SUCCESS              (0x40U)
-#define PECI_CC_RSP_TIMEOUT              (0x80U)
-#define PECI_CC_OUT_OF_RESOURCES_TIMEOUT (0x81U)
-#define PECI_CC_RESOURCES_LOWPWR_TIMEOUT (0x82U)
-#define PECI_CC_ILLEGAL_REQUEST          (0x90U)
+/* Status of a command on the bus */
+#define ASPEED_PECI_CMD_STS_BUSY     ASPEED_PECI_CMD_STS_ADDR_T_NEGO
+
+/* Clients must answer within this time, or the bus times out */
+#define ASPEED_PECI_TIMEOUT_NS  (10 * SCALE_MS)
+
+static void aspeed_peci_update_irq(AspeedPECIState *s)
+{
+    qemu_set_irq(s->irq, !!(s->regs[ASPEED_PECI_INT_STS] &
+                            s->regs[ASPEED_PECI_INT_CTRL] &
+                            ASPEED_PECI_INT_MASK));
+}
+
+/*
+ * The time a message takes on the wire: the timing negotiations, the
+ * address, lengths and data bytes, the FCS of both directions and the
+ * stop condition.
+ */
+static int64_t aspeed_peci_xfer_ns(AspeedPECIState *s)
+{
+    uint64_t bits = 2 + 8 + 2 + 8 * (2 + s->req.wlen + 1) + 2;
+
+    if (s->req.rlen) {
+        bits += 8 * (s->req.rlen + 1);
+    }
+
+    return muldiv64(bits, NANOSECONDS_PER_SECOND, s->bit_rate);
+}
+
+static void aspeed_peci_done(AspeedPECIState *s, uint32_t status)
+{
+    uint8_t hdr[3] = { s->req.addr, s->req.wlen, s->req.rlen };
+    uint8_t wr_fcs, rd_fcs = 0;
+    int i;
+
+    wr_fcs = peci_fcs(peci_fcs(0, hdr, sizeof(hdr)), s->req.wbuf,
+                      s->req.wlen);
+    if (s->req.rlen) {
+        rd_fcs = peci_fcs(0, s->req.rbuf, s->req.rlen);
+    }
+
+    for (i = 0; i < 4; i++) {
+        s->regs[ASPEED_PECI_RD_DATA0 + i] = ldl_le_p(&s->req.rbuf[i * 4]);
+        s->regs[ASPEED_PECI_RD_DATA4 + i] = ldl_le_p(&s->req.rbuf[16 + i * 4]);
+    }
+    s->regs[ASPEED_PECI_EXPECTED_FCS] = rd_fcs << 16 | wr_fcs;
+
+    /* Nothing is captured from an absent client */
+    if (s->answered && s->ok) {
+        s->regs[ASPEED_PECI_CAPTURED_FCS] = rd_fcs << 16 | wr_fcs;
+    } else {
+        s->regs[ASPEED_PECI_CAPTURED_FCS] = 0;
+    }
+
+    s->busy = false;
+    s->regs[ASPEED_PECI_CMD] &= ~(ASPEED_PECI_CMD_STS_MASK |
+                                  ASPEED_PECI_CMD_FIRE);
+    s->regs[ASPEED_PECI_INT_STS] |= ASPEED_PECI_INT_CMD_DONE | status;
+    trace_aspeed_peci_done(s->req.addr, s->regs[ASPEED_PECI_INT_STS]);
+    aspeed_peci_update_irq(s);
+}
+
+static void aspeed_peci_complete(PECIRequest *req, bool ok, void *opaque)
+{
+    AspeedPECIState *s = opaque;
+
+    if (!s->busy) {
+        return;
+    }
+
+    s->answered = true;
+    s->ok = ok;
+
+    /* The answer came after the message time, it ends the command now */
+    if (s->timeout) {
+        timer_del(&s->timer);
+        aspeed_peci_done(s, 0);
+    }
+}
+
+static void aspeed_peci_timer(void *opaque)
+{
+    AspeedPECIState *s = opaque;
+
+    if (s->answered) {
+        aspeed_peci_done(s, 0);
+    } else if (!s->timeout) {
+        s->timeout = true;
+        timer_mod(&s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  ASPEED_PECI_TIMEOUT_NS);
+    } else {
+        peci_bus_cancel(&s->req);
+        aspeed_peci_done(s, ASPEED_PECI_INT_BUS_TIMEOUT);
+    }
+}
+
+static void aspeed_peci_fire(AspeedPECIState *s)
+{
+    uint32_t rw_length = s->regs[ASPEED_PECI_RW_LENGTH];
+    uint8_t wbuf[ASPEED_PECI_DATA_BUF_SIZE_MAX];
+    int i;
+
+    if (s->busy) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: command already in progress\n",
+                      __func__);
+        return;
+    }
+
+    s->req.addr = rw_length & ASPEED_PECI_TARGET_ADDR_MASK;
+    s->req.wlen = (rw_length & ASPEED_PECI_WR_LEN_MASK) >> 8;
+    s->req.rlen = (rw_length & ASPEED_PECI_RD_LEN_MASK) >> 16;
+    if (s->req.wlen > ASPEED_PECI_DATA_BUF_SIZE_MAX ||
+        s->req.rlen > ASPEED_PECI_DATA_BUF_SIZE_MAX) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: invalid lengths: write %u"
+                      " read %u\n", __func__, s->req.wlen, s->req.rlen);
+        s->req.wlen = MIN(s->req.wlen, ASPEED_PECI_DATA_BUF_SIZE_MAX);
+        s->req.rlen = MIN(s->req.rlen, ASPEED_PECI_DATA_BUF_SIZE_MAX);
+    }
+
+    for (i = 0; i < 4; i++) {
+        stl_le_p(&wbuf[i * 4], s->regs[ASPEED_PECI_WR_DATA0 + i]);
+        stl_le_p(&wbuf[16 + i * 4], s->regs[ASPEED_PECI_WR_DATA4 + i]);
+    }
+    memcpy(s->req.wbuf, wbuf, s->req.wlen);
+
+    s->busy = true;
+    s->answered = false;
+    s->ok = false;
+    s->timeout = false;
+    s->regs[ASPEED_PECI_CMD] |= ASPEED_PECI_CMD_STS_BUSY << 24;
+
+    /* The command ends once the message went through the wire */
+    timer_mod(&s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              aspeed_peci_xfer_ns(s));
+    peci_bus_transfer(s->bus, &s->req);
+}
 
 static void aspeed_peci_instance_init(Object *obj)
 {
+    AspeedPECIState *s = ASPEED_PECI(obj);
+
+    s->req.complete = aspeed_peci_complete;
+    s->req.opaque = s;
 }
 
 static uint64_t aspeed_peci_read(void *opaque, hwaddr addr, unsigned size)
@@ -123,18 +263,13 @@ static uint64_t aspeed_peci_read(void *opaque, hwaddr addr, unsigned size)
     }
     addr >>= 2;
 
-    uint32_t reg = s->regs[addr];
-    //printf("%s:  0x%08lx 0x%08x %u\n", __func__, addr << 2, reg, size);
-
-    return reg;
+    return s->regs[addr];
 }
 
 static void aspeed_peci_write(void *opaque, hwaddr addr, uint64_t data, unsigned size)
 {
     AspeedPECIState *s = ASPEED_PECI(opaque);
 
-    //printf("%s: 0x%08lx 0x%08x %u\n", __func__, addr, reg, size);
-
     if (addr >= ASPEED_PECI_NR_REGS << 2) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: Out-of-bounds write at offset 0x%" HWADDR_PRIx "\n",
                       __func__, addr);
@@ -143,34 +278,31 @@ static void aspeed_peci_write(void *opaque, hwaddr addr, uint64_t data, unsigned
     addr >>= 2;
 
     switch (addr) {
+    case ASPEED_PECI_CMD:
+        /* The status is read-only */
+        s->regs[addr] = (data & ~ASPEED_PECI_CMD_STS_MASK) |
+            (s->regs[addr] & ASPEED_PECI_CMD_STS_MASK);
+        if (data & ASPEED_PECI_CMD_FIRE) {
+            aspeed_peci_fire(s);
+        }
+        break;
     case ASPEED_PECI_INT_STS:
         s->regs[addr] &= ~data;
+        aspeed_peci_update_irq(s);
         break;
-    default:
+    case ASPEED_PECI_INT_CTRL:
         s->regs[addr] = data;
+        aspeed_peci_update_irq(s);
         break;
-    }
-
-    switch (addr) {
-    case ASPEED_PECI_CMD:
-        if (!(s->regs[ASPEED_PECI_CMD] & ASPEED_PECI_CMD_FIRE)) {
-            break;
-        }
-        s->regs[ASPEED_PECI_RD_DATA0] = PECI_CC_RSP_SUCCESS;
-        s->regs[ASPEED_PECI_WR_DATA0] = PECI_CC_RSP_SUCCESS;
-
-        s->regs[ASPEED_PECI_INT_STS] |= ASPEED_PECI_INT_CMD_DONE;
-        qemu_irq_raise(s->irq);
-        break;
-    case ASPEED_PECI_INT_STS:
-        if (s->regs[ASPEED_PECI_INT_STS]) {
-            break;
-        }
-        qemu_irq_lower(s->irq);
+    case ASPEED_PECI_CAPTURED_FCS:
+    case ASPEED_PECI_RD_DATA0 ... ASPEED_PECI_RD_DATA3:
+    case ASPEED_PECI_RD_DATA4 ... ASPEED_PECI_RD_DATA7:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: register 0x%03" HWADDR_PRIx " is read-only\n",
+                      __func__, addr << 2);
         break;
     default:
-        qemu_log_mask(LOG_UNIMP, "%s: register 0x%03" HWADDR_PRIx " writes unimplemented\n",
-                      __func__, addr);
+        s->regs[addr] = data;
         break;
     }
 }
@@ -186,25 +318,73 @@ static void aspeed_peci_realize(DeviceState *dev, Error **errp)
     AspeedPECIState *s = ASPEED_PECI(dev);
     SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
 
+    if (!s->bit_rate) {
+        error_setg(errp, "'bit-rate' must not be 0");
+        return;
+    }
+
     memory_region_init_io(&s->mmio, OBJECT(s), &aspeed_peci_ops, s, TYPE_ASPEED_PECI, 0x1000);
     sysbus_init_mmio(sbd, &s->mmio);
     sysbus_init_irq(sbd, &s->irq);
+
+    s->bus = peci_bus_new(dev, "aspeed.peci");
+    timer_init_ns(&s->timer, QEMU_CLOCK_VIRTUAL, aspeed_peci_timer, s);
+}
+
+static void aspeed_peci_unrealize(DeviceState *dev)
+{
+    AspeedPECIState *s = ASPEED_PECI(dev);
+
+    timer_del(&s->timer);
 }
 
 static void aspeed_peci_reset(DeviceState *dev)
 {
     AspeedPECIState *s = ASPEED_PECI(dev);
 
+    if (s->busy) {
+        peci_bus_cancel(&s->req);
+        timer_del(&s->timer);
+        s->busy = false;
+    }
     memset(s->regs, 0, sizeof(s->regs));
 }
 
+static const VMStateDescription vmstate_aspeed_peci = {
+    .name = TYPE_ASPEED_PECI,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, AspeedPECIState, ASPEED_PECI_NR_REGS),
+        VMSTATE_TIMER(timer, AspeedPECIState),
+        VMSTATE_BOOL(busy, AspeedPECIState),
+        VMSTATE_BOOL(answered, AspeedPECIState),
+        VMSTATE_BOOL(ok, AspeedPECIState),
+        VMSTATE_BOOL(timeout, AspeedPECIState),
+        VMSTATE_UINT8(req.addr, AspeedPECIState),
+        VMSTATE_UINT8(req.wlen, AspeedPECIState),
+        VMSTATE_UINT8(req.rlen, AspeedPECIState),
+        VMSTATE_UINT8_ARRAY(req.wbuf, AspeedPECIState, PECI_BUFFER_SIZE),
+        VMSTATE_UINT8_ARRAY(req.rbuf, AspeedPECIState, PECI_BUFFER_SIZE),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
+static Property aspeed_peci_properties[] = {
+    DEFINE_PROP_UINT32("bit-rate", AspeedPECIState, bit_rate, 1000000),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void aspeed_peci_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = aspeed_peci_realize;
+    dc->unrealize = aspeed_peci_unrealize;
     dc->reset = aspeed_peci_reset;
     dc->desc = "Aspeed PECI Controller";
+    dc->vmsd = &vmstate_aspeed_peci;
+    device_class_set_props(dc, aspeed_peci_properties);
 }
 
 static const TypeInfo aspeed_peci_info = {
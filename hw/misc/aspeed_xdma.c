@@ -7,10 +7,13 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "qemu/units.h"
 #include "qemu/error-report.h"
 #include "hw/irq.h"
 #include "hw/misc/aspeed_xdma.h"
+#include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 #include "qapi/error.h"
 
@@ -43,6 +46,32 @@
 #define  XDMA_AST2600_IRQ_STATUS_US_COMP  BIT(16)
 #define  XDMA_AST2600_IRQ_STATUS_DS_COMP  BIT(17)
 
+/*
+ * AST2400/AST2500 commands
+ *
+ *   word 0: host address [31:0]
+ *   word 1: BMC pitch [62:51] and host pitch [46:35] in 8 byte units,
+ *           upstream [31], BMC address [29:4]
+ *   word 2: IRQ enable [31], line number [27:16], IRQ to BMC [15],
+ *           line size [14:4]
+ */
+#define XDMA_CMD_AST2500_PITCH_UPSTREAM  BIT_ULL(31)
+#define XDMA_CMD_AST2500_PITCH_ADDR      0x3FFFFFF0
+#define XDMA_CMD_AST2500_CMD_IRQ_BMC     BIT_ULL(15)
+#define XDMA_CMD_AST2500_CMD_LINE_SIZE   0x7FF0
+
+/*
+ * AST2600 commands
+ *
+ *   word 0: host address [63:0]
+ *   word 1: BMC pitch [62:48], host pitch [46:32], BMC address [30:0]
+ *   word 2: 64-bit host address [40], IRQ to BMC [37], IRQ to host [36],
+ *           upstream [32], line number [27:16], line size [14:0]
+ */
+#define XDMA_CMD_AST2600_CMD_64_EN       BIT_ULL(40)
+#define XDMA_CMD_AST2600_CMD_IRQ_BMC     BIT_ULL(37)
+#define XDMA_CMD_AST2600_CMD_UPSTREAM    BIT_ULL(32)
+
 #define XDMA_MEM_SIZE              0x1000
 
 #define TO_REG(addr) ((addr) / sizeof(uint32_t))
@@ -59,6 +88,164 @@ static uint64_t aspeed_xdma_read(void *opaque, hwaddr addr, unsigned int size)
     return (uint64_t)val;
 }
 
+/*
+ * Copy between BMC and host memory. Both are normally RAM which can be
+ * mapped and copied in large chunks, go through a bounce buffer
+ * otherwise.
+ */
+static bool aspeed_xdma_copy(AddressSpace *dst_as, hwaddr dst,
+                             AddressSpace *src_as, hwaddr src, uint64_t len)
+{
+    while (len) {
+        hwaddr slen = len;
+        hwaddr dlen = 0;
+        void *sptr, *dptr = NULL;
+
+        sptr = address_space_map(src_as, src, &slen, false,
+                                 MEMTXATTRS_UNSPECIFIED);
+        if (sptr) {
+            dlen = slen;
+            dptr = address_space_map(dst_as, dst, &dlen, true,
+                                     MEMTXATTRS_UNSPECIFIED);
+        }
+
+        if (dptr) {
+            memcpy(dptr, sptr, dlen);
+            address_space_unmap(dst_as, dptr, dlen, true, dlen);
+            address_space_unmap(src_as, sptr, slen, false, dlen);
+        } else {
+            uint8_t buf[4 * KiB];
+
+            if (sptr) {
+                address_space_unmap(src_as, sptr, slen, false, 0);
+            }
+
+            dlen = MIN(len, sizeof(buf));
+            if (address_space_read(src_as, src, MEMTXATTRS_UNSPECIFIED, buf,
+                                   dlen) != MEMTX_OK ||
+                address_space_write(dst_as, dst, MEMTXATTRS_UNSPECIFIED, buf,
+                                    dlen) != MEMTX_OK) {
+                return false;
+            }
+        }
+
+        src += dlen;
+        dst += dlen;
+        len -= dlen;
+    }
+
+    return true;
+}
+
+static bool aspeed_xdma_transfer(AspeedXDMAState *xdma,
+                                 const AspeedXDMACmd *cmd)
+{
+    uint32_t line_no = cmd->line_no ?: 1;
+    uint64_t len = cmd->line_size;
+    uint32_t i;
+
+    /* Contiguous lines are moved with a single copy */
+    if (cmd->host_pitch == len && cmd->bmc_pitch == len) {
+        len *= line_no;
+        line_no = 1;
+    }
+
+    for (i = 0; i < line_no; i++) {
+        hwaddr host_addr = cmd->host_addr + (uint64_t)i * cmd->host_pitch;
+        hwaddr bmc_addr = cmd->bmc_addr + (uint64_t)i * cmd->bmc_pitch;
+        bool ok;
+
+        if (cmd->upstream) {
+            ok = aspeed_xdma_copy(&xdma->host_as, host_addr,
+                                  &xdma->dram_as, bmc_addr, len);
+        } else {
+            ok = aspeed_xdma_copy(&xdma->dram_as, bmc_addr,
+                                  &xdma->host_as, host_addr, len);
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Returns the interrupt status bits raised by the command */
+static uint32_t aspeed_xdma_run_cmd(AspeedXDMAState *xdma, hwaddr addr)
+{
+    AspeedXDMAClass *axc = ASPEED_XDMA_GET_CLASS(xdma);
+    uint64_t raw[ASPEED_XDMA_CMD_SIZE / sizeof(uint64_t)];
+    AspeedXDMACmd cmd;
+    MemTxResult result;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(raw); i++) {
+        raw[i] = address_space_ldq_le(&xdma->dram_as, addr + i * 8,
+                                      MEMTXATTRS_UNSPECIFIED, &result);
+        if (result != MEMTX_OK) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: invalid command address 0x%"
+                          HWADDR_PRIx "\n", __func__, addr);
+            return 0;
+        }
+    }
+
+    axc->decode_cmd(raw, &cmd);
+    trace_aspeed_xdma_cmd(cmd.upstream, cmd.host_addr, cmd.bmc_addr,
+                          cmd.line_size, cmd.line_no);
+
+    if (!xdma->hostmem) {
+        qemu_log_mask(LOG_UNIMP, "%s: no host memory, transfer dropped\n",
+                      __func__);
+    } else if (!aspeed_xdma_transfer(xdma, &cmd)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: transfer failed: host 0x%" PRIx64
+                      " BMC 0x%" PRIx32 "\n", __func__, cmd.host_addr,
+                      cmd.bmc_addr);
+    }
+
+    if (!cmd.irq_bmc) {
+        return 0;
+    }
+    return cmd.upstream ? axc->intr_us_complete : axc->intr_ds_complete;
+}
+
+/* Run the commands between the read and the write pointers */
+static void aspeed_xdma_process_cmdq(AspeedXDMAState *xdma)
+{
+    AspeedXDMAClass *axc = ASPEED_XDMA_GET_CLASS(xdma);
+    uint32_t cmdq_addr = xdma->regs[TO_REG(axc->cmdq_addr)] &
+        axc->bmc_addr_mask;
+    uint32_t endp = xdma->regs[TO_REG(axc->cmdq_endp)];
+    uint32_t wrp = xdma->regs[TO_REG(axc->cmdq_wrp)];
+    uint32_t *rdp = &xdma->regs[TO_REG(axc->cmdq_rdp)];
+    uint32_t status = 0;
+
+    if (wrp >= endp || *rdp >= endp || wrp % axc->cmdq_entry_size ||
+        *rdp % axc->cmdq_entry_size) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: invalid queue pointers: read 0x%"
+                      PRIx32 " write 0x%" PRIx32 " end 0x%" PRIx32 "\n",
+                      __func__, *rdp, wrp, endp);
+        *rdp = wrp;
+        return;
+    }
+
+    while (*rdp != wrp) {
+        hwaddr addr = cmdq_addr +
+            (*rdp / axc->cmdq_entry_size) * ASPEED_XDMA_CMD_SIZE;
+
+        status |= aspeed_xdma_run_cmd(xdma, addr);
+
+        *rdp += axc->cmdq_entry_size;
+        if (*rdp >= endp) {
+            *rdp = 0;
+        }
+    }
+
+    xdma->regs[TO_REG(axc->intr_status)] |= status;
+    if (xdma->regs[TO_REG(axc->intr_ctrl)] & status) {
+        qemu_irq_raise(xdma->irq);
+    }
+}
+
 static void aspeed_xdma_write(void *opaque, hwaddr addr, uint64_t val,
                               unsigned int size)
 {
@@ -76,18 +263,15 @@ static void aspeed_xdma_write(void *opaque, hwaddr addr, uint64_t val,
     } else if (addr == axc->cmdq_wrp) {
         idx = TO_REG(addr);
         xdma->regs[idx] = val32 & XDMA_BMC_CMDQ_W_MASK;
-        xdma->regs[TO_REG(axc->cmdq_rdp)] = xdma->regs[idx];
 
         trace_aspeed_xdma_write(addr, val);
 
         if (xdma->bmc_cmdq_readp_set) {
+            /* The queue was reset, this only sets the starting point */
             xdma->bmc_cmdq_readp_set = 0;
+            xdma->regs[TO_REG(axc->cmdq_rdp)] = xdma->regs[idx];
         } else {
-            xdma->regs[TO_REG(axc->intr_status)] |= axc->intr_complete;
-
-            if (xdma->regs[TO_REG(axc->intr_ctrl)] & axc->intr_complete) {
-                qemu_irq_raise(xdma->irq);
-            }
+            aspeed_xdma_process_cmdq(xdma);
         }
     } else if (addr == axc->cmdq_rdp) {
         trace_aspeed_xdma_write(addr, val);
@@ -123,6 +307,25 @@ static void aspeed_xdma_realize(DeviceState *dev, Error **errp)
     SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
     AspeedXDMAState *xdma = ASPEED_XDMA(dev);
 
+    if (!xdma->dram_mr) {
+        error_setg(errp, TYPE_ASPEED_XDMA ": 'dram' link not set");
+        return;
+    }
+
+    if (xdma->hostmem) {
+        if (host_memory_backend_is_mapped(xdma->hostmem)) {
+            error_setg(errp, "can't use already busy memdev: %s",
+                       object_get_canonical_path_component(
+                           OBJECT(xdma->hostmem)));
+            return;
+        }
+        host_memory_backend_set_mapped(xdma->hostmem, true);
+        address_space_init(&xdma->host_as,
+                           host_memory_backend_get_memory(xdma->hostmem),
+                           TYPE_ASPEED_XDMA "-host");
+    }
+    address_space_init(&xdma->dram_as, xdma->dram_mr, TYPE_ASPEED_XDMA "-dram");
+
     sysbus_init_irq(sbd, &xdma->irq);
     memory_region_init_io(&xdma->iomem, OBJECT(xdma), &aspeed_xdma_ops, xdma,
                           TYPE_ASPEED_XDMA, XDMA_MEM_SIZE);
@@ -150,6 +353,30 @@ static const VMStateDescription aspeed_xdma_vmstate = {
     },
 };
 
+static Property aspeed_xdma_properties[] = {
+    DEFINE_PROP_LINK("dram", AspeedXDMAState, dram_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_LINK("memdev", AspeedXDMAState, hostmem,
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void aspeed_2600_xdma_decode_cmd(const uint64_t *raw,
+                                        AspeedXDMACmd *cmd)
+{
+    cmd->host_addr = raw[0];
+    if (!(raw[2] & XDMA_CMD_AST2600_CMD_64_EN)) {
+        cmd->host_addr &= UINT32_MAX;
+    }
+    cmd->bmc_addr = extract64(raw[1], 0, 31);
+    cmd->host_pitch = extract64(raw[1], 32, 15);
+    cmd->bmc_pitch = extract64(raw[1], 48, 15);
+    cmd->line_size = extract64(raw[2], 0, 15);
+    cmd->line_no = extract64(raw[2], 16, 12);
+    cmd->upstream = raw[2] & XDMA_CMD_AST2600_CMD_UPSTREAM;
+    cmd->irq_bmc = raw[2] & XDMA_CMD_AST2600_CMD_IRQ_BMC;
+}
+
 static void aspeed_2600_xdma_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -157,6 +384,7 @@ static void aspeed_2600_xdma_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "ASPEED 2600 XDMA Controller";
 
+    axc->cmdq_addr = XDMA_AST2600_BMC_CMDQ_ADDR;
     axc->cmdq_endp = XDMA_AST2600_BMC_CMDQ_ENDP;
     axc->cmdq_wrp = XDMA_AST2600_BMC_CMDQ_WRP;
     axc->cmdq_rdp = XDMA_AST2600_BMC_CMDQ_RDP;
@@ -165,6 +393,11 @@ static void aspeed_2600_xdma_class_init(ObjectClass *klass, void *data)
     axc->intr_status = XDMA_AST2600_IRQ_STATUS;
     axc->intr_complete = XDMA_AST2600_IRQ_STATUS_US_COMP |
         XDMA_AST2600_IRQ_STATUS_DS_COMP;
+    axc->intr_us_complete = XDMA_AST2600_IRQ_STATUS_US_COMP;
+    axc->intr_ds_complete = XDMA_AST2600_IRQ_STATUS_DS_COMP;
+    axc->cmdq_entry_size = 2;
+    axc->bmc_addr_mask = 0x7FFFFFFF;
+    axc->decode_cmd = aspeed_2600_xdma_decode_cmd;
 }
 
 static const TypeInfo aspeed_2600_xdma_info = {
@@ -173,6 +406,19 @@ static const TypeInfo aspeed_2600_xdma_info = {
     .class_init = aspeed_2600_xdma_class_init,
 };
 
+static void aspeed_2500_xdma_decode_cmd(const uint64_t *raw,
+                                        AspeedXDMACmd *cmd)
+{
+    cmd->host_addr = extract64(raw[0], 0, 32);
+    cmd->bmc_addr = raw[1] & XDMA_CMD_AST2500_PITCH_ADDR;
+    cmd->host_pitch = extract64(raw[1], 35, 12) << 3;
+    cmd->bmc_pitch = extract64(raw[1], 51, 12) << 3;
+    cmd->line_size = raw[2] & XDMA_CMD_AST2500_CMD_LINE_SIZE;
+    cmd->line_no = extract64(raw[2], 16, 12);
+    cmd->upstream = raw[1] & XDMA_CMD_AST2500_PITCH_UPSTREAM;
+    cmd->irq_bmc = raw[2] & XDMA_CMD_AST2500_CMD_IRQ_BMC;
+}
+
 static void aspeed_2500_xdma_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -180,6 +426,7 @@ static void aspeed_2500_xdma_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "ASPEED 2500 XDMA Controller";
 
+    axc->cmdq_addr = XDMA_BMC_CMDQ_ADDR;
     axc->cmdq_endp = XDMA_BMC_CMDQ_ENDP;
     axc->cmdq_wrp = XDMA_BMC_CMDQ_WRP;
     axc->cmdq_rdp = XDMA_BMC_CMDQ_RDP;
@@ -187,6 +434,11 @@ static void aspeed_2500_xdma_class_init(ObjectClass *klass, void *data)
     axc->intr_ctrl_mask = XDMA_IRQ_ENG_CTRL_W_MASK;
     axc->intr_status = XDMA_IRQ_ENG_STAT;
     axc->intr_complete = XDMA_IRQ_ENG_STAT_US_COMP | XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->intr_us_complete = XDMA_IRQ_ENG_STAT_US_COMP;
+    axc->intr_ds_complete = XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->cmdq_entry_size = 4;
+    axc->bmc_addr_mask = 0x3FFFFFFF;
+    axc->decode_cmd = aspeed_2500_xdma_decode_cmd;
 };
 
 static const TypeInfo aspeed_2500_xdma_info = {
@@ -202,6 +454,7 @@ static void aspeed_2400_xdma_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "ASPEED 2400 XDMA Controller";
 
+    axc->cmdq_addr = XDMA_BMC_CMDQ_ADDR;
     axc->cmdq_endp = XDMA_BMC_CMDQ_ENDP;
     axc->cmdq_wrp = XDMA_BMC_CMDQ_WRP;
     axc->cmdq_rdp = XDMA_BMC_CMDQ_RDP;
@@ -209,6 +462,11 @@ static void aspeed_2400_xdma_class_init(ObjectClass *klass, void *data)
     axc->intr_ctrl_mask = XDMA_IRQ_ENG_CTRL_W_MASK;
     axc->intr_status = XDMA_IRQ_ENG_STAT;
     axc->intr_complete = XDMA_IRQ_ENG_STAT_US_COMP | XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->intr_us_complete = XDMA_IRQ_ENG_STAT_US_COMP;
+    axc->intr_ds_complete = XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->cmdq_entry_size = 4;
+    axc->bmc_addr_mask = 0x3FFFFFFF;
+    axc->decode_cmd = aspeed_2500_xdma_decode_cmd;
 };
 
 static const TypeInfo aspeed_2400_xdma_info = {
@@ -224,6 +482,7 @@ static void aspeed_xdma_class_init(ObjectClass *classp, void *data)
     dc->realize = aspeed_xdma_realize;
     dc->reset = aspeed_xdma_reset;
     dc->vmsd = &aspeed_xdma_vmstate;
+    device_class_set_props(dc, aspeed_xdma_properties);
 }
 
 static const TypeInfo aspeed_xdma_info = {
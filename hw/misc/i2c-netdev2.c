@@ -1,11 +1,20 @@
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
+#include "qemu/log.h"
+#include "qemu/timer.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "hw/i2c/i2c.h"
 #include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "chardev/char-fe.h"
+#include "sysemu/hostmem.h"
 #include "net/net.h"
 #include "net/eth.h"
 #include "block/aio.h"
+#include "trace.h"
 
 #define DATA_LEN 1
 #define ACK_LEN 2
@@ -13,6 +22,96 @@
 #define STOP_LEN 4
 #define DEBUG 0
 
+/*
+ * Batched mode carries a whole transaction in a single frame instead of
+ * one packet per start, data byte and stop.  Every frame begins with a
+ * fixed header, which is longer than any legacy packet so that both
+ * protocols can be told apart on reception:
+ *
+ *   [0] FRAME_MAGIC
+ *   [1] frame type
+ *   [2] slave address, shifted left by 1 with the R/W bit
+ *   [3] status, only meaningful in FRAME_RESULT and FRAME_DATA
+ *   [4] count
+ *
+ * FRAME_WRITE carries the bytes to write and is answered by a FRAME_RESULT
+ * whose count is the number of bytes acknowledged by the slave.  Writes are
+ * posted, so a failure reported by the peer NACKs the next transfer of the
+ * local guest to that address.
+ *
+ * FRAME_READ carries an optional write prefix (e.g. a register index) sent
+ * before a repeated start, and asks for count bytes.  It is answered by a
+ * FRAME_DATA carrying the bytes read.
+ *
+ * Reads of the local guest are NACKed unless "read-len" is set, which is
+ * the default.  The length of a read is not known when its address is
+ * acknowledged, so the device prefetches "read-len" bytes from the peer
+ * and NACKs the address until they come in.  This only suits slaves that
+ * can be read ahead, and guest drivers that retry; write-only protocols
+ * such as IPMB don't need it.  The legacy (non batched) protocol has no
+ * master receive at all.
+ */
+#define FRAME_MAGIC 0xc2
+#define FRAME_HDR_LEN 5
+#define FRAME_MAX_PAYLOAD 255
+
+enum {
+    FRAME_WRITE = 1,
+    FRAME_READ,
+    FRAME_RESULT,
+    FRAME_DATA,
+};
+
+enum {
+    FRAME_STATUS_OK = 0,
+    FRAME_STATUS_ADDR_NACK,
+    FRAME_STATUS_DATA_NACK,
+};
+
+/* How long a read reply stays valid, and when a lost request is resent */
+#define READ_TIMEOUT_MS 1000
+
+/*
+ * Shared memory transport.  Instead of a netdev, co-located instances can
+ * exchange frames through a shared memory backend (e.g. a memory-backend-file
+ * on /dev/shm with share=on), split in two single-producer single-consumer
+ * rings.  The side with shm-side=0 transmits on the first ring, the other
+ * one on the second.  Each record is a little-endian 16-bit length followed
+ * by the frame.
+ *
+ * The chardev is only a doorbell: the producer rings it when the consumer
+ * went idle waiting for new records (need_kick), and the consumer rings it
+ * when the producer waits for space (need_space).
+ *
+ * Backpressure is applied to the local guest: a transfer is NACKed unless
+ * the transmit ring has room for its frame plus the reply to a peer frame,
+ * and peer frames are only consumed once their reply fits.
+ */
+typedef struct I2CNetdev2Ring {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t need_kick;
+    uint32_t need_space;
+} I2CNetdev2Ring;
+
+#define SHM_RING_HDR_SIZE 64
+#define SHM_RECORD_MAX (2 + FRAME_HDR_LEN + FRAME_MAX_PAYLOAD)
+#define SHM_RING_MIN_SIZE 4096
+
+/*
+ * In-process transport.  Two devices of the same machine, typically on the
+ * buses of different SoCs, can be linked to each other with the "peer"
+ * property.  Frames are then handed over directly, and queued while the
+ * peer is busy replaying a previous one.
+ */
+typedef struct I2CNetdev2Frame {
+    QSIMPLEQ_ENTRY(I2CNetdev2Frame) next;
+    int len;
+    uint8_t data[];
+} I2CNetdev2Frame;
+
+#define PEER_QUEUE_MAX 16
+
 #if !DEBUG
 #define printf(...)
 #endif
@@ -32,6 +131,51 @@ struct I2CNetdev2 {
     uint8_t rx_buf[10];
     int rx_len;
     bool rx_ack_pending;
+
+    bool batch;
+    uint8_t read_len;
+
+    /* Batched mode, transaction started by the local guest */
+    uint8_t tx_buf[FRAME_MAX_PAYLOAD];
+    int tx_len;
+    bool tx_active;
+    bool tx_failed;
+    bool rd_active;
+    bool rd_pending;
+    bool rd_valid;
+    int64_t rd_time;
+    uint8_t rd_prefix[FRAME_MAX_PAYLOAD];
+    int rd_prefix_len;
+    uint8_t rd_buf[FRAME_MAX_PAYLOAD];
+    int rd_len;
+    int rd_pos;
+
+    /* Batched mode, transaction replayed on the local bus for the peer */
+    QEMUBH *xfer_bh;
+    bool xfer_busy;
+    bool xfer_started;
+    uint8_t xfer_type;
+    uint8_t xfer_addr;
+    uint8_t xfer_buf[FRAME_MAX_PAYLOAD];
+    int xfer_len;
+    int xfer_pos;
+    uint8_t xfer_count;
+    uint8_t xfer_read_len;
+
+    /* Shared memory transport */
+    HostMemoryBackend *hostmem;
+    CharBackend doorbell;
+    uint8_t shm_side;
+    I2CNetdev2Ring *shm_tx;
+    I2CNetdev2Ring *shm_rx;
+    uint8_t *shm_tx_data;
+    uint8_t *shm_rx_data;
+    uint32_t shm_size;
+
+    /* In-process transport */
+    I2CNetdev2 *peer;
+    QSIMPLEQ_HEAD(, I2CNetdev2Frame) peer_queue;
+    int peer_queue_len;
 };
 
 static void print_bytes(const uint8_t *buf, size_t len)
@@ -49,6 +193,20 @@ static void print_bytes(const uint8_t *buf, size_t len)
 }
 
 static ssize_t i2c_netdev2_nic_receive(NetClientState *nc, const uint8_t *buf, size_t len);
+static void i2c_netdev2_frame_receive(I2CNetdev2 *s, const uint8_t *buf,
+                                      size_t len);
+static void i2c_netdev2_shm_poll(I2CNetdev2 *s);
+static void i2c_netdev2_peer_deliver(I2CNetdev2 *s, const uint8_t *frame,
+                                     int len);
+static void i2c_netdev2_peer_poll(I2CNetdev2 *s);
+
+static bool i2c_netdev2_nic_can_receive(NetClientState *nc)
+{
+    I2CNetdev2 *s = I2C_NETDEV2(qemu_get_nic_opaque(nc));
+
+    /* Frames are queued while a previous one is replayed on the bus */
+    return !s->xfer_busy;
+}
 
 static void i2c_netdev2_nic_cleanup(NetClientState *nc)
 {
@@ -60,6 +218,7 @@ static void i2c_netdev2_nic_cleanup(NetClientState *nc)
 static NetClientInfo net_client_info = {
     .type = NET_CLIENT_DRIVER_NIC,
     .size = sizeof(NetClientState),
+    .can_receive = i2c_netdev2_nic_can_receive,
     .receive = i2c_netdev2_nic_receive,
     .cleanup = i2c_netdev2_nic_cleanup,
 };
@@ -72,15 +231,24 @@ static ssize_t i2c_netdev2_nic_receive(NetClientState *nc, const uint8_t *buf, s
 
     I2CNetdev2 *s = I2C_NETDEV2(qemu_get_nic_opaque(nc));
 
+    if (len >= FRAME_HDR_LEN && buf[0] == FRAME_MAGIC) {
+        i2c_netdev2_frame_receive(s, buf, len);
+        return len;
+    }
+
     if (len == ACK_LEN) {
         return len;
     }
 
+    if (len > sizeof(s->rx_buf)) {
+        trace_i2c_netdev2_frame_drop(len);
+        return len;
+    }
+
     printf("prev rx_buf: ");
     print_bytes(s->rx_buf, sizeof(s->rx_buf));
     printf("\n");
-    
-    assert(len <= sizeof(s->rx_buf));
+
     memcpy(s->rx_buf, buf, len);
     s->rx_len = len;
 
@@ -152,51 +320,532 @@ static void i2c_netdev2_slave_mode_rx(void *opaque)
     s->rx_ack_pending = true;
 }
 
+static uint32_t i2c_netdev2_shm_room(I2CNetdev2 *s)
+{
+    I2CNetdev2Ring *ring = s->shm_tx;
+
+    return s->shm_size - (ring->head - qatomic_load_acquire(&ring->tail));
+}
+
+/* Whether a transfer started by the local guest can be sent to the peer */
+static bool i2c_netdev2_can_send(I2CNetdev2 *s)
+{
+    if (s->peer) {
+        return s->peer->peer_queue_len < PEER_QUEUE_MAX;
+    }
+    return !s->hostmem || i2c_netdev2_shm_room(s) >= 2 * SHM_RECORD_MAX;
+}
+
+static void i2c_netdev2_shm_kick(I2CNetdev2 *s)
+{
+    uint8_t b = 0;
+
+    qemu_chr_fe_write(&s->doorbell, &b, 1);
+}
+
+static void i2c_netdev2_shm_copy_in(I2CNetdev2 *s, uint32_t pos,
+                                    const uint8_t *buf, int len)
+{
+    uint32_t off = pos & (s->shm_size - 1);
+    uint32_t n = MIN(len, s->shm_size - off);
+
+    memcpy(s->shm_tx_data + off, buf, n);
+    memcpy(s->shm_tx_data, buf + n, len - n);
+}
+
+static void i2c_netdev2_shm_copy_out(I2CNetdev2 *s, uint32_t pos,
+                                     uint8_t *buf, int len)
+{
+    uint32_t off = pos & (s->shm_size - 1);
+    uint32_t n = MIN(len, s->shm_size - off);
+
+    memcpy(buf, s->shm_rx_data + off, n);
+    memcpy(buf + n, s->shm_rx_data, len - n);
+}
+
+static void i2c_netdev2_shm_send(I2CNetdev2 *s, const uint8_t *frame, int len)
+{
+    I2CNetdev2Ring *ring = s->shm_tx;
+    uint32_t head = ring->head;
+    uint8_t hdr[2];
+
+    if (i2c_netdev2_shm_room(s) < 2 + len) {
+        trace_i2c_netdev2_frame_drop(len);
+        return;
+    }
+
+    stw_le_p(hdr, len);
+    i2c_netdev2_shm_copy_in(s, head, hdr, sizeof(hdr));
+    i2c_netdev2_shm_copy_in(s, head + sizeof(hdr), frame, len);
+    qatomic_store_release(&ring->head, head + sizeof(hdr) + len);
+
+    smp_mb();
+    if (qatomic_read(&ring->need_kick)) {
+        qatomic_set(&ring->need_kick, 0);
+        i2c_netdev2_shm_kick(s);
+    }
+}
+
+static void i2c_netdev2_frame_send(I2CNetdev2 *s, uint8_t type, uint8_t addr,
+                                   uint8_t status, uint8_t count,
+                                   const uint8_t *payload, int len)
+{
+    uint8_t frame[FRAME_HDR_LEN + FRAME_MAX_PAYLOAD];
+
+    assert(len <= FRAME_MAX_PAYLOAD);
+
+    frame[0] = FRAME_MAGIC;
+    frame[1] = type;
+    frame[2] = addr;
+    frame[3] = status;
+    frame[4] = count;
+    if (len) {
+        memcpy(frame + FRAME_HDR_LEN, payload, len);
+    }
+
+    trace_i2c_netdev2_frame_tx(type, addr, status, count, len);
+    if (s->peer) {
+        i2c_netdev2_peer_deliver(s->peer, frame, FRAME_HDR_LEN + len);
+    } else if (s->hostmem) {
+        i2c_netdev2_shm_send(s, frame, FRAME_HDR_LEN + len);
+    } else {
+        qemu_send_packet(qemu_get_queue(s->nic), frame, FRAME_HDR_LEN + len);
+    }
+}
+
+static void i2c_netdev2_xfer_done(I2CNetdev2 *s, uint8_t status)
+{
+    uint8_t addr = s->xfer_addr << 1;
+
+    /*
+     * A failed first start may already have ended the transfer and handed
+     * the bus over to the next pending master.
+     */
+    if (s->bus->bh == s->xfer_bh) {
+        i2c_bus_release(s->bus);
+    }
+    if (s->xfer_started) {
+        i2c_end_transfer(s->bus);
+    }
+
+    if (s->xfer_type == FRAME_WRITE) {
+        i2c_netdev2_frame_send(s, FRAME_RESULT, addr, status, s->xfer_count,
+                               NULL, 0);
+    } else {
+        i2c_netdev2_frame_send(s, FRAME_DATA, addr | 1, status, s->xfer_count,
+                               s->xfer_buf, s->xfer_count);
+    }
+
+    s->xfer_busy = false;
+    if (s->peer) {
+        i2c_netdev2_peer_poll(s);
+    } else if (s->hostmem) {
+        i2c_netdev2_shm_poll(s);
+    } else {
+        qemu_flush_queued_packets(qemu_get_queue(s->nic));
+    }
+}
+
+/*
+ * Replays a FRAME_WRITE or FRAME_READ on the local bus.  Runs once the bus
+ * is granted, and again after each byte acknowledged by an asynchronous
+ * slave.
+ */
+static void i2c_netdev2_xfer_bh(void *opaque)
+{
+    I2CNetdev2 *s = opaque;
+
+    if (s->xfer_pos < 0) {
+        s->xfer_pos = 0;
+        if (s->xfer_type == FRAME_WRITE || s->xfer_len) {
+            if (i2c_start_send(s->bus, s->xfer_addr)) {
+                i2c_netdev2_xfer_done(s, FRAME_STATUS_ADDR_NACK);
+                return;
+            }
+            s->xfer_started = true;
+        }
+    }
+
+    while (s->xfer_pos < s->xfer_len) {
+        uint8_t byte = s->xfer_buf[s->xfer_pos++];
+
+        if (!i2c_send_async(s->bus, byte)) {
+            /* Resumed by i2c_ack() */
+            s->xfer_count = s->xfer_pos;
+            return;
+        }
+        if (i2c_send(s->bus, byte)) {
+            i2c_netdev2_xfer_done(s, FRAME_STATUS_DATA_NACK);
+            return;
+        }
+        s->xfer_count = s->xfer_pos;
+    }
+
+    if (s->xfer_type == FRAME_READ) {
+        s->xfer_count = s->xfer_read_len;
+        if (i2c_start_recv(s->bus, s->xfer_addr)) {
+            s->xfer_count = 0;
+            i2c_netdev2_xfer_done(s, FRAME_STATUS_ADDR_NACK);
+            return;
+        }
+        s->xfer_started = true;
+        i2c_recv_buf(s->bus, s->xfer_buf, s->xfer_read_len);
+        i2c_nack(s->bus);
+    }
+
+    i2c_netdev2_xfer_done(s, FRAME_STATUS_OK);
+}
+
+static void i2c_netdev2_frame_receive(I2CNetdev2 *s, const uint8_t *buf,
+                                      size_t len)
+{
+    uint8_t type = buf[1];
+    uint8_t addr = buf[2];
+    uint8_t status = buf[3];
+    uint8_t count = buf[4];
+    const uint8_t *payload = buf + FRAME_HDR_LEN;
+    int payload_len = len - FRAME_HDR_LEN;
+
+    trace_i2c_netdev2_frame_rx(type, addr, status, count, payload_len);
+
+    if (payload_len > FRAME_MAX_PAYLOAD) {
+        trace_i2c_netdev2_frame_drop(len);
+        return;
+    }
+
+    switch (type) {
+    case FRAME_WRITE:
+    case FRAME_READ:
+        s->xfer_busy = true;
+        s->xfer_started = false;
+        s->xfer_type = type;
+        s->xfer_addr = addr >> 1;
+        s->xfer_pos = -1;
+        s->xfer_count = 0;
+        s->xfer_len = payload_len;
+        s->xfer_read_len = type == FRAME_READ ? count : 0;
+        memcpy(s->xfer_buf, payload, payload_len);
+        i2c_bus_master(s->bus, s->xfer_bh);
+        break;
+    case FRAME_RESULT:
+        if (status != FRAME_STATUS_OK) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: write to 0x%02x failed after %d bytes\n",
+                          __func__, addr >> 1, count);
+            s->tx_failed = true;
+        }
+        break;
+    case FRAME_DATA:
+        if (!s->rd_pending) {
+            break;
+        }
+        s->rd_pending = false;
+        s->rd_valid = status == FRAME_STATUS_OK;
+        s->rd_len = MIN(count, payload_len);
+        memcpy(s->rd_buf, payload, s->rd_len);
+        s->rd_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        break;
+    default:
+        trace_i2c_netdev2_frame_drop(len);
+        break;
+    }
+}
+
+static void i2c_netdev2_shm_poll(I2CNetdev2 *s)
+{
+    I2CNetdev2Ring *ring = s->shm_rx;
+    uint8_t frame[FRAME_HDR_LEN + FRAME_MAX_PAYLOAD];
+    uint32_t tail;
+    uint8_t hdr[2];
+    uint16_t len;
+
+    while (!s->xfer_busy) {
+        /* Only take a frame once its reply is sure to fit */
+        if (i2c_netdev2_shm_room(s) < SHM_RECORD_MAX) {
+            qatomic_set(&s->shm_tx->need_space, 1);
+            smp_mb();
+            if (i2c_netdev2_shm_room(s) < SHM_RECORD_MAX) {
+                return;
+            }
+            qatomic_set(&s->shm_tx->need_space, 0);
+        }
+
+        tail = ring->tail;
+        if (qatomic_load_acquire(&ring->head) == tail) {
+            qatomic_set(&ring->need_kick, 1);
+            smp_mb();
+            if (qatomic_read(&ring->head) == tail) {
+                return;
+            }
+            qatomic_set(&ring->need_kick, 0);
+        }
+
+        i2c_netdev2_shm_copy_out(s, tail, hdr, sizeof(hdr));
+        len = lduw_le_p(hdr);
+        if (len > sizeof(frame)) {
+            /* The ring is corrupted, drop everything that is in it */
+            trace_i2c_netdev2_frame_drop(len);
+            qatomic_store_release(&ring->tail, qatomic_read(&ring->head));
+            return;
+        }
+        i2c_netdev2_shm_copy_out(s, tail + sizeof(hdr), frame, len);
+        qatomic_store_release(&ring->tail, tail + sizeof(hdr) + len);
+
+        smp_mb();
+        if (qatomic_read(&ring->need_space)) {
+            qatomic_set(&ring->need_space, 0);
+            i2c_netdev2_shm_kick(s);
+        }
+
+        if (len >= FRAME_HDR_LEN && frame[0] == FRAME_MAGIC) {
+            i2c_netdev2_frame_receive(s, frame, len);
+        } else {
+            trace_i2c_netdev2_frame_drop(len);
+        }
+    }
+}
+
+static void i2c_netdev2_peer_deliver(I2CNetdev2 *s, const uint8_t *frame,
+                                     int len)
+{
+    I2CNetdev2Frame *f;
+
+    if (!s->xfer_busy && QSIMPLEQ_EMPTY(&s->peer_queue)) {
+        i2c_netdev2_frame_receive(s, frame, len);
+        return;
+    }
+
+    f = g_malloc(sizeof(*f) + len);
+    f->len = len;
+    memcpy(f->data, frame, len);
+    QSIMPLEQ_INSERT_TAIL(&s->peer_queue, f, next);
+    s->peer_queue_len++;
+}
+
+static void i2c_netdev2_peer_poll(I2CNetdev2 *s)
+{
+    I2CNetdev2Frame *f;
+
+    while (!s->xfer_busy && !QSIMPLEQ_EMPTY(&s->peer_queue)) {
+        f = QSIMPLEQ_FIRST(&s->peer_queue);
+        QSIMPLEQ_REMOVE_HEAD(&s->peer_queue, next);
+        s->peer_queue_len--;
+        i2c_netdev2_frame_receive(s, f->data, f->len);
+        g_free(f);
+    }
+}
+
+static int i2c_netdev2_doorbell_can_receive(void *opaque)
+{
+    return 64;
+}
+
+static void i2c_netdev2_doorbell_receive(void *opaque, const uint8_t *buf,
+                                         int size)
+{
+    i2c_netdev2_shm_poll(opaque);
+}
+
+static void i2c_netdev2_doorbell_event(void *opaque, QEMUChrEvent event)
+{
+    /* Pick up whatever the peer queued before the doorbell was connected */
+    if (event == CHR_EVENT_OPENED) {
+        i2c_netdev2_shm_poll(opaque);
+    }
+}
+
+static void i2c_netdev2_shm_realize(I2CNetdev2 *s, Error **errp)
+{
+    MemoryRegion *mr;
+    uint8_t *base;
+    uint64_t half;
+
+    if (host_memory_backend_is_mapped(s->hostmem)) {
+        error_setg(errp, "can't use already busy memdev: %s",
+                   object_get_canonical_path_component(OBJECT(s->hostmem)));
+        return;
+    }
+    if (!s->batch) {
+        error_setg(errp, "the shared memory transport requires batch=on");
+        return;
+    }
+    if (s->shm_side > 1) {
+        error_setg(errp, "shm-side must be 0 or 1");
+        return;
+    }
+    if (!qemu_chr_fe_backend_connected(&s->doorbell)) {
+        error_setg(errp, "the shared memory transport requires a chardev");
+        return;
+    }
+
+    mr = host_memory_backend_get_memory(s->hostmem);
+    half = memory_region_size(mr) / 2;
+    if (half < SHM_RING_HDR_SIZE + SHM_RING_MIN_SIZE) {
+        error_setg(errp, "memdev is too small, need at least %d bytes",
+                   2 * (SHM_RING_HDR_SIZE + SHM_RING_MIN_SIZE));
+        return;
+    }
+    /* Free running indexes need a power of 2 ring */
+    s->shm_size = pow2floor(MIN(half - SHM_RING_HDR_SIZE, 1 * GiB));
+
+    host_memory_backend_set_mapped(s->hostmem, true);
+    base = memory_region_get_ram_ptr(mr);
+    s->shm_tx = (I2CNetdev2Ring *)(base + s->shm_side * half);
+    s->shm_rx = (I2CNetdev2Ring *)(base + !s->shm_side * half);
+    s->shm_tx_data = (uint8_t *)s->shm_tx + SHM_RING_HDR_SIZE;
+    s->shm_rx_data = (uint8_t *)s->shm_rx + SHM_RING_HDR_SIZE;
+
+    qatomic_set(&s->shm_rx->need_kick, 1);
+}
+
 static void i2c_netdev2_realize(DeviceState *dev, Error **errp)
 {
+    ERRP_GUARD();
     I2CNetdev2 *s = I2C_NETDEV2(dev);
 
+    if (s->peer && !s->batch) {
+        error_setg(errp, "the in-process transport requires batch=on");
+        return;
+    }
+    if (s->hostmem) {
+        i2c_netdev2_shm_realize(s, errp);
+        if (*errp) {
+            return;
+        }
+    }
+
     s->bus = I2C_BUS(qdev_get_parent_bus(dev));
-    s->nic = qemu_new_nic(&net_client_info, &s->nic_conf, TYPE_I2C_NETDEV2, dev->id, s);
+    if (!s->peer && !s->hostmem) {
+        s->nic = qemu_new_nic(&net_client_info, &s->nic_conf, TYPE_I2C_NETDEV2, dev->id, s);
+    }
     s->bh = qemu_bh_new(i2c_netdev2_slave_mode_rx, s);
+    s->xfer_bh = qemu_bh_new(i2c_netdev2_xfer_bh, s);
     s->rx_len = 0;
+    QSIMPLEQ_INIT(&s->peer_queue);
+
+    if (s->hostmem) {
+        qemu_chr_fe_set_handlers(&s->doorbell, i2c_netdev2_doorbell_can_receive,
+                                 i2c_netdev2_doorbell_receive,
+                                 i2c_netdev2_doorbell_event, NULL, s, NULL,
+                                 true);
+    }
+}
+
+static void i2c_netdev2_batch_flush_write(I2CNetdev2 *s, uint8_t addr)
+{
+    if (s->tx_active) {
+        i2c_netdev2_frame_send(s, FRAME_WRITE, addr, 0, s->tx_len,
+                               s->tx_buf, s->tx_len);
+        s->tx_active = false;
+    }
+}
+
+static int i2c_netdev2_batch_start_recv(I2CNetdev2 *s, uint8_t addr)
+{
+    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int prefix_len = s->tx_active ? s->tx_len : 0;
+    bool match = s->rd_prefix_len == prefix_len &&
+                 !memcmp(s->rd_prefix, s->tx_buf, prefix_len);
+    bool expired = now - s->rd_time >= READ_TIMEOUT_MS;
+
+    if (!s->read_len) {
+        qemu_log_mask(LOG_UNIMP, "%s: reads are disabled, set read-len\n",
+                      __func__);
+        s->tx_active = false;
+        return 1;
+    }
+
+    /* A write before a repeated start travels with the read request */
+    s->tx_active = false;
+
+    if (match && s->rd_valid && !expired) {
+        s->rd_valid = false;
+        s->rd_active = true;
+        s->rd_pos = 0;
+        return 0;
+    }
+
+    if ((!match || !s->rd_pending || expired) && i2c_netdev2_can_send(s)) {
+        memcpy(s->rd_prefix, s->tx_buf, prefix_len);
+        s->rd_prefix_len = prefix_len;
+        s->rd_pending = true;
+        s->rd_valid = false;
+        s->rd_time = now;
+        i2c_netdev2_frame_send(s, FRAME_READ, addr | 1, 0, s->read_len,
+                               s->tx_buf, prefix_len);
+    }
+
+    /*
+     * NACK the address until the reply comes in, the same way a busy
+     * EEPROM does.  The guest driver is expected to retry.
+     */
+    return 1;
+}
+
+static int i2c_netdev2_batch_event(I2CNetdev2 *s, enum i2c_event event)
+{
+    uint8_t addr = I2C_SLAVE(s)->address << 1;
+
+    /* Report the failure of the previous write, posted on stop */
+    if (s->tx_failed &&
+        (event == I2C_START_SEND || event == I2C_START_RECV)) {
+        s->tx_failed = false;
+        i2c_netdev2_batch_flush_write(s, addr);
+        return 1;
+    }
+
+    switch (event) {
+    case I2C_START_SEND:
+        i2c_netdev2_batch_flush_write(s, addr);
+        if (!i2c_netdev2_can_send(s)) {
+            return 1;
+        }
+        s->tx_active = true;
+        s->tx_len = 0;
+        s->rd_active = false;
+        break;
+    case I2C_START_RECV:
+        return i2c_netdev2_batch_start_recv(s, addr);
+    case I2C_FINISH:
+        i2c_netdev2_batch_flush_write(s, addr);
+        s->rd_active = false;
+        break;
+    case I2C_NACK:
+        break;
+    }
+
+    return 0;
 }
 
 static int i2c_netdev2_handle_event(I2CSlave *i2c, enum i2c_event event)
 {
     I2CNetdev2 *s = I2C_NETDEV2(i2c);
-    NetClientState *netdev = qemu_get_queue(s->nic);
+    NetClientState *netdev;
     uint8_t tx_addr = i2c->address << 1;
     uint8_t start_msg[START_LEN];
     uint8_t stop_msg[STOP_LEN];
 
-    // printf("%s: %d\n", __func__, event);
+    if (s->batch) {
+        return i2c_netdev2_batch_event(s, event);
+    }
+    netdev = qemu_get_queue(s->nic);
 
     switch (event) {
     case I2C_START_RECV:
-        printf("%s: RECV UNIMPLEMENTED\n", __func__);
-        abort();
+        qemu_log_mask(LOG_UNIMP, "%s: master receive needs batch=on\n",
+                      __func__);
+        return -1;
     case I2C_START_SEND:
-        // printf("%s: SENDING START MESSAGE PACKET\n", __func__);
         memset(start_msg, 0, sizeof(start_msg));
         start_msg[0] = tx_addr;
         qemu_send_packet(netdev, start_msg, sizeof(start_msg));
-        printf("%s: tx ", __FILE__);
-        print_bytes(start_msg, sizeof(start_msg));
-        printf("\n");
-        //sleep(1);
         break;
     case I2C_FINISH:
         memset(stop_msg, 0, sizeof(stop_msg));
         qemu_send_packet(netdev, stop_msg, sizeof(stop_msg));
-        printf("%s: tx ", __FILE__);
-        print_bytes(stop_msg, sizeof(stop_msg));
-        printf("\n");
-        //sleep(1);
         break;
     case I2C_NACK:
-        printf("%s: NACK UNIMPLEMENTED\n", __func__);
-        abort();
+        break;
     }
 
     return 0;
@@ -204,27 +853,48 @@ static int i2c_netdev2_handle_event(I2CSlave *i2c, enum i2c_event event)
 
 static uint8_t i2c_netdev2_handle_recv(I2CSlave *i2c)
 {
-    printf("%s: unimplemented\n", __func__);
-    abort();
+    I2CNetdev2 *s = I2C_NETDEV2(i2c);
+
+    if (s->batch) {
+        if (s->rd_active && s->rd_pos < s->rd_len) {
+            return s->rd_buf[s->rd_pos++];
+        }
+        return 0xff;
+    }
+
+    qemu_log_mask(LOG_UNIMP, "%s: master receive needs batch=on\n", __func__);
+    return 0xff;
 }
 
 static int i2c_netdev2_handle_send(I2CSlave *i2c, uint8_t byte)
 {
     I2CNetdev2 *s = I2C_NETDEV2(i2c);
-    NetClientState *netdev = qemu_get_queue(s->nic);
     uint8_t data_msg[DATA_LEN] = {byte};
 
-    qemu_send_packet(netdev, data_msg, sizeof(data_msg));
-    printf("%s: tx ", __FILE__);
-    print_bytes(data_msg, sizeof(data_msg));
-    printf("\n");
-    //sleep(1);
+    if (s->batch) {
+        if (s->tx_len >= sizeof(s->tx_buf)) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: transfer too long\n",
+                          __func__);
+            return -1;
+        }
+        s->tx_buf[s->tx_len++] = byte;
+        return 0;
+    }
+
+    qemu_send_packet(qemu_get_queue(s->nic), data_msg, sizeof(data_msg));
 
     return 0;
 }
 
 static Property i2c_netdev2_props[] = {
     DEFINE_NIC_PROPERTIES(I2CNetdev2, nic_conf),
+    DEFINE_PROP_BOOL("batch", I2CNetdev2, batch, false),
+    DEFINE_PROP_UINT8("read-len", I2CNetdev2, read_len, 0),
+    DEFINE_PROP_LINK("memdev", I2CNetdev2, hostmem, TYPE_MEMORY_BACKEND,
+                     HostMemoryBackend *),
+    DEFINE_PROP_CHR("chardev", I2CNetdev2, doorbell),
+    DEFINE_PROP_UINT8("shm-side", I2CNetdev2, shm_side, 0),
+    DEFINE_PROP_LINK("peer", I2CNetdev2, peer, TYPE_I2C_NETDEV2, I2CNetdev2 *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -20,6 +20,7 @@
 #include "qemu/module.h"
 #include "net/checksum.h"
 #include "net/eth.h"
+#include "standard-headers/linux/virtio_net.h"
 #include "hw/net/mii.h"
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
@@ -71,6 +72,22 @@
 #define FTGMAC100_INT_PHYSTS_CHG  (1 << 9)
 #define FTGMAC100_INT_NO_HPTXBUF  (1 << 10)
 
+/*
+ * Interrupt timer control register
+ */
+#define FTGMAC100_ITC_RXINT_CNT(x)          ((x) & 0xf)
+#define FTGMAC100_ITC_RXINT_THR(x)          (((x) >> 4) & 0x7)
+#define FTGMAC100_ITC_RXINT_TIME_SEL        (1 << 7)
+#define FTGMAC100_ITC_TXINT_CNT(x)          (((x) >> 8) & 0xf)
+#define FTGMAC100_ITC_TXINT_THR(x)          (((x) >> 12) & 0x7)
+#define FTGMAC100_ITC_TXINT_TIME_SEL        (1 << 15)
+
+/*
+ * Interrupt sources delayed by the interrupt timers
+ */
+#define FTGMAC100_INT_RX_ITC  (FTGMAC100_INT_RPKT_BUF | FTGMAC100_INT_RPKT_FIFO)
+#define FTGMAC100_INT_TX_ITC  (FTGMAC100_INT_XPKT_ETH | FTGMAC100_INT_XPKT_FIFO)
+
 /*
  * Automatic polling timer control register
  */
@@ -198,16 +215,6 @@
 #define FTGMAC100_RXDES1_UDP_CHKSUM_ERR  (1 << 26)
 #define FTGMAC100_RXDES1_IP_CHKSUM_ERR   (1 << 27)
 
-/*
- * Receive and transmit Buffer Descriptor
- */
-typedef struct {
-    uint32_t        des0;
-    uint32_t        des1;
-    uint32_t        des2;        /* not used by HW */
-    uint32_t        des3;
-} FTGMAC100Desc;
-
 #define FTGMAC100_DESC_ALIGNMENT 16
 
 /*
@@ -252,7 +259,150 @@ static int ftgmac100_max_frame_size(FTGMAC100State *s, uint16_t proto)
 
 static void ftgmac100_update_irq(FTGMAC100State *s)
 {
-    qemu_set_irq(s->irq, s->isr & s->ier);
+    qemu_set_irq(s->irq, s->isr & s->ier & ~s->isr_held);
+}
+
+/*
+ * The interrupt and polling timers count in units of 1024 (APTC) or
+ * 64 (ITC) cycles, and 16 times more with TIME_SEL. The cycle depends
+ * on the link speed.
+ *
+ * Polling times for a count of 1:
+ *
+ * Speed      TIME_SEL=0    TIME_SEL=1
+ *
+ *    10         51.2 ms      819.2 ms
+ *   100         5.12 ms      81.92 ms
+ *  1000        1.024 ms     16.384 ms
+ */
+static int64_t ftgmac100_timer_period(FTGMAC100State *s, uint32_t cnt,
+                                      uint32_t cycles, bool time_sel)
+{
+    static const int64_t cycle_ns[] = { 50000, 5000, 1000 };
+    uint32_t speed = (s->maccr & FTGMAC100_MACCR_FAST_MODE) ? 1 : 0;
+
+    if (s->maccr & FTGMAC100_MACCR_GIGA_MODE) {
+        speed = 2;
+    }
+
+    if (time_sel) {
+        cycles <<= 4;
+    }
+
+    return cycle_ns[speed] * cycles * cnt;
+}
+
+/*
+ * Interrupt moderation. When the interrupt timer of a direction is
+ * enabled, its completion interrupts are held until the threshold
+ * number of frames is reached or until the timer expires, whichever
+ * comes first. A threshold of zero only uses the timer. The ISR bits
+ * are always updated.
+ */
+static void ftgmac100_itc_event(FTGMAC100State *s, uint32_t mask,
+                                uint32_t cnt, uint32_t thr, bool time_sel,
+                                uint32_t *count, QEMUTimer *timer)
+{
+    if (!cnt) {
+        s->isr_held &= ~mask;
+        return;
+    }
+
+    if (thr && ++(*count) >= thr) {
+        *count = 0;
+        timer_del(timer);
+        s->isr_held &= ~mask;
+        return;
+    }
+
+    s->isr_held |= mask;
+    if (!timer_pending(timer)) {
+        timer_mod(timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  ftgmac100_timer_period(s, cnt, 64, time_sel));
+    }
+}
+
+static void ftgmac100_rx_itc_event(FTGMAC100State *s)
+{
+    ftgmac100_itc_event(s, FTGMAC100_INT_RX_ITC,
+                        FTGMAC100_ITC_RXINT_CNT(s->itc),
+                        FTGMAC100_ITC_RXINT_THR(s->itc),
+                        s->itc & FTGMAC100_ITC_RXINT_TIME_SEL,
+                        &s->rxint_count, s->rxint_timer);
+}
+
+static void ftgmac100_tx_itc_event(FTGMAC100State *s)
+{
+    ftgmac100_itc_event(s, FTGMAC100_INT_TX_ITC,
+                        FTGMAC100_ITC_TXINT_CNT(s->itc),
+                        FTGMAC100_ITC_TXINT_THR(s->itc),
+                        s->itc & FTGMAC100_ITC_TXINT_TIME_SEL,
+                        &s->txint_count, s->txint_timer);
+}
+
+static void ftgmac100_rxint_timer_expire(void *opaque)
+{
+    FTGMAC100State *s = opaque;
+
+    s->rxint_count = 0;
+    s->isr_held &= ~FTGMAC100_INT_RX_ITC;
+    ftgmac100_update_irq(s);
+}
+
+static void ftgmac100_txint_timer_expire(void *opaque)
+{
+    FTGMAC100State *s = opaque;
+
+    s->txint_count = 0;
+    s->isr_held &= ~FTGMAC100_INT_TX_ITC;
+    ftgmac100_update_irq(s);
+}
+
+static void ftgmac100_itc_reset(FTGMAC100State *s)
+{
+    timer_del(s->rxint_timer);
+    timer_del(s->txint_timer);
+    s->rxint_count = 0;
+    s->txint_count = 0;
+    s->isr_held = 0;
+}
+
+/*
+ * Automatic polling. When the RX ring is full, the RX poll timer checks
+ * for descriptors returned by the guest without a write to RXPD. The
+ * TX poll timer looks for descriptors queued without a write to NPTXPD.
+ * The timers only run when polling is enabled and the DMA engine is
+ * waiting for descriptors: the RX poll timer while the ring is full, the
+ * TX poll timer while the guest is queuing frames. The TX poll timer
+ * stops when a poll finds nothing new, and the next write to NPTXPD
+ * starts it again.
+ */
+static void ftgmac100_rxpoll_update(FTGMAC100State *s)
+{
+    uint32_t cnt = FTGMAC100_APTC_RXPOLL_CNT(s->aptcr);
+
+    if (!cnt) {
+        timer_del(s->rxpoll_timer);
+    } else if (!timer_pending(s->rxpoll_timer)) {
+        timer_mod(s->rxpoll_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  ftgmac100_timer_period(s, cnt, 1024, s->aptcr &
+                                         FTGMAC100_APTC_RXPOLL_TIME_SEL));
+    }
+}
+
+static void ftgmac100_txpoll_update(FTGMAC100State *s)
+{
+    uint32_t cnt = FTGMAC100_APTC_TXPOLL_CNT(s->aptcr);
+
+    if (!cnt || (s->maccr & (FTGMAC100_MACCR_TXDMA_EN |
+                             FTGMAC100_MACCR_TXMAC_EN))
+        != (FTGMAC100_MACCR_TXDMA_EN | FTGMAC100_MACCR_TXMAC_EN)) {
+        timer_del(s->txpoll_timer);
+    } else if (!timer_pending(s->txpoll_timer)) {
+        timer_mod(s->txpoll_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  ftgmac100_timer_period(s, cnt, 1024, s->aptcr &
+                                         FTGMAC100_APTC_TXPOLL_TIME_SEL));
+    }
 }
 
 /*
@@ -483,10 +633,11 @@ static int ftgmac100_write_bd(FTGMAC100Desc *bd, dma_addr_t addr)
     return 0;
 }
 
-static int ftgmac100_insert_vlan(FTGMAC100State *s, int frame_size,
-                                  uint8_t vlan_tci)
+static int ftgmac100_insert_vlan(FTGMAC100State *s, uint8_t *frame,
+                                 int frame_size, int buf_size,
+                                 uint16_t vlan_tci)
 {
-    uint8_t *vlan_hdr = s->frame + (ETH_ALEN * 2);
+    uint8_t *vlan_hdr = frame + (ETH_ALEN * 2);
     uint8_t *payload = vlan_hdr + sizeof(struct vlan_header);
 
     if (frame_size < sizeof(struct eth_header)) {
@@ -497,7 +648,7 @@ static int ftgmac100_insert_vlan(FTGMAC100State *s, int frame_size,
         goto out;
     }
 
-    if (frame_size + sizeof(struct vlan_header) > sizeof(s->frame)) {
+    if (frame_size + sizeof(struct vlan_header) > buf_size) {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: frame too big : %d bytes\n",
                       __func__, frame_size);
@@ -514,33 +665,334 @@ out:
     return frame_size;
 }
 
-static void ftgmac100_do_tx(FTGMAC100State *s, uint32_t tx_ring,
-                            uint32_t tx_descriptor)
+/*
+ * Segments of the frame being transmitted
+ */
+typedef struct FTGMAC100TxSeg {
+    uint32_t addr;              /* descriptor address */
+    FTGMAC100Desc bd;
+    int len;
+} FTGMAC100TxSeg;
+
+#define FTGMAC100_TX_MAX_SEGS       64
+
+/*
+ * Headers of a frame copied from the guest buffers, big enough for the
+ * L4 checksum field of a TCP/IPv4 frame with IP options and a VLAN tag
+ */
+#define FTGMAC100_TX_HDR_SIZE       128
+
+/*
+ * Copy @len bytes of the frame starting at offset @off to @buf
+ */
+static int ftgmac100_tx_read(FTGMAC100TxSeg *segs, int nsegs, int off,
+                             uint8_t *buf, int len)
+{
+    int i;
+
+    for (i = 0; i < nsegs && len; i++) {
+        int n;
+
+        if (off >= segs[i].len) {
+            off -= segs[i].len;
+            continue;
+        }
+
+        n = MIN(len, segs[i].len - off);
+        if (dma_memory_read(&address_space_memory, segs[i].bd.des3 + off,
+                            buf, n, MEMTXATTRS_UNSPECIFIED)) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: failed to read packet @ 0x%x\n",
+                          __func__, segs[i].bd.des3);
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        off = 0;
+    }
+
+    return 0;
+}
+
+/*
+ * Offload the checksums requested by the guest to a backend using a
+ * virtio-net header. Only the IP header checksum, which is part of the
+ * copied headers, is computed here. Returns false when the backend
+ * can not do it, the frame then goes through the software path.
+ */
+static bool ftgmac100_tx_offload(uint8_t *hdr, int hdr_len, int frame_size,
+                                 int csum, struct virtio_net_hdr *vhdr)
+{
+    struct ip_header *ip;
+    int l2_len = sizeof(struct eth_header);
+    int ip_hl, ip_len, l4_off, csum_off;
+    uint32_t sum, cso;
+
+    if (hdr_len < l2_len) {
+        return false;
+    }
+    if (lduw_be_p(&PKT_GET_ETH_HDR(hdr)->h_proto) == ETH_P_VLAN) {
+        l2_len += sizeof(struct vlan_header);
+    }
+    if (hdr_len < l2_len + sizeof(struct ip_header)) {
+        return false;
+    }
+
+    ip = (struct ip_header *)(hdr + l2_len);
+    ip_hl = IP_HDR_GET_LEN(ip);
+    ip_len = lduw_be_p(&ip->ip_len);
+    if (IP_HEADER_VERSION(ip) != IP_HEADER_VERSION_4 ||
+        hdr_len < l2_len + ip_hl || frame_size < l2_len + ip_len ||
+        ip_len < ip_hl) {
+        return false;
+    }
+
+    if (!(csum & (CSUM_TCP | CSUM_UDP)) || IP4_IS_FRAGMENT(ip)) {
+        /* Only the IP header checksum, if anything */
+        net_checksum_calculate(hdr, l2_len + ip_hl, csum & CSUM_IP);
+        return true;
+    }
+
+    l4_off = l2_len + ip_hl;
+    if (ip->ip_p == IP_PROTO_TCP && (csum & CSUM_TCP) &&
+        ip_len - ip_hl >= sizeof(tcp_header)) {
+        csum_off = offsetof(tcp_header, th_sum);
+    } else if (ip->ip_p == IP_PROTO_UDP && (csum & CSUM_UDP) &&
+               ip_len - ip_hl >= sizeof(udp_header)) {
+        csum_off = offsetof(udp_header, uh_sum);
+    } else {
+        net_checksum_calculate(hdr, l2_len + ip_hl, csum & CSUM_IP);
+        return true;
+    }
+
+    if (hdr_len < l4_off + csum_off + 2) {
+        return false;
+    }
+
+    if (csum & CSUM_IP) {
+        net_checksum_calculate(hdr, l2_len + ip_hl, CSUM_IP);
+    }
+
+    /* The backend expects the pseudo header checksum in the L4 header */
+    sum = eth_calc_ip4_pseudo_hdr_csum(ip, ip_len - ip_hl, &cso);
+    stw_be_p(hdr + l4_off + csum_off, ~net_checksum_finish(sum));
+
+    vhdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    vhdr->csum_start = cpu_to_le16(l4_off);
+    vhdr->csum_offset = cpu_to_le16(csum_off);
+    return true;
+}
+
+/*
+ * Software path : the frame is copied in a bounce buffer.
+ */
+static int ftgmac100_tx_frame_copy(FTGMAC100State *s, FTGMAC100TxSeg *segs,
+                                   int nsegs, int frame_size, uint32_t flags,
+                                   int csum)
 {
+    struct virtio_net_hdr vhdr = { .gso_type = VIRTIO_NET_HDR_GSO_NONE };
+    struct iovec iov[2];
+    int iovcnt = 0;
+
+    if (ftgmac100_tx_read(segs, nsegs, 0, s->frame, frame_size)) {
+        return -1;
+    }
+
+    /* Check for VLAN */
+    if (flags & FTGMAC100_TXDES1_INS_VLANTAG &&
+        be16_to_cpu(PKT_GET_ETH_HDR(s->frame)->h_proto) != ETH_P_VLAN) {
+        frame_size = ftgmac100_insert_vlan(s, s->frame, frame_size,
+                                           sizeof(s->frame),
+                                           FTGMAC100_TXDES1_VLANTAG_CI(flags));
+    }
+
+    if (csum) {
+        net_checksum_calculate(s->frame, frame_size, csum);
+    }
+
+    if (s->has_vnet_hdr) {
+        iov[iovcnt].iov_base = &vhdr;
+        iov[iovcnt++].iov_len = sizeof(vhdr);
+    }
+    iov[iovcnt].iov_base = s->frame;
+    iov[iovcnt++].iov_len = frame_size;
+
+    qemu_sendv_packet(qemu_get_queue(s->nic), iov, iovcnt);
+    return 0;
+}
+
+/*
+ * Send a complete frame. The headers are copied, for VLAN insertion
+ * and checksums, and the rest of the frame is sent from the mapped
+ * guest buffers.
+ */
+static int ftgmac100_tx_frame(FTGMAC100State *s, FTGMAC100TxSeg *segs,
+                              int nsegs, uint32_t flags)
+{
+    struct virtio_net_hdr vhdr = { .gso_type = VIRTIO_NET_HDR_GSO_NONE };
+    uint8_t hdr[FTGMAC100_TX_HDR_SIZE + sizeof(struct vlan_header)];
+    struct iovec iov[FTGMAC100_TX_MAX_SEGS + 2];
     int frame_size = 0;
-    uint8_t *ptr = s->frame;
+    int tx_size, hdr_len, off;
+    int iovcnt = 0, mapped;
+    int csum = 0;
+    int i;
+
+    for (i = 0; i < nsegs; i++) {
+        segs[i].len = FTGMAC100_TXDES0_TXBUF_SIZE(segs[i].bd.des0);
+        if (frame_size + segs[i].len > sizeof(s->frame)) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: frame too big : %d bytes\n",
+                          __func__, segs[i].len);
+            s->isr |= FTGMAC100_INT_XPKT_LOST;
+            segs[i].len = sizeof(s->frame) - frame_size;
+        }
+        frame_size += segs[i].len;
+    }
+
+    if (flags & FTGMAC100_TXDES1_IP_CHKSUM) {
+        csum |= CSUM_IP;
+    }
+    if (flags & FTGMAC100_TXDES1_TCP_CHKSUM) {
+        csum |= CSUM_TCP;
+    }
+    if (flags & FTGMAC100_TXDES1_UDP_CHKSUM) {
+        csum |= CSUM_UDP;
+    }
+
+    if (csum && !s->has_vnet_hdr) {
+        goto copy;
+    }
+
+    off = hdr_len = MIN(frame_size, FTGMAC100_TX_HDR_SIZE);
+    if (ftgmac100_tx_read(segs, nsegs, 0, hdr, hdr_len)) {
+        return -1;
+    }
+
+    /* Check for VLAN */
+    if (flags & FTGMAC100_TXDES1_INS_VLANTAG &&
+        be16_to_cpu(PKT_GET_ETH_HDR(hdr)->h_proto) != ETH_P_VLAN) {
+        if (frame_size + sizeof(struct vlan_header) > sizeof(s->frame)) {
+            goto copy;
+        }
+        hdr_len = ftgmac100_insert_vlan(s, hdr, hdr_len, sizeof(hdr),
+                                        FTGMAC100_TXDES1_VLANTAG_CI(flags));
+    }
+    tx_size = frame_size + hdr_len - off;
+
+    if (csum && !ftgmac100_tx_offload(hdr, hdr_len, tx_size, csum, &vhdr)) {
+        goto copy;
+    }
+
+    if (s->has_vnet_hdr) {
+        iov[iovcnt].iov_base = &vhdr;
+        iov[iovcnt++].iov_len = sizeof(vhdr);
+    }
+    iov[iovcnt].iov_base = hdr;
+    iov[iovcnt++].iov_len = hdr_len;
+    mapped = iovcnt;
+
+    for (i = 0; i < nsegs; i++) {
+        dma_addr_t len;
+
+        if (off >= segs[i].len) {
+            off -= segs[i].len;
+            continue;
+        }
+
+        len = segs[i].len - off;
+        iov[iovcnt].iov_base = dma_memory_map(&address_space_memory,
+                                              segs[i].bd.des3 + off, &len,
+                                              DMA_DIRECTION_TO_DEVICE,
+                                              MEMTXATTRS_UNSPECIFIED);
+        if (!iov[iovcnt].iov_base) {
+            break;
+        }
+        iov[iovcnt++].iov_len = len;
+        if (len != segs[i].len - off) {
+            break;
+        }
+        off = 0;
+    }
+
+    if (i == nsegs) {
+        qemu_sendv_packet(qemu_get_queue(s->nic), iov, iovcnt);
+    }
+
+    while (iovcnt > mapped) {
+        iovcnt--;
+        dma_memory_unmap(&address_space_memory, iov[iovcnt].iov_base,
+                         iov[iovcnt].iov_len, DMA_DIRECTION_TO_DEVICE,
+                         iov[iovcnt].iov_len);
+    }
+
+    if (i == nsegs) {
+        return 0;
+    }
+
+    /* Not plain RAM */
+copy:
+    return ftgmac100_tx_frame_copy(s, segs, nsegs, frame_size, flags, csum);
+}
+
+static uint32_t ftgmac100_next_txdes(FTGMAC100State *s, uint32_t tx_ring,
+                                     FTGMAC100Desc *bd, uint32_t addr)
+{
+    if (bd->des0 & s->txdes0_edotr) {
+        return tx_ring;
+    }
+    return addr + FTGMAC100_DBLAC_TXDES_SIZE(s->dblac);
+}
+
+/*
+ * Give the descriptors of a frame back to the guest
+ */
+static void ftgmac100_tx_release(FTGMAC100State *s, FTGMAC100TxSeg *segs,
+                                 int nsegs, uint32_t flags)
+{
+    int i;
+
+    for (i = 0; i < nsegs; i++) {
+        if (flags & FTGMAC100_TXDES1_TX2FIC) {
+            s->isr |= FTGMAC100_INT_XPKT_FIFO;
+        }
+        segs[i].bd.des0 &= ~FTGMAC100_TXDES0_TXDMA_OWN;
+
+        /* Write back the modified descriptor.  */
+        ftgmac100_write_bd(&segs[i].bd, segs[i].addr);
+    }
+}
+
+/*
+ * Returns true when the guest is still queuing frames: a frame was sent,
+ * or the last descriptor of a frame is not owned by the device yet.
+ */
+static bool ftgmac100_do_tx(FTGMAC100State *s, uint32_t tx_ring,
+                            uint32_t tx_descriptor)
+{
+    FTGMAC100TxSeg segs[FTGMAC100_TX_MAX_SEGS];
     uint32_t addr = tx_descriptor;
     uint32_t flags = 0;
+    bool sent = false;
+    int nsegs = 0;
 
     while (1) {
-        FTGMAC100Desc bd;
-        int len;
+        FTGMAC100TxSeg *seg = &segs[nsegs];
 
-        if (ftgmac100_read_bd(&bd, addr) ||
-            ((bd.des0 & FTGMAC100_TXDES0_TXDMA_OWN) == 0)) {
+        if (ftgmac100_read_bd(&seg->bd, addr) ||
+            ((seg->bd.des0 & FTGMAC100_TXDES0_TXDMA_OWN) == 0)) {
             /* Run out of descriptors to transmit.  */
             s->isr |= FTGMAC100_INT_NO_NPTXBUF;
             break;
         }
+        seg->addr = addr;
+        nsegs++;
 
         /* record transmit flags as they are valid only on the first
          * segment */
-        if (bd.des0 & FTGMAC100_TXDES0_FTS) {
-            flags = bd.des1;
+        if (seg->bd.des0 & FTGMAC100_TXDES0_FTS) {
+            flags = seg->bd.des1;
         }
 
-        len = FTGMAC100_TXDES0_TXBUF_SIZE(bd.des0);
-        if (!len) {
+        if (!FTGMAC100_TXDES0_TXBUF_SIZE(seg->bd.des0)) {
             /*
              * 0 is an invalid size, however the HW does not raise any
              * interrupt. Flag an error because the guest is buggy.
@@ -549,71 +1001,145 @@ static void ftgmac100_do_tx(FTGMAC100State *s, uint32_t tx_ring,
                           __func__);
         }
 
-        if (frame_size + len > sizeof(s->frame)) {
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: frame too big : %d bytes\n",
-                          __func__, len);
+        addr = ftgmac100_next_txdes(s, tx_ring, &seg->bd, addr);
+
+        if (seg->bd.des0 & FTGMAC100_TXDES0_LTS) {
+            /* Last buffer in frame.  */
+            if (ftgmac100_tx_frame(s, segs, nsegs, flags)) {
+                s->isr |= FTGMAC100_INT_AHB_ERR;
+                addr = segs[0].addr;
+                nsegs = 0;
+                break;
+            }
+            s->isr |= FTGMAC100_INT_XPKT_ETH;
+            ftgmac100_tx_itc_event(s);
+        } else if (nsegs < FTGMAC100_TX_MAX_SEGS) {
+            continue;
+        } else {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: too many segments\n",
+                          __func__);
             s->isr |= FTGMAC100_INT_XPKT_LOST;
-            len =  sizeof(s->frame) - frame_size;
         }
 
-        if (dma_memory_read(&address_space_memory, bd.des3,
-                            ptr, len, MEMTXATTRS_UNSPECIFIED)) {
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: failed to read packet @ 0x%x\n",
-                          __func__, bd.des3);
-            s->isr |= FTGMAC100_INT_AHB_ERR;
-            break;
-        }
+        /*
+         * The descriptors are only released once the frame is sent, the
+         * guest buffers are mapped until then.
+         */
+        ftgmac100_tx_release(s, segs, nsegs, flags);
+        nsegs = 0;
+        sent = true;
+    }
 
-        ptr += len;
-        frame_size += len;
-        if (bd.des0 & FTGMAC100_TXDES0_LTS) {
-            int csum = 0;
+    /* Wait for the end of an incomplete frame */
+    if (nsegs) {
+        addr = segs[0].addr;
+    }
 
-            /* Check for VLAN */
-            if (flags & FTGMAC100_TXDES1_INS_VLANTAG &&
-                be16_to_cpu(PKT_GET_ETH_HDR(s->frame)->h_proto) != ETH_P_VLAN) {
-                frame_size = ftgmac100_insert_vlan(s, frame_size,
-                                            FTGMAC100_TXDES1_VLANTAG_CI(flags));
-            }
+    s->tx_descriptor = addr;
 
-            if (flags & FTGMAC100_TXDES1_IP_CHKSUM) {
-                csum |= CSUM_IP;
-            }
-            if (flags & FTGMAC100_TXDES1_TCP_CHKSUM) {
-                csum |= CSUM_TCP;
-            }
-            if (flags & FTGMAC100_TXDES1_UDP_CHKSUM) {
-                csum |= CSUM_UDP;
-            }
-            if (csum) {
-                net_checksum_calculate(s->frame, frame_size, csum);
-            }
+    ftgmac100_update_irq(s);
 
-            /* Last buffer in frame.  */
-            qemu_send_packet(qemu_get_queue(s->nic), s->frame, frame_size);
-            ptr = s->frame;
-            frame_size = 0;
-            s->isr |= FTGMAC100_INT_XPKT_ETH;
-        }
+    return sent || nsegs;
+}
 
-        if (flags & FTGMAC100_TXDES1_TX2FIC) {
-            s->isr |= FTGMAC100_INT_XPKT_FIFO;
+/*
+ * Available RX descriptors are read in batches and kept until they are
+ * filled. The guest does not modify them while they are owned by the
+ * device. The batch is dropped when the ring is reconfigured.
+ */
+static void ftgmac100_rx_flush_bds(FTGMAC100State *s)
+{
+    s->rx_bds_count = 0;
+    s->rx_bds_pos = 0;
+}
+
+static void ftgmac100_rx_prefetch_bds(FTGMAC100State *s, uint32_t addr)
+{
+    int stride = FTGMAC100_DBLAC_RXDES_SIZE(s->dblac);
+    uint8_t buf[FTGMAC100_RX_BATCH * FTGMAC100_DBLAC_RXDES_SIZE(~0)];
+    int i;
+
+    ftgmac100_rx_flush_bds(s);
+
+    if (dma_memory_read(&address_space_memory, addr, buf,
+                        FTGMAC100_RX_BATCH * stride, MEMTXATTRS_UNSPECIFIED)) {
+        return;
+    }
+
+    for (i = 0; i < FTGMAC100_RX_BATCH; i++) {
+        FTGMAC100Desc *bd = &s->rx_bds[i];
+
+        bd->des0 = ldl_le_p(buf + i * stride);
+        bd->des1 = ldl_le_p(buf + i * stride + 4);
+        bd->des2 = ldl_le_p(buf + i * stride + 8);
+        bd->des3 = ldl_le_p(buf + i * stride + 12);
+        if (bd->des0 & FTGMAC100_RXDES0_RXPKT_RDY) {
+            break;
+        }
+        s->rx_bds_addr[i] = addr + i * stride;
+        s->rx_bds_count++;
+        if (bd->des0 & s->rxdes0_edorr) {
+            break;
         }
-        bd.des0 &= ~FTGMAC100_TXDES0_TXDMA_OWN;
+    }
+}
 
-        /* Write back the modified descriptor.  */
-        ftgmac100_write_bd(&bd, addr);
-        /* Advance to the next descriptor.  */
-        if (bd.des0 & s->txdes0_edotr) {
-            addr = tx_ring;
-        } else {
-            addr += FTGMAC100_DBLAC_TXDES_SIZE(s->dblac);
+static int ftgmac100_rx_read_bd(FTGMAC100State *s, FTGMAC100Desc *bd,
+                                uint32_t addr)
+{
+    if (s->rx_bds_pos == s->rx_bds_count ||
+        s->rx_bds_addr[s->rx_bds_pos] != addr) {
+        ftgmac100_rx_prefetch_bds(s, addr);
+        if (!s->rx_bds_count) {
+            return ftgmac100_read_bd(bd, addr);
         }
     }
 
-    s->tx_descriptor = addr;
+    *bd = s->rx_bds[s->rx_bds_pos];
+    return 0;
+}
 
-    ftgmac100_update_irq(s);
+static int ftgmac100_rx_write_bd(FTGMAC100State *s, FTGMAC100Desc *bd,
+                                 uint32_t addr)
+{
+    if (s->rx_bds_pos < s->rx_bds_count &&
+        s->rx_bds_addr[s->rx_bds_pos] == addr) {
+        s->rx_bds_pos++;
+    }
+    return ftgmac100_write_bd(bd, addr);
+}
+
+/*
+ * Copy @len bytes of received data and @crc_len bytes of CRC in the
+ * guest buffer, with a single mapping when the buffer is in RAM.
+ */
+static void ftgmac100_rx_dma_write(uint32_t addr, const uint8_t *buf,
+                                   uint32_t len, const uint8_t *crc,
+                                   uint32_t crc_len)
+{
+    dma_addr_t plen = len + crc_len;
+    uint8_t *ptr;
+
+    ptr = dma_memory_map(&address_space_memory, addr, &plen,
+                         DMA_DIRECTION_FROM_DEVICE, MEMTXATTRS_UNSPECIFIED);
+    if (ptr && plen == len + crc_len) {
+        memcpy(ptr, buf, len);
+        memcpy(ptr + len, crc, crc_len);
+        dma_memory_unmap(&address_space_memory, ptr, plen,
+                         DMA_DIRECTION_FROM_DEVICE, plen);
+        return;
+    }
+    if (ptr) {
+        dma_memory_unmap(&address_space_memory, ptr, plen,
+                         DMA_DIRECTION_FROM_DEVICE, 0);
+    }
+
+    dma_memory_write(&address_space_memory, addr, buf, len,
+                     MEMTXATTRS_UNSPECIFIED);
+    if (crc_len) {
+        dma_memory_write(&address_space_memory, addr + len, crc, crc_len,
+                         MEMTXATTRS_UNSPECIFIED);
+    }
 }
 
 static bool ftgmac100_can_receive(NetClientState *nc)
@@ -626,41 +1152,32 @@ static bool ftgmac100_can_receive(NetClientState *nc)
         return false;
     }
 
-    if (ftgmac100_read_bd(&bd, s->rx_descriptor)) {
+    if (ftgmac100_rx_read_bd(s, &bd, s->rx_descriptor) ||
+        (bd.des0 & FTGMAC100_RXDES0_RXPKT_RDY)) {
+        ftgmac100_rxpoll_update(s);
         return false;
     }
-    return !(bd.des0 & FTGMAC100_RXDES0_RXPKT_RDY);
+    return true;
 }
 
-/*
- * This is purely informative. The HW can poll the RW (and RX) ring
- * buffers for available descriptors but we don't need to trigger a
- * timer for that in qemu.
- */
-static uint32_t ftgmac100_rxpoll(FTGMAC100State *s)
+static void ftgmac100_rxpoll_timer_expire(void *opaque)
 {
-    /* Polling times :
-     *
-     * Speed      TIME_SEL=0    TIME_SEL=1
-     *
-     *    10         51.2 ms      819.2 ms
-     *   100         5.12 ms      81.92 ms
-     *  1000        1.024 ms     16.384 ms
-     */
-    static const int div[] = { 20, 200, 1000 };
-
-    uint32_t cnt = 1024 * FTGMAC100_APTC_RXPOLL_CNT(s->aptcr);
-    uint32_t speed = (s->maccr & FTGMAC100_MACCR_FAST_MODE) ? 1 : 0;
+    FTGMAC100State *s = opaque;
+    NetClientState *nc = qemu_get_queue(s->nic);
 
-    if (s->aptcr & FTGMAC100_APTC_RXPOLL_TIME_SEL) {
-        cnt <<= 4;
+    /* can_receive() re-arms the timer if the ring is still full */
+    if (ftgmac100_can_receive(nc)) {
+        qemu_flush_queued_packets(nc);
     }
+}
 
-    if (s->maccr & FTGMAC100_MACCR_GIGA_MODE) {
-        speed = 2;
-    }
+static void ftgmac100_txpoll_timer_expire(void *opaque)
+{
+    FTGMAC100State *s = opaque;
 
-    return cnt / div[speed];
+    if (ftgmac100_do_tx(s, s->tx_ring, s->tx_descriptor)) {
+        ftgmac100_txpoll_update(s);
+    }
 }
 
 static void ftgmac100_do_reset(FTGMAC100State *s, bool sw_reset)
@@ -672,12 +1189,16 @@ static void ftgmac100_do_reset(FTGMAC100State *s, bool sw_reset)
     s->rx_ring = 0;
     s->rbsr = 0x640;
     s->rx_descriptor = 0;
+    ftgmac100_rx_flush_bds(s);
     s->tx_ring = 0;
     s->tx_descriptor = 0;
     s->math[0] = 0;
     s->math[1] = 0;
     s->itc = 0;
+    ftgmac100_itc_reset(s);
     s->aptcr = 1;
+    timer_del(s->rxpoll_timer);
+    timer_del(s->txpoll_timer);
     s->dblac = 0x00022f00;
     s->revr = 0;
     s->fear1 = 0;
@@ -786,8 +1307,10 @@ static void ftgmac100_write(void *opaque, hwaddr addr,
     case FTGMAC100_MATH1: /* Multicast Address Hash Table 1 */
         s->math[1] = value;
         break;
-    case FTGMAC100_ITC: /* TODO: Interrupt Timer Control */
+    case FTGMAC100_ITC: /* Interrupt Timer Control */
+        /* Deliver what is held with the previous settings */
         s->itc = value;
+        ftgmac100_itc_reset(s);
         break;
     case FTGMAC100_RXR_BADR: /* Ring buffer address */
         if (!QEMU_IS_ALIGNED(value, FTGMAC100_DESC_ALIGNMENT)) {
@@ -798,6 +1321,7 @@ static void ftgmac100_write(void *opaque, hwaddr addr,
 
         s->rx_ring = value;
         s->rx_descriptor = s->rx_ring;
+        ftgmac100_rx_flush_bds(s);
         break;
 
     case FTGMAC100_RBSR: /* DMA buffer size */
@@ -818,7 +1342,9 @@ static void ftgmac100_write(void *opaque, hwaddr addr,
         if ((s->maccr & (FTGMAC100_MACCR_TXDMA_EN | FTGMAC100_MACCR_TXMAC_EN))
             == (FTGMAC100_MACCR_TXDMA_EN | FTGMAC100_MACCR_TXMAC_EN)) {
             /* TODO: high priority tx ring */
-            ftgmac100_do_tx(s, s->tx_ring, s->tx_descriptor);
+            if (ftgmac100_do_tx(s, s->tx_ring, s->tx_descriptor)) {
+                ftgmac100_txpoll_update(s);
+            }
         }
         if (ftgmac100_can_receive(qemu_get_queue(s->nic))) {
             qemu_flush_queued_packets(qemu_get_queue(s->nic));
@@ -833,22 +1359,22 @@ static void ftgmac100_write(void *opaque, hwaddr addr,
 
     case FTGMAC100_APTC: /* Automatic polling */
         s->aptcr = value;
-
-        if (FTGMAC100_APTC_RXPOLL_CNT(s->aptcr)) {
-            ftgmac100_rxpoll(s);
-        }
-
-        if (FTGMAC100_APTC_TXPOLL_CNT(s->aptcr)) {
-            qemu_log_mask(LOG_UNIMP, "%s: no transmit polling\n", __func__);
+        timer_del(s->rxpoll_timer);
+        timer_del(s->txpoll_timer);
+        ftgmac100_txpoll_update(s);
+        if (ftgmac100_can_receive(qemu_get_queue(s->nic))) {
+            qemu_flush_queued_packets(qemu_get_queue(s->nic));
         }
         break;
 
     case FTGMAC100_MACCR: /* MAC Device control */
         s->maccr = value;
+        ftgmac100_rx_flush_bds(s);
         if (value & FTGMAC100_MACCR_SW_RST) {
             ftgmac100_do_reset(s, true);
         }
 
+        ftgmac100_txpoll_update(s);
         if (ftgmac100_can_receive(qemu_get_queue(s->nic))) {
             qemu_flush_queued_packets(qemu_get_queue(s->nic));
         }
@@ -881,6 +1407,7 @@ static void ftgmac100_write(void *opaque, hwaddr addr,
             break;
         }
         s->dblac = value;
+        ftgmac100_rx_flush_bds(s);
         break;
     case FTGMAC100_REVR:  /* Feature Register */
         s->revr = value;
@@ -960,8 +1487,20 @@ static ssize_t ftgmac100_receive(NetClientState *nc, const uint8_t *buf,
     uint32_t buf_len;
     size_t size = len;
     uint32_t first = FTGMAC100_RXDES0_FRS;
-    uint16_t proto = be16_to_cpu(PKT_GET_ETH_HDR(buf)->h_proto);
-    int max_frame_size = ftgmac100_max_frame_size(s, proto);
+    uint16_t proto;
+    int max_frame_size;
+
+    if (s->has_vnet_hdr) {
+        /* No offloads are enabled, the header carries no information */
+        if (size < sizeof(struct virtio_net_hdr)) {
+            return len;
+        }
+        buf += sizeof(struct virtio_net_hdr);
+        size -= sizeof(struct virtio_net_hdr);
+    }
+
+    proto = be16_to_cpu(PKT_GET_ETH_HDR(buf)->h_proto);
+    max_frame_size = ftgmac100_max_frame_size(s, proto);
 
     if ((s->maccr & (FTGMAC100_MACCR_RXDMA_EN | FTGMAC100_MACCR_RXMAC_EN))
          != (FTGMAC100_MACCR_RXDMA_EN | FTGMAC100_MACCR_RXMAC_EN)) {
@@ -1007,12 +1546,7 @@ static ssize_t ftgmac100_receive(NetClientState *nc, const uint8_t *buf,
     s->isr |= FTGMAC100_INT_RPKT_FIFO;
     addr = s->rx_descriptor;
     while (size > 0) {
-        if (!ftgmac100_can_receive(nc)) {
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: Unexpected packet\n", __func__);
-            return -1;
-        }
-
-        if (ftgmac100_read_bd(&bd, addr) ||
+        if (ftgmac100_rx_read_bd(s, &bd, addr) ||
             (bd.des0 & FTGMAC100_RXDES0_RXPKT_RDY)) {
             /* No descriptors available.  Bail out.  */
             qemu_log_mask(LOG_GUEST_ERROR, "%s: Lost end of frame\n",
@@ -1042,16 +1576,19 @@ static ssize_t ftgmac100_receive(NetClientState *nc, const uint8_t *buf,
                 dma_memory_write(&address_space_memory, buf_addr, buf,
                                  buf_len, MEMTXATTRS_UNSPECIFIED);
             }
+            buf += buf_len;
+            if (size < 4) {
+                dma_memory_write(&address_space_memory, buf_addr + buf_len,
+                                 crc_ptr, 4 - size, MEMTXATTRS_UNSPECIFIED);
+                crc_ptr += 4 - size;
+            }
         } else {
+            uint32_t crc_len = size < 4 ? 4 - size : 0;
+
             bd.des1 = 0;
-            dma_memory_write(&address_space_memory, buf_addr, buf, buf_len,
-                             MEMTXATTRS_UNSPECIFIED);
-        }
-        buf += buf_len;
-        if (size < 4) {
-            dma_memory_write(&address_space_memory, buf_addr + buf_len,
-                             crc_ptr, 4 - size, MEMTXATTRS_UNSPECIFIED);
-            crc_ptr += 4 - size;
+            ftgmac100_rx_dma_write(buf_addr, buf, buf_len, crc_ptr, crc_len);
+            buf += buf_len;
+            crc_ptr += crc_len;
         }
 
         bd.des0 |= first | FTGMAC100_RXDES0_RXPKT_RDY;
@@ -1060,8 +1597,9 @@ static ssize_t ftgmac100_receive(NetClientState *nc, const uint8_t *buf,
             /* Last buffer in frame.  */
             bd.des0 |= flags | FTGMAC100_RXDES0_LRS;
             s->isr |= FTGMAC100_INT_RPKT_BUF;
+            ftgmac100_rx_itc_event(s);
         }
-        ftgmac100_write_bd(&bd, addr);
+        ftgmac100_rx_write_bd(s, &bd, addr);
         if (bd.des0 & s->rxdes0_edorr) {
             addr = s->rx_ring;
         } else {
@@ -1102,6 +1640,7 @@ static void ftgmac100_realize(DeviceState *dev, Error **errp)
 {
     FTGMAC100State *s = FTGMAC100(dev);
     SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    NetClientState *peer;
 
     if (s->aspeed) {
         s->txdes0_edotr = FTGMAC100_TXDES0_EDOTR_ASPEED;
@@ -1117,11 +1656,58 @@ static void ftgmac100_realize(DeviceState *dev, Error **errp)
     sysbus_init_irq(sbd, &s->irq);
     qemu_macaddr_default_if_unset(&s->conf.macaddr);
 
+    s->rxint_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                  ftgmac100_rxint_timer_expire, s);
+    s->txint_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                  ftgmac100_txint_timer_expire, s);
+    s->rxpoll_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                   ftgmac100_rxpoll_timer_expire, s);
+    s->txpoll_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                   ftgmac100_txpoll_timer_expire, s);
+
     s->nic = qemu_new_nic(&net_ftgmac100_info, &s->conf,
                           object_get_typename(OBJECT(dev)), dev->id, s);
     qemu_format_nic_info_str(qemu_get_queue(s->nic), s->conf.macaddr.a);
+
+    /*
+     * Let a backend with a virtio-net header compute the TCP/UDP
+     * checksums of the transmitted frames
+     */
+    peer = qemu_get_queue(s->nic)->peer;
+    if (peer && qemu_has_vnet_hdr(peer)) {
+        qemu_using_vnet_hdr(peer, true);
+        qemu_set_vnet_hdr_len(peer, sizeof(struct virtio_net_hdr));
+        qemu_set_offload(peer, 0, 0, 0, 0, 0);
+        s->has_vnet_hdr = true;
+    }
+}
+
+static bool ftgmac100_timers_needed(void *opaque)
+{
+    FTGMAC100State *s = opaque;
+
+    return s->isr_held || timer_pending(s->rxint_timer) ||
+        timer_pending(s->txint_timer) || timer_pending(s->rxpoll_timer) ||
+        timer_pending(s->txpoll_timer);
 }
 
+static const VMStateDescription vmstate_ftgmac100_timers = {
+    .name = TYPE_FTGMAC100 "/timers",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = ftgmac100_timers_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(isr_held, FTGMAC100State),
+        VMSTATE_UINT32(rxint_count, FTGMAC100State),
+        VMSTATE_UINT32(txint_count, FTGMAC100State),
+        VMSTATE_TIMER_PTR(rxint_timer, FTGMAC100State),
+        VMSTATE_TIMER_PTR(txint_timer, FTGMAC100State),
+        VMSTATE_TIMER_PTR(rxpoll_timer, FTGMAC100State),
+        VMSTATE_TIMER_PTR(txpoll_timer, FTGMAC100State),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_ftgmac100 = {
     .name = TYPE_FTGMAC100,
     .version_id = 1,
@@ -1155,6 +1741,10 @@ static const VMStateDescription vmstate_ftgmac100 = {
         VMSTATE_UINT32(txdes0_edotr, FTGMAC100State),
         VMSTATE_UINT32(rxdes0_edorr, FTGMAC100State),
         VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_ftgmac100_timers,
+        NULL
     }
 };
 
@@ -10,10 +10,12 @@
 #include "qemu/osdep.h"
 
 #include "qapi/error.h"
+#include "qemu/bitmap.h"
 #include "qemu/module.h"
 #include "hw/i2c/i2c.h"
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
+#include "migration/vmstate.h"
 #include "sysemu/block-backend.h"
 #include "qom/object.h"
 #include "hw/nvram/eeprom_at24c.h"
@@ -29,6 +31,15 @@
 #define ERR(FMT, ...) fprintf(stderr, TYPE_AT24C_EE " : " FMT, \
                             ## __VA_ARGS__)
 
+/*
+ * The contents are kept in pages which are only allocated when written.
+ * Until then a page reads from the template: the ROM given by the board,
+ * the backing file or zeroes. Boards with many placeholder EEPROMs only
+ * pay for what the guest actually writes.
+ */
+#define AT24C_PAGE_BITS 8
+#define AT24C_PAGE_SIZE (1u << AT24C_PAGE_BITS)
+
 #define TYPE_AT24C_EE "at24c-eeprom"
 typedef struct EEPROMState EEPROMState;
 DECLARE_INSTANCE_CHECKER(EEPROMState, AT24C_EE,
@@ -47,12 +58,87 @@ struct EEPROMState {
     /* during WRITE, # of address bytes transfered */
     uint8_t haveaddr;
 
-    uint8_t *mem;
+    /* pages written since reset, NULL for pages still reading the template */
+    uint8_t **pages;
+    int32_t nr_pages;
 
     BlockBackend *blk;
+    /* contents of the backing file at reset */
+    uint8_t *blk_data;
     const uint8_t *rom;
+
+    /* written pages packed for migration */
+    unsigned long *page_map;
+    uint8_t *saved;
+    uint32_t saved_size;
 };
 
+static const uint8_t *at24c_eeprom_template(EEPROMState *ee)
+{
+    return ee->rom ? ee->rom : ee->blk_data;
+}
+
+/* Copy @len bytes at @addr, which must not cross the end of the EEPROM */
+static void at24c_eeprom_read(EEPROMState *ee, uint32_t addr, uint8_t *buf,
+                              uint32_t len)
+{
+    const uint8_t *template = at24c_eeprom_template(ee);
+
+    while (len > 0) {
+        uint32_t offset = addr & (AT24C_PAGE_SIZE - 1);
+        uint32_t n = MIN(len, AT24C_PAGE_SIZE - offset);
+        uint8_t *page = ee->pages[addr >> AT24C_PAGE_BITS];
+
+        if (page) {
+            memcpy(buf, page + offset, n);
+        } else if (template) {
+            memcpy(buf, template + addr, n);
+        } else {
+            memset(buf, 0, n);
+        }
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static uint8_t *at24c_eeprom_page(EEPROMState *ee, uint32_t index)
+{
+    uint32_t addr = index << AT24C_PAGE_BITS;
+
+    if (!ee->pages[index]) {
+        ee->pages[index] = g_malloc0(AT24C_PAGE_SIZE);
+        at24c_eeprom_read(ee, addr, ee->pages[index],
+                          MIN(AT24C_PAGE_SIZE, ee->rsize - addr));
+    }
+
+    return ee->pages[index];
+}
+
+static void at24c_eeprom_write(EEPROMState *ee, uint32_t addr,
+                               const uint8_t *buf, uint32_t len)
+{
+    while (len > 0) {
+        uint32_t offset = addr & (AT24C_PAGE_SIZE - 1);
+        uint32_t n = MIN(len, AT24C_PAGE_SIZE - offset);
+
+        memcpy(at24c_eeprom_page(ee, addr >> AT24C_PAGE_BITS) + offset, buf, n);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void at24c_eeprom_free_pages(EEPROMState *ee)
+{
+    int i;
+
+    for (i = 0; i < ee->nr_pages; i++) {
+        g_free(ee->pages[i]);
+        ee->pages[i] = NULL;
+    }
+}
+
 static
 int at24c_eeprom_event(I2CSlave *s, enum i2c_event event)
 {
@@ -66,10 +152,19 @@ int at24c_eeprom_event(I2CSlave *s, enum i2c_event event)
     case I2C_START_RECV:
         DPRINTK("clear\n");
         if (ee->blk && ee->changed) {
-            int len = blk_pwrite(ee->blk, 0, ee->mem, ee->rsize, 0);
-            if (len != ee->rsize) {
-                ERR(TYPE_AT24C_EE
-                        " : failed to write backing file\n");
+            int i;
+
+            /* Only the written pages can differ from the backing file */
+            for (i = 0; i < ee->nr_pages; i++) {
+                uint32_t addr = i << AT24C_PAGE_BITS;
+                uint32_t n = MIN(AT24C_PAGE_SIZE, ee->rsize - addr);
+
+                if (ee->pages[i] &&
+                    blk_pwrite(ee->blk, addr, ee->pages[i], n, 0) < 0) {
+                    ERR(TYPE_AT24C_EE
+                            " : failed to write backing file\n");
+                    break;
+                }
             }
             DPRINTK("Wrote to backing file\n");
         }
@@ -91,7 +186,7 @@ uint8_t at24c_eeprom_recv(I2CSlave *s)
         return 0xff;
     }
 
-    ret = ee->mem[ee->cur];
+    at24c_eeprom_read(ee, ee->cur, &ret, 1);
 
     ee->cur = (ee->cur + 1u) % ee->rsize;
     DPRINTK("Recv %02x %c\n", ret, ret);
@@ -116,7 +211,7 @@ int at24c_eeprom_send(I2CSlave *s, uint8_t data)
     } else {
         if (ee->writable) {
             DPRINTK("Send %02x\n", data);
-            ee->mem[ee->cur] = data;
+            at24c_eeprom_write(ee, ee->cur, &data, 1);
             ee->changed = true;
         } else {
             DPRINTK("Send error %02x read-only\n", data);
@@ -128,6 +223,57 @@ int at24c_eeprom_send(I2CSlave *s, uint8_t data)
     return 0;
 }
 
+static
+void at24c_eeprom_recv_buf(I2CSlave *s, uint8_t *buf, int len)
+{
+    EEPROMState *ee = AT24C_EE(s);
+
+    if (ee->haveaddr == 1) {
+        memset(buf, 0xff, len);
+        return;
+    }
+
+    while (len > 0) {
+        int n = MIN(len, ee->rsize - ee->cur);
+
+        at24c_eeprom_read(ee, ee->cur, buf, n);
+        ee->cur = (ee->cur + n) % ee->rsize;
+        buf += n;
+        len -= n;
+    }
+    DPRINTK("Recv block, pointer now %04x\n", ee->cur);
+}
+
+static
+int at24c_eeprom_send_buf(I2CSlave *s, const uint8_t *buf, int len)
+{
+    EEPROMState *ee = AT24C_EE(s);
+    int i = 0;
+
+    /* Address bytes */
+    while (i < len && ee->haveaddr < 2) {
+        at24c_eeprom_send(s, buf[i++]);
+    }
+
+    if (!ee->writable) {
+        DPRINTK("Send error, %d bytes read-only\n", len - i);
+        ee->cur = (ee->cur + (len - i)) % ee->rsize;
+        return len;
+    }
+
+    while (i < len) {
+        int n = MIN(len - i, ee->rsize - ee->cur);
+
+        at24c_eeprom_write(ee, ee->cur, &buf[i], n);
+        ee->cur = (ee->cur + n) % ee->rsize;
+        ee->changed = true;
+        i += n;
+    }
+    DPRINTK("Send block, pointer now %04x\n", ee->cur);
+
+    return len;
+}
+
 static void at24c_eeprom_realize(DeviceState *dev, Error **errp)
 {
     EEPROMState *ee = AT24C_EE(dev);
@@ -148,9 +294,23 @@ static void at24c_eeprom_realize(DeviceState *dev, Error **errp)
                        TYPE_AT24C_EE);
             return;
         }
+
+        ee->blk_data = g_malloc0(ee->rsize);
     }
 
-    ee->mem = g_malloc0(ee->rsize);
+    ee->nr_pages = DIV_ROUND_UP(ee->rsize, AT24C_PAGE_SIZE);
+    ee->pages = g_new0(uint8_t *, ee->nr_pages);
+    ee->page_map = bitmap_new(ee->nr_pages);
+}
+
+static void at24c_eeprom_unrealize(DeviceState *dev)
+{
+    EEPROMState *ee = AT24C_EE(dev);
+
+    at24c_eeprom_free_pages(ee);
+    g_free(ee->pages);
+    g_free(ee->page_map);
+    g_free(ee->blk_data);
 }
 
 static
@@ -162,23 +322,103 @@ void at24c_eeprom_reset(DeviceState *state)
     ee->cur = 0;
     ee->haveaddr = 0;
 
-    memset(ee->mem, 0, ee->rsize);
+    at24c_eeprom_free_pages(ee);
 
     if (ee->blk) {
-        int len = blk_pread(ee->blk, 0, ee->mem, ee->rsize);
-
-        if (len != ee->rsize) {
+        if (blk_pread(ee->blk, 0, ee->blk_data, ee->rsize) < 0) {
             ERR(TYPE_AT24C_EE
                     " : Failed initial sync with backing file\n");
+            memset(ee->blk_data, 0, ee->rsize);
         }
         DPRINTK("Reset read backing file\n");
     }
+}
 
-    if (ee->rom) {
-        memcpy(ee->mem, ee->rom, ee->rsize);
+static int at24c_eeprom_pre_save(void *opaque)
+{
+    EEPROMState *ee = opaque;
+    uint8_t *p;
+    int i;
+
+    bitmap_zero(ee->page_map, ee->nr_pages);
+    ee->saved_size = 0;
+    for (i = 0; i < ee->nr_pages; i++) {
+        if (ee->pages[i]) {
+            set_bit(i, ee->page_map);
+            ee->saved_size += AT24C_PAGE_SIZE;
+        }
+    }
+
+    p = ee->saved = g_malloc(ee->saved_size);
+    for (i = 0; i < ee->nr_pages; i++) {
+        if (ee->pages[i]) {
+            memcpy(p, ee->pages[i], AT24C_PAGE_SIZE);
+            p += AT24C_PAGE_SIZE;
+        }
     }
+
+    return 0;
+}
+
+static int at24c_eeprom_post_save(void *opaque)
+{
+    EEPROMState *ee = opaque;
+
+    g_free(ee->saved);
+    ee->saved = NULL;
+
+    return 0;
+}
+
+static int at24c_eeprom_post_load(void *opaque, int version_id)
+{
+    EEPROMState *ee = opaque;
+    const uint8_t *p = ee->saved;
+    int ret = 0;
+    int i;
+
+    if (ee->cur >= ee->rsize ||
+        ee->saved_size != bitmap_count_one(ee->page_map, ee->nr_pages) *
+                          AT24C_PAGE_SIZE) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    at24c_eeprom_free_pages(ee);
+    for (i = 0; i < ee->nr_pages; i++) {
+        if (test_bit(i, ee->page_map)) {
+            ee->pages[i] = g_memdup2(p, AT24C_PAGE_SIZE);
+            p += AT24C_PAGE_SIZE;
+        }
+    }
+
+out:
+    g_free(ee->saved);
+    ee->saved = NULL;
+
+    return ret;
 }
 
+static const VMStateDescription vmstate_at24c_eeprom = {
+    .name = TYPE_AT24C_EE,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_save = at24c_eeprom_pre_save,
+    .post_save = at24c_eeprom_post_save,
+    .post_load = at24c_eeprom_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_I2C_SLAVE(parent_obj, EEPROMState),
+        VMSTATE_UINT32_EQUAL(rsize, EEPROMState, NULL),
+        VMSTATE_UINT16(cur, EEPROMState),
+        VMSTATE_BOOL(changed, EEPROMState),
+        VMSTATE_UINT8(haveaddr, EEPROMState),
+        VMSTATE_BITMAP(page_map, EEPROMState, 0, nr_pages),
+        VMSTATE_UINT32(saved_size, EEPROMState),
+        VMSTATE_VBUFFER_ALLOC_UINT32(saved, EEPROMState, 0, NULL, saved_size),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 void at24c_eeprom_init(I2CBus *bus, uint8_t address, const uint8_t *rom, uint32_t rom_size, bool writable)
 {
     EEPROMState *s;
@@ -206,9 +446,13 @@ void at24c_eeprom_class_init(ObjectClass *klass, void *data)
     I2CSlaveClass *k = I2C_SLAVE_CLASS(klass);
 
     dc->realize = &at24c_eeprom_realize;
+    dc->unrealize = &at24c_eeprom_unrealize;
+    dc->vmsd = &vmstate_at24c_eeprom;
     k->event = &at24c_eeprom_event;
     k->recv = &at24c_eeprom_recv;
     k->send = &at24c_eeprom_send;
+    k->recv_buf = &at24c_eeprom_recv_buf;
+    k->send_buf = &at24c_eeprom_send_buf;
 
     device_class_set_props(dc, at24c_eeprom_props);
     dc->reset = at24c_eeprom_reset;
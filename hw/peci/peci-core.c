@@ -0,0 +1,142 @@
+/*
+ * PECI (Platform Environment Control Interface) bus
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "hw/peci/peci.h"
+#include "hw/qdev-properties.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+static Property peci_device_props[] = {
+    DEFINE_PROP_UINT8("address", PECIDevice, address, PECI_BASE_ADDR),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+PECIBus *peci_bus_new(DeviceState *parent, const char *name)
+{
+    return PECI_BUS(qbus_new(TYPE_PECI_BUS, parent, name));
+}
+
+static PECIDevice *peci_bus_find(PECIBus *bus, uint8_t addr)
+{
+    BusChild *kid;
+
+    QTAILQ_FOREACH(kid, &bus->qbus.children, sibling) {
+        PECIDevice *dev = PECI_DEVICE(kid->child);
+
+        if (dev->address == addr) {
+            return dev;
+        }
+    }
+
+    return NULL;
+}
+
+void peci_bus_transfer(PECIBus *bus, PECIRequest *req)
+{
+    PECIDevice *dev = peci_bus_find(bus, req->addr);
+
+    trace_peci_bus_transfer(req->addr, req->wlen, req->rlen,
+                            req->wlen ? req->wbuf[0] : 0);
+
+    memset(req->rbuf, 0, sizeof(req->rbuf));
+    if (!dev) {
+        req->dev = NULL;
+        req->complete(req, false, req->opaque);
+        return;
+    }
+
+    req->dev = dev;
+    PECI_DEVICE_GET_CLASS(dev)->transfer(dev, req);
+}
+
+void peci_bus_cancel(PECIRequest *req)
+{
+    PECIDevice *dev = req->dev;
+
+    if (dev) {
+        PECIDeviceClass *pdc = PECI_DEVICE_GET_CLASS(dev);
+
+        req->dev = NULL;
+        if (pdc->cancel) {
+            pdc->cancel(dev, req);
+        }
+    }
+}
+
+void peci_request_complete(PECIRequest *req)
+{
+    /* Cancelled */
+    if (!req->dev) {
+        return;
+    }
+
+    req->dev = NULL;
+    trace_peci_request_complete(req->addr, req->rlen ? req->rbuf[0] : 0);
+    req->complete(req, true, req->opaque);
+}
+
+uint8_t peci_fcs(uint8_t fcs, const uint8_t *buf, size_t len)
+{
+    while (len--) {
+        fcs ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            fcs = fcs & 0x80 ? (fcs << 1) ^ 0x07 : fcs << 1;
+        }
+    }
+
+    return fcs;
+}
+
+static bool peci_bus_check_address(BusState *qbus, DeviceState *dev,
+                                   Error **errp)
+{
+    PECIDevice *pdev = PECI_DEVICE(dev);
+    PECIDevice *other = peci_bus_find(PECI_BUS(qbus), pdev->address);
+
+    if (other && other != pdev) {
+        error_setg(errp, "PECI address 0x%02x is already in use",
+                   pdev->address);
+        return false;
+    }
+
+    return true;
+}
+
+static void peci_bus_class_init(ObjectClass *klass, void *data)
+{
+    BusClass *bc = BUS_CLASS(klass);
+
+    bc->check_address = peci_bus_check_address;
+}
+
+static void peci_device_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->bus_type = TYPE_PECI_BUS;
+    device_class_set_props(dc, peci_device_props);
+}
+
+static const TypeInfo peci_types[] = {
+    {
+        .name = TYPE_PECI_BUS,
+        .parent = TYPE_BUS,
+        .instance_size = sizeof(PECIBus),
+        .class_init = peci_bus_class_init,
+    }, {
+        .name = TYPE_PECI_DEVICE,
+        .parent = TYPE_DEVICE,
+        .instance_size = sizeof(PECIDevice),
+        .class_size = sizeof(PECIDeviceClass),
+        .class_init = peci_device_class_init,
+        .abstract = true,
+    },
+};
+
+DEFINE_TYPES(peci_types)
@@ -0,0 +1,324 @@
+/*
+ * PECI client of an Intel CPU
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * The package temperature is the "temperature" property, in millidegrees
+ * Celsius, which can be changed at runtime (e.g. by a sensor-playback
+ * device). RdPkgConfig and RdIAMSR answer from the "table" file, with
+ * lines of the form:
+ *
+ *   pkgcfg <index> <parameter> <value>
+ *   msr <thread> <address> <value>
+ *
+ * and fall back to a few built-in values derived from the properties.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/cutils.h"
+#include "qemu/log.h"
+#include "qemu/table-file.h"
+#include "hw/peci/peci.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+
+#define TYPE_PECI_CPU "peci-cpu"
+OBJECT_DECLARE_SIMPLE_TYPE(PECICPUState, PECI_CPU)
+
+/* RdPkgConfig indexes */
+#define PECI_PCS_PKG_ID             0
+#define PECI_PCS_MODULE_TEMP        9
+#define PECI_PCS_TEMP_TARGET        16
+
+/* MSRs */
+#define MSR_IA32_THERM_STATUS       0x19c
+#define MSR_IA32_TEMPERATURE_TARGET 0x1a2
+
+/* Revision 4.0 of the PECI specification */
+#define PECI_CPU_REVISION           0x40
+
+enum {
+    PECI_CPU_PKG_CFG,
+    PECI_CPU_MSR,
+};
+
+struct PECICPUState {
+    PECIDevice parent;
+
+    int32_t temperature;
+
+    /* (type, index or thread, parameter or address) -> value */
+    GHashTable *table;
+
+    char *table_path;
+    uint32_t cpuid;
+    uint8_t tjmax;
+    uint8_t tcontrol;
+};
+
+static uint64_t peci_cpu_key(uint32_t type, uint8_t idx, uint16_t param)
+{
+    return (uint64_t)type << 32 | idx << 16 | param;
+}
+
+/* The temperature relative to Tjmax in 1/64 degree, as in GetTemp() */
+static int16_t peci_cpu_dts(PECICPUState *s)
+{
+    int64_t dts = ((int64_t)s->temperature - s->tjmax * 1000) * 64 / 1000;
+
+    return MIN(dts, 0);
+}
+
+static uint32_t peci_cpu_temp_target(PECICPUState *s)
+{
+    return s->tjmax << 16 | s->tcontrol << 8;
+}
+
+static bool peci_cpu_lookup(PECICPUState *s, uint32_t type, uint8_t idx,
+                            uint16_t param, uint64_t *value)
+{
+    uint64_t key = peci_cpu_key(type, idx, param);
+    uint64_t *entry = g_hash_table_lookup(s->table, &key);
+
+    if (entry) {
+        *value = *entry;
+        return true;
+    }
+
+    switch (type) {
+    case PECI_CPU_PKG_CFG:
+        switch (idx) {
+        case PECI_PCS_PKG_ID:
+            if (param) {
+                break;
+            }
+            *value = s->cpuid;
+            return true;
+        case PECI_PCS_MODULE_TEMP:
+            /* All the cores are at the package temperature */
+            *value = (uint16_t)peci_cpu_dts(s);
+            return true;
+        case PECI_PCS_TEMP_TARGET:
+            *value = peci_cpu_temp_target(s);
+            return true;
+        }
+        break;
+    case PECI_CPU_MSR:
+        switch (param) {
+        case MSR_IA32_THERM_STATUS:
+            /* Valid digital readout, in degrees below Tjmax */
+            *value = BIT(31) | MIN(-peci_cpu_dts(s) / 64, 0x7f) << 16;
+            return true;
+        case MSR_IA32_TEMPERATURE_TARGET:
+            *value = peci_cpu_temp_target(s);
+            return true;
+        }
+        break;
+    }
+
+    return false;
+}
+
+/* RdPkgConfig() and RdIAMSR() share the same message layout */
+static void peci_cpu_read(PECICPUState *s, PECIRequest *req, uint32_t type)
+{
+    uint64_t value;
+    int i;
+
+    if (!req->rlen) {
+        return;
+    }
+
+    if (req->wlen < 5 ||
+        !peci_cpu_lookup(s, type, req->wbuf[2], lduw_le_p(&req->wbuf[3]),
+                         &value)) {
+        req->rbuf[0] = PECI_CC_ILLEGAL_REQUEST;
+        return;
+    }
+
+    req->rbuf[0] = PECI_CC_SUCCESS;
+    for (i = 1; i < req->rlen && i <= sizeof(value); i++) {
+        req->rbuf[i] = value >> ((i - 1) * 8);
+    }
+}
+
+static void peci_cpu_transfer(PECIDevice *dev, PECIRequest *req)
+{
+    PECICPUState *s = PECI_CPU(dev);
+
+    /* Ping() has no command */
+    if (!req->wlen) {
+        peci_request_complete(req);
+        return;
+    }
+
+    switch (req->wbuf[0]) {
+    case PECI_CMD_GET_DIB:
+        if (req->rlen >= 2) {
+            req->rbuf[1] = PECI_CPU_REVISION;
+        }
+        break;
+    case PECI_CMD_GET_TEMP:
+        if (req->rlen >= 2) {
+            stw_le_p(req->rbuf, peci_cpu_dts(s));
+        }
+        break;
+    case PECI_CMD_RD_PKG_CFG:
+        peci_cpu_read(s, req, PECI_CPU_PKG_CFG);
+        break;
+    case PECI_CMD_RD_IA_MSR:
+        peci_cpu_read(s, req, PECI_CPU_MSR);
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented command 0x%02x\n",
+                      __func__, req->wbuf[0]);
+        if (req->rlen) {
+            req->rbuf[0] = PECI_CC_ILLEGAL_REQUEST;
+        }
+        break;
+    }
+
+    peci_request_complete(req);
+}
+
+static void peci_cpu_get_temperature(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    PECICPUState *s = PECI_CPU(obj);
+    int64_t value = s->temperature;
+
+    visit_type_int(v, name, &value, errp);
+}
+
+static void peci_cpu_set_temperature(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    PECICPUState *s = PECI_CPU(obj);
+    int64_t temp;
+
+    if (!visit_type_int(v, name, &temp, errp)) {
+        return;
+    }
+    if (temp >= 256000 || temp <= -256000) {
+        error_setg(errp, "value %" PRId64 ".%03" PRIu64 " C is out of range",
+                   temp / 1000, temp % 1000);
+        return;
+    }
+
+    s->temperature = temp;
+}
+
+static bool peci_cpu_table_line(void *opaque, char **tokens, Error **errp)
+{
+    PECICPUState *s = opaque;
+    uint64_t idx, param, value;
+    uint64_t *key;
+    uint32_t type;
+
+    if (!strcmp(tokens[0], "pkgcfg")) {
+        type = PECI_CPU_PKG_CFG;
+    } else if (!strcmp(tokens[0], "msr")) {
+        type = PECI_CPU_MSR;
+    } else {
+        error_setg(errp, "unknown entry '%s'", tokens[0]);
+        return false;
+    }
+
+    if (qemu_strtou64(tokens[1], NULL, 0, &idx) < 0 || idx > UINT8_MAX ||
+        qemu_strtou64(tokens[2], NULL, 0, &param) < 0 || param > UINT16_MAX ||
+        qemu_strtou64(tokens[3], NULL, 0, &value) < 0) {
+        error_setg(errp, "invalid '%s' entry", tokens[0]);
+        return false;
+    }
+
+    key = g_new(uint64_t, 1);
+    *key = peci_cpu_key(type, idx, param);
+    g_hash_table_insert(s->table, key, g_memdup2(&value, sizeof(value)));
+
+    return true;
+}
+
+static void peci_cpu_realize(DeviceState *dev, Error **errp)
+{
+    PECICPUState *s = PECI_CPU(dev);
+
+    if (s->table_path &&
+        !qemu_table_file_load(s->table_path, 4, peci_cpu_table_line, s,
+                              errp)) {
+        g_hash_table_remove_all(s->table);
+        return;
+    }
+}
+
+static void peci_cpu_init(Object *obj)
+{
+    PECICPUState *s = PECI_CPU(obj);
+
+    s->table = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                     g_free);
+    s->temperature = 40000;
+
+    object_property_add(obj, "temperature", "int", peci_cpu_get_temperature,
+                        peci_cpu_set_temperature, NULL, NULL);
+}
+
+static void peci_cpu_finalize(Object *obj)
+{
+    PECICPUState *s = PECI_CPU(obj);
+
+    g_hash_table_destroy(s->table);
+}
+
+static const VMStateDescription vmstate_peci_cpu = {
+    .name = TYPE_PECI_CPU,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_INT32(temperature, PECICPUState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property peci_cpu_props[] = {
+    DEFINE_PROP_STRING("table", PECICPUState, table_path),
+    /* Ice Lake-SP */
+    DEFINE_PROP_UINT32("cpuid", PECICPUState, cpuid, 0x000606a6),
+    DEFINE_PROP_UINT8("tjmax", PECICPUState, tjmax, 100),
+    DEFINE_PROP_UINT8("tcontrol", PECICPUState, tcontrol, 10),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void peci_cpu_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    PECIDeviceClass *pdc = PECI_DEVICE_CLASS(klass);
+
+    dc->realize = peci_cpu_realize;
+    dc->desc = "PECI Intel CPU";
+    dc->vmsd = &vmstate_peci_cpu;
+    device_class_set_props(dc, peci_cpu_props);
+    pdc->transfer = peci_cpu_transfer;
+}
+
+static const TypeInfo peci_cpu_info = {
+    .name = TYPE_PECI_CPU,
+    .parent = TYPE_PECI_DEVICE,
+    .instance_size = sizeof(PECICPUState),
+    .instance_init = peci_cpu_init,
+    .instance_finalize = peci_cpu_finalize,
+    .class_init = peci_cpu_class_init,
+};
+
+static void peci_cpu_register_types(void)
+{
+    type_register_static(&peci_cpu_info);
+}
+
+type_init(peci_cpu_register_types)
@@ -0,0 +1,137 @@
+/*
+ * PECI client forwarding the requests to a network backend
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This lets an external model of the host answer for a CPU. Each request
+ * is sent as one packet:
+ *
+ *   address, write length, read length, write data...
+ *
+ * and the peer answers with one packet holding the read data. Requests
+ * left unanswered are dropped when the controller times out.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/peci/peci.h"
+#include "hw/qdev-properties.h"
+#include "net/net.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define TYPE_PECI_NETDEV "peci-netdev"
+OBJECT_DECLARE_SIMPLE_TYPE(PECINetdev, PECI_NETDEV)
+
+struct PECINetdev {
+    PECIDevice parent;
+
+    NICConf conf;
+    NICState *nic;
+
+    /* The request waiting for an answer */
+    PECIRequest *req;
+};
+
+static void peci_netdev_transfer(PECIDevice *dev, PECIRequest *req)
+{
+    PECINetdev *s = PECI_NETDEV(dev);
+    uint8_t buf[3 + PECI_BUFFER_SIZE];
+
+    buf[0] = req->addr;
+    buf[1] = req->wlen;
+    buf[2] = req->rlen;
+    memcpy(&buf[3], req->wbuf, req->wlen);
+
+    s->req = req;
+    qemu_send_packet(qemu_get_queue(s->nic), buf, 3 + req->wlen);
+}
+
+static void peci_netdev_cancel(PECIDevice *dev, PECIRequest *req)
+{
+    PECINetdev *s = PECI_NETDEV(dev);
+
+    if (s->req == req) {
+        s->req = NULL;
+    }
+}
+
+static ssize_t peci_netdev_receive(NetClientState *nc, const uint8_t *buf,
+                                   size_t len)
+{
+    PECINetdev *s = PECI_NETDEV(qemu_get_nic_opaque(nc));
+    PECIRequest *req = s->req;
+
+    trace_peci_netdev_receive(len, !!req);
+
+    /* Late answers are dropped */
+    if (req) {
+        s->req = NULL;
+        memcpy(req->rbuf, buf, MIN(len, req->rlen));
+        peci_request_complete(req);
+    }
+
+    return len;
+}
+
+static void peci_netdev_cleanup(NetClientState *nc)
+{
+    PECINetdev *s = PECI_NETDEV(qemu_get_nic_opaque(nc));
+
+    s->nic = NULL;
+}
+
+static NetClientInfo peci_netdev_info = {
+    .type = NET_CLIENT_DRIVER_NIC,
+    .size = sizeof(NICState),
+    .receive = peci_netdev_receive,
+    .cleanup = peci_netdev_cleanup,
+};
+
+static void peci_netdev_realize(DeviceState *dev, Error **errp)
+{
+    PECINetdev *s = PECI_NETDEV(dev);
+
+    s->nic = qemu_new_nic(&peci_netdev_info, &s->conf,
+                          object_get_typename(OBJECT(dev)), dev->id, s);
+}
+
+static void peci_netdev_unrealize(DeviceState *dev)
+{
+    PECINetdev *s = PECI_NETDEV(dev);
+
+    qemu_del_nic(s->nic);
+}
+
+static Property peci_netdev_props[] = {
+    DEFINE_NIC_PROPERTIES(PECINetdev, conf),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void peci_netdev_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    PECIDeviceClass *pdc = PECI_DEVICE_CLASS(klass);
+
+    dc->realize = peci_netdev_realize;
+    dc->unrealize = peci_netdev_unrealize;
+    dc->desc = "PECI client over a network backend";
+    device_class_set_props(dc, peci_netdev_props);
+    pdc->transfer = peci_netdev_transfer;
+    pdc->cancel = peci_netdev_cancel;
+}
+
+static const TypeInfo peci_netdev_info_type = {
+    .name = TYPE_PECI_NETDEV,
+    .parent = TYPE_PECI_DEVICE,
+    .instance_size = sizeof(PECINetdev),
+    .class_init = peci_netdev_class_init,
+};
+
+static void peci_netdev_register_types(void)
+{
+    type_register_static(&peci_netdev_info_type);
+}
+
+type_init(peci_netdev_register_types)
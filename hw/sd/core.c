@@ -160,6 +160,24 @@ void sdbus_read_data(SDBus *sdbus, void *buf, size_t length)
     }
 }
 
+BlockAIOCB *sdbus_transfer_blocks(SDBus *sdbus, QEMUSGList *sg,
+                                  BlockCompletionFunc *cb, void *opaque)
+{
+    SDState *card = get_card(sdbus);
+    BlockAIOCB *aiocb = NULL;
+
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+
+        if (sc->transfer_blocks) {
+            aiocb = sc->transfer_blocks(card, sg, cb, opaque);
+        }
+    }
+    trace_sdbus_transfer_blocks(sdbus_name(sdbus), sg->size, !!aiocb);
+
+    return aiocb;
+}
+
 bool sdbus_receive_ready(SDBus *sdbus)
 {
     SDState *card = get_card(sdbus);
@@ -134,6 +134,12 @@ struct SDState {
     uint64_t data_start;
     uint32_t data_offset;
     uint8_t data[512];
+    /* Multiple block transfer handed over by the host controller */
+    BlockAIOCB *aiocb;
+    BlockCompletionFunc *aio_cb;
+    void *aio_opaque;
+    uint64_t aio_len;
+    uint32_t aio_blocks;
     qemu_irq readonly_cb;
     qemu_irq inserted_cb;
     QEMUTimer *ocr_power_timer;
@@ -558,6 +564,9 @@ static void sd_reset(DeviceState *dev)
     uint64_t sect;
 
     trace_sdcard_reset();
+    while (sd->aiocb) {
+        blk_aio_cancel(sd->aiocb);
+    }
     if (sd->blk) {
         blk_get_geometry(sd->blk, &sect);
     } else {
@@ -2096,6 +2105,102 @@ uint8_t sd_read_byte(SDState *sd)
     return ret;
 }
 
+static void sd_transfer_blocks_cb(void *opaque, int ret)
+{
+    SDState *sd = opaque;
+
+    trace_sdcard_transfer_blocks_done(sd->data_start, sd->aio_len, ret);
+    sd->aiocb = NULL;
+
+    if (sd->current_cmd == 25) {
+        sd->state = sd_receivingdata_state;
+    }
+    if (ret == 0) {
+        if (sd->current_cmd == 25) {
+            sd->blk_written += sd->aio_blocks;
+            sd->csd[14] |= 0x40;
+        }
+        sd->data_start += sd->aio_len;
+
+        if (sd->multi_blk_cnt != 0) {
+            sd->multi_blk_cnt -= sd->aio_blocks;
+            if (sd->multi_blk_cnt == 0) {
+                /* Stop! */
+                sd->state = sd_transfer_state;
+            }
+        }
+    } else if (ret != -ECANCELED) {
+        error_report("sd_transfer_blocks: %s error on host side",
+                     sd->current_cmd == 25 ? "write" : "read");
+    }
+
+    sd->aio_cb(sd->aio_opaque, ret);
+}
+
+/*
+ * Run the whole data phase of CMD18/CMD25 as one vectored request on
+ * the backend, straight into or out of guest memory. Anything which
+ * would need the per-block checks of sd_read_byte() and sd_write_byte()
+ * to fail part way through is left to them.
+ */
+static BlockAIOCB *sd_transfer_blocks(SDState *sd, QEMUSGList *sg,
+                                      BlockCompletionFunc *cb, void *opaque)
+{
+    uint32_t io_len;
+    uint64_t addr;
+
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable || sd->aiocb) {
+        return NULL;
+    }
+
+    if (sd->data_offset != 0 ||
+        (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+        return NULL;
+    }
+
+    if (sd->current_cmd == 18 && sd->state == sd_sendingdata_state) {
+        io_len = (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+    } else if (sd->current_cmd == 25 && sd->state == sd_receivingdata_state) {
+        io_len = sd->blk_len;
+    } else {
+        return NULL;
+    }
+
+    if (!sg->size || sg->size % io_len ||
+        sd->data_start + sg->size > sd->size) {
+        return NULL;
+    }
+
+    sd->aio_len = sg->size;
+    sd->aio_blocks = sg->size / io_len;
+    if (sd->multi_blk_cnt != 0 && sd->aio_blocks > sd->multi_blk_cnt) {
+        return NULL;
+    }
+
+    trace_sdcard_transfer_blocks(sd->current_cmd, sd->data_start, sg->size);
+    sd->aio_cb = cb;
+    sd->aio_opaque = opaque;
+
+    if (sd->current_cmd == 18) {
+        sd->aiocb = dma_blk_read(sd->blk, sg, sd->data_start,
+                                 BDRV_SECTOR_SIZE, sd_transfer_blocks_cb, sd);
+    } else {
+        if (sd->size <= SDSC_MAX_CAPACITY) {
+            for (addr = sd->data_start; addr < sd->data_start + sg->size;
+                 addr += io_len) {
+                if (sd_wp_addr(sd, addr)) {
+                    return NULL;
+                }
+            }
+        }
+        sd->state = sd_programming_state;
+        sd->aiocb = dma_blk_write(sd->blk, sg, sd->data_start,
+                                  BDRV_SECTOR_SIZE, sd_transfer_blocks_cb, sd);
+    }
+
+    return sd->aiocb;
+}
+
 static bool sd_receive_ready(SDState *sd)
 {
     return sd->state == sd_receivingdata_state;
@@ -2211,6 +2316,7 @@ static void sd_class_init(ObjectClass *klass, void *data)
     sc->do_command = sd_do_command;
     sc->write_byte = sd_write_byte;
     sc->read_byte = sd_read_byte;
+    sc->transfer_blocks = sd_transfer_blocks;
     sc->receive_ready = sd_receive_ready;
     sc->data_ready = sd_data_ready;
     sc->enable = sd_enable;
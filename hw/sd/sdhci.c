@@ -31,6 +31,7 @@
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
 #include "sysemu/dma.h"
+#include "sysemu/block-backend.h"
 #include "qemu/timer.h"
 #include "qemu/bitops.h"
 #include "hw/sd/sdhci.h"
@@ -283,12 +284,21 @@ static void sdhci_set_readonly(DeviceState *dev, bool level)
     }
 }
 
+static void sdhci_cancel_transfer_blocks(SDHCIState *s)
+{
+    /* A request completing before it is cancelled may start the next one */
+    while (s->dma_aiocb) {
+        blk_aio_cancel(s->dma_aiocb);
+    }
+}
+
 static void sdhci_reset(SDHCIState *s)
 {
     DeviceState *dev = DEVICE(s);
 
     timer_del(s->insert_timer);
     timer_del(s->transfer_timer);
+    sdhci_cancel_transfer_blocks(s);
 
     /* Set all registers to 0. Capabilities/Version registers are not cleared
      * and assumed to always preserve their value, given to them during
@@ -573,6 +583,113 @@ static void sdhci_write_dataport(SDHCIState *s, uint32_t value, unsigned size)
     }
 }
 
+/*
+ * Multiple block DMA transfer handed over to the card
+ */
+
+static void sdhci_do_adma(SDHCIState *s);
+
+static bool sdhci_can_transfer_blocks(SDHCIState *s)
+{
+    return (s->trnmod & SDHC_TRNS_BLK_CNT_EN) && s->blkcnt &&
+        (s->blksize & BLOCK_SIZE_MASK) && !s->data_count &&
+        s->stopped_state == sdhc_not_stopped;
+}
+
+static void sdhci_transfer_blocks_done(void *opaque, int ret)
+{
+    SDHCIState *s = opaque;
+
+    s->dma_aiocb = NULL;
+    qemu_sglist_destroy(&s->dma_sg);
+
+    if (ret == -ECANCELED) {
+        return;
+    }
+
+    if (ret < 0) {
+        trace_sdhci_error("block transfer failed");
+        if (s->errintstsen & SDHC_EISEN_DATACRC) {
+            s->errintsts |= SDHC_EIS_DATACRC;
+            s->norintsts |= SDHC_NIS_ERR;
+        }
+        s->prnsts &= ~(SDHC_DOING_READ | SDHC_DOING_WRITE |
+                SDHC_DAT_LINE_ACTIVE | SDHC_DATA_INHIBIT);
+        sdhci_update_irq(s);
+        return;
+    }
+
+    s->blkcnt -= s->dma_blocks;
+
+    if (SDHC_DMA_TYPE(s->hostctl1) == SDHC_CTRL_SDMA) {
+        s->sdmasysad = s->dma_next;
+        if (s->blkcnt == 0) {
+            sdhci_end_transfer(s);
+        } else {
+            if (s->norintstsen & SDHC_NISEN_DMA) {
+                s->norintsts |= SDHC_NIS_DMA;
+            }
+            sdhci_update_irq(s);
+        }
+    } else {
+        s->admasysaddr = s->dma_next;
+        if (s->blkcnt == 0) {
+            trace_sdhci_adma_transfer_completed();
+            sdhci_end_transfer(s);
+        } else {
+            sdhci_do_adma(s);
+        }
+    }
+}
+
+/*
+ * Hand s->dma_sg to the card as a single request. Returns false if the
+ * card cannot take it, in which case the blocks must be copied through
+ * the FIFO buffer.
+ */
+static bool sdhci_transfer_blocks(SDHCIState *s)
+{
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+
+    s->dma_blocks = s->dma_sg.size / block_size;
+    s->dma_aiocb = sdbus_transfer_blocks(&s->sdbus, &s->dma_sg,
+                                         sdhci_transfer_blocks_done, s);
+    if (!s->dma_aiocb) {
+        qemu_sglist_destroy(&s->dma_sg);
+        return false;
+    }
+
+    s->prnsts |= SDHC_DATA_INHIBIT | SDHC_DAT_LINE_ACTIVE;
+    s->prnsts |= (s->trnmod & SDHC_TRNS_READ) ? SDHC_DOING_READ :
+        SDHC_DOING_WRITE;
+    return true;
+}
+
+static bool sdhci_sdma_transfer_blocks(SDHCIState *s)
+{
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+    uint32_t boundary_chk = 1 << (((s->blksize & ~BLOCK_SIZE_MASK) >> 12) + 12);
+    uint64_t length = (uint64_t)s->blkcnt * block_size;
+
+    if (!sdhci_can_transfer_blocks(s)) {
+        return false;
+    }
+
+    /* Pause at the buffer boundary like sdhci_sdma_transfer_multi_blocks() */
+    if ((s->sdmasysad % boundary_chk) == 0) {
+        if (boundary_chk % block_size) {
+            return false;
+        }
+        length = MIN(length, boundary_chk);
+    }
+
+    qemu_sglist_init(&s->dma_sg, DEVICE(s), 1, s->dma_as);
+    qemu_sglist_add(&s->dma_sg, s->sdmasysad, length);
+    s->dma_next = s->sdmasysad + length;
+
+    return sdhci_transfer_blocks(s);
+}
+
 /*
  * Single DMA data transfer
  */
@@ -591,6 +708,10 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
         return;
     }
 
+    if (sdhci_sdma_transfer_blocks(s)) {
+        return;
+    }
+
     /* XXX: Some sd/mmc drivers (for example, u-boot-slp) do not account for
      * possible stop at page boundary if initial address is not page aligned,
      * allow them to work properly */
@@ -689,11 +810,11 @@ typedef struct ADMADescr {
     uint8_t incr;
 } ADMADescr;
 
-static void get_adma_description(SDHCIState *s, ADMADescr *dscr)
+static void get_adma_description(SDHCIState *s, hwaddr entry_addr,
+                                 ADMADescr *dscr)
 {
     uint32_t adma1 = 0;
     uint64_t adma2 = 0;
-    hwaddr entry_addr = (hwaddr)s->admasysaddr;
     switch (SDHC_DMA_TYPE(s->hostctl1)) {
     case SDHC_CTRL_ADMA2_32:
         dma_memory_read(s->dma_as, entry_addr, &adma2, sizeof(adma2),
@@ -737,6 +858,62 @@ static void get_adma_description(SDHCIState *s, ADMADescr *dscr)
 
 /* Advanced DMA data transfer */
 
+/*
+ * Gather the data of consecutive descriptors into s->dma_sg. Invalid
+ * descriptors, interrupt requests, partial blocks and length mismatches
+ * are left to the descriptor by descriptor loop of sdhci_do_adma().
+ */
+static bool sdhci_adma_transfer_blocks(SDHCIState *s)
+{
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+    uint64_t remaining = (uint64_t)s->blkcnt * block_size;
+    hwaddr entry_addr = s->admasysaddr;
+    ADMADescr dscr = {};
+    unsigned int length;
+    bool tran;
+    int i;
+
+    if (!sdhci_can_transfer_blocks(s)) {
+        return false;
+    }
+
+    qemu_sglist_init(&s->dma_sg, DEVICE(s), 8, s->dma_as);
+
+    for (i = 0; i < SDHC_ADMA_DESCS_PER_REQUEST && remaining; ++i) {
+        get_adma_description(s, entry_addr, &dscr);
+        tran = (dscr.attr & SDHC_ADMA_ATTR_ACT_MASK) == SDHC_ADMA_ATTR_ACT_TRAN;
+        length = dscr.length ? dscr.length : 64 * KiB;
+
+        if (!(dscr.attr & SDHC_ADMA_ATTR_VALID) ||
+            (dscr.attr & SDHC_ADMA_ATTR_INT) ||
+            (tran && (length % block_size || length > remaining)) ||
+            ((dscr.attr & SDHC_ADMA_ATTR_END) &&
+             (!tran || length != remaining))) {
+            break;
+        }
+
+        trace_sdhci_adma_loop(dscr.addr, dscr.length, dscr.attr);
+        if (tran) {
+            qemu_sglist_add(&s->dma_sg, dscr.addr, length);
+            remaining -= length;
+        }
+
+        if ((dscr.attr & SDHC_ADMA_ATTR_ACT_MASK) == SDHC_ADMA_ATTR_ACT_LINK) {
+            entry_addr = dscr.addr;
+        } else {
+            entry_addr += dscr.incr;
+        }
+    }
+
+    if (!s->dma_sg.size) {
+        qemu_sglist_destroy(&s->dma_sg);
+        return false;
+    }
+    s->dma_next = entry_addr;
+
+    return sdhci_transfer_blocks(s);
+}
+
 static void sdhci_do_adma(SDHCIState *s)
 {
     unsigned int begin, length;
@@ -752,10 +929,14 @@ static void sdhci_do_adma(SDHCIState *s)
         return;
     }
 
+    if (sdhci_adma_transfer_blocks(s)) {
+        return;
+    }
+
     for (i = 0; i < SDHC_ADMA_DESCS_PER_DELAY; ++i) {
         s->admaerr &= ~SDHC_ADMAERR_LENGTH_MISMATCH;
 
-        get_adma_description(s, &dscr);
+        get_adma_description(s, s->admasysaddr, &dscr);
         trace_sdhci_adma_loop(dscr.addr, dscr.length, dscr.attr);
 
         if ((dscr.attr & SDHC_ADMA_ATTR_VALID) == 0) {
@@ -908,6 +1089,11 @@ static void sdhci_data_transfer(void *opaque)
 {
     SDHCIState *s = (SDHCIState *)opaque;
 
+    if (s->dma_aiocb) {
+        /* The transfer continues when the card completes the request */
+        return;
+    }
+
     if (s->trnmod & SDHC_TRNS_DMA) {
         switch (SDHC_DMA_TYPE(s->hostctl1)) {
         case SDHC_CTRL_SDMA:
@@ -1123,6 +1309,7 @@ static inline void sdhci_reset_write(SDHCIState *s, uint8_t value)
         s->norintsts &= ~SDHC_NIS_CMDCMP;
         break;
     case SDHC_RESET_DATA:
+        sdhci_cancel_transfer_blocks(s);
         s->data_count = 0;
         s->prnsts &= ~(SDHC_SPACE_AVAILABLE | SDHC_DATA_AVAILABLE |
                 SDHC_DOING_READ | SDHC_DOING_WRITE |
@@ -1402,6 +1589,7 @@ void sdhci_common_unrealize(SDHCIState *s)
      * - PCI:       via PCIDeviceClass->exit().
      * However to avoid double-free and/or use-after-free we still nullify
      * this variable (better safe than sorry!). */
+    sdhci_cancel_transfer_blocks(s);
     g_free(s->fifo_buffer);
     s->fifo_buffer = NULL;
 }
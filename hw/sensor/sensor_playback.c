@@ -0,0 +1,427 @@
+/*
+ * Sensor value playback
+ *
+ * Drive the QOM properties of sensor devices (temperatures, PMBus
+ * readings, ...) from a time series file or from a shared memory ring
+ * fed by a host process, without a monitor round trip per reading.
+ *
+ * The time series file has one reading per line:
+ *
+ *   # time(us)  path                        property      value
+ *   0           /machine/peripheral/temp0   temperature   25000
+ *   500000      /machine/peripheral/vr0     vout[0]       1200
+ *
+ * Times are relative to the last reset, on the virtual clock, and must
+ * not go backwards. Readings with the same time are applied together.
+ * With loop=on, the file starts over every "period-us", which must be
+ * longer than the time of its last reading.
+ *
+ * The map file of a ring lists one "path property" pair per line, and
+ * the channel of a ring entry is the index of its line.
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "hw/sensor/sensor_playback.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/host-utils.h"
+#include "qemu/module.h"
+#include "qemu/table-file.h"
+#include "qemu/timer.h"
+#include "sysemu/reset.h"
+#include "sysemu/sysemu.h"
+
+static uint32_t sensor_playback_channel(SensorPlaybackState *s,
+                                        const char *path, const char *property)
+{
+    g_autofree char *key = g_strdup_printf("%s %s", path, property);
+    SensorPlaybackChannel ch;
+    gpointer index;
+
+    if (g_hash_table_lookup_extended(s->channel_index, key, NULL, &index)) {
+        return GPOINTER_TO_UINT(index);
+    }
+
+    ch.path = g_strdup(path);
+    ch.property = g_strdup(property);
+    ch.obj = NULL;
+    g_array_append_val(s->channels, ch);
+    g_hash_table_insert(s->channel_index, g_steal_pointer(&key),
+                        GUINT_TO_POINTER(s->channels->len - 1));
+
+    return s->channels->len - 1;
+}
+
+static void sensor_playback_set(SensorPlaybackState *s, uint32_t channel,
+                                int64_t value)
+{
+    SensorPlaybackChannel *ch;
+    Error *err = NULL;
+
+    if (channel >= s->channels->len) {
+        warn_report_once("sensor-playback: invalid channel %u", channel);
+        return;
+    }
+
+    ch = &g_array_index(s->channels, SensorPlaybackChannel, channel);
+    if (!ch->obj) {
+        return;
+    }
+
+    if (!object_property_set_int(ch->obj, ch->property, value, &err)) {
+        /* Don't report the same error for every reading */
+        error_prepend(&err, "sensor-playback: %s %s: ", ch->path,
+                      ch->property);
+        warn_report_err(err);
+        ch->obj = NULL;
+    }
+}
+
+static void sensor_playback_drain_ring(SensorPlaybackState *s)
+{
+    SensorPlaybackRing *ring = s->ring;
+    uint32_t head = le32_to_cpu(qatomic_load_acquire(&ring->head));
+    uint32_t tail = le32_to_cpu(ring->tail);
+
+    /* The producer overran the ring, skip to the oldest valid entry */
+    if (head - tail > s->ring_size) {
+        tail = head - s->ring_size;
+    }
+
+    while (tail != head) {
+        SensorPlaybackEntry *e = &ring->entries[tail & (s->ring_size - 1)];
+
+        sensor_playback_set(s, le32_to_cpu(e->channel), le64_to_cpu(e->value));
+        tail++;
+    }
+
+    qatomic_store_release(&ring->tail, cpu_to_le32(tail));
+}
+
+static void sensor_playback_timer(void *opaque)
+{
+    SensorPlaybackState *s = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t deadline = INT64_MAX;
+    SensorPlaybackRecord *rec;
+
+    if (s->ring) {
+        sensor_playback_drain_ring(s);
+        deadline = now + s->interval_us * SCALE_US;
+    }
+
+    while (s->next < s->records->len) {
+        rec = &g_array_index(s->records, SensorPlaybackRecord, s->next);
+        if (s->base + rec->time_ns > now) {
+            deadline = MIN(deadline, s->base + rec->time_ns);
+            break;
+        }
+
+        sensor_playback_set(s, rec->channel, rec->value);
+
+        if (++s->next == s->records->len && s->loop) {
+            s->base += s->period_us * SCALE_US;
+            s->next = 0;
+        }
+    }
+
+    if (deadline != INT64_MAX) {
+        timer_mod(s->timer, deadline);
+    }
+}
+
+static void sensor_playback_reset(void *opaque)
+{
+    SensorPlaybackState *s = opaque;
+
+    /*
+     * Let the sensors reset to their defaults before applying the
+     * first readings.
+     */
+    s->next = 0;
+    s->base = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    timer_mod(s->timer, s->base);
+}
+
+static void sensor_playback_machine_done(Notifier *notifier, void *data)
+{
+    SensorPlaybackState *s = container_of(notifier, SensorPlaybackState,
+                                          machine_done);
+    unsigned int i;
+
+    for (i = 0; i < s->channels->len; i++) {
+        SensorPlaybackChannel *ch = &g_array_index(s->channels,
+                                                   SensorPlaybackChannel, i);
+
+        ch->obj = object_resolve_path(ch->path, NULL);
+        if (!ch->obj) {
+            warn_report("sensor-playback: no object at '%s'", ch->path);
+        } else if (!object_property_find(ch->obj, ch->property)) {
+            warn_report("sensor-playback: '%s' has no property '%s'",
+                        ch->path, ch->property);
+            ch->obj = NULL;
+        }
+    }
+
+    sensor_playback_reset(s);
+}
+
+static bool sensor_playback_map_line(void *opaque, char **tokens,
+                                     Error **errp)
+{
+    SensorPlaybackState *s = opaque;
+
+    if (sensor_playback_channel(s, tokens[0], tokens[1]) !=
+        s->channels->len - 1) {
+        error_setg(errp, "duplicate channel '%s %s'", tokens[0], tokens[1]);
+        return false;
+    }
+
+    return true;
+}
+
+static bool sensor_playback_file_line(void *opaque, char **tokens,
+                                      Error **errp)
+{
+    SensorPlaybackState *s = opaque;
+    SensorPlaybackRecord rec;
+    uint64_t time_us;
+
+    if (qemu_strtou64(tokens[0], NULL, 0, &time_us) < 0 ||
+        time_us > INT64_MAX / SCALE_US) {
+        error_setg(errp, "invalid time '%s'", tokens[0]);
+        return false;
+    }
+
+    if (qemu_strtoi64(tokens[3], NULL, 0, &rec.value) < 0) {
+        error_setg(errp, "invalid value '%s'", tokens[3]);
+        return false;
+    }
+
+    rec.time_ns = time_us * SCALE_US;
+    if (s->records->len &&
+        rec.time_ns < g_array_index(s->records, SensorPlaybackRecord,
+                                    s->records->len - 1).time_ns) {
+        error_setg(errp, "time goes backwards");
+        return false;
+    }
+
+    rec.channel = sensor_playback_channel(s, tokens[1], tokens[2]);
+    g_array_append_val(s->records, rec);
+
+    return true;
+}
+
+static bool sensor_playback_map_ring(SensorPlaybackState *s, Error **errp)
+{
+#ifdef CONFIG_POSIX
+    struct stat st;
+    void *ptr;
+    int fd;
+
+    fd = qemu_open(s->ring_path, O_RDWR, errp);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        error_setg_errno(errp, errno, "cannot stat '%s'", s->ring_path);
+        close(fd);
+        return false;
+    }
+
+    if (st.st_size < sizeof(SensorPlaybackRing)) {
+        error_setg(errp, "'%s' is too small for a sensor ring", s->ring_path);
+        close(fd);
+        return false;
+    }
+
+    ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        error_setg_errno(errp, errno, "cannot map '%s'", s->ring_path);
+        return false;
+    }
+    s->ring = ptr;
+    s->ring_len = st.st_size;
+
+    if (le32_to_cpu(s->ring->magic) != SENSOR_PLAYBACK_RING_MAGIC) {
+        error_setg(errp, "'%s' is not a sensor ring", s->ring_path);
+        return false;
+    }
+
+    s->ring_size = le32_to_cpu(s->ring->size);
+    if (!is_power_of_2(s->ring_size) ||
+        sizeof(SensorPlaybackRing) +
+        (uint64_t)s->ring_size * sizeof(SensorPlaybackEntry) > s->ring_len) {
+        error_setg(errp, "invalid size %u for sensor ring '%s'",
+                   s->ring_size, s->ring_path);
+        return false;
+    }
+
+    return true;
+#else
+    error_setg(errp, "sensor rings are not supported on this host");
+    return false;
+#endif
+}
+
+static void sensor_playback_realize(DeviceState *dev, Error **errp)
+{
+    SensorPlaybackState *s = SENSOR_PLAYBACK(dev);
+
+    if (!s->file && !s->ring_path) {
+        error_setg(errp, "'file' or 'ring' property must be set");
+        return;
+    }
+
+    if (!s->ring_path != !s->map) {
+        error_setg(errp, "'ring' and 'map' properties go together");
+        return;
+    }
+
+    if (s->ring_path && !s->interval_us) {
+        error_setg(errp, "'interval-us' must not be 0");
+        return;
+    }
+
+    if (s->map &&
+        !qemu_table_file_load(s->map, 2, sensor_playback_map_line, s, errp)) {
+        return;
+    }
+
+    if (s->file &&
+        !qemu_table_file_load(s->file, 4, sensor_playback_file_line, s,
+                              errp)) {
+        return;
+    }
+
+    if (s->loop && (!s->records->len || s->period_us > INT64_MAX / SCALE_US ||
+                    s->period_us * SCALE_US <=
+                    g_array_index(s->records, SensorPlaybackRecord,
+                                  s->records->len - 1).time_ns)) {
+        error_setg(errp, "'loop' needs a 'period-us' longer than the file");
+        return;
+    }
+
+    if (s->ring_path && !sensor_playback_map_ring(s, errp)) {
+        return;
+    }
+
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, sensor_playback_timer, s);
+
+    /*
+     * The sensors are looked up once the machine is complete, and this
+     * device requires a global reset because it is not plugged to a bus.
+     */
+    s->machine_done.notify = sensor_playback_machine_done;
+    qemu_add_machine_init_done_notifier(&s->machine_done);
+    qemu_register_reset(sensor_playback_reset, dev);
+}
+
+static void sensor_playback_channel_clear(gpointer data)
+{
+    SensorPlaybackChannel *ch = data;
+
+    g_free(ch->path);
+    g_free(ch->property);
+}
+
+static void sensor_playback_init(Object *obj)
+{
+    SensorPlaybackState *s = SENSOR_PLAYBACK(obj);
+
+    s->channels = g_array_new(false, false, sizeof(SensorPlaybackChannel));
+    g_array_set_clear_func(s->channels, sensor_playback_channel_clear);
+    s->channel_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             g_free, NULL);
+    s->records = g_array_new(false, false, sizeof(SensorPlaybackRecord));
+}
+
+static void sensor_playback_finalize(Object *obj)
+{
+    SensorPlaybackState *s = SENSOR_PLAYBACK(obj);
+
+    if (s->timer) {
+        timer_free(s->timer);
+    }
+#ifdef CONFIG_POSIX
+    if (s->ring) {
+        munmap(s->ring, s->ring_len);
+    }
+#endif
+    g_array_free(s->records, true);
+    g_hash_table_destroy(s->channel_index);
+    g_array_free(s->channels, true);
+}
+
+static int sensor_playback_post_load(void *opaque, int version_id)
+{
+    SensorPlaybackState *s = opaque;
+
+    if (s->next > s->records->len) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static const VMStateDescription vmstate_sensor_playback = {
+    .name = TYPE_SENSOR_PLAYBACK,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = sensor_playback_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(next, SensorPlaybackState),
+        VMSTATE_INT64(base, SensorPlaybackState),
+        VMSTATE_TIMER_PTR(timer, SensorPlaybackState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property sensor_playback_properties[] = {
+    DEFINE_PROP_STRING("file", SensorPlaybackState, file),
+    DEFINE_PROP_STRING("ring", SensorPlaybackState, ring_path),
+    DEFINE_PROP_STRING("map", SensorPlaybackState, map),
+    DEFINE_PROP_UINT32("interval-us", SensorPlaybackState, interval_us, 1000),
+    DEFINE_PROP_BOOL("loop", SensorPlaybackState, loop, false),
+    DEFINE_PROP_UINT64("period-us", SensorPlaybackState, period_us, 0),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void sensor_playback_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->desc = "Sensor value playback";
+    dc->realize = sensor_playback_realize;
+    dc->vmsd = &vmstate_sensor_playback;
+    dc->hotpluggable = false;
+    device_class_set_props(dc, sensor_playback_properties);
+    set_bit(DEVICE_CATEGORY_MISC, dc->categories);
+}
+
+static const TypeInfo sensor_playback_info = {
+    .name          = TYPE_SENSOR_PLAYBACK,
+    .parent        = TYPE_DEVICE,
+    .instance_size = sizeof(SensorPlaybackState),
+    .instance_init = sensor_playback_init,
+    .instance_finalize = sensor_playback_finalize,
+    .class_init    = sensor_playback_class_init,
+};
+
+static void sensor_playback_register_types(void)
+{
+    type_register_static(&sensor_playback_info);
+}
+
+type_init(sensor_playback_register_types)
@@ -34,6 +34,7 @@
 
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
+#include "hw/block/flash.h"
 #include "hw/ssi/aspeed_smc.h"
 
 /* CE Type Setting Register */
@@ -449,6 +450,98 @@ static int aspeed_smc_flash_dummies(const AspeedSMCFlash *fl)
     return dummies;
 }
 
+/*
+ * Find the m25p80 flash device wired to the CS line of the segment
+ */
+static DeviceState *aspeed_smc_flash_device(const AspeedSMCFlash *fl)
+{
+    const AspeedSMCState *s = fl->controller;
+    BusChild *kid;
+
+    QTAILQ_FOREACH(kid, &BUS(s->spi)->children, sibling) {
+        DeviceState *dev = kid->child;
+
+        if (object_dynamic_cast(OBJECT(dev), TYPE_M25P80) &&
+            qdev_get_gpio_in_named(dev, SSI_GPIO_CS, 0) ==
+            s->cs_lines[fl->cs]) {
+            return dev;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * In the read modes, with a plain READ or FAST_READ command, the
+ * segment contents are those of the flash storage. Map the storage
+ * directly in the segment so that reads are served at memory
+ * speed. Any other mode goes through the SPI transfers.
+ */
+static void aspeed_smc_flash_update_direct(AspeedSMCFlash *fl)
+{
+    AspeedSMCState *s = fl->controller;
+    AspeedSMCClass *asc = ASPEED_SMC_GET_CLASS(s);
+    uint32_t r_ctrl0 = s->regs[s->r_ctrl0 + fl->cs];
+    int mode = aspeed_smc_flash_mode(fl);
+    MemoryRegion *storage = NULL;
+    AspeedSegments seg;
+
+    if (!s->direct_read) {
+        return;
+    }
+
+    if ((mode == CTRL_READMODE || mode == CTRL_FREADMODE) &&
+        !(s->regs[R_CE_CMD_CTRL] & (0xf << CTRL_ADDR_BYTE0_DISABLE_SHIFT))) {
+        DeviceState *dev = aspeed_smc_flash_device(fl);
+        uint8_t cmd = SPI_OP_READ;
+        int nbytes = aspeed_smc_flash_addr_width(fl);
+
+        if (mode == CTRL_FREADMODE) {
+            cmd = (r_ctrl0 >> CTRL_CMD_SHIFT) & CTRL_CMD_MASK;
+            nbytes += aspeed_smc_flash_dummies(fl);
+        }
+
+        if (dev) {
+            storage = m25p80_get_read_region(dev, cmd, nbytes);
+        }
+    }
+
+    if (!storage && !fl->storage) {
+        return;
+    }
+
+    asc->reg_to_segment(s, s->regs[R_SEG_ADDR0 + fl->cs], &seg);
+
+    memory_region_transaction_begin();
+    if (storage && !fl->storage) {
+        g_autofree char *name = g_strdup_printf(TYPE_ASPEED_SMC_FLASH
+                                                ".direct.%d", fl->cs);
+
+        fl->storage = storage;
+        memory_region_init_alias(&fl->direct, OBJECT(fl), name, storage, 0,
+                                 memory_region_size(storage));
+        memory_region_add_subregion_overlap(&fl->mmio, 0, &fl->direct, 1);
+    }
+    if (storage) {
+        memory_region_set_size(&fl->direct,
+                               MIN(seg.size, memory_region_size(storage)));
+    }
+    memory_region_set_enabled(&fl->direct, storage && seg.size);
+    memory_region_transaction_commit();
+
+    trace_aspeed_smc_flash_direct(fl->cs, !!storage);
+}
+
+static void aspeed_smc_update_direct(AspeedSMCState *s)
+{
+    AspeedSMCClass *asc = ASPEED_SMC_GET_CLASS(s);
+    int i;
+
+    for (i = 0; i < asc->cs_num_max; i++) {
+        aspeed_smc_flash_update_direct(&s->flashes[i]);
+    }
+}
+
 static void aspeed_smc_flash_setup(AspeedSMCFlash *fl, uint32_t addr)
 {
     const AspeedSMCState *s = fl->controller;
@@ -482,23 +575,21 @@ static uint64_t aspeed_smc_flash_read(void *opaque, hwaddr addr, unsigned size)
 {
     AspeedSMCFlash *fl = opaque;
     AspeedSMCState *s = fl->controller;
+    uint8_t buf[4];
     uint64_t ret = 0;
-    int i;
 
     switch (aspeed_smc_flash_mode(fl)) {
     case CTRL_USERMODE:
-        for (i = 0; i < size; i++) {
-            ret |= ssi_transfer(s->spi, 0x0) << (8 * i);
-        }
+        ssi_transfer_buf(s->spi, NULL, buf, size);
+        ret = ldn_le_p(buf, size);
         break;
     case CTRL_READMODE:
     case CTRL_FREADMODE:
         aspeed_smc_flash_select(fl);
         aspeed_smc_flash_setup(fl, addr);
 
-        for (i = 0; i < size; i++) {
-            ret |= ssi_transfer(s->spi, 0x0) << (8 * i);
-        }
+        ssi_transfer_buf(s->spi, NULL, buf, size);
+        ret = ldn_le_p(buf, size);
 
         aspeed_smc_flash_unselect(fl);
         break;
@@ -614,7 +705,7 @@ static void aspeed_smc_flash_write(void *opaque, hwaddr addr, uint64_t data,
 {
     AspeedSMCFlash *fl = opaque;
     AspeedSMCState *s = fl->controller;
-    int i;
+    uint8_t buf[4];
 
     trace_aspeed_smc_flash_write(fl->cs, addr, size, data,
                                  aspeed_smc_flash_mode(fl));
@@ -630,17 +721,15 @@ static void aspeed_smc_flash_write(void *opaque, hwaddr addr, uint64_t data,
             break;
         }
 
-        for (i = 0; i < size; i++) {
-            ssi_transfer(s->spi, (data >> (8 * i)) & 0xff);
-        }
+        stn_le_p(buf, size, data);
+        ssi_transfer_buf(s->spi, buf, NULL, size);
         break;
     case CTRL_WRITEMODE:
         aspeed_smc_flash_select(fl);
         aspeed_smc_flash_setup(fl, addr);
 
-        for (i = 0; i < size; i++) {
-            ssi_transfer(s->spi, (data >> (8 * i)) & 0xff);
-        }
+        stn_le_p(buf, size, data);
+        ssi_transfer_buf(s->spi, buf, NULL, size);
 
         aspeed_smc_flash_unselect(fl);
         break;
@@ -678,6 +767,7 @@ static void aspeed_smc_flash_update_ctrl(AspeedSMCFlash *fl, uint32_t value)
     s->snoop_index = unselect ? SNOOP_OFF : SNOOP_START;
 
     aspeed_smc_flash_do_select(fl, unselect);
+    aspeed_smc_flash_update_direct(fl);
 }
 
 static void aspeed_smc_reset(DeviceState *d)
@@ -706,6 +796,8 @@ static void aspeed_smc_reset(DeviceState *d)
 
     s->snoop_index = SNOOP_OFF;
     s->snoop_dummies = 0;
+
+    aspeed_smc_update_direct(s);
 }
 
 static uint64_t aspeed_smc_read(void *opaque, hwaddr addr, unsigned int size)
@@ -826,6 +918,175 @@ static bool aspeed_smc_inject_read_failure(AspeedSMCState *s)
     }
 }
 
+/*
+ * Bulk DMA transfers are done in chunks to bound the size of the
+ * bounce buffers and of the DRAM mappings.
+ */
+#define ASPEED_SMC_DMA_CHUNK  (64 * KiB)
+
+/*
+ * Sum of the 32-bit LE words of a buffer. Use independent
+ * accumulators so that the compiler can vectorize the loop.
+ */
+static uint32_t aspeed_smc_dma_sum(const uint8_t *buf, uint32_t len)
+{
+    uint32_t sum[4] = { 0 };
+    uint32_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        sum[0] += ldl_le_p(buf + i);
+        sum[1] += ldl_le_p(buf + i + 4);
+        sum[2] += ldl_le_p(buf + i + 8);
+        sum[3] += ldl_le_p(buf + i + 12);
+    }
+    for (; i + 4 <= len; i += 4) {
+        sum[0] += ldl_le_p(buf + i);
+    }
+
+    return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+/*
+ * Find the flash module whose segment fully contains the DMA flash
+ * range and return the offset of the range in the segment.
+ */
+static AspeedSMCFlash *aspeed_smc_dma_flash(AspeedSMCState *s, uint32_t addr,
+                                            uint32_t len, uint32_t *offset)
+{
+    AspeedSMCClass *asc = ASPEED_SMC_GET_CLASS(s);
+    AspeedSegments seg;
+    int cs;
+
+    for (cs = 0; cs < asc->cs_num_max; cs++) {
+        hwaddr start;
+
+        asc->reg_to_segment(s, s->regs[R_SEG_ADDR0 + cs], &seg);
+        if (!seg.size) {
+            continue;
+        }
+
+        start = seg.addr - asc->flash_window_base;
+        if (addr >= start && addr + len <= start + seg.size) {
+            *offset = addr - start;
+            return &s->flashes[cs];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Read a chunk of flash contents for the DMA engine. In read modes,
+ * the SPI command and address are sent once for the whole chunk
+ * instead of once per word as the MMIO path would do.
+ */
+static MemTxResult aspeed_smc_dma_flash_read(AspeedSMCState *s, uint32_t addr,
+                                             uint8_t *buf, uint32_t len)
+{
+    AspeedSMCFlash *fl;
+    uint32_t offset;
+    int mode;
+
+    fl = aspeed_smc_dma_flash(s, addr, len, &offset);
+    if (!fl) {
+        return address_space_read(&s->flash_as, addr, MEMTXATTRS_UNSPECIFIED,
+                                  buf, len);
+    }
+
+    mode = aspeed_smc_flash_mode(fl);
+    if (mode != CTRL_READMODE && mode != CTRL_FREADMODE) {
+        return address_space_read(&s->flash_as, addr, MEMTXATTRS_UNSPECIFIED,
+                                  buf, len);
+    }
+
+    aspeed_smc_flash_select(fl);
+    aspeed_smc_flash_setup(fl, offset);
+    ssi_transfer_buf(s->spi, NULL, buf, len);
+    aspeed_smc_flash_unselect(fl);
+
+    return MEMTX_OK;
+}
+
+/*
+ * Bulk version of the checksum loop. If a chunk fails, the DMA
+ * registers reflect the progress made and the word loop resumes from
+ * there.
+ */
+static void aspeed_smc_dma_checksum_bulk(AspeedSMCState *s)
+{
+    g_autofree uint8_t *buf = NULL;
+
+    if (!s->regs[R_DMA_LEN]) {
+        return;
+    }
+
+    buf = g_malloc(MIN(s->regs[R_DMA_LEN], ASPEED_SMC_DMA_CHUNK));
+
+    while (s->regs[R_DMA_LEN]) {
+        uint32_t len = MIN(s->regs[R_DMA_LEN], ASPEED_SMC_DMA_CHUNK);
+
+        if (aspeed_smc_dma_flash_read(s, s->regs[R_DMA_FLASH_ADDR], buf,
+                                      len) != MEMTX_OK) {
+            return;
+        }
+
+        s->regs[R_DMA_CHECKSUM] += aspeed_smc_dma_sum(buf, len);
+        s->regs[R_DMA_FLASH_ADDR] += len;
+        s->regs[R_DMA_LEN] -= len;
+    }
+}
+
+/*
+ * Bulk version of the DMA read/write loop. The DRAM side is mapped
+ * and the flash side is accessed a chunk at a time.
+ */
+static bool aspeed_smc_dma_rw_bulk(AspeedSMCState *s)
+{
+    bool is_write = !!(s->regs[R_DMA_CTRL] & DMA_CTRL_WRITE);
+
+    while (s->regs[R_DMA_LEN]) {
+        hwaddr len = MIN(s->regs[R_DMA_LEN], ASPEED_SMC_DMA_CHUNK);
+        MemTxResult result;
+        uint8_t *dram;
+
+        dram = address_space_map(&s->dram_as, s->regs[R_DMA_DRAM_ADDR], &len,
+                                 !is_write, MEMTXATTRS_UNSPECIFIED);
+        if (!dram) {
+            return false;
+        }
+
+        len = QEMU_ALIGN_DOWN(len, 4);
+        if (!len) {
+            address_space_unmap(&s->dram_as, dram, 0, !is_write, 0);
+            return false;
+        }
+
+        if (is_write) {
+            result = address_space_write(&s->flash_as,
+                                         s->regs[R_DMA_FLASH_ADDR],
+                                         MEMTXATTRS_UNSPECIFIED, dram, len);
+        } else {
+            result = aspeed_smc_dma_flash_read(s, s->regs[R_DMA_FLASH_ADDR],
+                                               dram, len);
+        }
+
+        if (result != MEMTX_OK) {
+            address_space_unmap(&s->dram_as, dram, len, !is_write, 0);
+            return false;
+        }
+
+        s->regs[R_DMA_CHECKSUM] += aspeed_smc_dma_sum(dram, len);
+        address_space_unmap(&s->dram_as, dram, len, !is_write,
+                            is_write ? 0 : len);
+
+        s->regs[R_DMA_FLASH_ADDR] += len;
+        s->regs[R_DMA_DRAM_ADDR] += len;
+        s->regs[R_DMA_LEN] -= len;
+    }
+
+    return true;
+}
+
 /*
  * Accumulate the result of the reads to provide a checksum that will
  * be used to validate the read timing settings.
@@ -844,6 +1105,10 @@ static void aspeed_smc_dma_checksum(AspeedSMCState *s)
         aspeed_smc_dma_calibration(s);
     }
 
+    if (s->dma_bulk) {
+        aspeed_smc_dma_checksum_bulk(s);
+    }
+
     while (s->regs[R_DMA_LEN]) {
         data = address_space_ldl_le(&s->flash_as, s->regs[R_DMA_FLASH_ADDR],
                                     MEMTXATTRS_UNSPECIFIED, &result);
@@ -879,6 +1144,11 @@ static void aspeed_smc_dma_rw(AspeedSMCState *s)
                             s->regs[R_DMA_FLASH_ADDR],
                             s->regs[R_DMA_DRAM_ADDR],
                             s->regs[R_DMA_LEN]);
+
+    if (s->dma_bulk && aspeed_smc_dma_rw_bulk(s)) {
+        return;
+    }
+
     while (s->regs[R_DMA_LEN]) {
         if (s->regs[R_DMA_CTRL] & DMA_CTRL_WRITE) {
             data = address_space_ldl_le(&s->dram_as, s->regs[R_DMA_DRAM_ADDR],
@@ -1042,6 +1312,7 @@ static void aspeed_smc_write(void *opaque, hwaddr addr, uint64_t data,
          addr < s->r_timings + asc->nregs_timings) ||
         addr == s->r_ce_ctrl) {
         s->regs[addr] = value;
+        aspeed_smc_update_direct(s);
     } else if (addr >= s->r_ctrl0 && addr < s->r_ctrl0 + asc->cs_num_max) {
         int cs = addr - s->r_ctrl0;
         aspeed_smc_flash_update_ctrl(&s->flashes[cs], value);
@@ -1051,9 +1322,11 @@ static void aspeed_smc_write(void *opaque, hwaddr addr, uint64_t data,
 
         if (value != s->regs[R_SEG_ADDR0 + cs]) {
             aspeed_smc_flash_set_segment(s, cs, value);
+            aspeed_smc_flash_update_direct(&s->flashes[cs]);
         }
     } else if (addr == R_CE_CMD_CTRL) {
         s->regs[addr] = value & 0xff;
+        aspeed_smc_update_direct(s);
     } else if (addr == R_DUMMY_DATA) {
         s->regs[addr] = value & 0xff;
     } else if (aspeed_smc_has_wdt_control(asc) && addr == R_FMC_WDT2_CTRL) {
@@ -1192,10 +1465,17 @@ static void aspeed_smc_realize(DeviceState *dev, Error **errp)
     }
 }
 
+static int aspeed_smc_post_load(void *opaque, int version_id)
+{
+    aspeed_smc_update_direct(ASPEED_SMC(opaque));
+    return 0;
+}
+
 static const VMStateDescription vmstate_aspeed_smc = {
     .name = "aspeed.smc",
     .version_id = 2,
     .minimum_version_id = 2,
+    .post_load = aspeed_smc_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, AspeedSMCState, ASPEED_SMC_R_MAX),
         VMSTATE_UINT8(snoop_index, AspeedSMCState),
@@ -1206,6 +1486,8 @@ static const VMStateDescription vmstate_aspeed_smc = {
 
 static Property aspeed_smc_properties[] = {
     DEFINE_PROP_BOOL("inject-failure", AspeedSMCState, inject_failure, false),
+    DEFINE_PROP_BOOL("dma-bulk", AspeedSMCState, dma_bulk, true),
+    DEFINE_PROP_BOOL("direct-read", AspeedSMCState, direct_read, true),
     DEFINE_PROP_LINK("dram", AspeedSMCState, dram_mr,
                      TYPE_MEMORY_REGION, MemoryRegion *),
     DEFINE_PROP_END_OF_LIST(),
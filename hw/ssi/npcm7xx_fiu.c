@@ -148,6 +148,7 @@ static uint64_t npcm7xx_fiu_flash_read(void *opaque, hwaddr addr,
 {
     NPCM7xxFIUFlash *f = opaque;
     NPCM7xxFIUState *fiu = f->fiu;
+    uint8_t buf[8];
     uint64_t value = 0;
     uint32_t drd_cfg;
     int dummy_cycles;
@@ -187,9 +188,8 @@ static uint64_t npcm7xx_fiu_flash_read(void *opaque, hwaddr addr,
         ssi_transfer(fiu->spi, 0);
     }
 
-    for (i = 0; i < size; i++) {
-        value = deposit64(value, 8 * i, 8, ssi_transfer(fiu->spi, 0));
-    }
+    ssi_transfer_buf(fiu->spi, NULL, buf, size);
+    value = ldn_le_p(buf, size);
 
     trace_npcm7xx_fiu_flash_read(DEVICE(fiu)->canonical_path, fiu->active_cs,
                                  addr, size, value);
@@ -205,9 +205,9 @@ static void npcm7xx_fiu_flash_write(void *opaque, hwaddr addr, uint64_t v,
 {
     NPCM7xxFIUFlash *f = opaque;
     NPCM7xxFIUState *fiu = f->fiu;
+    uint8_t buf[8];
     uint32_t dwr_cfg;
     unsigned cs_id;
-    int i;
 
     if (fiu->active_cs != -1) {
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -239,9 +239,8 @@ static void npcm7xx_fiu_flash_write(void *opaque, hwaddr addr, uint64_t v,
         break;
     }
 
-    for (i = 0; i < size; i++) {
-        ssi_transfer(fiu->spi, extract64(v, i * 8, 8));
-    }
+    stn_le_p(buf, size, v);
+    ssi_transfer_buf(fiu->spi, buf, NULL, size);
 
     npcm7xx_fiu_deselect(fiu);
 }
@@ -321,8 +320,10 @@ static void send_dummy_bits(SSIBus *spi, uint32_t uma_cfg, uint32_t uma_cmd)
 static void npcm7xx_fiu_uma_transaction(NPCM7xxFIUState *s)
 {
     uint32_t uma_cts = s->regs[NPCM7XX_FIU_UMA_CTS];
+    uint8_t buf[16];
     uint32_t uma_cfg;
-    unsigned int i;
+    unsigned int len;
+    unsigned int i, j;
 
     /* SW_CS means the CS is already forced low, so don't touch it. */
     if (uma_cts & FIU_UMA_CTS_SW_CS) {
@@ -341,26 +342,33 @@ static void npcm7xx_fiu_uma_transaction(NPCM7xxFIUState *s)
                  s->regs[NPCM7XX_FIU_UMA_ADDR]);
 
     /* Write data, if present. */
-    for (i = 0; i < FIU_UMA_CFG_WDATSIZ(uma_cfg); i++) {
-        unsigned int reg =
-            (i < 16) ? (NPCM7XX_FIU_UMA_DW0 + i / 4) : NPCM7XX_FIU_UMA_DW3;
-        unsigned int field = (i % 4) * 8;
-
-        ssi_transfer(s->spi, extract32(s->regs[reg], field, 8));
+    for (i = 0; i < FIU_UMA_CFG_WDATSIZ(uma_cfg); i += len) {
+        len = MIN(FIU_UMA_CFG_WDATSIZ(uma_cfg) - i, sizeof(buf));
+        for (j = 0; j < len; j++) {
+            unsigned int k = i + j;
+            unsigned int reg = (k < 16) ? (NPCM7XX_FIU_UMA_DW0 + k / 4)
+                                        : NPCM7XX_FIU_UMA_DW3;
+            unsigned int field = (k % 4) * 8;
+
+            buf[j] = extract32(s->regs[reg], field, 8);
+        }
+        ssi_transfer_buf(s->spi, buf, NULL, len);
     }
 
     /* Send dummy bits, if present. */
     send_dummy_bits(s->spi, uma_cfg, s->regs[NPCM7XX_FIU_UMA_CMD]);
 
     /* Read data, if present. */
-    for (i = 0; i < FIU_UMA_CFG_RDATSIZ(uma_cfg); i++) {
-        unsigned int reg = NPCM7XX_FIU_UMA_DR0 + i / 4;
-        unsigned int field = (i % 4) * 8;
-        uint8_t c;
-
-        c = ssi_transfer(s->spi, 0);
-        if (reg <= NPCM7XX_FIU_UMA_DR3) {
-            s->regs[reg] = deposit32(s->regs[reg], field, 8, c);
+    for (i = 0; i < FIU_UMA_CFG_RDATSIZ(uma_cfg); i += len) {
+        len = MIN(FIU_UMA_CFG_RDATSIZ(uma_cfg) - i, sizeof(buf));
+        ssi_transfer_buf(s->spi, NULL, buf, len);
+        for (j = 0; j < len; j++) {
+            unsigned int reg = NPCM7XX_FIU_UMA_DR0 + (i + j) / 4;
+            unsigned int field = ((i + j) % 4) * 8;
+
+            if (reg <= NPCM7XX_FIU_UMA_DR3) {
+                s->regs[reg] = deposit32(s->regs[reg], field, 8, buf[j]);
+            }
         }
     }
 
@@ -42,13 +42,20 @@ static void ssi_cs_default(void *opaque, int n, int level)
     s->cs = cs;
 }
 
+static bool ssi_peripheral_selected(SSIPeripheral *dev)
+{
+    SSIPeripheralClass *ssc = SSI_PERIPHERAL_GET_CLASS(dev);
+
+    return (dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
+        (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
+        ssc->cs_polarity == SSI_CS_NONE;
+}
+
 static uint32_t ssi_transfer_raw_default(SSIPeripheral *dev, uint32_t val)
 {
     SSIPeripheralClass *ssc = SSI_PERIPHERAL_GET_CLASS(dev);
 
-    if ((dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
-            (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
-            ssc->cs_polarity == SSI_CS_NONE) {
+    if (ssi_peripheral_selected(dev)) {
         return ssc->transfer(dev, val);
     }
     return 0;
@@ -123,6 +130,102 @@ uint32_t ssi_transfer(SSIBus *bus, uint32_t val)
     return r;
 }
 
+/*
+ * Returns true if the peripheral takes part in the transfers of the
+ * bus. Peripherals with a raw transfer handler always do.
+ */
+static bool ssi_peripheral_active(SSIPeripheral *dev)
+{
+    SSIPeripheralClass *ssc = SSI_PERIPHERAL_GET_CLASS(dev);
+
+    return ssc->transfer_raw != ssi_transfer_raw_default ||
+        ssi_peripheral_selected(dev);
+}
+
+static void ssi_transfer_buf_peripheral(SSIPeripheral *dev, const uint8_t *tx,
+                                        uint8_t *rx, uint32_t len)
+{
+    SSIPeripheralClass *ssc = SSI_PERIPHERAL_GET_CLASS(dev);
+    uint32_t i, r;
+
+    if (ssc->transfer_raw == ssi_transfer_raw_default && ssc->transfer_buf) {
+        ssc->transfer_buf(dev, tx, rx, len);
+        return;
+    }
+
+    for (i = 0; i < len; i++) {
+        r = ssc->transfer_raw(dev, tx ? tx[i] : 0);
+        if (rx) {
+            rx[i] = r;
+        }
+    }
+}
+
+/* OR the bytes received from @dev into @rx, as ssi_transfer() does */
+static void ssi_transfer_buf_merge(SSIPeripheral *dev, const uint8_t *tx,
+                                   uint8_t *rx, uint32_t len)
+{
+    uint8_t tmp[64];
+    uint32_t i, n;
+
+    if (!rx) {
+        ssi_transfer_buf_peripheral(dev, tx, NULL, len);
+        return;
+    }
+
+    for (; len; len -= n) {
+        n = MIN(len, sizeof(tmp));
+        ssi_transfer_buf_peripheral(dev, tx, tmp, n);
+        for (i = 0; i < n; i++) {
+            rx[i] |= tmp[i];
+        }
+        rx += n;
+        if (tx) {
+            tx += n;
+        }
+    }
+}
+
+void ssi_transfer_buf(SSIBus *bus, const uint8_t *tx, uint8_t *rx,
+                      uint32_t len)
+{
+    BusState *b = BUS(bus);
+    BusChild *kid;
+    SSIPeripheral *first = NULL;
+    bool merge = false;
+
+    QTAILQ_FOREACH(kid, &b->children, sibling) {
+        SSIPeripheral *peripheral = SSI_PERIPHERAL(kid->child);
+
+        if (!ssi_peripheral_active(peripheral)) {
+            continue;
+        }
+
+        /* The common case: a single peripheral drives the bus */
+        if (!first) {
+            first = peripheral;
+            continue;
+        }
+
+        if (!merge) {
+            merge = true;
+            if (rx) {
+                memset(rx, 0, len);
+            }
+            ssi_transfer_buf_merge(first, tx, rx, len);
+        }
+        ssi_transfer_buf_merge(peripheral, tx, rx, len);
+    }
+
+    if (!first) {
+        if (rx) {
+            memset(rx, 0, len);
+        }
+    } else if (!merge) {
+        ssi_transfer_buf_peripheral(first, tx, rx, len);
+    }
+}
+
 const VMStateDescription vmstate_ssi_peripheral = {
     .name = "SSISlave",
     .version_id = 1,
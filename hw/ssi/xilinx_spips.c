@@ -1196,6 +1196,18 @@ static void lqspi_load_cache(void *opaque, hwaddr addr)
 
         DB_PRINT_L(0, "starting QSPI data read\n");
 
+        /*
+         * With a single bus past the command, address and dummy
+         * phases, the data bytes are received as is. Read the whole
+         * cache line at once.
+         */
+        if (num_effective_busses(s) == 1 && s->snoop_state == SNOOP_NONE &&
+            !s->rx_discard && !s->link_state_next_when &&
+            !(s->regs[R_CMND] & R_CMND_RXFIFO_DRAIN)) {
+            ssi_transfer_buf(s->spi[0], NULL, q->lqspi_buf, LQSPI_CACHE_SIZE);
+            cache_entry = LQSPI_CACHE_SIZE;
+        }
+
         while (cache_entry < LQSPI_CACHE_SIZE) {
             for (i = 0; i < 64; ++i) {
                 tx_data_bytes(&s->tx_fifo, 0, 1, false);
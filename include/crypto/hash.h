@@ -25,6 +25,13 @@
 
 /* See also "QCryptoHashAlgorithm" defined in qapi/crypto.json */
 
+typedef struct QCryptoHash QCryptoHash;
+struct QCryptoHash {
+    QCryptoHashAlgorithm alg;
+    void *opaque;
+    void *driver;
+};
+
 /**
  * qcrypto_hash_supports:
  * @alg: the hash algorithm
@@ -189,4 +196,84 @@ int qcrypto_hash_base64(QCryptoHashAlgorithm alg,
                         char **base64,
                         Error **errp);
 
+/**
+ * qcrypto_hash_new:
+ * @alg: the hash algorithm
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Creates a new hash context with the algorithm @alg,
+ * to compute a digest over data provided incrementally
+ * with qcrypto_hash_updatev()
+ *
+ * Note: must use qcrypto_hash_free() to release the
+ * returned hash object when no longer required
+ *
+ * Returns: a new hash object, or NULL on error
+ */
+QCryptoHash *qcrypto_hash_new(QCryptoHashAlgorithm alg, Error **errp);
+
+/**
+ * qcrypto_hash_free:
+ * @hash: the hash object
+ *
+ * Release the memory associated with @hash that was
+ * previously allocated by qcrypto_hash_new()
+ */
+void qcrypto_hash_free(QCryptoHash *hash);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(QCryptoHash, qcrypto_hash_free)
+
+/**
+ * qcrypto_hash_updatev:
+ * @hash: the hash object
+ * @iov: the array of memory regions to hash
+ * @niov: the length of @iov
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Adds the data of all the memory regions present in
+ * @iov to the digest computed by @hash
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qcrypto_hash_updatev(QCryptoHash *hash,
+                         const struct iovec *iov,
+                         size_t niov,
+                         Error **errp);
+
+/**
+ * qcrypto_hash_update:
+ * @hash: the hash object
+ * @buf: the memory region to hash
+ * @len: the length of @buf
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Adds the data of the memory region @buf of length
+ * @len to the digest computed by @hash
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qcrypto_hash_update(QCryptoHash *hash,
+                        const char *buf,
+                        size_t len,
+                        Error **errp);
+
+/**
+ * qcrypto_hash_finalize_bytes:
+ * @hash: the hash object
+ * @result: pointer to hold output hash
+ * @resultlen: pointer to hold length of @result
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Completes the digest of all the data added to @hash.
+ * @result and @resultlen follow the same rules as for
+ * qcrypto_hash_bytesv(). No more data can be added to
+ * @hash afterwards, it can only be freed.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qcrypto_hash_finalize_bytes(QCryptoHash *hash,
+                                uint8_t **result,
+                                size_t *resultlen,
+                                Error **errp);
+
 #endif /* QCRYPTO_HASH_H */
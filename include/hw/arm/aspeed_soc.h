@@ -50,6 +50,7 @@ struct AspeedSoCState {
     ARMCPU cpu[ASPEED_CPUS_NUM];
     A15MPPrivState     a7mpcore;
     ARMv7MState        armv7m;
+    MemoryRegion *memory;
     MemoryRegion *dram_mr;
     MemoryRegion sram;
     AspeedVICState vic;
@@ -76,6 +77,9 @@ struct AspeedSoCState {
     AspeedLPCState lpc;
     AspeedPECIState peci;
     uint32_t uart_default;
+    uint32_t serial_base;
+    /* RAMBlock name of the SRAM, "aspeed.sram" when unset */
+    char *sram_name;
     Clock *sysclk;
 };
 
@@ -168,5 +172,8 @@ enum {
 
 qemu_irq aspeed_soc_get_irq(AspeedSoCState *s, int dev);
 void aspeed_soc_uart_init(AspeedSoCState *s);
+void aspeed_mmio_map(AspeedSoCState *s, SysBusDevice *dev, int n, hwaddr addr);
+void aspeed_mmio_map_unimplemented(AspeedSoCState *s, const char *name,
+                                   hwaddr addr, uint64_t size);
 
 #endif /* ASPEED_SOC_H */
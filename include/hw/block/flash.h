@@ -44,6 +44,25 @@ PFlashCFI02 *pflash_cfi02_register(hwaddr base,
                                    uint16_t unlock_addr1,
                                    int be);
 
+/* m25p80.c */
+
+#define TYPE_M25P80 "m25p80-generic"
+
+/*
+ * Returns the storage of the flash device if the data read after the
+ * @cmd read command followed by @nbytes address and dummy bytes are
+ * the storage contents at the given address. Returns NULL otherwise.
+ */
+MemoryRegion *m25p80_get_read_region(DeviceState *dev, uint8_t cmd,
+                                     int nbytes);
+
+/*
+ * Returns the storage of the flash device, a ROM device region which
+ * can be mapped read-only by boards booting from the flash contents.
+ * In the lazy mode, the whole contents are loaded first.
+ */
+MemoryRegion *m25p80_get_storage(DeviceState *dev);
+
 /* nand.c */
 DeviceState *nand_init(BlockBackend *blk, int manf_id, int chip_id);
 void nand_setpins(DeviceState *dev, uint8_t cle, uint8_t ale,
@@ -34,6 +34,7 @@
 #include "qom/object.h"
 
 #define UART_FIFO_LENGTH    16      /* 16550A Fifo Length */
+#define SERIAL_TX_BATCH_SIZE 4096
 
 struct SerialState {
     DeviceState parent;
@@ -78,6 +79,13 @@ struct SerialState {
 
     QEMUTimer *modem_status_poll;
     MemoryRegion io;
+
+    /* Transmitted bytes not written to the chardev yet, in batch mode */
+    bool tx_batch;
+    uint8_t *tx_batch_buf;
+    uint32_t tx_batch_len;
+    QEMUBH *tx_batch_bh;
+    guint tx_batch_watch;
 };
 typedef struct SerialState SerialState;
 
@@ -70,6 +70,7 @@ struct AspeedGPIOState {
     /*< public >*/
     MemoryRegion iomem;
     int pending;
+    bool events;
     qemu_irq irq;
     qemu_irq gpios[ASPEED_GPIO_MAX_NR_SETS][ASPEED_GPIOS_PER_SET];
 
@@ -93,4 +94,26 @@ struct AspeedGPIOState {
     } sets[ASPEED_GPIO_MAX_NR_SETS];
 };
 
+/**
+ * aspeed_gpio_get_set: Read the pin levels of a GPIO set
+ * @s: the GPIO controller
+ * @set_idx: index of the set, as in the "gpio-set<N>" properties
+ *
+ * Returns the data value of all the pins of the set, one bit per pin.
+ */
+uint32_t aspeed_gpio_get_set(AspeedGPIOState *s, uint32_t set_idx);
+
+/**
+ * aspeed_gpio_set_set: Drive several pins of a GPIO set at once
+ * @s: the GPIO controller
+ * @set_idx: index of the set, as in the "gpio-set<N>" properties
+ * @mask: the pins to change
+ * @value: the new levels of the pins in @mask
+ *
+ * This is the equivalent of setting the "gpio<Group><n>" property of each
+ * pin in @mask, with a single update of the set.
+ */
+void aspeed_gpio_set_set(AspeedGPIOState *s, uint32_t set_idx, uint32_t mask,
+                         uint32_t value);
+
 #endif /* ASPEED_GPIO_H */
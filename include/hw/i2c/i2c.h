@@ -37,6 +37,20 @@ struct I2CSlaveClass {
      */
     uint8_t (*recv)(I2CSlave *s);
 
+    /*
+     * Master to slave, block variant of send.  Returns the number of
+     * bytes accepted; a value lower than len means the following byte
+     * was NAKed.  This may be NULL, the I2C core then calls send for
+     * each byte.
+     */
+    int (*send_buf)(I2CSlave *s, const uint8_t *buf, int len);
+
+    /*
+     * Slave to master, block variant of recv.  This cannot fail either.
+     * This may be NULL, the I2C core then calls recv for each byte.
+     */
+    void (*recv_buf)(I2CSlave *s, uint8_t *buf, int len);
+
     /*
      * Notify the slave of a bus state change.  For start event,
      * returns non-zero to NAK an operation.  For other events the
@@ -138,6 +152,33 @@ void i2c_bus_release(I2CBus *bus);
 int i2c_send(I2CBus *bus, uint8_t data);
 int i2c_send_async(I2CBus *bus, uint8_t data);
 uint8_t i2c_recv(I2CBus *bus);
+
+/**
+ * i2c_send_buf: send a block of data to the current slave
+ *
+ * @bus: #I2CBus to be used
+ * @buf: data to send
+ * @len: number of bytes in @buf
+ *
+ * The transfer stops at the first byte the slave NAKs. Slaves
+ * implementing the send_buf method get the whole block in one call.
+ *
+ * Returns: the number of bytes acknowledged by the slave. A value
+ * lower than @len means byte number (return value) was NAKed.
+ */
+int i2c_send_buf(I2CBus *bus, const uint8_t *buf, int len);
+
+/**
+ * i2c_recv_buf: receive a block of data from the current slave
+ *
+ * @bus: #I2CBus to be used
+ * @buf: buffer receiving the data
+ * @len: number of bytes to receive
+ *
+ * Slaves implementing the recv_buf method fill the whole block in one
+ * call.
+ */
+void i2c_recv_buf(I2CBus *bus, uint8_t *buf, int len);
 bool i2c_scan_bus(I2CBus *bus, uint8_t address, bool broadcast,
                   I2CNodeList *current_devs);
 
@@ -62,6 +62,13 @@ struct SMBusDeviceClass {
      * return 0xff in that case.
      */
     uint8_t (*receive_byte)(SMBusDevice *dev);
+
+    /*
+     * Block variant of receive_byte, used when the master reads several
+     * bytes at once.  This may be NULL, receive_byte is then called for
+     * each byte.
+     */
+    void (*receive_buf)(SMBusDevice *dev, uint8_t *buf, int len);
 };
 
 #define SMBUS_DATA_MAX_LEN 34  /* command + len + 32 bytes of data.  */
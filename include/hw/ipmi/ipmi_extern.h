@@ -0,0 +1,57 @@
+/*
+ * IPMI external BMC protocol
+ *
+ * Copyright (c) 2015 Corey Minyard, MontaVista Software, LLC
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef HW_IPMI_EXTERN_H
+#define HW_IPMI_EXTERN_H
+
+/*
+ * The OpenIPMI lanserv serial "VM" protocol. Messages and commands are
+ * byte-stuffed and end with a marker character.
+ */
+#define VM_MSG_CHAR        0xA0 /* Marks end of message */
+#define VM_CMD_CHAR        0xA1 /* Marks end of a command */
+#define VM_ESCAPE_CHAR     0xAA /* Set bit 4 from the next byte to 0 */
+
+#define VM_PROTOCOL_VERSION        1
+#define VM_CMD_VERSION             0xff /* A version number byte follows */
+#define VM_CMD_NOATTN              0x00
+#define VM_CMD_ATTN                0x01
+#define VM_CMD_ATTN_IRQ            0x02
+#define VM_CMD_POWEROFF            0x03
+#define VM_CMD_RESET               0x04
+#define VM_CMD_ENABLE_IRQ          0x05 /* Enable/disable the messaging irq */
+#define VM_CMD_DISABLE_IRQ         0x06
+#define VM_CMD_SEND_NMI            0x07
+#define VM_CMD_CAPABILITIES        0x08
+#define   VM_CAPABILITIES_POWER    0x01
+#define   VM_CAPABILITIES_RESET    0x02
+#define   VM_CAPABILITIES_IRQ      0x04
+#define   VM_CAPABILITIES_NMI      0x08
+#define   VM_CAPABILITIES_ATTN     0x10
+#define   VM_CAPABILITIES_GRACEFUL_SHUTDOWN 0x20
+#define VM_CMD_GRACEFUL_SHUTDOWN   0x09
+
+/*
+ * The framed variant carries the same messages and commands without
+ * stuffing or checksum, for links between two QEMU instances. Each frame
+ * is a header followed by the payload:
+ *
+ *   byte 0    frame type
+ *   byte 1    message id, echoed in the response
+ *   byte 2-3  payload length, little endian
+ *
+ * The payload of a message frame is the netfn, command and data of the
+ * request, or the netfn, command, completion code and data of the
+ * response. The payload of a command frame is one of the VM_CMD_* codes
+ * and its argument, if any.
+ */
+#define IPMI_EXTERN_FRAME_HDR_SIZE 4
+#define IPMI_EXTERN_FRAME_MSG      0x01
+#define IPMI_EXTERN_FRAME_CMD      0x02
+
+#endif /* HW_IPMI_EXTERN_H */
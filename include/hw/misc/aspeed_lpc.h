@@ -11,6 +11,9 @@
 #define ASPEED_LPC_H
 
 #include "hw/sysbus.h"
+#include "hw/ipmi/ipmi.h"
+#include "hw/ipmi/ipmi_extern.h"
+#include "chardev/char-fe.h"
 
 #include <stdint.h>
 
@@ -29,6 +32,32 @@ enum aspeed_lpc_subdevice {
 
 #define ASPEED_LPC_NR_SUBDEVS   5
 
+#define ASPEED_KCS_NR_CHANNELS  4
+
+/*
+ * The host side of a KCS channel. It runs the KCS transfers of the IPMI
+ * requests received as frames on the chardev, and sends the responses
+ * back the same way.
+ */
+typedef struct AspeedKCSBridge {
+    struct AspeedLPCState *lpc;
+    unsigned int id;
+    CharBackend chr;
+
+    uint8_t phase;
+    uint8_t msg_id;
+    uint8_t req[MAX_IPMI_MSG_SIZE];
+    uint32_t req_len;
+    uint32_t req_pos;
+    uint8_t rsp[MAX_IPMI_MSG_SIZE];
+    uint32_t rsp_len;
+
+    /* The frame being received */
+    uint8_t inhdr[IPMI_EXTERN_FRAME_HDR_SIZE];
+    uint8_t inbuf[MAX_IPMI_MSG_SIZE];
+    uint32_t inpos;
+} AspeedKCSBridge;
+
 typedef struct AspeedLPCState {
     /* <private> */
     SysBusDevice parent;
@@ -42,6 +71,8 @@ typedef struct AspeedLPCState {
 
     uint32_t regs[ASPEED_LPC_NR_REGS];
     uint32_t hicr7;
+
+    AspeedKCSBridge kcs[ASPEED_KCS_NR_CHANNELS];
 } AspeedLPCState;
 
 #endif /* ASPEED_LPC_H */
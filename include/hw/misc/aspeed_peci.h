@@ -11,6 +11,8 @@
 #define ASPEED_PECI_H
 
 #include "hw/sysbus.h"
+#include "hw/peci/peci.h"
+#include "qemu/timer.h"
 
 #define TYPE_ASPEED_PECI "aspeed.peci"
 OBJECT_DECLARE_TYPE(AspeedPECIState, AspeedPECIClass, ASPEED_PECI);
@@ -25,6 +27,19 @@ struct AspeedPECIState {
     qemu_irq irq;
 
     uint32_t regs[ASPEED_PECI_NR_REGS];
+
+    PECIBus *bus;
+    PECIRequest req;
+    QEMUTimer timer;
+    /* A command is in progress */
+    bool busy;
+    /* The client answered, ok if one was at the address */
+    bool answered;
+    bool ok;
+    /* The message time elapsed, waiting for the client */
+    bool timeout;
+
+    uint32_t bit_rate;
 };
 
 struct AspeedPECIClass {
@@ -11,6 +11,7 @@
 
 #include "hw/sysbus.h"
 #include "qom/object.h"
+#include "sysemu/hostmem.h"
 
 #define TYPE_ASPEED_XDMA "aspeed.xdma"
 #define TYPE_ASPEED_2400_XDMA TYPE_ASPEED_XDMA "-ast2400"
@@ -21,12 +22,33 @@ OBJECT_DECLARE_TYPE(AspeedXDMAState, AspeedXDMAClass, ASPEED_XDMA)
 #define ASPEED_XDMA_NUM_REGS (ASPEED_XDMA_REG_SIZE / sizeof(uint32_t))
 #define ASPEED_XDMA_REG_SIZE 0x7C
 
+/* Commands are four little-endian 64-bit words in BMC memory */
+#define ASPEED_XDMA_CMD_SIZE 32
+
+typedef struct AspeedXDMACmd {
+    uint64_t host_addr;
+    uint32_t bmc_addr;
+    uint32_t host_pitch;
+    uint32_t bmc_pitch;
+    uint32_t line_size;
+    uint32_t line_no;
+    bool upstream;
+    bool irq_bmc;
+} AspeedXDMACmd;
+
 struct AspeedXDMAState {
     SysBusDevice parent;
 
     MemoryRegion iomem;
     qemu_irq irq;
 
+    MemoryRegion *dram_mr;
+    AddressSpace dram_as;
+
+    /* Host memory seen through the PCIe window, if any */
+    HostMemoryBackend *hostmem;
+    AddressSpace host_as;
+
     char bmc_cmdq_readp_set;
     uint32_t regs[ASPEED_XDMA_NUM_REGS];
 };
@@ -34,6 +56,7 @@ struct AspeedXDMAState {
 struct AspeedXDMAClass {
     SysBusDeviceClass parent_class;
 
+    uint8_t cmdq_addr;
     uint8_t cmdq_endp;
     uint8_t cmdq_wrp;
     uint8_t cmdq_rdp;
@@ -41,6 +64,14 @@ struct AspeedXDMAClass {
     uint32_t intr_ctrl_mask;
     uint8_t intr_status;
     uint32_t intr_complete;
+    uint32_t intr_us_complete;
+    uint32_t intr_ds_complete;
+
+    /* Queue pointer units per command */
+    uint8_t cmdq_entry_size;
+    /* BMC addresses are offsets in DRAM */
+    uint32_t bmc_addr_mask;
+    void (*decode_cmd)(const uint64_t *raw, AspeedXDMACmd *cmd);
 };
 
 #endif /* ASPEED_XDMA_H */
@@ -16,12 +16,28 @@ OBJECT_DECLARE_SIMPLE_TYPE(FTGMAC100State, FTGMAC100)
 
 #include "hw/sysbus.h"
 #include "net/net.h"
+#include "qemu/timer.h"
 
 /*
  * Max frame size for the receiving buffer
  */
 #define FTGMAC100_MAX_FRAME_SIZE    9220
 
+/*
+ * Receive and transmit Buffer Descriptor
+ */
+typedef struct {
+    uint32_t        des0;
+    uint32_t        des1;
+    uint32_t        des2;        /* not used by HW */
+    uint32_t        des3;
+} FTGMAC100Desc;
+
+/*
+ * Number of RX descriptors read at once
+ */
+#define FTGMAC100_RX_BATCH          8
+
 struct FTGMAC100State {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -65,6 +81,20 @@ struct FTGMAC100State {
     bool aspeed;
     uint32_t txdes0_edotr;
     uint32_t rxdes0_edorr;
+
+    QEMUTimer *rxint_timer;
+    QEMUTimer *txint_timer;
+    QEMUTimer *rxpoll_timer;
+    QEMUTimer *txpoll_timer;
+    uint32_t isr_held;
+    uint32_t rxint_count;
+    uint32_t txint_count;
+
+    bool has_vnet_hdr;
+    FTGMAC100Desc rx_bds[FTGMAC100_RX_BATCH];
+    uint32_t rx_bds_addr[FTGMAC100_RX_BATCH];
+    int rx_bds_count;
+    int rx_bds_pos;
 };
 
 #define TYPE_ASPEED_MII "aspeed-mmi"
@@ -0,0 +1,114 @@
+/*
+ * PECI (Platform Environment Control Interface) bus
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_PECI_H
+#define HW_PECI_H
+
+#include "hw/qdev-core.h"
+#include "qom/object.h"
+
+/* Client addresses, one per CPU socket */
+#define PECI_BASE_ADDR              0x30
+#define PECI_BUFFER_SIZE            32
+
+/* Commands */
+#define PECI_CMD_GET_DIB            0xf7
+#define PECI_CMD_GET_TEMP           0x01
+#define PECI_CMD_RD_PKG_CFG         0xa1
+#define PECI_CMD_WR_PKG_CFG         0xa5
+#define PECI_CMD_RD_IA_MSR          0xb1
+
+/* Completion codes */
+#define PECI_CC_SUCCESS             0x40
+#define PECI_CC_TIMEOUT             0x80
+#define PECI_CC_OUT_OF_RESOURCES    0x81
+#define PECI_CC_LOW_POWER           0x82
+#define PECI_CC_ILLEGAL_REQUEST     0x90
+
+#define TYPE_PECI_BUS "peci-bus"
+OBJECT_DECLARE_SIMPLE_TYPE(PECIBus, PECI_BUS)
+
+struct PECIBus {
+    BusState qbus;
+};
+
+#define TYPE_PECI_DEVICE "peci-device"
+OBJECT_DECLARE_TYPE(PECIDevice, PECIDeviceClass, PECI_DEVICE)
+
+typedef struct PECIRequest PECIRequest;
+
+/*
+ * A message on the bus. The controller fills in the address and the
+ * write buffer, the client the read buffer.
+ */
+struct PECIRequest {
+    uint8_t addr;
+    uint8_t wlen;
+    uint8_t rlen;
+    uint8_t wbuf[PECI_BUFFER_SIZE];
+    uint8_t rbuf[PECI_BUFFER_SIZE];
+
+    /*
+     * Called once the request completed, @ok is false when no client
+     * answered.
+     */
+    void (*complete)(PECIRequest *req, bool ok, void *opaque);
+    void *opaque;
+
+    /* Internal to the PECI code */
+    PECIDevice *dev;
+};
+
+struct PECIDeviceClass {
+    DeviceClass parent_class;
+
+    /*
+     * Handle @req. The client fills in req->rbuf and calls
+     * peci_request_complete(), either from this handler or later.
+     */
+    void (*transfer)(PECIDevice *dev, PECIRequest *req);
+
+    /*
+     * Drop a request which has not been completed yet. This may be NULL
+     * for clients which always complete from transfer.
+     */
+    void (*cancel)(PECIDevice *dev, PECIRequest *req);
+};
+
+struct PECIDevice {
+    DeviceState qdev;
+
+    uint8_t address;
+};
+
+PECIBus *peci_bus_new(DeviceState *parent, const char *name);
+
+/**
+ * peci_bus_transfer: Send a request on the bus
+ * @bus: the PECI bus
+ * @req: the request, which must stay valid until it completes
+ *
+ * req->complete is called once the client at req->addr answered, which
+ * can be before this function returns.
+ */
+void peci_bus_transfer(PECIBus *bus, PECIRequest *req);
+
+/**
+ * peci_bus_cancel: Drop a request before it completes
+ * @req: a request passed to peci_bus_transfer()
+ *
+ * req->complete is not called for a cancelled request.
+ */
+void peci_bus_cancel(PECIRequest *req);
+
+void peci_request_complete(PECIRequest *req);
+
+/* The CRC-8 of the frame check sequences */
+uint8_t peci_fcs(uint8_t fcs, const uint8_t *buf, size_t len);
+
+#endif /* HW_PECI_H */
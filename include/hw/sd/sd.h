@@ -31,6 +31,7 @@
 #define HW_SD_H
 
 #include "hw/qdev-core.h"
+#include "sysemu/dma.h"
 #include "qom/object.h"
 
 #define OUT_OF_RANGE            (1 << 31)
@@ -116,6 +117,22 @@ struct SDCardClass {
      * Return: byte value read
      */
     uint8_t (*read_byte)(SDState *sd);
+    /**
+     * Transfer whole blocks between a SD card and guest memory.
+     * @sd: card
+     * @sg: guest memory the blocks are read into or written from
+     * @cb: called once the transfer completed
+     * @opaque: argument for @cb
+     *
+     * Start the data phase of the pending READ_MULTIPLE_BLOCK or
+     * WRITE_MULTIPLE_BLOCK command as a single asynchronous request
+     * covering @sg, whose size must be a multiple of the block length.
+     *
+     * Return: the request, or NULL if the card cannot transfer @sg
+     * this way and the data must go through read_byte/write_byte.
+     */
+    BlockAIOCB *(*transfer_blocks)(SDState *sd, QEMUSGList *sg,
+                                   BlockCompletionFunc *cb, void *opaque);
     bool (*receive_ready)(SDState *sd);
     bool (*data_ready)(SDState *sd);
     void (*set_voltage)(SDState *sd, uint16_t millivolts);
@@ -188,6 +205,21 @@ void sdbus_write_data(SDBus *sdbus, const void *buf, size_t length);
  * Read multiple bytes of data on the data lines of a SD bus.
  */
 void sdbus_read_data(SDBus *sdbus, void *buf, size_t length);
+/**
+ * Transfer whole blocks on a SD bus.
+ * @sdbus: bus
+ * @sg: guest memory the blocks are read into or written from
+ * @cb: called once the transfer completed
+ * @opaque: argument for @cb
+ *
+ * Hand the data phase of a multiple block command to the card as a
+ * single asynchronous request. The direction follows the command.
+ *
+ * Return: the request, or NULL if the data must be transferred with
+ * sdbus_read_data() or sdbus_write_data() instead.
+ */
+BlockAIOCB *sdbus_transfer_blocks(SDBus *sdbus, QEMUSGList *sg,
+                                  BlockCompletionFunc *cb, void *opaque);
 bool sdbus_receive_ready(SDBus *sd);
 bool sdbus_data_ready(SDBus *sd);
 bool sdbus_get_inserted(SDBus *sd);
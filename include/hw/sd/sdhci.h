@@ -50,6 +50,12 @@ struct SDHCIState {
     QEMUTimer *transfer_timer;
     qemu_irq irq;
 
+    /* Multiple block DMA transfer handed over to the card */
+    QEMUSGList dma_sg;
+    BlockAIOCB *dma_aiocb;
+    uint16_t dma_blocks;   /* Blocks covered by dma_sg */
+    uint64_t dma_next;     /* SDMA/ADMA address once dma_sg is transferred */
+
     /* Registers cleared on reset */
     uint32_t sdmasysad;    /* SDMA System Address register */
     uint16_t blksize;      /* Host DMA Buff Boundary and Transfer BlkSize Reg */
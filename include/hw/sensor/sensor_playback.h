@@ -0,0 +1,81 @@
+/*
+ * Sensor value playback
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_SENSOR_SENSOR_PLAYBACK_H
+#define HW_SENSOR_SENSOR_PLAYBACK_H
+
+#include "hw/qdev-core.h"
+#include "qemu/notify.h"
+#include "qom/object.h"
+
+#define TYPE_SENSOR_PLAYBACK "sensor-playback"
+OBJECT_DECLARE_SIMPLE_TYPE(SensorPlaybackState, SENSOR_PLAYBACK)
+
+/*
+ * Shared memory ring fed by a host process. The producer fills
+ * entries[head % size] and then advances @head, QEMU consumes the
+ * entries up to @head and advances @tail. All fields are little endian
+ * and @size must be a power of 2.
+ */
+#define SENSOR_PLAYBACK_RING_MAGIC 0x53505247 /* "SPRG" */
+
+typedef struct SensorPlaybackEntry {
+    uint32_t channel;       /* line of the channel in the map file */
+    uint32_t reserved;
+    int64_t value;
+} SensorPlaybackEntry;
+
+typedef struct SensorPlaybackRing {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t head;
+    uint32_t tail;
+    SensorPlaybackEntry entries[];
+} SensorPlaybackRing;
+
+typedef struct SensorPlaybackChannel {
+    char *path;
+    char *property;
+    Object *obj;
+} SensorPlaybackChannel;
+
+typedef struct SensorPlaybackRecord {
+    uint64_t time_ns;
+    uint32_t channel;
+    int64_t value;
+} SensorPlaybackRecord;
+
+struct SensorPlaybackState {
+    DeviceState parent_obj;
+
+    QEMUTimer *timer;
+    Notifier machine_done;
+
+    GArray *channels;       /* of SensorPlaybackChannel */
+    GHashTable *channel_index;
+
+    /* Time series file */
+    GArray *records;        /* of SensorPlaybackRecord */
+    uint32_t next;
+    int64_t base;
+
+    /* Shared memory ring */
+    SensorPlaybackRing *ring;
+    size_t ring_len;
+    uint32_t ring_size;
+
+    /* Properties */
+    char *file;
+    char *ring_path;
+    char *map;
+    uint32_t interval_us;
+    bool loop;
+    uint64_t period_us;
+};
+
+#endif /* HW_SENSOR_SENSOR_PLAYBACK_H */
@@ -40,6 +40,10 @@ struct AspeedSMCFlash {
     uint8_t cs;
 
     MemoryRegion mmio;
+
+    /* Direct mapping of the flash storage in read modes */
+    MemoryRegion direct;
+    MemoryRegion *storage;
 };
 
 #define TYPE_ASPEED_SMC "aspeed.smc"
@@ -59,6 +63,8 @@ struct AspeedSMCState {
 
     qemu_irq *cs_lines;
     bool inject_failure;
+    bool dma_bulk;
+    bool direct_read;
 
     SSIBus *spi;
 
@@ -59,6 +59,15 @@ struct SSIPeripheralClass {
      * always be called for the device for every txrx access to the parent bus
      */
     uint32_t (*transfer_raw)(SSIPeripheral *dev, uint32_t val);
+
+    /* Optional. Transfer @len bytes in one call. @tx is NULL when the
+     * master sends zeroes and @rx is NULL when it discards the received
+     * bytes. This is called when the device cs is active,
+     * for devices with standard CS behaviour only. Others fall back on
+     * per byte transfers.
+     */
+    void (*transfer_buf)(SSIPeripheral *dev, const uint8_t *tx, uint8_t *rx,
+                         uint32_t len);
 };
 
 struct SSIPeripheral {
@@ -111,4 +120,18 @@ SSIBus *ssi_create_bus(DeviceState *parent, const char *name);
 
 uint32_t ssi_transfer(SSIBus *bus, uint32_t val);
 
+/**
+ * ssi_transfer_buf: transfer a buffer of bytes on an SSI bus
+ * @bus: SSI bus
+ * @tx: bytes to send, or NULL to send zeroes
+ * @rx: buffer for the received bytes, or NULL to discard them
+ * @len: number of bytes
+ *
+ * Equivalent to @len calls to ssi_transfer() with 8-bit words, but
+ * peripherals implementing the transfer_buf() handler move the whole
+ * buffer in one call.
+ */
+void ssi_transfer_buf(SSIBus *bus, const uint8_t *tx, uint8_t *rx,
+                      uint32_t len);
+
 #endif
@@ -0,0 +1,34 @@
+/*
+ * Reading tables of whitespace separated fields from text files
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_TABLE_FILE_H
+#define QEMU_TABLE_FILE_H
+
+typedef bool (*QemuTableLineFunc)(void *opaque, char **fields, Error **errp);
+
+/**
+ * qemu_table_file_load:
+ * @path: the file to read
+ * @nr_fields: the number of fields of each line
+ * @fn: called with the fields of each line, in order
+ * @opaque: passed to @fn
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Read a text file with one record of @nr_fields fields, separated by
+ * spaces or tabs, per line. A '#' starts a comment up to the end of the
+ * line, and lines without any field are skipped.
+ *
+ * The errors set by @fn are prefixed with the file name and line number.
+ *
+ * Returns: true on success, false if the file can't be read, a line
+ * doesn't have @nr_fields fields or @fn fails.
+ */
+bool qemu_table_file_load(const char *path, unsigned int nr_fields,
+                          QemuTableLineFunc fn, void *opaque, Error **errp);
+
+#endif /* QEMU_TABLE_FILE_H */
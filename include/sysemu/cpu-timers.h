@@ -81,6 +81,15 @@ int64_t cpu_get_ticks(void);
  */
 int64_t cpu_get_clock(void);
 
+/*
+ * Set by "-accel tcg,sleep=off": rather than waiting for the next timer in
+ * real time, cpu_clock_warp_idle() moves QEMU_CLOCK_VIRTUAL forward to its
+ * deadline as soon as all the vCPUs are idle. Returns true if the clock
+ * moved, in which case a timer is due and the main loop must not block.
+ */
+extern bool cpu_clock_skip_idle;
+bool cpu_clock_warp_idle(void);
+
 void qemu_timer_notify_cb(void *opaque, QEMUClockType type);
 
 /* get the VIRTUAL clock and VM elapsed ticks via the cpus accel interface */
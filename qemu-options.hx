@@ -149,6 +149,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                sleep=on|off (wait for the timers of idle TCG vCPUs in real time, default=on)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
@@ -176,6 +177,16 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``sleep=on|off``
+        When the TCG vCPUs are all idle, e.g. waiting for an interrupt, the
+        virtual clock normally advances in real time until the next timer
+        fires. With ``sleep=off`` it jumps straight to the deadline of that
+        timer instead, so that guests which mostly wait on timers run many
+        times faster than real time. The real time clocks, used by the
+        character and network backends, are not affected. This is the
+        equivalent of ``-icount sleep=off`` without instruction counting,
+        which cannot be used together with it.
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
@@ -1003,7 +1014,7 @@ SRST
         is set, get "Get GUID" command to the BMC will return it.
         Otherwise "Get GUID" will return an error.
 
-``-device ipmi-bmc-extern,id=id,chardev=id[,slave_addr=val]``
+``-device ipmi-bmc-extern,id=id,chardev=id[,slave_addr=val][,framed=on|off]``
     Add a connection to an external IPMI BMC simulator. Instead of
     locally emulating the BMC like the above item, instead connect to an
     external entity that provides the IPMI services.
@@ -1020,6 +1031,12 @@ SRST
     See the "lanserv/README.vm" file in the OpenIPMI library for more
     details on the external interface.
 
+    ``framed=on|off``
+        Send the messages as length prefixed frames instead of the
+        byte-stuffed OpenIPMI protocol. This is the protocol of the KCS
+        channels of the Aspeed BMC machines, so a host VM can talk to
+        the firmware of an emulated BMC. The default is off.
+
 ``-device isa-ipmi-kcs,bmc=id[,ioport=val][,irq=val]``
     Add a KCS IPMI interafce on the ISA bus. This also adds a
     corresponding ACPI and SMBIOS entries, if appropriate.
@@ -31,6 +31,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/option.h"
 #include "qemu/seqlock.h"
+#include "sysemu/qtest.h"
 #include "sysemu/replay.h"
 #include "sysemu/runstate.h"
 #include "hw/core/cpu.h"
@@ -135,6 +136,41 @@ void cpu_disable_ticks(void)
                          &timers_state.vm_clock_lock);
 }
 
+bool cpu_clock_skip_idle;
+
+/*
+ * Skip the idle time without icount. Called from the main loop before it
+ * polls, which the vCPU threads wake up when they all go idle.
+ * Caller must hold BQL which serves as mutex for vm_clock_seqlock.
+ */
+bool cpu_clock_warp_idle(void)
+{
+    int64_t deadline;
+
+    /* Nothing to skip when the clock is stopped or driven by qtest */
+    if (!runstate_is_running() || qtest_enabled() || !all_cpu_threads_idle()) {
+        return false;
+    }
+
+    /*
+     * As with icount, timers with external side effects do not make the
+     * clock jump, so that their period still holds in real time.
+     */
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          ~QEMU_TIMER_ATTR_EXTERNAL);
+    if (deadline <= 0) {
+        return false;
+    }
+
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    timers_state.cpu_clock_offset += deadline;
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+    qemu_clock_notify(QEMU_CLOCK_VIRTUAL);
+    return true;
+}
+
 static bool icount_state_needed(void *opaque)
 {
     return icount_enabled();
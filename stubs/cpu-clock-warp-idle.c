@@ -0,0 +1,9 @@
+#include "qemu/osdep.h"
+#include "sysemu/cpu-timers.h"
+
+bool cpu_clock_skip_idle;
+
+bool cpu_clock_warp_idle(void)
+{
+    abort();
+}
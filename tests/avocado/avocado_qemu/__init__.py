@@ -8,8 +8,10 @@
 # This work is licensed under the terms of the GNU GPL, version 2 or
 # later.  See the COPYING file in the top-level directory.
 
+import hashlib
 import logging
 import os
+import shlex
 import shutil
 import subprocess
 import sys
@@ -18,7 +20,7 @@
 import uuid
 
 import avocado
-from avocado.utils import cloudinit, datadrainer, process, ssh, vmimage
+from avocado.utils import cloudinit, datadrainer, process, ssh, vmimage, wait
 from avocado.utils.path import find_command
 
 #: The QEMU build root directory.  It may also be the source directory
@@ -407,6 +409,159 @@ def ssh_command(self, command):
                          f'Guest command failed: {command}')
         return stdout_lines, stderr_lines
 
+class BootCheckpointMixIn:
+    """
+    Restores a machine from a cached boot checkpoint instead of booting it.
+
+    Checkpoints are kept in the directory given by the
+    QEMU_BOOT_CHECKPOINT_DIR environment variable, one sub-directory per
+    checkpoint named after a hash of the QEMU binary, the machine type,
+    the command line and the flash images. A checkpoint holds the guest
+    RAM as a plain file, a qcow2 overlay of each flash image and the
+    device state as a migration stream.
+
+    The RAM file is mapped privately on restore: guest pages are only
+    read when touched and are shared by all the machines restored from
+    the same checkpoint.
+    """
+
+    CHECKPOINT_RAM_ID = 'checkpoint-ram'
+
+    def _checkpoint_qemu_img(self):
+        qemu_img = os.path.join(BUILD_DIR, 'qemu-img')
+        if not os.path.exists(qemu_img):
+            qemu_img = find_command('qemu-img', False)
+        if qemu_img is False:
+            self.cancel('Could not find "qemu-img", which is required to '
+                        'create the flash overlays')
+        return qemu_img
+
+    @staticmethod
+    def _checkpoint_hash_file(digest, path):
+        with open(path, 'rb') as f:
+            for chunk in iter(lambda: f.read(1 << 20), b''):
+                digest.update(chunk)
+
+    def _checkpoint_key(self, vm, images):
+        digest = hashlib.sha256()
+        self._checkpoint_hash_file(digest, self.qemu_bin)
+        digest.update(str(self.machine).encode())
+        digest.update(' '.join(map(shlex.quote, vm.args)).encode())
+        for image in images:
+            self._checkpoint_hash_file(digest, image)
+        return digest.hexdigest()
+
+    def _checkpoint_overlays(self, directory, images, backing_fmt):
+        qemu_img = self._checkpoint_qemu_img()
+        overlays = []
+        for i, image in enumerate(images):
+            overlay = os.path.join(directory, 'flash%d.qcow2' % i)
+            process.run('%s create -f qcow2 -F %s -b %s %s' %
+                        (qemu_img, backing_fmt,
+                         shlex.quote(os.path.abspath(image)),
+                         shlex.quote(overlay)))
+            overlays.append(overlay)
+        return overlays
+
+    def _checkpoint_add_args(self, vm, ram_path, ram_size, share, overlays):
+        vm.add_args('-object',
+                    'memory-backend-file,id=%s,size=%d,mem-path=%s,share=%s' %
+                    (self.CHECKPOINT_RAM_ID, ram_size, ram_path,
+                     'on' if share else 'off'),
+                    '-machine', 'memory-backend=%s' % self.CHECKPOINT_RAM_ID,
+                    '-m', '%dM' % (ram_size >> 20))
+        for overlay in overlays:
+            vm.add_args('-drive', 'file=%s,format=qcow2,if=mtd' % overlay)
+
+    def _checkpoint_ram_size(self):
+        vm = self.get_vm('-S', '-nodefaults', name='checkpoint-probe')
+        vm.launch()
+        ram_size = vm.command('query-memory-size-summary')['base-memory']
+        vm.shutdown()
+        return ram_size
+
+    @staticmethod
+    def _checkpoint_migration_done(vm):
+        return vm.command('query-migrate').get('status') in ('completed',
+                                                             'failed')
+
+    def _checkpoint_save(self, cache_dir, path, images, setup, ready):
+        tmp = tempfile.mkdtemp(prefix=os.path.basename(path) + '.',
+                               dir=cache_dir)
+        ram_size = self._checkpoint_ram_size()
+        overlays = self._checkpoint_overlays(tmp, images, 'raw')
+
+        vm = self.get_vm(name='checkpoint')
+        setup(vm)
+        self._checkpoint_add_args(vm, os.path.join(tmp, 'ram'), ram_size,
+                                  True, overlays)
+        vm.launch()
+        ready(vm)
+
+        self.log.info('Saving boot checkpoint %s', path)
+        vm.command('migrate-set-capabilities',
+                   capabilities=[{'capability': 'x-ignore-shared',
+                                  'state': True}])
+        vm.command('migrate', uri='exec:cat > %s' %
+                   shlex.quote(os.path.join(tmp, 'state')))
+        wait.wait_for(self._checkpoint_migration_done, timeout=self.timeout,
+                      step=0.1, args=(vm,))
+        status = vm.command('query-migrate')['status']
+        vm.shutdown()
+        if status != 'completed':
+            shutil.rmtree(tmp)
+            self.fail('Failed to save the boot checkpoint')
+
+        try:
+            os.rename(tmp, path)
+        except OSError:
+            # Saved concurrently by another test
+            shutil.rmtree(tmp)
+
+    def launch_from_checkpoint(self, images, setup, ready):
+        """
+        Launches the test VM with the flash images attached as MTD
+        drives, from a boot checkpoint when the cache is enabled
+
+        :param images: paths of the raw flash images
+        :param setup: callable configuring a QEMUMachine before its launch
+        :param ready: callable waiting for the boot point to checkpoint,
+                      called with the QEMUMachine once launched
+        """
+        setup(self.vm)
+        cache_dir = os.getenv('QEMU_BOOT_CHECKPOINT_DIR')
+        if not cache_dir:
+            for image in images:
+                self.vm.add_args('-drive', 'file=%s,format=raw,if=mtd' % image)
+            self.vm.launch()
+            ready(self.vm)
+            return
+
+        os.makedirs(cache_dir, exist_ok=True)
+        path = os.path.join(cache_dir, self._checkpoint_key(self.vm, images))
+        if not os.path.isdir(path):
+            self._checkpoint_save(cache_dir, path, images, setup, ready)
+
+        self.log.info('Restoring boot checkpoint %s', path)
+        ram_path = os.path.join(path, 'ram')
+        overlays = self._checkpoint_overlays(
+            self.workdir, [os.path.join(path, 'flash%d.qcow2' % i)
+                           for i in range(len(images))], 'qcow2')
+        self._checkpoint_add_args(self.vm, ram_path,
+                                  os.path.getsize(ram_path), False, overlays)
+        self.vm.add_args('-incoming', 'defer')
+        self.vm.launch()
+        self.vm.command('migrate-set-capabilities',
+                        capabilities=[{'capability': 'x-ignore-shared',
+                                       'state': True}])
+        self.vm.command('migrate-incoming', uri='exec:cat %s' %
+                        shlex.quote(os.path.join(path, 'state')))
+        wait.wait_for(self._checkpoint_migration_done, timeout=self.timeout,
+                      step=0.1, args=(self.vm,))
+        self.assertEqual(self.vm.command('query-migrate')['status'],
+                         'completed')
+
+
 class LinuxDistro:
     """Represents a Linux distribution
 
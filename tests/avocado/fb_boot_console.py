@@ -10,10 +10,11 @@
 # This work is licensed under the terms of the GNU GPL, version 2 or
 # later.  See the COPYING file in the top-level directory.
 
-from avocado_qemu import (QemuSystemTest, wait_for_console_pattern,
+from avocado_qemu import (BootCheckpointMixIn, QemuSystemTest,
+                          wait_for_console_pattern,
                           exec_command_and_wait_for_pattern)
 
-class BootTests(QemuSystemTest):
+class BootTests(BootCheckpointMixIn, QemuSystemTest):
     timeout = 500
 
     def test_fby35_bmc(self):
@@ -25,13 +26,17 @@ def test_fby35_bmc(self):
         image_hash = '0a3635646f38373e318811be1ec3743540cc456aafe87234655081684b03b713'
         image_path = self.fetch_asset(image_url, asset_hash=image_hash, algorithm='sha256')
 
-        self.vm.set_console()
-        self.vm.add_args('-drive', f'file={image_path},format=raw,if=mtd',
-                         '-drive', f'file={image_path},format=raw,if=mtd', '-netdev',
-                         'user,id=nic,mfr-id=0x8119,oob-eth-addr=de:ad:be:ef:ca:fe,hostfwd=::2222-:22',
-                         '-net', 'nic,model=ftgmac100,netdev=nic')
-        self.vm.launch()
-        wait_for_console_pattern(self, 'vboot_verify_uboot 387', vm=self.vm)
+        def setup(vm):
+            vm.set_console()
+            vm.add_args('-netdev',
+                        'user,id=nic,mfr-id=0x8119,oob-eth-addr=de:ad:be:ef:ca:fe,hostfwd=::2222-:22',
+                        '-net', 'nic,model=ftgmac100,netdev=nic')
+
+        def ready(vm):
+            wait_for_console_pattern(self, 'vboot_verify_uboot 387', vm=vm)
+
+        # With QEMU_BOOT_CHECKPOINT_DIR set, U-Boot runs only once
+        self.launch_from_checkpoint([image_path, image_path], setup, ready)
         wait_for_console_pattern(self, 'OpenBMC Release fby35-e2294ff5d3', vm=self.vm)
 
         # FIXME: For some reason the login prompt doesn't appear, but if we can get it to work, I'd
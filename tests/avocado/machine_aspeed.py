@@ -5,6 +5,9 @@
 # This work is licensed under the terms of the GNU GPL, version 2 or
 # later.  See the COPYING file in the top-level directory.
 
+import re
+import time
+
 from avocado_qemu import QemuSystemTest
 from avocado_qemu import wait_for_console_pattern
 from avocado_qemu import exec_command_and_wait_for_pattern
@@ -16,11 +19,7 @@ class AST1030Machine(QemuSystemTest):
 
     timeout = 10
 
-    def test_ast1030_zephyros(self):
-        """
-        :avocado: tags=arch:arm
-        :avocado: tags=machine:ast1030-evb
-        """
+    def do_boot_zephyros(self, *args):
         tar_url = ('https://github.com/AspeedTech-BMC'
                    '/zephyr/releases/download/v00.01.04/ast1030-evb-demo.zip')
         tar_hash = '4c6a8ce3a8ba76ef1a65dae419ae3409343c4b20'
@@ -29,8 +28,38 @@ def test_ast1030_zephyros(self):
         kernel_file = self.workdir + "/ast1030-evb-demo/zephyr.elf"
         self.vm.set_console()
         self.vm.add_args('-kernel', kernel_file,
-                         '-nographic')
+                         '-nographic', *args)
         self.vm.launch()
         wait_for_console_pattern(self, "Booting Zephyr OS")
+
+    def get_zephyros_uptime(self):
+        self.vm.console_socket.sendall(b'kernel uptime\r')
+        console = self.vm.console_socket.makefile(mode='rb')
+        while True:
+            msg = console.readline().decode(errors='replace')
+            match = re.search(r'Uptime: (\d+) ms', msg)
+            if match:
+                return int(match.group(1))
+
+    def test_ast1030_zephyros(self):
+        """
+        :avocado: tags=arch:arm
+        :avocado: tags=machine:ast1030-evb
+        """
+        self.do_boot_zephyros()
         exec_command_and_wait_for_pattern(self, "help",
                                           "Available commands")
+
+    def test_ast1030_zephyros_sleep_off(self):
+        """
+        Check that the virtual clock of an idle guest runs ahead of real
+        time, while the timers of the SoC devices keep firing
+
+        :avocado: tags=arch:arm
+        :avocado: tags=machine:ast1030-evb
+        """
+        self.do_boot_zephyros('-accel', 'tcg,sleep=off')
+        start = self.get_zephyros_uptime()
+        time.sleep(2)
+        elapsed = self.get_zephyros_uptime() - start
+        self.assertGreater(elapsed, 4000)
@@ -0,0 +1,227 @@
+/*
+ * QTest testcase for the AT24C EEPROM behind the Aspeed I2C Controller
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define ASPEED_I2C_BASE         0x1E78A000
+#define ASPEED_I2C_BUS_BASE(n)  (ASPEED_I2C_BASE + 0x80 * ((n) + 1))
+#define I2CD_FUN_CTRL_REG       0x00
+#define   I2CD_MASTER_EN        BIT(0)
+#define I2CD_INTR_CTRL_REG      0x0c
+#define I2CD_INTR_STS_REG       0x10
+#define   I2CD_INTR_TX_ACK      BIT(0)
+#define I2CD_CMD_REG            0x14
+#define   I2CD_M_STOP_CMD       BIT(5)
+#define   I2CD_M_S_RX_CMD_LAST  BIT(4)
+#define   I2CD_M_RX_CMD         BIT(3)
+#define   I2CD_M_TX_CMD         BIT(1)
+#define   I2CD_M_START_CMD      BIT(0)
+#define I2CD_BYTE_BUF_REG       0x20
+#define   I2CD_BYTE_BUF_RX_SHIFT 8
+
+#define EEPROM_BUS              5
+#define EEPROM_ADDR             0x50
+#define EEPROM_SIZE             1024
+#define EEPROM_BASE             ASPEED_I2C_BUS_BASE(EEPROM_BUS)
+
+/* The EEPROM allocates its contents in pages of that size */
+#define EEPROM_PAGE_SIZE        256
+
+#define EEPROM_ARGS \
+    "-machine ast2600-evb " \
+    "-device at24c-eeprom,bus=aspeed.i2c.bus.5,address=0x50,rom-size=1024"
+
+/* Runs a command of the old register mode and clears its status */
+static uint32_t i2c_cmd(QTestState *s, uint32_t cmd)
+{
+    uint32_t sts;
+
+    qtest_writel(s, EEPROM_BASE + I2CD_CMD_REG, cmd);
+    sts = qtest_readl(s, EEPROM_BASE + I2CD_INTR_STS_REG);
+    qtest_writel(s, EEPROM_BASE + I2CD_INTR_STS_REG, sts);
+
+    return sts;
+}
+
+static void i2c_tx(QTestState *s, uint32_t cmd, uint8_t byte)
+{
+    qtest_writel(s, EEPROM_BASE + I2CD_BYTE_BUF_REG, byte);
+    g_assert(i2c_cmd(s, cmd) & I2CD_INTR_TX_ACK);
+}
+
+static void eeprom_set_addr(QTestState *s, uint16_t addr)
+{
+    qtest_writel(s, EEPROM_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    qtest_writel(s, EEPROM_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    i2c_tx(s, I2CD_M_START_CMD, EEPROM_ADDR << 1);
+    i2c_tx(s, I2CD_M_TX_CMD, addr >> 8);
+    i2c_tx(s, I2CD_M_TX_CMD, addr & 0xff);
+}
+
+static void eeprom_write(QTestState *s, uint16_t addr, const uint8_t *buf,
+                         int len)
+{
+    int i;
+
+    eeprom_set_addr(s, addr);
+    for (i = 0; i < len; i++) {
+        i2c_tx(s, I2CD_M_TX_CMD, buf[i]);
+    }
+    i2c_cmd(s, I2CD_M_STOP_CMD);
+}
+
+static void eeprom_read(QTestState *s, uint16_t addr, uint8_t *buf, int len)
+{
+    int i;
+
+    eeprom_set_addr(s, addr);
+    i2c_tx(s, I2CD_M_START_CMD, (EEPROM_ADDR << 1) | 1);
+    for (i = 0; i < len; i++) {
+        i2c_cmd(s, i == len - 1 ? I2CD_M_S_RX_CMD_LAST : I2CD_M_RX_CMD);
+        buf[i] = qtest_readl(s, EEPROM_BASE + I2CD_BYTE_BUF_REG) >>
+                 I2CD_BYTE_BUF_RX_SHIFT;
+    }
+    i2c_cmd(s, I2CD_M_STOP_CMD);
+}
+
+static void fill_pattern(uint8_t *buf, int len, uint8_t seed)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = i ^ seed;
+    }
+}
+
+/* The written bytes straddle the first two pages */
+static const uint8_t test_data[] = {
+    0xde, 0xad, 0xbe, 0xef, 0xca, 0xfe, 0xba, 0xbe,
+};
+#define TEST_ADDR (EEPROM_PAGE_SIZE - sizeof(test_data) / 2)
+
+static void test_drive(void)
+{
+    g_autofree char *path = NULL;
+    uint8_t expected[EEPROM_SIZE];
+    uint8_t buf[EEPROM_SIZE];
+    QTestState *s;
+    int fd;
+
+    fd = g_file_open_tmp("eeprom-XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    fill_pattern(expected, sizeof(expected), 0x5a);
+    g_assert_cmpint(pwrite(fd, expected, sizeof(expected), 0), ==,
+                    sizeof(expected));
+
+    s = qtest_initf(EEPROM_ARGS ",drive=ee "
+                    "-drive file=%s,if=none,id=ee,format=raw", path);
+
+    /* Untouched pages read from the drive */
+    eeprom_read(s, 0, buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+
+    eeprom_write(s, TEST_ADDR, test_data, sizeof(test_data));
+    memcpy(expected + TEST_ADDR, test_data, sizeof(test_data));
+
+    /* The next read writes the changed pages back to the drive */
+    eeprom_read(s, 0, buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+    g_assert_cmpint(pread(fd, buf, sizeof(buf), 0), ==, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+
+    /* After a reset, unwritten pages read the drive again */
+    fill_pattern(expected + 3 * EEPROM_PAGE_SIZE, EEPROM_PAGE_SIZE, 0xa5);
+    g_assert_cmpint(pwrite(fd, expected + 3 * EEPROM_PAGE_SIZE,
+                           EEPROM_PAGE_SIZE, 3 * EEPROM_PAGE_SIZE), ==,
+                    EEPROM_PAGE_SIZE);
+    qtest_qmp_assert_success(s, "{ 'execute': 'system_reset' }");
+    qtest_qmp_eventwait(s, "RESET");
+
+    eeprom_read(s, 0, buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+
+    qtest_quit(s);
+    close(fd);
+    unlink(path);
+}
+
+static void test_reset(void)
+{
+    QTestState *s = qtest_init(EEPROM_ARGS);
+    uint8_t expected[EEPROM_SIZE] = {};
+    uint8_t buf[EEPROM_SIZE];
+
+    eeprom_write(s, TEST_ADDR, test_data, sizeof(test_data));
+    memcpy(expected + TEST_ADDR, test_data, sizeof(test_data));
+    eeprom_read(s, 0, buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+
+    /* Without a drive, the contents are lost */
+    qtest_qmp_assert_success(s, "{ 'execute': 'system_reset' }");
+    qtest_qmp_eventwait(s, "RESET");
+
+    memset(expected, 0, sizeof(expected));
+    eeprom_read(s, 0, buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+
+    qtest_quit(s);
+}
+
+static void test_migrate(void)
+{
+    g_autofree char *dir = g_dir_make_tmp("eeprom-XXXXXX", NULL);
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", dir);
+    uint8_t expected[EEPROM_SIZE] = {};
+    uint8_t buf[EEPROM_SIZE];
+    QTestState *src, *dst;
+
+    src = qtest_init(EEPROM_ARGS);
+    dst = qtest_initf(EEPROM_ARGS " -incoming %s", uri);
+
+    eeprom_write(src, TEST_ADDR, test_data, sizeof(test_data));
+    memcpy(expected + TEST_ADDR, test_data, sizeof(test_data));
+
+    /* Leave the address pointer in the middle of the written pages */
+    eeprom_set_addr(src, TEST_ADDR);
+    i2c_cmd(src, I2CD_M_STOP_CMD);
+
+    qtest_qmp_assert_success(src, "{ 'execute': 'migrate',"
+                             "  'arguments': { 'uri': %s } }", uri);
+    qtest_qmp_eventwait(src, "STOP");
+    qtest_qmp_eventwait(dst, "RESUME");
+
+    /* A current address read continues from the migrated pointer */
+    qtest_writel(dst, EEPROM_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    i2c_tx(dst, I2CD_M_START_CMD, (EEPROM_ADDR << 1) | 1);
+    i2c_cmd(dst, I2CD_M_S_RX_CMD_LAST);
+    g_assert_cmphex(qtest_readl(dst, EEPROM_BASE + I2CD_BYTE_BUF_REG) >>
+                    I2CD_BYTE_BUF_RX_SHIFT, ==, test_data[0]);
+    i2c_cmd(dst, I2CD_M_STOP_CMD);
+
+    eeprom_read(dst, 0, buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+
+    qtest_quit(src);
+    qtest_quit(dst);
+    g_rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/ast2600/eeprom/drive", test_drive);
+    qtest_add_func("/ast2600/eeprom/reset", test_reset);
+    qtest_add_func("/ast2600/eeprom/migrate", test_migrate);
+
+    return g_test_run();
+}
@@ -0,0 +1,62 @@
+/*
+ * QTest testcase for the fby35 machine and its bridge ICs
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define ASPEED_DRAM_BASE    0x80000000
+
+static void test_slots(void)
+{
+    int slots;
+
+    for (slots = 0; slots <= 4; slots++) {
+        QTestState *s = qtest_initf("-machine fby35,slots=%d", slots);
+
+        g_assert_cmphex(qtest_readl(s, ASPEED_DRAM_BASE), ==, 0);
+        qtest_quit(s);
+    }
+}
+
+/*
+ * All the SoCs of the machine must have RAMBlocks and device states of
+ * their own for the migration to go through.
+ */
+static void test_migrate(void)
+{
+    g_autofree char *dir = g_dir_make_tmp("fby35-XXXXXX", NULL);
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", dir);
+    QTestState *src, *dst;
+
+    src = qtest_init("-machine fby35,slots=4");
+    dst = qtest_initf("-machine fby35,slots=4 -incoming %s", uri);
+
+    qtest_writel(src, ASPEED_DRAM_BASE, 0xdeadbeef);
+
+    qtest_qmp_assert_success(src, "{ 'execute': 'migrate',"
+                             "  'arguments': { 'uri': %s } }", uri);
+    qtest_qmp_eventwait(src, "STOP");
+    qtest_qmp_eventwait(dst, "RESUME");
+
+    g_assert_cmphex(qtest_readl(dst, ASPEED_DRAM_BASE), ==, 0xdeadbeef);
+
+    qtest_quit(src);
+    qtest_quit(dst);
+    g_rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/fby35/slots", test_slots);
+    qtest_add_func("/fby35/migrate", test_migrate);
+
+    return g_test_run();
+}
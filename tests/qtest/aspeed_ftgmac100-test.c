@@ -0,0 +1,520 @@
+/*
+ * QTest testcase for the FTGMAC100 of the Aspeed SoCs.
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/iov.h"
+#include "libqtest.h"
+
+#define FTGMAC100_BASE      0x1E660000
+#define FTGMAC100_GIC_IRQ   2
+#define   FTGMAC100_ISR     0x00
+#define   FTGMAC100_IER     0x04
+#define     FTGMAC100_INT_RPKT_BUF  BIT(0)
+#define   FTGMAC100_NPTXPD  0x18
+#define   FTGMAC100_RXPD    0x1C
+#define   FTGMAC100_NPTXR_BADR 0x20
+#define   FTGMAC100_RXR_BADR 0x24
+#define   FTGMAC100_ITC     0x30
+#define     FTGMAC100_ITC_RXINT_CNT(x)  ((x) & 0xf)
+#define     FTGMAC100_ITC_RXINT_THR(x)  (((x) & 0x7) << 4)
+#define   FTGMAC100_APTC    0x34
+#define     FTGMAC100_APTC_TXPOLL_CNT(x) (((x) & 0xf) << 8)
+#define   FTGMAC100_RBSR    0x4c
+#define   FTGMAC100_MACCR   0x50
+#define     FTGMAC100_MACCR_TXDMA_EN    BIT(0)
+#define     FTGMAC100_MACCR_RXDMA_EN    BIT(1)
+#define     FTGMAC100_MACCR_TXMAC_EN    BIT(2)
+#define     FTGMAC100_MACCR_RXMAC_EN    BIT(3)
+#define     FTGMAC100_MACCR_GIGA_MODE   BIT(9)
+#define     FTGMAC100_MACCR_RX_ALL      BIT(14)
+#define     FTGMAC100_MACCR_SW_RST      BIT(31)
+
+#define RXDES0_EDORR        BIT(30)
+#define RXDES0_RXPKT_RDY    BIT(31)
+#define RXDES_SIZE          16
+
+#define RX_RING_ADDR        0x80100000
+#define RX_BUF_ADDR         0x80200000
+#define RX_BUF_SIZE         0x600
+#define RX_RING_SIZE        16
+
+#define TXDES0_LTS          BIT(28)
+#define TXDES0_FTS          BIT(29)
+#define TXDES0_EDOTR        BIT(30)
+#define TXDES0_TXDMA_OWN    BIT(31)
+#define TXDES1_INS_VLANTAG  BIT(16)
+#define TXDES_SIZE          16
+
+#define TX_RING_ADDR        0x80300000
+#define TX_BUF_ADDR         0x80400000
+#define TX_RING_SIZE        8
+
+/* One count of the TX poll timer in giga mode */
+#define TXPOLL_PERIOD_NS    (1024 * 1000)
+
+/* One count of the RX interrupt timer in giga mode */
+#define RXINT_PERIOD_NS     (64 * 1000)
+
+#define TIMEOUT_US          (10 * G_USEC_PER_SEC)
+
+typedef struct {
+    QTestState *qts;
+    int fd;
+    int rx_next;
+} TestState;
+
+static void test_init(TestState *t, uint32_t itc)
+{
+    int sv[2];
+    int i;
+
+    g_assert_cmpint(socketpair(PF_UNIX, SOCK_STREAM, 0, sv), ==, 0);
+    t->qts = qtest_initf("-machine ast2600-evb "
+                         "-nic socket,fd=%d,model=ftgmac100", sv[1]);
+    close(sv[1]);
+    t->fd = sv[0];
+    t->rx_next = 0;
+
+    qtest_irq_intercept_in(t->qts, "/machine/soc/a7mpcore/gic");
+
+    for (i = 0; i < RX_RING_SIZE; i++) {
+        uint32_t addr = RX_RING_ADDR + i * RXDES_SIZE;
+
+        qtest_writel(t->qts, addr,
+                     i == RX_RING_SIZE - 1 ? RXDES0_EDORR : 0);
+        qtest_writel(t->qts, addr + 4, 0);
+        qtest_writel(t->qts, addr + 8, 0);
+        qtest_writel(t->qts, addr + 12, RX_BUF_ADDR + i * RX_BUF_SIZE);
+    }
+
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_MACCR,
+                 FTGMAC100_MACCR_SW_RST);
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_RXR_BADR, RX_RING_ADDR);
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_NPTXR_BADR, TX_RING_ADDR);
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_RBSR, RX_BUF_SIZE);
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_APTC, 0);
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_ITC, itc);
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_IER,
+                 FTGMAC100_INT_RPKT_BUF);
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_MACCR,
+                 FTGMAC100_MACCR_RXDMA_EN | FTGMAC100_MACCR_RXMAC_EN |
+                 FTGMAC100_MACCR_TXDMA_EN | FTGMAC100_MACCR_TXMAC_EN |
+                 FTGMAC100_MACCR_GIGA_MODE | FTGMAC100_MACCR_RX_ALL);
+}
+
+static void test_cleanup(TestState *t)
+{
+    qtest_quit(t->qts);
+    close(t->fd);
+}
+
+static void send_frame(TestState *t)
+{
+    uint8_t frame[64] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,     /* broadcast */
+        0x52, 0x54, 0x00, 0x12, 0x34, 0x56,
+        0x08, 0x00,
+    };
+    uint32_t len = htonl(sizeof(frame));
+    struct iovec iov[] = {
+        { .iov_base = &len, .iov_len = sizeof(len) },
+        { .iov_base = frame, .iov_len = sizeof(frame) },
+    };
+
+    g_assert_cmpint(iov_send(t->fd, iov, 2, 0, sizeof(len) + sizeof(frame)),
+                    ==, sizeof(len) + sizeof(frame));
+}
+
+/*
+ * Wait for the next RX descriptor to be filled, without moving the
+ * virtual clock so that the interrupt timer cannot fire.
+ */
+static void wait_rx(TestState *t)
+{
+    uint32_t addr = RX_RING_ADDR + t->rx_next * RXDES_SIZE;
+    gint64 end = g_get_monotonic_time() + TIMEOUT_US;
+
+    while (!(qtest_readl(t->qts, addr) & RXDES0_RXPKT_RDY)) {
+        g_assert_cmpint(g_get_monotonic_time(), <, end);
+        g_usleep(10);
+    }
+    t->rx_next = (t->rx_next + 1) % RX_RING_SIZE;
+}
+
+static bool rx_irq(TestState *t)
+{
+    return qtest_get_irq(t->qts, FTGMAC100_GIC_IRQ);
+}
+
+static void tx_frame_init(uint8_t *frame, int len)
+{
+    static const uint8_t hdr[] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,     /* broadcast */
+        0x52, 0x54, 0x00, 0x12, 0x34, 0x56,
+        0x08, 0x00,
+    };
+    int i;
+
+    memcpy(frame, hdr, sizeof(hdr));
+    for (i = sizeof(hdr); i < len; i++) {
+        frame[i] = i;
+    }
+}
+
+/*
+ * Queue a frame in the TX ring from @first, with one descriptor per
+ * segment. The last descriptor is left to the guest if @own_last is false.
+ */
+static void tx_queue(TestState *t, int first, const uint8_t *frame,
+                     const int *seg_len, int nsegs, uint32_t des1,
+                     bool own_last)
+{
+    uint32_t buf = TX_BUF_ADDR;
+    int i;
+
+    for (i = 0; i < nsegs; i++) {
+        uint32_t addr = TX_RING_ADDR + (first + i) * TXDES_SIZE;
+        uint32_t des0 = seg_len[i];
+
+        if (i == 0) {
+            des0 |= TXDES0_FTS;
+        }
+        if (i == nsegs - 1) {
+            des0 |= TXDES0_LTS;
+        }
+        if (first + i == TX_RING_SIZE - 1) {
+            des0 |= TXDES0_EDOTR;
+        }
+        if (i < nsegs - 1 || own_last) {
+            des0 |= TXDES0_TXDMA_OWN;
+        }
+
+        qtest_memwrite(t->qts, buf, frame, seg_len[i]);
+        qtest_writel(t->qts, addr + 4, des1);
+        qtest_writel(t->qts, addr + 8, 0);
+        qtest_writel(t->qts, addr + 12, buf);
+        qtest_writel(t->qts, addr, des0);
+
+        frame += seg_len[i];
+        buf += 0x100;
+    }
+}
+
+static bool tx_owned(TestState *t, int index)
+{
+    return qtest_readl(t->qts, TX_RING_ADDR + index * TXDES_SIZE) &
+           TXDES0_TXDMA_OWN;
+}
+
+static void tx_kick(TestState *t)
+{
+    qtest_writel(t->qts, FTGMAC100_BASE + FTGMAC100_NPTXPD, 1);
+}
+
+static int recv_frame(TestState *t, uint8_t *buf, int size)
+{
+    uint32_t len;
+
+    g_assert_cmpint(recv(t->fd, &len, sizeof(len), MSG_WAITALL), ==,
+                    sizeof(len));
+    len = ntohl(len);
+    g_assert_cmpint(len, <=, size);
+    g_assert_cmpint(recv(t->fd, buf, len, MSG_WAITALL), ==, len);
+
+    return len;
+}
+
+static void assert_no_frame(TestState *t)
+{
+    uint8_t buf[4];
+
+    g_assert_cmpint(recv(t->fd, buf, sizeof(buf), MSG_DONTWAIT), ==, -1);
+}
+
+/*
+ * A frame split over several descriptors. The headers, copied by the
+ * device, span several of them and the rest is sent from the buffers.
+ */
+static void test_tx_segments(void)
+{
+    static const int seg_len[] = { 10, 50, 1, 139, 100 };
+    uint8_t frame[300];
+    uint8_t buf[400];
+    TestState t;
+    int i;
+
+    test_init(&t, 0);
+    tx_frame_init(frame, sizeof(frame));
+
+    tx_queue(&t, 0, frame, seg_len, ARRAY_SIZE(seg_len), 0, true);
+    tx_kick(&t);
+
+    g_assert_cmpint(recv_frame(&t, buf, sizeof(buf)), ==, sizeof(frame));
+    g_assert_cmpmem(buf, sizeof(frame), frame, sizeof(frame));
+    for (i = 0; i < ARRAY_SIZE(seg_len); i++) {
+        g_assert_false(tx_owned(&t, i));
+    }
+
+    test_cleanup(&t);
+}
+
+/* The tag is inserted in headers split over several descriptors */
+static void test_tx_segments_vlan(void)
+{
+    static const int seg_len[] = { 10, 150, 140 };
+    uint8_t frame[300];
+    uint8_t expected[304];
+    uint8_t buf[400];
+    TestState t;
+
+    test_init(&t, 0);
+    tx_frame_init(frame, sizeof(frame));
+
+    memcpy(expected, frame, 12);
+    expected[12] = 0x81;
+    expected[13] = 0x00;
+    expected[14] = 0x01;
+    expected[15] = 0x23;
+    memcpy(expected + 16, frame + 12, sizeof(frame) - 12);
+
+    tx_queue(&t, 0, frame, seg_len, ARRAY_SIZE(seg_len),
+             TXDES1_INS_VLANTAG | 0x123, true);
+    tx_kick(&t);
+
+    g_assert_cmpint(recv_frame(&t, buf, sizeof(buf)), ==, sizeof(expected));
+    g_assert_cmpmem(buf, sizeof(expected), expected, sizeof(expected));
+
+    test_cleanup(&t);
+}
+
+/*
+ * A frame whose last descriptor is not owned by the device yet stays
+ * pending, and goes out once the guest completes it.
+ */
+static void test_tx_pending(void)
+{
+    static const int seg_len[] = { 30, 30, 40 };
+    uint8_t frame[100];
+    uint8_t buf[200];
+    TestState t;
+    int i;
+
+    test_init(&t, 0);
+    tx_frame_init(frame, sizeof(frame));
+
+    tx_queue(&t, 0, frame, seg_len, ARRAY_SIZE(seg_len), 0, false);
+    tx_kick(&t);
+    assert_no_frame(&t);
+    g_assert_true(tx_owned(&t, 0));
+    g_assert_true(tx_owned(&t, 1));
+
+    /* Completed behind the back of the device, the poll timer finds it */
+    qtest_writel(t.qts, FTGMAC100_BASE + FTGMAC100_APTC,
+                 FTGMAC100_APTC_TXPOLL_CNT(1));
+    tx_queue(&t, 0, frame, seg_len, ARRAY_SIZE(seg_len), 0, true);
+    qtest_clock_step(t.qts, TXPOLL_PERIOD_NS);
+
+    g_assert_cmpint(recv_frame(&t, buf, sizeof(buf)), ==, sizeof(frame));
+    g_assert_cmpmem(buf, sizeof(frame), frame, sizeof(frame));
+    for (i = 0; i < ARRAY_SIZE(seg_len); i++) {
+        g_assert_false(tx_owned(&t, i));
+    }
+
+    /* The next frame starts after it */
+    tx_queue(&t, ARRAY_SIZE(seg_len), frame, seg_len, 1, 0, true);
+    tx_kick(&t);
+    g_assert_cmpint(recv_frame(&t, buf, sizeof(buf)), ==, seg_len[0]);
+
+    test_cleanup(&t);
+}
+
+/*
+ * The RX descriptors are read ahead. Moving the ring must drop them,
+ * even when the new ring starts on a descriptor that was read ahead.
+ */
+static void test_rx_ring_change(void)
+{
+    const uint32_t new_ring = RX_RING_ADDR + RXDES_SIZE;
+    const uint32_t new_buf = RX_BUF_ADDR + RX_RING_SIZE * RX_BUF_SIZE;
+    TestState t;
+    int i;
+
+    test_init(&t, 0);
+
+    send_frame(&t);
+    wait_rx(&t);
+
+    /* A new ring of 4 descriptors, from the second one of the old ring */
+    for (i = 0; i < 4; i++) {
+        uint32_t addr = new_ring + i * RXDES_SIZE;
+
+        qtest_writel(t.qts, addr, i == 3 ? RXDES0_EDORR : 0);
+        qtest_writel(t.qts, addr + 12, new_buf + i * RX_BUF_SIZE);
+    }
+    qtest_writel(t.qts, FTGMAC100_BASE + FTGMAC100_RXR_BADR, new_ring);
+    qtest_writel(t.qts, FTGMAC100_BASE + FTGMAC100_RXPD, 1);
+
+    send_frame(&t);
+    wait_rx(&t);
+
+    /* The frame went to the buffer of the new descriptor */
+    g_assert_cmphex(qtest_readl(t.qts, new_buf), ==, 0xffffffff);
+    g_assert_cmphex(qtest_readl(t.qts, RX_BUF_ADDR + RX_BUF_SIZE), ==, 0);
+
+    test_cleanup(&t);
+}
+
+static void test_itc_disabled(void)
+{
+    TestState t;
+
+    test_init(&t, 0);
+
+    send_frame(&t);
+    wait_rx(&t);
+    g_assert_true(rx_irq(&t));
+
+    test_cleanup(&t);
+}
+
+static void test_itc_timer(void)
+{
+    TestState t;
+
+    test_init(&t, FTGMAC100_ITC_RXINT_CNT(2));
+
+    send_frame(&t);
+    wait_rx(&t);
+    g_assert_false(rx_irq(&t));
+    g_assert_cmphex(qtest_readl(t.qts, FTGMAC100_BASE + FTGMAC100_ISR) &
+                    FTGMAC100_INT_RPKT_BUF, ==, FTGMAC100_INT_RPKT_BUF);
+
+    qtest_clock_step(t.qts, RXINT_PERIOD_NS);
+    g_assert_false(rx_irq(&t));
+    qtest_clock_step(t.qts, RXINT_PERIOD_NS);
+    g_assert_true(rx_irq(&t));
+
+    test_cleanup(&t);
+}
+
+static void test_itc_threshold(void)
+{
+    TestState t;
+    int i;
+
+    test_init(&t, FTGMAC100_ITC_RXINT_CNT(0xf) | FTGMAC100_ITC_RXINT_THR(4));
+
+    for (i = 0; i < 3; i++) {
+        send_frame(&t);
+        wait_rx(&t);
+        g_assert_false(rx_irq(&t));
+    }
+
+    send_frame(&t);
+    wait_rx(&t);
+    g_assert_true(rx_irq(&t));
+
+    test_cleanup(&t);
+}
+
+/*
+ * Receive frames the way a driver would: wait for the interrupt,
+ * acknowledge it, then hand back all the filled descriptors.
+ */
+static void rx_benchmark(uint32_t itc, const char *name)
+{
+    const int nr_frames = 4096;
+    int frames = 0;
+    int irqs = 0;
+    double elapsed;
+    TestState t;
+
+    test_init(&t, itc);
+    g_test_timer_start();
+
+    while (frames < nr_frames) {
+        int i;
+
+        for (i = 0; i < RX_RING_SIZE; i++) {
+            send_frame(&t);
+        }
+
+        i = 0;
+        while (i < RX_RING_SIZE) {
+            uint32_t addr = RX_RING_ADDR + t.rx_next * RXDES_SIZE;
+
+            while (!rx_irq(&t)) {
+                qtest_clock_step(t.qts, RXINT_PERIOD_NS / 4);
+            }
+            irqs++;
+            qtest_writel(t.qts, FTGMAC100_BASE + FTGMAC100_ISR,
+                         FTGMAC100_INT_RPKT_BUF);
+
+            while (i < RX_RING_SIZE &&
+                   (qtest_readl(t.qts, addr) & RXDES0_RXPKT_RDY)) {
+                qtest_writel(t.qts, addr,
+                             t.rx_next == RX_RING_SIZE - 1 ? RXDES0_EDORR : 0);
+                t.rx_next = (t.rx_next + 1) % RX_RING_SIZE;
+                addr = RX_RING_ADDR + t.rx_next * RXDES_SIZE;
+                i++;
+            }
+            qtest_writel(t.qts, FTGMAC100_BASE + FTGMAC100_RXPD, 1);
+        }
+        frames += RX_RING_SIZE;
+    }
+
+    elapsed = g_test_timer_elapsed();
+    g_test_message("%s: %d frames, %d interrupts, %.0f frames/s", name,
+                   frames, irqs, frames / elapsed);
+    g_test_minimized_result(elapsed, "%s: %.3f s", name, elapsed);
+
+    test_cleanup(&t);
+}
+
+static void test_rx_rate(void)
+{
+    rx_benchmark(0, "no moderation");
+    rx_benchmark(FTGMAC100_ITC_RXINT_CNT(1) | FTGMAC100_ITC_RXINT_THR(7),
+                 "moderation");
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/ast2600/ftgmac100/itc_disabled", test_itc_disabled);
+    qtest_add_func("/ast2600/ftgmac100/itc_timer", test_itc_timer);
+    qtest_add_func("/ast2600/ftgmac100/itc_threshold", test_itc_threshold);
+    qtest_add_func("/ast2600/ftgmac100/tx_segments", test_tx_segments);
+    qtest_add_func("/ast2600/ftgmac100/tx_segments_vlan",
+                   test_tx_segments_vlan);
+    qtest_add_func("/ast2600/ftgmac100/tx_pending", test_tx_pending);
+    qtest_add_func("/ast2600/ftgmac100/rx_ring_change", test_rx_ring_change);
+    if (g_test_perf()) {
+        qtest_add_func("/ast2600/ftgmac100/rx_rate", test_rx_rate);
+    }
+
+    return g_test_run();
+}
@@ -28,6 +28,12 @@
 #include "qapi/qmp/qdict.h"
 #include "libqtest-single.h"
 
+#define AST2600_GPIO_BASE 0x1E780000
+
+/* GPIO set A-D */
+#define GPIO_ABCD_DATA_VALUE 0x000
+#define GPIO_ABCD_DIRECTION  0x004
+
 static void test_set_colocated_pins(const void *data)
 {
     QTestState *s = (QTestState *)data;
@@ -46,6 +52,69 @@ static void test_set_colocated_pins(const void *data)
     g_assert(!qtest_qom_get_bool(s, "/machine/soc/gpio", "gpioV7"));
 }
 
+static uint32_t qom_get_set(QTestState *s, const char *name)
+{
+    QDict *r;
+    uint32_t value;
+
+    r = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                  "{ 'path': '/machine/soc/gpio', 'property': %s } }", name);
+    g_assert(qdict_haskey(r, "return"));
+    value = qdict_get_int(r, "return");
+    qobject_unref(r);
+
+    return value;
+}
+
+static void qom_set_set(QTestState *s, const char *name, uint32_t value)
+{
+    QDict *r;
+
+    r = qtest_qmp(s, "{ 'execute': 'qom-set', 'arguments': "
+                  "{ 'path': '/machine/soc/gpio', 'property': %s, "
+                  "'value': %u } }", name, value);
+    g_assert(qdict_haskey(r, "return"));
+    qobject_unref(r);
+}
+
+static void test_set_bulk(const void *data)
+{
+    QTestState *s = (QTestState *)data;
+    uint32_t value = qom_get_set(s, "gpio-set5");
+
+    /* gpioV4-7 are bits 12-15 of the set holding groups U, V, W and X */
+    value = (value & ~(0xf << 12)) | (0x5 << 12);
+    qom_set_set(s, "gpio-set5", value);
+    g_assert_cmphex(qom_get_set(s, "gpio-set5"), ==, value);
+    g_assert(qtest_qom_get_bool(s, "/machine/soc/gpio", "gpioV4"));
+    g_assert(!qtest_qom_get_bool(s, "/machine/soc/gpio", "gpioV5"));
+    g_assert(qtest_qom_get_bool(s, "/machine/soc/gpio", "gpioV6"));
+    g_assert(!qtest_qom_get_bool(s, "/machine/soc/gpio", "gpioV7"));
+
+    qtest_qom_set_bool(s, "/machine/soc/gpio", "gpioV5", true);
+    g_assert_cmphex(qom_get_set(s, "gpio-set5"), ==, value | BIT(13));
+}
+
+static void test_output_events(void)
+{
+    QTestState *s = qtest_init("-machine ast2600-evb "
+                               "-global aspeed.gpio-ast2600.events=on");
+    QDict *rsp, *data;
+
+    qtest_writel(s, AST2600_GPIO_BASE + GPIO_ABCD_DIRECTION, 0x3);
+    qtest_writel(s, AST2600_GPIO_BASE + GPIO_ABCD_DATA_VALUE, 0x3);
+
+    rsp = qtest_qmp_eventwait_ref(s, "GPIO_OUTPUT_CHANGE");
+    data = qdict_get_qdict(rsp, "data");
+    g_assert_cmpstr(qdict_get_str(data, "qom-path"), ==, "/machine/soc/gpio");
+    g_assert_cmpint(qdict_get_int(data, "set"), ==, 0);
+    g_assert_cmphex(qdict_get_int(data, "value"), ==, 0x3);
+    g_assert_cmphex(qdict_get_int(data, "changed"), ==, 0x3);
+    qobject_unref(rsp);
+
+    qtest_quit(s);
+}
+
 int main(int argc, char **argv)
 {
     QTestState *s;
@@ -56,6 +125,8 @@ int main(int argc, char **argv)
     s = qtest_init("-machine ast2600-evb");
     qtest_add_data_func("/ast2600/gpio/set_colocated_pins", s,
                         test_set_colocated_pins);
+    qtest_add_data_func("/ast2600/gpio/set_bulk", s, test_set_bulk);
+    qtest_add_func("/ast2600/gpio/output_events", test_output_events);
     r = g_test_run();
     qtest_quit(s);
 
@@ -148,6 +148,28 @@ static const uint8_t test_result_accum_sha256[] = {
     0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
     0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
 
+/*
+ * "a" repeated 64 times followed by "abc", hashed in several accumulative
+ * requests. The message is padded by test_sha256_accum_split().
+ *
+ *  echo -n -e "$(printf 'a%.0s' $(seq 64))abc" | sha256sum
+ */
+static const uint8_t test_result_accum_split_sha256[] = {
+    0x18, 0x91, 0x7c, 0x88, 0x75, 0x94, 0xf9, 0x5a, 0x0a, 0x81, 0x70, 0x1c,
+    0x58, 0x95, 0x33, 0xff, 0x21, 0xc7, 0x4b, 0x1f, 0xb5, 0x67, 0xe4, 0x52,
+    0x12, 0x72, 0xf3, 0x78, 0x15, 0xa6, 0x42, 0x75};
+
+/* The hash runs in the background, poll until the engine is idle */
+static void wait_hash_done(QTestState *s, uint32_t base)
+{
+    gint64 end = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+
+    while (qtest_readl(s, base + HACE_STS) & HACE_HASH_BUSY) {
+        g_assert_cmpint(g_get_monotonic_time(), <, end);
+        g_usleep(100);
+    }
+}
+
 static void write_regs(QTestState *s, uint32_t base, uint32_t src,
                        uint32_t length, uint32_t out, uint32_t method)
 {
@@ -155,6 +177,7 @@ static void write_regs(QTestState *s, uint32_t base, uint32_t src,
         qtest_writel(s, base + HACE_HASH_DIGEST, out);
         qtest_writel(s, base + HACE_HASH_DATA_LEN, length);
         qtest_writel(s, base + HACE_HASH_CMD, HACE_SHA_BE_EN | method);
+        wait_hash_done(s, base);
 }
 
 static void test_md5(const char *machine, const uint32_t base,
@@ -400,6 +423,60 @@ static void test_sha256_accum(const char *machine, const uint32_t base,
     qtest_quit(s);
 }
 
+/*
+ * Split one message over several requests, the way the driver streams
+ * data: only the last request holds the padding and gets a digest.
+ */
+static void test_sha256_accum_split(const char *machine, const uint32_t base,
+                                    const uint32_t src_addr)
+{
+    QTestState *s = qtest_init(machine);
+
+    const uint32_t buffer_addr = src_addr + 0x1000000;
+    const uint32_t digest_addr = src_addr + 0x4000000;
+    static const uint32_t chunks[][2] = { { 0, 32 }, { 32, 32 }, { 64, 64 } };
+    const uint8_t zero[32] = {0};
+    uint8_t vector[128] = {0};
+    uint8_t digest[32] = {0};
+    int i;
+
+    /* 67 bytes of message, then the padding and the length in bits */
+    memset(vector, 'a', 64);
+    memcpy(vector + 64, "abc", 3);
+    vector[67] = 0x80;
+    stq_be_p(vector + sizeof(vector) - 8, 67 * 8);
+
+    g_assert_cmphex(qtest_readl(s, base + HACE_STS), ==, 0);
+    qtest_memwrite(s, buffer_addr, vector, sizeof(vector));
+
+    for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+        struct AspeedSgList array[] = {
+            {  cpu_to_le32(chunks[i][1] | SG_LIST_LEN_LAST),
+               cpu_to_le32(buffer_addr + chunks[i][0]) },
+        };
+
+        qtest_memwrite(s, src_addr, array, sizeof(array));
+        write_regs(s, base, src_addr, chunks[i][1], digest_addr,
+                   HACE_ALGO_SHA256 | HACE_SG_EN | HACE_ACCUM_EN);
+
+        /* Each request completes */
+        g_assert_cmphex(qtest_readl(s, base + HACE_STS), ==, 0x00000200);
+        qtest_writel(s, base + HACE_STS, 0x00000200);
+        g_assert_cmphex(qtest_readl(s, base + HACE_STS), ==, 0);
+
+        /* But only the last one writes a digest */
+        qtest_memread(s, digest_addr, digest, sizeof(digest));
+        if (i < ARRAY_SIZE(chunks) - 1) {
+            g_assert_cmpmem(digest, sizeof(digest), zero, sizeof(zero));
+        }
+    }
+
+    g_assert_cmpmem(digest, sizeof(digest),
+                    test_result_accum_split_sha256, sizeof(digest));
+
+    qtest_quit(s);
+}
+
 static void test_sha512_accum(const char *machine, const uint32_t base,
                         const uint32_t src_addr)
 {
@@ -539,6 +616,11 @@ static void test_sha512_accum_ast2600(void)
     test_sha512_accum("-machine ast2600-evb", 0x1e6d0000, 0x80000000);
 }
 
+static void test_sha256_accum_split_ast2600(void)
+{
+    test_sha256_accum_split("-machine ast2600-evb", 0x1e6d0000, 0x80000000);
+}
+
 static void test_addresses_ast2600(void)
 {
     test_addresses("-machine ast2600-evb", 0x1e6d0000, &ast2600_masks);
@@ -600,6 +682,8 @@ int main(int argc, char **argv)
 
     qtest_add_func("ast2600/hace/sha512_accum", test_sha512_accum_ast2600);
     qtest_add_func("ast2600/hace/sha256_accum", test_sha256_accum_ast2600);
+    qtest_add_func("ast2600/hace/sha256_accum_split",
+                   test_sha256_accum_split_ast2600);
 
     qtest_add_func("ast2500/hace/addresses", test_addresses_ast2500);
     qtest_add_func("ast2500/hace/sha512", test_sha512_ast2500);
@@ -24,10 +24,18 @@
 
 #include "qemu/osdep.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
 #include "libqtest-single.h"
+#include <sys/mman.h>
+#include <sys/un.h>
 
 #define ASPEED_I2C_BASE 0x1E78A000
 #define ASPEED_I2C_BUS0_BASE (ASPEED_I2C_BASE + 0x80)
+#define ASPEED_I2C_BUS1_BASE (ASPEED_I2C_BASE + 0x100)
+#define ASPEED_I2C_BUS2_BASE (ASPEED_I2C_BASE + 0x180)
+#define ASPEED_I2C_BUS4_BASE (ASPEED_I2C_BASE + 0x280)
+#define ASPEED_I2C_BUS11_BASE (ASPEED_I2C_BASE + 0x600)
 #define I2C_CTRL_GLOBAL 0x0C
 #define   I2C_CTRL_NEW_REG_MODE BIT(2)
 #define I2CD_FUN_CTRL_REG 0x00
@@ -35,6 +43,8 @@
 #define   I2CD_MASTER_EN (0x1)
 #define I2CD_INTR_CTRL_REG 0x0c
 #define I2CD_INTR_STS_REG 0x10
+#define   I2CD_INTR_TX_NAK                 (0x1 << 1)
+#define   I2CD_INTR_TX_ACK                 (0x1 << 0)
 #define   I2CD_INTR_SLAVE_ADDR_RX_MATCH    (0x1 << 7)  /* use RX_DONE */
 #define   I2CD_INTR_NORMAL_STOP            (0x1 << 4)
 #define   I2CD_INTR_RX_DONE                (0x1 << 2)
@@ -55,25 +65,45 @@
 #define   I2CD_BYTE_BUF_TX_MASK            0xff
 #define   I2CD_BYTE_BUF_RX_SHIFT           8
 #define   I2CD_BYTE_BUF_RX_MASK            0xff
+#define I2CD_DMA_ADDR           0x24       /* DMA Buffer Address */
+#define I2CD_DMA_LEN            0x28       /* DMA Transfer Length < 4KB */
+
+#define ASPEED_DRAM_BASE 0x80000000
+#define DMA_OFFSET 0x100000
 
 #define DATA_LEN 1
 #define ACK_LEN 2
 #define START_LEN 3
 #define STOP_LEN 4
 
-static void aspeed_i2c_master_mode_tx(const uint8_t *buf, int len)
+#define FRAME_MAGIC 0xc2
+#define FRAME_HDR_LEN 5
+#define FRAME_WRITE 1
+#define FRAME_READ 2
+#define FRAME_RESULT 3
+#define FRAME_DATA 4
+#define FRAME_STATUS_OK 0
+#define FRAME_STATUS_DATA_NACK 2
+
+static void aspeed_i2c_bus_master_mode_tx(uint32_t base, const uint8_t *buf,
+                                          int len)
 {
     int i;
 
-    writel(ASPEED_I2C_BUS0_BASE + I2CD_BYTE_BUF_REG, buf[0]);
-    writel(ASPEED_I2C_BUS0_BASE + I2CD_CMD_REG, I2CD_M_START_CMD);
+    writel(base + I2CD_BYTE_BUF_REG, buf[0]);
+    writel(base + I2CD_CMD_REG, I2CD_M_START_CMD);
 
     for (i = 1; i < len; i++) {
-        writel(ASPEED_I2C_BUS0_BASE + I2CD_BYTE_BUF_REG, buf[i]);
-        writel(ASPEED_I2C_BUS0_BASE + I2CD_CMD_REG, I2CD_M_TX_CMD);
+        writel(base + I2CD_BYTE_BUF_REG, buf[i]);
+        writel(base + I2CD_CMD_REG, I2CD_M_TX_CMD);
     }
 
-    writel(ASPEED_I2C_BUS0_BASE + I2CD_CMD_REG, I2CD_M_STOP_CMD);
+    writel(base + I2CD_CMD_REG, I2CD_M_STOP_CMD);
+}
+
+static void aspeed_i2c_master_mode_tx(const uint8_t *buf, int len)
+{
+    aspeed_i2c_bus_master_mode_tx(ASPEED_I2C_BUS0_BASE, buf, len);
 }
 
 static void aspeed_i2c_slave_mode_enable(uint8_t addr)
@@ -112,6 +142,7 @@ static uint8_t aspeed_i2c_slave_mode_rx_byte(void)
 }
 
 static int udp_socket;
+static int udp_socket_batch;
 
 static void test_write_in_old_byte_mode(void)
 {
@@ -192,6 +223,430 @@ static void test_slave_mode_rx_byte_buf(void)
     g_assert(sts & I2CD_INTR_NORMAL_STOP);
 }
 
+static void test_write_batch(void)
+{
+    uint8_t pkt[] = {0x64, 0xde, 0xad, 0xbe, 0xef};
+    uint8_t buf[32];
+    ssize_t n;
+
+    writel(ASPEED_I2C_BUS1_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    writel(ASPEED_I2C_BUS1_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    aspeed_i2c_bus_master_mode_tx(ASPEED_I2C_BUS1_BASE, pkt, sizeof(pkt));
+
+    /* The whole transaction arrives as a single frame, without any ACKs */
+    n = recv(udp_socket_batch, buf, sizeof(buf), 0);
+    g_assert_cmpint(n, ==, FRAME_HDR_LEN + sizeof(pkt) - 1);
+    g_assert_cmphex(buf[0], ==, FRAME_MAGIC);
+    g_assert_cmphex(buf[1], ==, FRAME_WRITE);
+    g_assert_cmphex(buf[2], ==, pkt[0]);
+    g_assert_cmpint(buf[4], ==, sizeof(pkt) - 1);
+    g_assert(!memcmp(buf + FRAME_HDR_LEN, pkt + 1, sizeof(pkt) - 1));
+}
+
+static void batch_send_frame(uint8_t type, uint8_t addr, uint8_t status,
+                             const uint8_t *payload, int len)
+{
+    struct sockaddr_in dst = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = inet_addr("127.0.0.1"),
+        .sin_port = htons(6001),
+    };
+    uint8_t frame[FRAME_HDR_LEN + 32] = {
+        FRAME_MAGIC, type, addr, status, len
+    };
+
+    if (len) {
+        memcpy(frame + FRAME_HDR_LEN, payload, len);
+    }
+    g_assert_cmpint(sendto(udp_socket_batch, frame, FRAME_HDR_LEN + len, 0,
+                           (const struct sockaddr *)&dst, sizeof(dst)),
+                    ==, FRAME_HDR_LEN + len);
+
+    /* Let the main loop pick up the frame before the next command */
+    g_usleep(10 * 1000);
+    readl(ASPEED_I2C_BUS1_BASE + I2CD_INTR_STS_REG);
+}
+
+/* Returns the interrupt status of the START command, and clears it */
+static uint32_t aspeed_i2c_bus_start(uint32_t base, uint8_t addr)
+{
+    uint32_t sts;
+
+    writel(base + I2CD_BYTE_BUF_REG, addr);
+    writel(base + I2CD_CMD_REG, I2CD_M_START_CMD);
+    sts = readl(base + I2CD_INTR_STS_REG);
+    writel(base + I2CD_INTR_STS_REG, sts);
+
+    return sts & (I2CD_INTR_TX_ACK | I2CD_INTR_TX_NAK);
+}
+
+static void aspeed_i2c_bus_stop(uint32_t base)
+{
+    writel(base + I2CD_CMD_REG, I2CD_M_STOP_CMD);
+    writel(base + I2CD_INTR_STS_REG, 0xFFFFFFFF);
+}
+
+/*
+ * Reads @len bytes from register @reg of the slave at 0x32, with a write
+ * of the register index and a repeated start. Returns false when the
+ * read address is NACKed.
+ */
+static bool aspeed_i2c_bus_read(uint32_t base, uint8_t reg, uint8_t *buf,
+                                int len)
+{
+    int i;
+
+    g_assert_cmphex(aspeed_i2c_bus_start(base, 0x64), ==, I2CD_INTR_TX_ACK);
+    writel(base + I2CD_BYTE_BUF_REG, reg);
+    writel(base + I2CD_CMD_REG, I2CD_M_TX_CMD);
+
+    if (aspeed_i2c_bus_start(base, 0x65) != I2CD_INTR_TX_ACK) {
+        aspeed_i2c_bus_stop(base);
+        return false;
+    }
+
+    for (i = 0; i < len; i++) {
+        writel(base + I2CD_CMD_REG,
+               i == len - 1 ? I2CD_M_S_RX_CMD_LAST : I2CD_M_RX_CMD);
+        buf[i] = readl(base + I2CD_BYTE_BUF_REG) >> I2CD_BYTE_BUF_RX_SHIFT;
+        writel(base + I2CD_INTR_STS_REG, I2CD_INTR_RX_DONE);
+    }
+    aspeed_i2c_bus_stop(base);
+
+    return true;
+}
+
+/* The legacy protocol has no master receive, the read address is NACKed */
+static void test_read_in_old_byte_mode(void)
+{
+    uint8_t buf[32];
+
+    writel(ASPEED_I2C_BUS0_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    writel(ASPEED_I2C_BUS0_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    g_assert_cmphex(aspeed_i2c_bus_start(ASPEED_I2C_BUS0_BASE, 0x65), ==,
+                    I2CD_INTR_TX_NAK);
+    aspeed_i2c_bus_stop(ASPEED_I2C_BUS0_BASE);
+
+    /* Nothing goes out for the NACKed read */
+    g_assert_cmpint(recv(udp_socket, buf, sizeof(buf), MSG_DONTWAIT), ==, -1);
+}
+
+static void test_read_batch(void)
+{
+    uint8_t data[] = {0x11, 0x22, 0x33, 0x44};
+    uint8_t buf[32];
+    ssize_t n;
+
+    writel(ASPEED_I2C_BUS1_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    writel(ASPEED_I2C_BUS1_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    /* The first attempt is NACKed and goes out with its register index */
+    g_assert_false(aspeed_i2c_bus_read(ASPEED_I2C_BUS1_BASE, 0x10, buf, 2));
+    n = recv(udp_socket_batch, buf, sizeof(buf), 0);
+    g_assert_cmpint(n, ==, FRAME_HDR_LEN + 1);
+    g_assert_cmphex(buf[1], ==, FRAME_READ);
+    g_assert_cmphex(buf[2], ==, 0x65);
+    g_assert_cmpint(buf[4], ==, sizeof(data));
+    g_assert_cmphex(buf[FRAME_HDR_LEN], ==, 0x10);
+
+    /* Retries are NACKed without a new request until the data is in */
+    g_assert_false(aspeed_i2c_bus_read(ASPEED_I2C_BUS1_BASE, 0x10, buf, 2));
+    g_assert_cmpint(recv(udp_socket_batch, buf, sizeof(buf), MSG_DONTWAIT),
+                    ==, -1);
+
+    batch_send_frame(FRAME_DATA, 0x65, FRAME_STATUS_OK, data, sizeof(data));
+    g_assert_true(aspeed_i2c_bus_read(ASPEED_I2C_BUS1_BASE, 0x10, buf, 2));
+    g_assert(!memcmp(buf, data, 2));
+
+    /* The reply is consumed */
+    g_assert_false(aspeed_i2c_bus_read(ASPEED_I2C_BUS1_BASE, 0x10, buf, 2));
+    n = recv(udp_socket_batch, buf, sizeof(buf), 0);
+    g_assert_cmphex(buf[1], ==, FRAME_READ);
+    batch_send_frame(FRAME_DATA, 0x65, FRAME_STATUS_OK, data, sizeof(data));
+    g_assert_true(aspeed_i2c_bus_read(ASPEED_I2C_BUS1_BASE, 0x10, buf, 2));
+}
+
+static void test_write_batch_nack(void)
+{
+    uint8_t pkt[] = {0x64, 0x01, 0x02};
+    uint8_t buf[32];
+    ssize_t n;
+
+    writel(ASPEED_I2C_BUS1_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    writel(ASPEED_I2C_BUS1_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    aspeed_i2c_bus_master_mode_tx(ASPEED_I2C_BUS1_BASE, pkt, sizeof(pkt));
+    writel(ASPEED_I2C_BUS1_BASE + I2CD_INTR_STS_REG, 0xFFFFFFFF);
+    n = recv(udp_socket_batch, buf, sizeof(buf), 0);
+    g_assert_cmpint(n, ==, FRAME_HDR_LEN + sizeof(pkt) - 1);
+
+    /* The peer slave NACKed the second byte */
+    batch_send_frame(FRAME_RESULT, 0x64, FRAME_STATUS_DATA_NACK, NULL, 0);
+
+    /* The failure is reported on the next transfer, once */
+    g_assert_cmphex(aspeed_i2c_bus_start(ASPEED_I2C_BUS1_BASE, 0x64), ==,
+                    I2CD_INTR_TX_NAK);
+    g_assert_cmphex(aspeed_i2c_bus_start(ASPEED_I2C_BUS1_BASE, 0x64), ==,
+                    I2CD_INTR_TX_ACK);
+    aspeed_i2c_bus_stop(ASPEED_I2C_BUS1_BASE);
+    n = recv(udp_socket_batch, buf, sizeof(buf), 0);
+    g_assert_cmpint(n, ==, FRAME_HDR_LEN);
+    g_assert_cmphex(buf[1], ==, FRAME_WRITE);
+}
+
+/*
+ * Reads @len bytes from the slave at @addr after writing the @cmd bytes,
+ * one byte at a time.
+ */
+static void aspeed_i2c_bus_byte_read(uint32_t base, uint8_t addr,
+                                     const uint8_t *cmd, int cmd_len,
+                                     uint8_t *buf, int len)
+{
+    int i;
+
+    g_assert_cmphex(aspeed_i2c_bus_start(base, addr << 1), ==,
+                    I2CD_INTR_TX_ACK);
+    for (i = 0; i < cmd_len; i++) {
+        writel(base + I2CD_BYTE_BUF_REG, cmd[i]);
+        writel(base + I2CD_CMD_REG, I2CD_M_TX_CMD);
+        writel(base + I2CD_INTR_STS_REG, I2CD_INTR_TX_ACK);
+    }
+
+    g_assert_cmphex(aspeed_i2c_bus_start(base, addr << 1 | 1), ==,
+                    I2CD_INTR_TX_ACK);
+    for (i = 0; i < len; i++) {
+        writel(base + I2CD_CMD_REG,
+               i == len - 1 ? I2CD_M_S_RX_CMD_LAST : I2CD_M_RX_CMD);
+        buf[i] = readl(base + I2CD_BYTE_BUF_REG) >> I2CD_BYTE_BUF_RX_SHIFT;
+        writel(base + I2CD_INTR_STS_REG, I2CD_INTR_RX_DONE);
+    }
+    aspeed_i2c_bus_stop(base);
+}
+
+/* Sends the slave address and @buf in a single DMA transfer */
+static void aspeed_i2c_bus_dma_tx(uint32_t base, uint8_t addr,
+                                  const uint8_t *buf, int len, uint32_t cmd)
+{
+    uint32_t sts;
+
+    writeb(ASPEED_DRAM_BASE + DMA_OFFSET, addr << 1);
+    memwrite(ASPEED_DRAM_BASE + DMA_OFFSET + 1, buf, len);
+    writel(base + I2CD_DMA_ADDR, DMA_OFFSET);
+    writel(base + I2CD_DMA_LEN, len + 1);
+    writel(base + I2CD_CMD_REG, I2CD_M_START_CMD | I2CD_M_TX_CMD |
+           I2CD_TX_DMA_ENABLE | cmd);
+
+    sts = readl(base + I2CD_INTR_STS_REG);
+    writel(base + I2CD_INTR_STS_REG, sts);
+    g_assert_cmphex(sts & (I2CD_INTR_TX_ACK | I2CD_INTR_TX_NAK), ==,
+                    I2CD_INTR_TX_ACK);
+}
+
+/* The DMA variant of aspeed_i2c_bus_byte_read() */
+static void aspeed_i2c_bus_dma_read(uint32_t base, uint8_t addr,
+                                    const uint8_t *cmd, int cmd_len,
+                                    uint8_t *buf, int len)
+{
+    uint32_t sts;
+
+    aspeed_i2c_bus_dma_tx(base, addr, cmd, cmd_len, 0);
+
+    memset(buf, 0, len);
+    memwrite(ASPEED_DRAM_BASE + DMA_OFFSET, buf, len);
+    writel(base + I2CD_DMA_ADDR, DMA_OFFSET);
+    writel(base + I2CD_DMA_LEN, len);
+    writel(base + I2CD_BYTE_BUF_REG, addr << 1 | 1);
+    writel(base + I2CD_CMD_REG, I2CD_M_START_CMD | I2CD_M_RX_CMD |
+           I2CD_RX_DMA_ENABLE | I2CD_M_S_RX_CMD_LAST | I2CD_M_STOP_CMD);
+
+    sts = readl(base + I2CD_INTR_STS_REG);
+    writel(base + I2CD_INTR_STS_REG, sts);
+    g_assert_cmphex(sts & I2CD_INTR_TX_ACK, ==, I2CD_INTR_TX_ACK);
+    g_assert_cmphex(sts & I2CD_INTR_RX_DONE, ==, I2CD_INTR_RX_DONE);
+    g_assert_cmphex(sts & I2CD_INTR_NORMAL_STOP, ==, I2CD_INTR_NORMAL_STOP);
+
+    memread(ASPEED_DRAM_BASE + DMA_OFFSET, buf, len);
+}
+
+/* Block transfers with the AT24C EEPROM of the machine on bus 4 */
+static void test_dma_eeprom(void)
+{
+    uint8_t offset[] = {0x12, 0x34};
+    uint8_t data[2 + 64];
+    uint8_t buf[64];
+    int i;
+
+    writel(ASPEED_I2C_BUS4_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    writel(ASPEED_I2C_BUS4_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    memcpy(data, offset, sizeof(offset));
+    for (i = sizeof(offset); i < sizeof(data); i++) {
+        data[i] = i * 3;
+    }
+    aspeed_i2c_bus_dma_tx(ASPEED_I2C_BUS4_BASE, 0x51, data, sizeof(data),
+                          I2CD_M_STOP_CMD);
+
+    aspeed_i2c_bus_byte_read(ASPEED_I2C_BUS4_BASE, 0x51, offset,
+                             sizeof(offset), buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), data + sizeof(offset), sizeof(buf));
+
+    aspeed_i2c_bus_dma_read(ASPEED_I2C_BUS4_BASE, 0x51, offset,
+                            sizeof(offset), buf, sizeof(buf));
+    g_assert_cmpmem(buf, sizeof(buf), data + sizeof(offset), sizeof(buf));
+
+    /* A current address read continues where the block read stopped */
+    aspeed_i2c_bus_dma_read(ASPEED_I2C_BUS4_BASE, 0x51, offset,
+                            sizeof(offset), buf, sizeof(buf) / 2);
+    aspeed_i2c_bus_byte_read(ASPEED_I2C_BUS4_BASE, 0x51, NULL, 0,
+                             buf + sizeof(buf) / 2, sizeof(buf) / 2);
+    g_assert_cmpmem(buf, sizeof(buf), data + sizeof(offset), sizeof(buf));
+}
+
+/* Block reads of the ADM1272 hot swap controller of the machine on bus 11 */
+static void test_dma_pmbus(void)
+{
+    const char model[] = "ADM1272-A1";
+    uint8_t cmd;
+    uint8_t buf[32];
+    uint8_t expected[32];
+
+    writel(ASPEED_I2C_BUS11_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    writel(ASPEED_I2C_BUS11_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    /* MFR_MODEL, a block read with a length byte */
+    cmd = 0x9a;
+    aspeed_i2c_bus_dma_read(ASPEED_I2C_BUS11_BASE, 0x44, &cmd, 1, buf,
+                            strlen(model) + 1);
+    g_assert_cmpint(buf[0], ==, strlen(model));
+    g_assert_cmpmem(buf + 1, buf[0], model, strlen(model));
+
+    aspeed_i2c_bus_byte_read(ASPEED_I2C_BUS11_BASE, 0x44, &cmd, 1, expected,
+                             strlen(model) + 1);
+    g_assert_cmpmem(buf, strlen(model) + 1, expected, strlen(model) + 1);
+
+    /* READ_VIN, a word read */
+    cmd = 0x88;
+    aspeed_i2c_bus_dma_read(ASPEED_I2C_BUS11_BASE, 0x44, &cmd, 1, buf, 2);
+    aspeed_i2c_bus_byte_read(ASPEED_I2C_BUS11_BASE, 0x44, &cmd, 1, expected,
+                             2);
+    g_assert_cmpmem(buf, 2, expected, 2);
+    g_assert_cmphex(lduw_le_p(buf), !=, 0);
+}
+
+/*
+ * Shared memory transport of the device on bus 2, with shm-side=0. The
+ * test is the peer: it consumes the first ring and produces the second.
+ */
+#define SHM_SIZE (16 * KiB)
+#define SHM_RING_HDR_SIZE 64
+#define SHM_RING_SIZE 4096
+
+typedef struct ShmRing {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t need_kick;
+    uint32_t need_space;
+} ShmRing;
+
+static uint8_t *shm;
+static int shm_doorbell;
+
+static ShmRing *shm_ring(int side)
+{
+    return (ShmRing *)(shm + side * SHM_SIZE / 2);
+}
+
+static uint8_t *shm_data(int side, uint32_t pos)
+{
+    return shm + side * SHM_SIZE / 2 + SHM_RING_HDR_SIZE +
+        (pos & (SHM_RING_SIZE - 1));
+}
+
+/* Pops the next frame sent by the device and returns its length */
+static int shm_recv_frame(uint8_t *frame)
+{
+    ShmRing *ring = shm_ring(0);
+    uint32_t tail = ring->tail;
+    int i, len;
+
+    g_assert_cmphex(qatomic_load_acquire(&ring->head), !=, tail);
+    len = *shm_data(0, tail) | *shm_data(0, tail + 1) << 8;
+    for (i = 0; i < len; i++) {
+        frame[i] = *shm_data(0, tail + 2 + i);
+    }
+    qatomic_store_release(&ring->tail, tail + 2 + len);
+
+    return len;
+}
+
+static void shm_send_frame(uint8_t type, uint8_t addr, uint8_t count,
+                           const uint8_t *payload, int len)
+{
+    ShmRing *ring = shm_ring(1);
+    uint32_t head = ring->head;
+    uint8_t frame[FRAME_HDR_LEN + 32] = {
+        FRAME_MAGIC, type, addr, FRAME_STATUS_OK, count
+    };
+    uint8_t b = 0;
+    int i;
+
+    if (len) {
+        memcpy(frame + FRAME_HDR_LEN, payload, len);
+    }
+    *shm_data(1, head) = FRAME_HDR_LEN + len;
+    *shm_data(1, head + 1) = 0;
+    for (i = 0; i < FRAME_HDR_LEN + len; i++) {
+        *shm_data(1, head + 2 + i) = frame[i];
+    }
+    qatomic_store_release(&ring->head, head + 2 + FRAME_HDR_LEN + len);
+
+    /* The device waits for the doorbell once it has drained the ring */
+    smp_mb();
+    g_assert(qatomic_read(&ring->need_kick));
+    qatomic_set(&ring->need_kick, 0);
+    g_assert_cmpint(write(shm_doorbell, &b, 1), ==, 1);
+
+    g_usleep(10 * 1000);
+    readl(ASPEED_I2C_BUS2_BASE + I2CD_INTR_STS_REG);
+    g_assert_cmphex(qatomic_load_acquire(&ring->tail), ==, ring->head);
+}
+
+static void test_shm(void)
+{
+    uint8_t pkt[] = {0x64, 0xca, 0xfe};
+    uint8_t data[] = {0x55, 0xaa, 0x5a, 0xa5};
+    uint8_t frame[FRAME_HDR_LEN + 32];
+    uint8_t buf[sizeof(data)];
+
+    writel(ASPEED_I2C_BUS2_BASE + I2CD_FUN_CTRL_REG, I2CD_MASTER_EN);
+    writel(ASPEED_I2C_BUS2_BASE + I2CD_INTR_CTRL_REG, 0xFFFFFFFF);
+
+    aspeed_i2c_bus_master_mode_tx(ASPEED_I2C_BUS2_BASE, pkt, sizeof(pkt));
+    writel(ASPEED_I2C_BUS2_BASE + I2CD_INTR_STS_REG, 0xFFFFFFFF);
+    g_assert_cmpint(shm_recv_frame(frame), ==, FRAME_HDR_LEN + 2);
+    g_assert_cmphex(frame[0], ==, FRAME_MAGIC);
+    g_assert_cmphex(frame[1], ==, FRAME_WRITE);
+    g_assert_cmphex(frame[2], ==, pkt[0]);
+    g_assert_cmpint(frame[4], ==, 2);
+    g_assert(!memcmp(frame + FRAME_HDR_LEN, pkt + 1, 2));
+    shm_send_frame(FRAME_RESULT, pkt[0], 2, NULL, 0);
+
+    g_assert_false(aspeed_i2c_bus_read(ASPEED_I2C_BUS2_BASE, 0x20, buf,
+                                       sizeof(buf)));
+    g_assert_cmpint(shm_recv_frame(frame), ==, FRAME_HDR_LEN + 1);
+    g_assert_cmphex(frame[1], ==, FRAME_READ);
+    g_assert_cmphex(frame[2], ==, 0x65);
+    g_assert_cmpint(frame[4], ==, sizeof(data));
+    g_assert_cmphex(frame[FRAME_HDR_LEN], ==, 0x20);
+    shm_send_frame(FRAME_DATA, 0x65, sizeof(data), data, sizeof(data));
+
+    g_assert_true(aspeed_i2c_bus_read(ASPEED_I2C_BUS2_BASE, 0x20, buf,
+                                      sizeof(buf)));
+    g_assert(!memcmp(buf, data, sizeof(data)));
+}
+
 static int udp_socket_init(const char *ip_addr, uint16_t port)
 {
     bool reuseaddr = true;
@@ -219,25 +674,76 @@ static int udp_socket_init(const char *ip_addr, uint16_t port)
 
 int main(int argc, char **argv)
 {
-    int ret;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    g_autofree char *dir = NULL;
+    g_autofree char *shm_path = NULL;
+    g_autofree char *sock_path = NULL;
+    int ret, fd, lfd;
 
     udp_socket = udp_socket_init("127.0.0.1", 5000);
     if (udp_socket == -1) {
         return 1;
     }
+    udp_socket_batch = udp_socket_init("127.0.0.1", 5001);
+    if (udp_socket_batch == -1) {
+        return 1;
+    }
+
+    dir = g_dir_make_tmp("aspeed_i2c_XXXXXX", NULL);
+    g_assert(dir);
+    shm_path = g_build_filename(dir, "shm", NULL);
+    sock_path = g_build_filename(dir, "doorbell.sock", NULL);
+
+    fd = open(shm_path, O_RDWR | O_CREAT, 0600);
+    g_assert(fd >= 0);
+    g_assert(ftruncate(fd, SHM_SIZE) == 0);
+    shm = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    g_assert(shm != MAP_FAILED);
+    close(fd);
+
+    g_strlcpy(addr.sun_path, sock_path, sizeof(addr.sun_path));
+    lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_assert(lfd >= 0);
+    g_assert(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    g_assert(listen(lfd, 1) == 0);
 
     g_test_init(&argc, &argv, NULL);
 
     global_qtest = qtest_initf("-machine fby35-bmc "
                                "-netdev socket,id=socket0,udp=localhost:5000,localaddr=localhost:6000 "
-                               "-device i2c-netdev2,bus=aspeed.i2c.bus.0,address=0x32,netdev=socket0");
+                               "-device i2c-netdev2,bus=aspeed.i2c.bus.0,address=0x32,netdev=socket0 "
+                               "-netdev socket,id=socket1,udp=localhost:5001,localaddr=localhost:6001 "
+                               "-device i2c-netdev2,bus=aspeed.i2c.bus.1,address=0x32,netdev=socket1,batch=on,"
+                               "read-len=4 "
+                               "-object memory-backend-file,id=shm,size=16K,mem-path=%s,share=on "
+                               "-chardev socket,id=doorbell,path=%s "
+                               "-device i2c-netdev2,bus=aspeed.i2c.bus.2,address=0x32,batch=on,"
+                               "read-len=4,memdev=shm,chardev=doorbell",
+                               shm_path, sock_path);
+    shm_doorbell = accept(lfd, NULL, NULL);
+    g_assert(shm_doorbell >= 0);
+    close(lfd);
 
     qtest_add_func("/ast2600/i2c/write_in_old_byte_mode", test_write_in_old_byte_mode);
     qtest_add_func("/ast2600/i2c/slave_mode_rx_byte_buf", test_slave_mode_rx_byte_buf);
+    qtest_add_func("/ast2600/i2c/read_in_old_byte_mode",
+                   test_read_in_old_byte_mode);
+    qtest_add_func("/ast2600/i2c/write_batch", test_write_batch);
+    qtest_add_func("/ast2600/i2c/write_batch_nack", test_write_batch_nack);
+    qtest_add_func("/ast2600/i2c/read_batch", test_read_batch);
+    qtest_add_func("/ast2600/i2c/shm", test_shm);
+    qtest_add_func("/ast2600/i2c/dma_eeprom", test_dma_eeprom);
+    qtest_add_func("/ast2600/i2c/dma_pmbus", test_dma_pmbus);
 
     ret = g_test_run();
     qtest_quit(global_qtest);
     close(udp_socket);
+    close(udp_socket_batch);
+    close(shm_doorbell);
+    munmap(shm, SHM_SIZE);
+    unlink(shm_path);
+    unlink(sock_path);
+    rmdir(dir);
 
     return ret;
 }
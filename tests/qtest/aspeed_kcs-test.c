@@ -0,0 +1,228 @@
+/*
+ * QTest testcase for the KCS channels of the ASPEED LPC Controller
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "libqtest.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LPC_BASE                0x1E789000
+#define   HICR0                 0x00
+#define     HICR0_LPC3E         BIT(7)
+#define   HICR2                 0x08
+#define     HICR2_IBFIE3        BIT(3)
+#define   HICR4                 0x10
+#define     HICR4_KCSENBL       BIT(2)
+#define   IDR3                  0x2C
+#define   ODR3                  0x38
+#define   STR3                  0x44
+#define     STR_IBF             BIT(1)
+#define     STR_CMD_DATA        BIT(3)
+#define KCS3_GIC_IRQ            140
+
+#define KCS_STATE_IDLE          0
+#define KCS_STATE_READ          1
+#define KCS_STATE_WRITE         2
+
+#define KCS_CMD_WRITE_START     0x61
+#define KCS_CMD_WRITE_END       0x62
+#define KCS_CMD_READ_BYTE       0x68
+
+#define FRAME_HDR_SIZE          4
+#define FRAME_MSG               0x01
+
+typedef struct TestState {
+    QTestState *qts;
+    char *dir;
+    char *path;
+    int fd;
+} TestState;
+
+static void test_init(TestState *t)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int lfd;
+
+    t->dir = g_dir_make_tmp("aspeed_kcs_XXXXXX", NULL);
+    g_assert(t->dir);
+    t->path = g_build_filename(t->dir, "kcs.sock", NULL);
+    g_strlcpy(addr.sun_path, t->path, sizeof(addr.sun_path));
+
+    lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_assert(lfd >= 0);
+    g_assert(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    g_assert(listen(lfd, 1) == 0);
+
+    t->qts = qtest_initf("-machine ast2600-evb "
+                         "-chardev socket,id=kcs,path=%s "
+                         "-global aspeed.lpc.kcs3-chardev=kcs", t->path);
+    qtest_irq_intercept_in(t->qts, "/machine/soc/a7mpcore/gic");
+
+    t->fd = accept(lfd, NULL, NULL);
+    g_assert(t->fd >= 0);
+    close(lfd);
+
+    /* Enable the channel as the BMC firmware does */
+    qtest_writel(t->qts, LPC_BASE + HICR0, HICR0_LPC3E);
+    qtest_writel(t->qts, LPC_BASE + HICR4, HICR4_KCSENBL);
+    qtest_writel(t->qts, LPC_BASE + HICR2, HICR2_IBFIE3);
+}
+
+static void test_cleanup(TestState *t)
+{
+    qtest_quit(t->qts);
+    close(t->fd);
+    unlink(t->path);
+    rmdir(t->dir);
+    g_free(t->path);
+    g_free(t->dir);
+}
+
+static void host_send(TestState *t, uint8_t msg_id, const uint8_t *msg,
+                      size_t len)
+{
+    uint8_t frame[FRAME_HDR_SIZE + 64] = { FRAME_MSG, msg_id };
+
+    stw_le_p(&frame[2], len);
+    memcpy(&frame[FRAME_HDR_SIZE], msg, len);
+    g_assert_cmpint(write(t->fd, frame, FRAME_HDR_SIZE + len), ==,
+                    FRAME_HDR_SIZE + len);
+}
+
+static void host_recv(TestState *t, uint8_t msg_id, const uint8_t *msg,
+                      size_t len)
+{
+    uint8_t frame[FRAME_HDR_SIZE + 64];
+
+    g_assert_cmpint(recv(t->fd, frame, FRAME_HDR_SIZE + len, MSG_WAITALL),
+                    ==, FRAME_HDR_SIZE + len);
+    g_assert_cmphex(frame[0], ==, FRAME_MSG);
+    g_assert_cmphex(frame[1], ==, msg_id);
+    g_assert_cmpuint(lduw_le_p(&frame[2]), ==, len);
+    g_assert(!memcmp(&frame[FRAME_HDR_SIZE], msg, len));
+}
+
+/* The BMC side follows the sequence of the Linux kcs_bmc driver */
+static uint32_t bmc_wait_ibf(TestState *t)
+{
+    int count = 1000;
+    uint32_t str;
+
+    while (!((str = qtest_readl(t->qts, LPC_BASE + STR3)) & STR_IBF)) {
+        g_assert(--count);
+        g_usleep(1000);
+    }
+    g_assert(qtest_get_irq(t->qts, KCS3_GIC_IRQ));
+
+    return str;
+}
+
+static void bmc_set_state(TestState *t, uint8_t state)
+{
+    uint32_t str = qtest_readl(t->qts, LPC_BASE + STR3);
+
+    qtest_writel(t->qts, LPC_BASE + STR3, (str & ~0xc0) | state << 6);
+}
+
+static uint8_t bmc_read_byte(TestState *t, bool ack)
+{
+    bmc_set_state(t, ack ? KCS_STATE_WRITE : KCS_STATE_READ);
+    if (ack) {
+        qtest_writel(t->qts, LPC_BASE + ODR3, 0);
+    }
+
+    return qtest_readl(t->qts, LPC_BASE + IDR3);
+}
+
+static size_t bmc_recv(TestState *t, uint8_t *msg)
+{
+    size_t len = 0;
+
+    g_assert(bmc_wait_ibf(t) & STR_CMD_DATA);
+    g_assert_cmphex(bmc_read_byte(t, true), ==, KCS_CMD_WRITE_START);
+
+    for (;;) {
+        if (bmc_wait_ibf(t) & STR_CMD_DATA) {
+            g_assert_cmphex(bmc_read_byte(t, true), ==, KCS_CMD_WRITE_END);
+            g_assert_false(bmc_wait_ibf(t) & STR_CMD_DATA);
+            msg[len++] = bmc_read_byte(t, false);
+            return len;
+        }
+        msg[len++] = bmc_read_byte(t, true);
+    }
+}
+
+static void bmc_send(TestState *t, const uint8_t *msg, size_t len)
+{
+    size_t i;
+
+    qtest_writel(t->qts, LPC_BASE + ODR3, msg[0]);
+    for (i = 1; ; i++) {
+        bmc_wait_ibf(t);
+        if (i == len) {
+            bmc_set_state(t, KCS_STATE_IDLE);
+        }
+        g_assert_cmphex(qtest_readl(t->qts, LPC_BASE + IDR3), ==,
+                        KCS_CMD_READ_BYTE);
+        if (i == len) {
+            qtest_writel(t->qts, LPC_BASE + ODR3, 0);
+            return;
+        }
+        qtest_writel(t->qts, LPC_BASE + ODR3, msg[i]);
+    }
+}
+
+static void test_transfer(void)
+{
+    /* Get Device ID, with some extra data to go through the write phase */
+    static const uint8_t req[] = { 0x18, 0x01, 0xaa, 0x55 };
+    static const uint8_t rsp[] = { 0x1c, 0x01, 0x00, 0x20, 0x81, 0x02 };
+    uint8_t msg[64];
+    TestState t;
+    int i;
+
+    test_init(&t);
+
+    for (i = 0; i < 2; i++) {
+        host_send(&t, 0x40 + i, req, sizeof(req));
+        g_assert_cmpuint(bmc_recv(&t, msg), ==, sizeof(req));
+        g_assert(!memcmp(msg, req, sizeof(req)));
+        bmc_send(&t, rsp, sizeof(rsp));
+        host_recv(&t, 0x40 + i, rsp, sizeof(rsp));
+    }
+
+    test_cleanup(&t);
+}
+
+static void test_disabled(void)
+{
+    static const uint8_t req[] = { 0x18, 0x01 };
+    static const uint8_t rsp[] = { 0x1c, 0x01, 0xd2 };
+    TestState t;
+
+    test_init(&t);
+
+    qtest_writel(t.qts, LPC_BASE + HICR0, 0);
+    host_send(&t, 0x10, req, sizeof(req));
+    host_recv(&t, 0x10, rsp, sizeof(rsp));
+    g_assert_false(qtest_readl(t.qts, LPC_BASE + STR3) & STR_IBF);
+
+    test_cleanup(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/ast2600/kcs/transfer", test_transfer);
+    qtest_add_func("/ast2600/kcs/disabled", test_disabled);
+
+    return g_test_run();
+}
@@ -0,0 +1,175 @@
+/*
+ * QTest testcase for the Aspeed PECI Controller and the PECI CPU client
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/timer.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define PECI_BASE               0x1E78B000
+#define PECI_GIC_IRQ            38
+#define   PECI_CMD              0x08
+#define     PECI_CMD_STS_MASK   (0xf << 24)
+#define     PECI_CMD_FIRE       BIT(0)
+#define   PECI_RW_LENGTH        0x0c
+#define   PECI_EXPECTED_FCS     0x10
+#define   PECI_CAPTURED_FCS     0x14
+#define   PECI_INT_CTRL         0x18
+#define   PECI_INT_STS          0x1c
+#define     PECI_INT_CMD_DONE   BIT(0)
+#define   PECI_WR_DATA0         0x20
+#define   PECI_WR_DATA1         0x24
+#define   PECI_RD_DATA0         0x30
+#define   PECI_RD_DATA1         0x34
+#define   PECI_RD_DATA2         0x38
+
+#define PECI_CPU_ADDR           0x30
+#define PECI_CC_SUCCESS         0x40
+
+/* One bit at the default rate of 1 MHz */
+#define PECI_BIT_NS             1000
+
+static QTestState *peci_init(const char *extra)
+{
+    QTestState *qts;
+
+    qts = qtest_initf("-machine ast2600-evb "
+                      "-device peci-cpu,bus=aspeed.peci,id=cpu0%s", extra);
+    qtest_irq_intercept_in(qts, "/machine/soc/a7mpcore/gic");
+    qtest_writel(qts, PECI_BASE + PECI_INT_CTRL, PECI_INT_CMD_DONE);
+
+    return qts;
+}
+
+static void peci_fire(QTestState *qts, uint8_t addr, uint8_t wlen,
+                      uint8_t rlen, uint32_t wr0, uint32_t wr1)
+{
+    qtest_writel(qts, PECI_BASE + PECI_RW_LENGTH,
+                 rlen << 16 | wlen << 8 | addr);
+    qtest_writel(qts, PECI_BASE + PECI_WR_DATA0, wr0);
+    qtest_writel(qts, PECI_BASE + PECI_WR_DATA1, wr1);
+    qtest_writel(qts, PECI_BASE + PECI_CMD, PECI_CMD_FIRE);
+}
+
+static void peci_wait(QTestState *qts)
+{
+    while (!qtest_get_irq(qts, PECI_GIC_IRQ)) {
+        qtest_clock_step(qts, 8 * PECI_BIT_NS);
+    }
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_INT_STS), ==,
+                    PECI_INT_CMD_DONE);
+    qtest_writel(qts, PECI_BASE + PECI_INT_STS, PECI_INT_CMD_DONE);
+    g_assert_false(qtest_get_irq(qts, PECI_GIC_IRQ));
+}
+
+static void test_get_temp(void)
+{
+    QTestState *qts = peci_init("");
+    QDict *rsp;
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'qom-set', 'arguments': "
+                    "{ 'path': '/machine/peripheral/cpu0', "
+                    "'property': 'temperature', 'value': 70000 } }");
+    g_assert(qdict_haskey(rsp, "return"));
+    qobject_unref(rsp);
+
+    /* GetTemp() takes 70 bits on the wire */
+    peci_fire(qts, PECI_CPU_ADDR, 1, 2, 0x01, 0);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_CMD) &
+                    PECI_CMD_STS_MASK, !=, 0);
+    qtest_clock_step(qts, 69 * PECI_BIT_NS);
+    g_assert_false(qtest_get_irq(qts, PECI_GIC_IRQ));
+    qtest_clock_step(qts, PECI_BIT_NS);
+    g_assert_true(qtest_get_irq(qts, PECI_GIC_IRQ));
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_CMD) &
+                    PECI_CMD_STS_MASK, ==, 0);
+
+    /* 30 degrees below Tjmax, in 1/64 degree */
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_RD_DATA0) & 0xffff, ==,
+                    (uint16_t)(-30 * 64));
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_CAPTURED_FCS), ==,
+                    qtest_readl(qts, PECI_BASE + PECI_EXPECTED_FCS));
+
+    qtest_quit(qts);
+}
+
+static void test_rd_pkg_config(void)
+{
+    QTestState *qts = peci_init(",tjmax=95,tcontrol=5");
+
+    /* RdPkgConfig() of the temperature target */
+    peci_fire(qts, PECI_CPU_ADDR, 5, 5, 16 << 16 | 0xa1, 0);
+    peci_wait(qts);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_RD_DATA0), ==,
+                    95 << 24 | 5 << 16 | PECI_CC_SUCCESS);
+
+    qtest_quit(qts);
+}
+
+static void test_rd_ia_msr(void)
+{
+    const char *table = "# An MSR of the first thread\n"
+                        "msr 0 0x1234 0x1122334455667788\n";
+    g_autofree char *path = NULL;
+    g_autofree char *extra = NULL;
+    GError *error = NULL;
+    QTestState *qts;
+    int fd;
+
+    fd = g_file_open_tmp("peci_cpu_XXXXXX", &path, &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(write(fd, table, strlen(table)), ==, strlen(table));
+    close(fd);
+
+    extra = g_strdup_printf(",table=%s", path);
+    qts = peci_init(extra);
+
+    peci_fire(qts, PECI_CPU_ADDR, 5, 9, 0x34 << 24 | 0xb1, 0x12);
+    peci_wait(qts);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_RD_DATA0), ==,
+                    0x66778800 | PECI_CC_SUCCESS);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_RD_DATA1), ==,
+                    0x22334455);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_RD_DATA2) & 0xff, ==,
+                    0x11);
+
+    /* Not in the table */
+    peci_fire(qts, PECI_CPU_ADDR, 5, 9, 0x35 << 24 | 0xb1, 0x12);
+    peci_wait(qts);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_RD_DATA0) & 0xff, ==,
+                    0x90);
+
+    qtest_quit(qts);
+    unlink(path);
+}
+
+static void test_no_client(void)
+{
+    QTestState *qts = peci_init("");
+
+    /* Ping() */
+    peci_fire(qts, PECI_CPU_ADDR + 1, 0, 0, 0, 0);
+    peci_wait(qts);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_CAPTURED_FCS), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, PECI_BASE + PECI_EXPECTED_FCS), !=, 0);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/ast2600/peci/get_temp", test_get_temp);
+    qtest_add_func("/ast2600/peci/rd_pkg_config", test_rd_pkg_config);
+    qtest_add_func("/ast2600/peci/rd_ia_msr", test_rd_ia_msr);
+    qtest_add_func("/ast2600/peci/no_client", test_no_client);
+
+    return g_test_run();
+}
@@ -27,6 +27,7 @@
 #include "qemu/bswap.h"
 #include "libqtest-single.h"
 #include "qemu/bitops.h"
+#include "qapi/qmp/qdict.h"
 
 /*
  * ASPEED SPI Controller registers
@@ -35,16 +36,25 @@
 #define   CONF_ENABLE_W0       (1 << 16)
 #define R_CE_CTRL           0x04
 #define   CRTL_EXTENDED0       0  /* 32 bit addressing for SPI */
+#define R_INTR_CTRL         0x08
+#define   INTR_CTRL_DMA_STATUS (1 << 11)
 #define R_CTRL0             0x10
 #define   CTRL_CE_STOP_ACTIVE  (1 << 2)
 #define   CTRL_READMODE        0x0
 #define   CTRL_FREADMODE       0x1
 #define   CTRL_WRITEMODE       0x2
 #define   CTRL_USERMODE        0x3
+#define R_DMA_CTRL          0x80
+#define   DMA_CTRL_ENABLE      (1 << 0)
+#define R_DMA_FLASH_ADDR    0x84
+#define R_DMA_DRAM_ADDR     0x88
+#define R_DMA_LEN           0x8C
+#define R_DMA_CHECKSUM      0x90
 #define SR_WEL BIT(1)
 
 #define ASPEED_FMC_BASE    0x1E620000
 #define ASPEED_FLASH_BASE  0x20000000
+#define ASPEED_DRAM_BASE   0x40000000
 
 /*
  * Flash commands
@@ -63,12 +73,14 @@ enum {
     RESET_MEMORY = 0x99,
     EN_4BYTE_ADDR = 0xB7,
     ERASE_SECTOR = 0xd8,
+    ERASE_4K = 0x20,
 };
 
 #define FLASH_JEDEC         0x20ba19  /* n25q256a */
 #define FLASH_SIZE          (32 * 1024 * 1024)
 
 #define FLASH_PAGE_SIZE           256
+#define FLASH_SECTOR_SIZE         (64 * 1024)
 
 /*
  * Use an explicit bswap for the values read/wrote to the flash region
@@ -423,6 +435,56 @@ static void test_write_page_mem(void)
     flash_reset();
 }
 
+static void test_dma_read(void)
+{
+    uint32_t my_page_addr = 0x16000 * FLASH_PAGE_SIZE;
+    uint32_t dram_addr = 0x100000;
+    uint32_t checksum = 0;
+    int i;
+
+    spi_ce_ctrl(1 << CRTL_EXTENDED0);
+
+    spi_conf(CONF_ENABLE_W0);
+    spi_ctrl_start_user();
+    writeb(ASPEED_FLASH_BASE, EN_4BYTE_ADDR);
+    writeb(ASPEED_FLASH_BASE, WREN);
+    writeb(ASPEED_FLASH_BASE, PP);
+    writel(ASPEED_FLASH_BASE, make_be32(my_page_addr));
+
+    /* Fill the page with its own addresses */
+    for (i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+        writel(ASPEED_FLASH_BASE, make_be32(my_page_addr + i * 4));
+    }
+    spi_ctrl_stop_user();
+    spi_conf_remove(CONF_ENABLE_W0);
+
+    /* DMA the page from flash to DRAM */
+    spi_ctrl_setmode(CTRL_READMODE, READ);
+    writel(ASPEED_FMC_BASE + R_DMA_FLASH_ADDR, my_page_addr);
+    writel(ASPEED_FMC_BASE + R_DMA_DRAM_ADDR, dram_addr);
+    writel(ASPEED_FMC_BASE + R_DMA_LEN, FLASH_PAGE_SIZE);
+    writel(ASPEED_FMC_BASE + R_DMA_CTRL, DMA_CTRL_ENABLE);
+
+    g_assert(readl(ASPEED_FMC_BASE + R_INTR_CTRL) & INTR_CTRL_DMA_STATUS);
+    g_assert_cmphex(readl(ASPEED_FMC_BASE + R_DMA_LEN), ==, 0);
+    g_assert_cmphex(readl(ASPEED_FMC_BASE + R_DMA_FLASH_ADDR), ==,
+                    my_page_addr + FLASH_PAGE_SIZE);
+    g_assert_cmphex(readl(ASPEED_FMC_BASE + R_DMA_DRAM_ADDR), ==,
+                    dram_addr + FLASH_PAGE_SIZE);
+
+    for (i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+        uint32_t data = readl(ASPEED_DRAM_BASE + dram_addr + i * 4);
+
+        g_assert_cmphex(make_be32(data), ==, my_page_addr + i * 4);
+        checksum += data;
+    }
+    g_assert_cmphex(readl(ASPEED_FMC_BASE + R_DMA_CHECKSUM), ==, checksum);
+
+    writel(ASPEED_FMC_BASE + R_DMA_CTRL, 0);
+
+    flash_reset();
+}
+
 static void test_read_status_reg(void)
 {
     uint8_t r;
@@ -608,6 +670,334 @@ static void test_write_block_protect_bottom_bit(void)
     flash_reset();
 }
 
+/*
+ * The tests below run on a machine of their own, with a backing file
+ * prefilled by the test and the extra @args they need.
+ */
+static QTestState *flash_machine_init(const char *path, const char *args)
+{
+    QTestState *s = global_qtest;
+
+    global_qtest = qtest_initf("-m 256 -machine palmetto-bmc "
+                               "-drive file=%s,format=raw,if=mtd %s",
+                               path, args);
+    return s;
+}
+
+static void flash_machine_quit(QTestState *s)
+{
+    qtest_quit(global_qtest);
+    global_qtest = s;
+}
+
+static int flash_image_create(char **path, uint8_t **image)
+{
+    int fd = g_file_open_tmp("qtest.m25p80.XXXXXX", path, NULL);
+
+    g_assert(fd >= 0);
+    g_assert(ftruncate(fd, FLASH_SIZE) == 0);
+    *image = g_malloc0(FLASH_SIZE);
+    return fd;
+}
+
+/* Fills a sector of the image and of the backing file with a pattern */
+static void flash_image_fill(int fd, uint8_t *image, uint32_t addr,
+                             uint8_t seed)
+{
+    int i;
+
+    for (i = 0; i < FLASH_SECTOR_SIZE; i++) {
+        image[addr + i] = (i * 7) ^ seed;
+    }
+    g_assert_cmpint(pwrite(fd, image + addr, FLASH_SECTOR_SIZE, addr), ==,
+                    FLASH_SECTOR_SIZE);
+}
+
+static void program_page(uint8_t *image, uint32_t addr, uint32_t value)
+{
+    int i;
+
+    spi_ctrl_start_user();
+    writeb(ASPEED_FLASH_BASE, EN_4BYTE_ADDR);
+    writeb(ASPEED_FLASH_BASE, WREN);
+    writeb(ASPEED_FLASH_BASE, PP);
+    writel(ASPEED_FLASH_BASE, make_be32(addr));
+    for (i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+        writel(ASPEED_FLASH_BASE, make_be32(value));
+    }
+    spi_ctrl_stop_user();
+
+    /* Programming can only clear bits */
+    for (i = 0; i < FLASH_PAGE_SIZE; i++) {
+        image[addr + i] &= value >> (24 - (i % 4) * 8);
+    }
+}
+
+static void erase(uint8_t *image, uint8_t cmd, uint32_t addr, uint32_t len)
+{
+    spi_ctrl_start_user();
+    writeb(ASPEED_FLASH_BASE, EN_4BYTE_ADDR);
+    writeb(ASPEED_FLASH_BASE, WREN);
+    writeb(ASPEED_FLASH_BASE, cmd);
+    writel(ASPEED_FLASH_BASE, make_be32(addr));
+    spi_ctrl_stop_user();
+
+    memset(image + addr, 0xff, len);
+}
+
+static void assert_page(uint32_t *page, const uint8_t *image, uint32_t addr)
+{
+    int i;
+
+    for (i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+        g_assert_cmphex(page[i], ==, ldl_be_p(image + addr + i * 4));
+    }
+}
+
+static void assert_file(const char *path, const uint8_t *image)
+{
+    g_autofree char *contents = NULL;
+    gsize len;
+
+    g_assert(g_file_get_contents(path, &contents, &len, NULL));
+    g_assert_cmpmem(contents, len, image, FLASH_SIZE);
+}
+
+static void test_lazy_load(void)
+{
+    uint32_t read_addr = 0x10 * FLASH_SECTOR_SIZE;
+    uint32_t mem_addr = 0x20 * FLASH_SECTOR_SIZE;
+    uint32_t prog_addr = 0x30 * FLASH_SECTOR_SIZE;
+    uint32_t erase_addr = 0x40 * FLASH_SECTOR_SIZE;
+    uint32_t erase_4k_addr = 0x50 * FLASH_SECTOR_SIZE;
+    uint32_t page[FLASH_PAGE_SIZE / 4];
+    g_autofree uint8_t *image = NULL;
+    g_autofree char *path = NULL;
+    QTestState *s;
+    uint32_t addr;
+    int fd;
+
+    /* Each chunk used by the test starts with a different pattern */
+    fd = flash_image_create(&path, &image);
+    for (addr = read_addr; addr <= erase_4k_addr; addr += 0x100000) {
+        flash_image_fill(fd, image, addr, addr >> 16);
+    }
+
+    s = flash_machine_init(path, "-global m25p80-generic.lazy=on");
+
+    spi_ce_ctrl(1 << CRTL_EXTENDED0);
+    spi_conf(CONF_ENABLE_W0);
+
+    /* Chunks are loaded from the file on first access */
+    read_page(read_addr + FLASH_PAGE_SIZE, page);
+    assert_page(page, image, read_addr + FLASH_PAGE_SIZE);
+
+    read_page_mem(mem_addr + FLASH_PAGE_SIZE, page);
+    assert_page(page, image, mem_addr + FLASH_PAGE_SIZE);
+
+    /* Programming a page loads the rest of its chunk */
+    program_page(image, prog_addr + FLASH_PAGE_SIZE, 0xffff0000);
+    read_page(prog_addr + FLASH_PAGE_SIZE, page);
+    assert_page(page, image, prog_addr + FLASH_PAGE_SIZE);
+    read_page(prog_addr, page);
+    assert_page(page, image, prog_addr);
+
+    /* A chunk entirely erased is not read, one partially erased is */
+    erase(image, ERASE_SECTOR, erase_addr, FLASH_SECTOR_SIZE);
+    read_page(erase_addr + FLASH_PAGE_SIZE, page);
+    assert_page(page, image, erase_addr + FLASH_PAGE_SIZE);
+
+    erase(image, ERASE_4K, erase_4k_addr, 4 * 1024);
+    read_page(erase_4k_addr, page);
+    assert_page(page, image, erase_4k_addr);
+    read_page(erase_4k_addr + 4 * 1024, page);
+    assert_page(page, image, erase_4k_addr + 4 * 1024);
+
+    /*
+     * Reading every chunk through the mapping loads the whole storage,
+     * which is then mapped as RAM. Its contents must be unchanged and
+     * stay coherent with the programs.
+     */
+    spi_ctrl_setmode(CTRL_READMODE, READ);
+    for (addr = 0; addr < FLASH_SIZE; addr += FLASH_SECTOR_SIZE) {
+        g_assert_cmphex(readl(ASPEED_FLASH_BASE + addr), ==,
+                        ldl_le_p(image + addr));
+    }
+
+    program_page(image, prog_addr, 0x00ff00ff);
+    read_page_mem(prog_addr, page);
+    assert_page(page, image, prog_addr);
+
+    /* Stopping the VM waits for the writes to the file */
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'stop' }");
+    assert_file(path, image);
+
+    flash_machine_quit(s);
+    close(fd);
+    unlink(path);
+}
+
+/* Write-backs are asynchronous, wait for them to reach the file */
+static void wait_file(const char *path, const uint8_t *image)
+{
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        g_autofree char *contents = NULL;
+        gsize len;
+
+        g_assert(g_file_get_contents(path, &contents, &len, NULL));
+        if (len == FLASH_SIZE && !memcmp(contents, image, len)) {
+            return;
+        }
+        g_usleep(10 * 1000);
+    }
+    assert_file(path, image);
+}
+
+static void wait_migration_complete(void)
+{
+    for (;;) {
+        QDict *rsp = qtest_qmp(global_qtest, "{ 'execute': 'query-migrate' }");
+        QDict *ret = qdict_get_qdict(rsp, "return");
+        const char *status = qdict_get_try_str(ret, "status");
+        bool done = !g_strcmp0(status, "completed");
+
+        g_assert_cmpstr(status, !=, "failed");
+        qobject_unref(rsp);
+        if (done) {
+            return;
+        }
+        g_usleep(10 * 1000);
+    }
+}
+
+static void test_writeback(void)
+{
+    uint32_t page[FLASH_PAGE_SIZE / 4];
+    g_autofree uint8_t *image = NULL;
+    g_autofree uint8_t *orig = NULL;
+    g_autofree char *path = NULL;
+    QTestState *s;
+    uint32_t addr;
+    int fd;
+
+    fd = flash_image_create(&path, &image);
+    for (addr = 0; addr < 4 * FLASH_SECTOR_SIZE; addr += FLASH_SECTOR_SIZE) {
+        flash_image_fill(fd, image, addr, addr >> 16);
+    }
+
+    /* The delay is long enough for the timer not to flush */
+    s = flash_machine_init(path,
+                           "-global m25p80-generic.writeback-delay=600000");
+
+    spi_conf(CONF_ENABLE_W0);
+
+    /* Programs are only written to the file on the next flush */
+    orig = g_memdup2(image, FLASH_SIZE);
+    program_page(image, 0, 0xffff0000);
+    program_page(image, FLASH_PAGE_SIZE, 0x0000ffff);
+    read_page(FLASH_PAGE_SIZE, page);
+    assert_page(page, image, FLASH_PAGE_SIZE);
+    assert_file(path, orig);
+
+    /* Stopping the VM flushes them */
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'stop' }");
+    assert_file(path, image);
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'cont' }");
+
+    /* Deasserting CS after an erase flushes all the pending writes */
+    program_page(image, FLASH_SECTOR_SIZE, 0x00ff00ff);
+    erase(image, ERASE_SECTOR, 2 * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+    wait_file(path, image);
+
+    /* So does saving the device state, even with the VM stopped */
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'stop' }");
+    program_page(image, 3 * FLASH_SECTOR_SIZE, 0xff00ff00);
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'migrate',"
+                             "  'arguments': { 'uri': 'exec:cat > /dev/null' } }");
+    wait_migration_complete();
+    assert_file(path, image);
+
+    flash_machine_quit(s);
+    close(fd);
+    unlink(path);
+}
+
+static void test_writeback_timer(void)
+{
+    g_autofree uint8_t *image = NULL;
+    g_autofree char *path = NULL;
+    QTestState *s;
+    int fd;
+
+    fd = flash_image_create(&path, &image);
+    flash_image_fill(fd, image, 0, 0x5a);
+
+    s = flash_machine_init(path, "-global m25p80-generic.writeback-delay=100");
+
+    spi_conf(CONF_ENABLE_W0);
+    program_page(image, 0, 0x0f0f0f0f);
+    program_page(image, FLASH_PAGE_SIZE, 0xf0f0f0f0);
+    wait_file(path, image);
+
+    flash_machine_quit(s);
+    close(fd);
+    unlink(path);
+}
+
+/* Whether the boot ROM is mapped as a ROMD region, which code runs from */
+static bool boot_rom_is_romd(void)
+{
+    g_autofree char *mtree = qtest_hmp(global_qtest, "info mtree");
+    g_auto(GStrv) lines = g_strsplit(mtree, "\n", -1);
+    int i;
+
+    for (i = 0; lines[i]; i++) {
+        if (strstr(lines[i], "alias aspeed.boot_rom ")) {
+            return strstr(lines[i], "romd") != NULL;
+        }
+    }
+    g_assert_not_reached();
+}
+
+static void test_shared_boot_rom(gconstpointer data)
+{
+    g_autofree uint8_t *image = NULL;
+    g_autofree char *path = NULL;
+    QTestState *s;
+    uint32_t addr;
+    int fd;
+
+    fd = flash_image_create(&path, &image);
+    flash_image_fill(fd, image, 0, 0x3c);
+
+    s = flash_machine_init(path, data);
+
+    /* The boot ROM maps the flash contents, also in the lazy mode */
+    g_assert(boot_rom_is_romd());
+    for (addr = 0; addr < FLASH_PAGE_SIZE; addr += 4) {
+        g_assert_cmphex(readl(addr), ==, ldl_le_p(image + addr));
+    }
+
+    /* Guest writes are dropped */
+    writel(0, ~ldl_le_p(image));
+    g_assert_cmphex(readl(0), ==, ldl_le_p(image));
+
+    /* Programs of the flash are seen without a reset */
+    spi_conf(CONF_ENABLE_W0);
+    program_page(image, 0, 0x00ff00ff);
+    g_assert_cmphex(readl(0), ==, ldl_le_p(image));
+
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'system_reset' }");
+    qtest_qmp_eventwait(global_qtest, "RESET");
+    g_assert_cmphex(readl(0), ==, ldl_le_p(image));
+
+    flash_machine_quit(s);
+    close(fd);
+    unlink(path);
+}
+
 static char tmp_path[] = "/tmp/qtest.m25p80.XXXXXX";
 
 int main(int argc, char **argv)
@@ -633,6 +1023,7 @@ int main(int argc, char **argv)
     qtest_add_func("/ast2400/smc/write_page", test_write_page);
     qtest_add_func("/ast2400/smc/read_page_mem", test_read_page_mem);
     qtest_add_func("/ast2400/smc/write_page_mem", test_write_page_mem);
+    qtest_add_func("/ast2400/smc/dma_read", test_dma_read);
     qtest_add_func("/ast2400/smc/read_status_reg", test_read_status_reg);
     qtest_add_func("/ast2400/smc/status_reg_write_protection",
                    test_status_reg_write_protection);
@@ -640,6 +1031,15 @@ int main(int argc, char **argv)
                    test_write_block_protect);
     qtest_add_func("/ast2400/smc/write_block_protect_bottom_bit",
                    test_write_block_protect_bottom_bit);
+    qtest_add_func("/ast2400/smc/lazy_load", test_lazy_load);
+    qtest_add_func("/ast2400/smc/writeback", test_writeback);
+    qtest_add_func("/ast2400/smc/writeback_timer", test_writeback_timer);
+    qtest_add_data_func("/ast2400/smc/shared_boot_rom",
+                        "-machine shared-boot-rom=on", test_shared_boot_rom);
+    qtest_add_data_func("/ast2400/smc/shared_boot_rom_lazy",
+                        "-machine shared-boot-rom=on "
+                        "-global m25p80-generic.lazy=on",
+                        test_shared_boot_rom);
 
     flash_reset();
     ret = g_test_run();
@@ -0,0 +1,94 @@
+/*
+ * QTest testcase for the batched transmit mode of the ASPEED UARTs
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* The console UART of the ast2600-evb, with 32-bit register spacing */
+#define UART5_BASE              0x1E784000
+#define   UART_THR              (0 << 2)
+#define   UART_IER              (1 << 2)
+#define     UART_IER_THRI       0x02
+#define   UART_IIR              (2 << 2)
+#define     UART_IIR_ID         0x0f
+#define     UART_IIR_NO_INT     0x01
+#define     UART_IIR_THRI       0x02
+#define   UART_FCR              (2 << 2)
+#define     UART_FCR_FE         0x01
+#define   UART_LCR              (3 << 2)
+#define     UART_LCR_8N1        0x03
+#define   UART_LSR              (5 << 2)
+#define     UART_LSR_THRE       0x20
+#define     UART_LSR_TEMT       0x40
+
+static void test_batch(const void *fifo)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    static const char msg[] = "U-Boot 2019.04 (batched console)\r\n";
+    char buf[sizeof(msg)];
+    g_autofree char *dir = NULL;
+    g_autofree char *path = NULL;
+    QTestState *qts;
+    int lfd, fd, i;
+
+    dir = g_dir_make_tmp("aspeed_uart_XXXXXX", NULL);
+    g_assert(dir);
+    path = g_build_filename(dir, "uart.sock", NULL);
+    g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_assert(lfd >= 0);
+    g_assert(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    g_assert(listen(lfd, 1) == 0);
+
+    qts = qtest_initf("-machine ast2600-evb "
+                      "-chardev socket,id=uart,path=%s "
+                      "-serial chardev:uart "
+                      "-global serial.tx-batch=on", path);
+    fd = accept(lfd, NULL, NULL);
+    g_assert(fd >= 0);
+    close(lfd);
+
+    qtest_writel(qts, UART5_BASE + UART_LCR, UART_LCR_8N1);
+    qtest_writel(qts, UART5_BASE + UART_FCR, fifo ? UART_FCR_FE : 0);
+    qtest_writel(qts, UART5_BASE + UART_IER, UART_IER_THRI);
+
+    for (i = 0; i < sizeof(msg) - 1; i++) {
+        qtest_writel(qts, UART5_BASE + UART_THR, msg[i]);
+
+        /* The byte is out for the guest, as without batching */
+        g_assert_cmphex(qtest_readl(qts, UART5_BASE + UART_LSR) &
+                        (UART_LSR_THRE | UART_LSR_TEMT), ==,
+                        UART_LSR_THRE | UART_LSR_TEMT);
+        g_assert_cmphex(qtest_readl(qts, UART5_BASE + UART_IIR) &
+                        UART_IIR_ID, ==, UART_IIR_THRI);
+        g_assert_cmphex(qtest_readl(qts, UART5_BASE + UART_IIR) &
+                        UART_IIR_ID, ==, UART_IIR_NO_INT);
+    }
+
+    g_assert_cmpint(recv(fd, buf, sizeof(msg) - 1, MSG_WAITALL), ==,
+                    sizeof(msg) - 1);
+    g_assert(!memcmp(buf, msg, sizeof(msg) - 1));
+
+    qtest_quit(qts);
+    close(fd);
+    unlink(path);
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_data_func("/ast2600/uart/tx_batch", NULL, test_batch);
+    qtest_add_data_func("/ast2600/uart/tx_batch_fifo", "fifo", test_batch);
+
+    return g_test_run();
+}
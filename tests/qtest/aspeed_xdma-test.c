@@ -0,0 +1,167 @@
+/*
+ * QTest testcase for the ASPEED XDMA Controller
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+
+#define XDMA_BASE                   0x1E6E7000
+#define XDMA_BMC_CMDQ_ADDR          0x14
+#define XDMA_BMC_CMDQ_ENDP          0x18
+#define XDMA_BMC_CMDQ_WRP           0x1c
+#define XDMA_BMC_CMDQ_RDP           0x20
+#define  XDMA_BMC_CMDQ_RDP_MAGIC    0xEE882266
+#define XDMA_IRQ_CTRL               0x38
+#define XDMA_IRQ_STATUS             0x3c
+#define  XDMA_IRQ_US_COMP           BIT(16)
+#define  XDMA_IRQ_DS_COMP           BIT(17)
+
+#define XDMA_CMD_IRQ_BMC            BIT_ULL(37)
+#define XDMA_CMD_UPSTREAM           BIT_ULL(32)
+
+/* Queue pointer units per command */
+#define XDMA_CMDQ_ENTRY_SIZE        2
+#define XDMA_CMD_SIZE               32
+#define XDMA_NUM_CMDS               16
+
+#define DRAM_BASE                   0x80000000
+#define CMDQ_ADDR                   (DRAM_BASE + 0x100000)
+#define BMC_BUF_ADDR                (DRAM_BASE + 0x200000)
+
+#define HOST_MEM_SIZE               (1 * MiB)
+
+typedef struct TestState {
+    QTestState *qts;
+    char *path;
+    uint8_t *host;
+    int next;
+} TestState;
+
+static void test_init(TestState *t)
+{
+    GError *error = NULL;
+    int fd;
+
+    fd = g_file_open_tmp("aspeed_xdma_XXXXXX", &t->path, &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(ftruncate(fd, HOST_MEM_SIZE), ==, 0);
+    t->host = mmap(NULL, HOST_MEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    g_assert(t->host != MAP_FAILED);
+    close(fd);
+
+    t->qts = qtest_initf("-machine ast2600-evb "
+                         "-object memory-backend-file,id=hostmem,share=on,"
+                         "size=%d,mem-path=%s "
+                         "-global aspeed.xdma-ast2600.memdev=hostmem",
+                         HOST_MEM_SIZE, t->path);
+    t->next = 0;
+
+    /* The queue setup sequence of the Linux driver */
+    qtest_writel(t->qts, XDMA_BASE + XDMA_BMC_CMDQ_ADDR, CMDQ_ADDR);
+    qtest_writel(t->qts, XDMA_BASE + XDMA_BMC_CMDQ_ENDP,
+                 XDMA_NUM_CMDS * XDMA_CMDQ_ENTRY_SIZE);
+    qtest_writel(t->qts, XDMA_BASE + XDMA_BMC_CMDQ_RDP,
+                 XDMA_BMC_CMDQ_RDP_MAGIC);
+    qtest_writel(t->qts, XDMA_BASE + XDMA_BMC_CMDQ_WRP, 0);
+    qtest_writel(t->qts, XDMA_BASE + XDMA_IRQ_CTRL,
+                 XDMA_IRQ_US_COMP | XDMA_IRQ_DS_COMP);
+}
+
+static void test_cleanup(TestState *t)
+{
+    qtest_quit(t->qts);
+    munmap(t->host, HOST_MEM_SIZE);
+    unlink(t->path);
+    g_free(t->path);
+}
+
+static void submit_cmd(TestState *t, bool upstream, uint64_t host_addr,
+                       uint32_t host_pitch, uint32_t bmc_pitch,
+                       uint32_t line_size, uint32_t line_no)
+{
+    uint64_t addr = CMDQ_ADDR + t->next * XDMA_CMD_SIZE;
+    uint64_t pitch = ((uint64_t)bmc_pitch << 48) |
+        ((uint64_t)host_pitch << 32) | (BMC_BUF_ADDR & 0x7FFFFFFF);
+    uint64_t cmd = XDMA_CMD_IRQ_BMC | (upstream ? XDMA_CMD_UPSTREAM : 0) |
+        ((uint64_t)line_no << 16) | line_size;
+
+    qtest_writeq(t->qts, addr, host_addr);
+    qtest_writeq(t->qts, addr + 8, pitch);
+    qtest_writeq(t->qts, addr + 16, cmd);
+    qtest_writeq(t->qts, addr + 24, 0);
+
+    t->next = (t->next + 1) % XDMA_NUM_CMDS;
+    qtest_writel(t->qts, XDMA_BASE + XDMA_BMC_CMDQ_WRP,
+                 t->next * XDMA_CMDQ_ENTRY_SIZE);
+}
+
+static void check_irq(TestState *t, uint32_t bit)
+{
+    g_assert_cmphex(qtest_readl(t->qts, XDMA_BASE + XDMA_IRQ_STATUS) &
+                    (XDMA_IRQ_US_COMP | XDMA_IRQ_DS_COMP), ==, bit);
+    qtest_writel(t->qts, XDMA_BASE + XDMA_IRQ_STATUS, bit);
+}
+
+static void test_downstream(void)
+{
+    g_autofree uint8_t *buf = g_malloc(8 * KiB);
+    TestState t;
+    int i;
+
+    test_init(&t);
+
+    for (i = 0; i < 8 * KiB; i++) {
+        t.host[0x1000 + i] = i * 7;
+    }
+
+    /* Contiguous lines */
+    submit_cmd(&t, false, 0x1000, 2 * KiB, 2 * KiB, 2 * KiB, 4);
+    check_irq(&t, XDMA_IRQ_DS_COMP);
+
+    qtest_memread(t.qts, BMC_BUF_ADDR, buf, 8 * KiB);
+    g_assert(!memcmp(buf, t.host + 0x1000, 8 * KiB));
+
+    test_cleanup(&t);
+}
+
+static void test_upstream(void)
+{
+    g_autofree uint8_t *buf = g_malloc(1 * KiB);
+    TestState t;
+    int i;
+
+    test_init(&t);
+
+    for (i = 0; i < 1 * KiB; i++) {
+        buf[i] = i * 3;
+    }
+    qtest_memwrite(t.qts, BMC_BUF_ADDR, buf, 1 * KiB);
+
+    /* Spread four lines of the BMC buffer over the host memory */
+    submit_cmd(&t, true, 0x10000, 512, 256, 256, 4);
+    check_irq(&t, XDMA_IRQ_US_COMP);
+
+    for (i = 0; i < 4; i++) {
+        g_assert(!memcmp(t.host + 0x10000 + i * 512, buf + i * 256, 256));
+        g_assert(t.host[0x10000 + i * 512 + 256] == 0);
+    }
+
+    test_cleanup(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/ast2600/xdma/downstream", test_downstream);
+    qtest_add_func("/ast2600/xdma/upstream", test_upstream);
+
+    return g_test_run();
+}
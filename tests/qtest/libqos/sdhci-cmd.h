@@ -24,15 +24,27 @@
 #define SDHC_CMDREG 0x0E
 #define SDHC_BDATA 0x20
 #define SDHC_PRNSTS 0x24
+#define SDHC_HOSTCTL 0x28
 #define SDHC_BLKGAP 0x2A
 #define SDHC_CLKCON 0x2C
 #define SDHC_SWRST 0x2F
+#define SDHC_NORINTSTS 0x30
+#define SDHC_NORINTSTSEN 0x34
 #define SDHC_CAPAB 0x40
 #define SDHC_MAXCURR 0x48
+#define SDHC_ADMASYSADDR 0x58
 #define SDHC_HCVER 0xFE
 
+/* HOSTCTL Reg */
+#define SDHC_CTRL_ADMA2_32 0x10
+
+/* NORINTSTS Reg */
+#define SDHC_NIS_TRSCMP 0x0002
+
 /* TRNSMOD Reg */
+#define SDHC_TRNS_DMA 0x0001
 #define SDHC_TRNS_BLK_CNT_EN 0x0002
+#define SDHC_TRNS_ACMD12 0x0004
 #define SDHC_TRNS_READ 0x0010
 #define SDHC_TRNS_WRITE 0x0000
 #define SDHC_TRNS_MULTI 0x0020
@@ -48,6 +60,11 @@
 #define SDHC_WRITE_MULTIPLE_BLOCK (25 << 8)
 #define SDHC_APP_CMD (55 << 8)
 
+/* ADMA2 descriptor attributes */
+#define SDHC_ADMA_ATTR_VALID (1 << 0)
+#define SDHC_ADMA_ATTR_END (1 << 1)
+#define SDHC_ADMA_ATTR_ACT_TRAN (1 << 5)
+
 /* SWRST Reg */
 #define SDHC_RESET_ALL 0x01
 
@@ -25,6 +25,11 @@
 #define NPCM7XX_MMC_BA 0xF0842000
 #define NPCM7XX_BLK_SIZE 512
 #define NPCM7XX_TEST_IMAGE_SIZE (1 << 30)
+#define NPCM7XX_ADMA_DESC_ADDR 0x100000
+#define NPCM7XX_ADMA_BUF_ADDR 0x200000
+#define NPCM7XX_ADMA_BLKCNT 8
+#define NPCM7XX_ADMA_SIZE (NPCM7XX_ADMA_BLKCNT * NPCM7XX_BLK_SIZE)
+#define NPCM7XX_TIMEOUT_US (10 * G_USEC_PER_SEC)
 
 char *sd_path;
 
@@ -172,6 +177,83 @@ static void test_reset(void)
     qtest_quit(qts);
 }
 
+/*
+ * Transfer NPCM7XX_ADMA_SIZE bytes at the start of the card with a two
+ * descriptor ADMA2 table and wait for the transfer complete status.
+ */
+static void adma_transfer(QTestState *qts, bool read)
+{
+    uint32_t len = NPCM7XX_ADMA_SIZE / 2;
+    uint16_t cmd = read ? SDHC_READ_MULTIPLE_BLOCK : SDHC_WRITE_MULTIPLE_BLOCK;
+    uint64_t desc[2];
+    gint64 end;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        uint64_t addr = NPCM7XX_ADMA_BUF_ADDR + i * len;
+        uint64_t attr = SDHC_ADMA_ATTR_VALID | SDHC_ADMA_ATTR_ACT_TRAN;
+
+        if (i == 1) {
+            attr |= SDHC_ADMA_ATTR_END;
+        }
+        desc[i] = cpu_to_le64(attr | ((uint64_t)len << 16) | (addr << 32));
+    }
+    qtest_memwrite(qts, NPCM7XX_ADMA_DESC_ADDR, desc, sizeof(desc));
+
+    qtest_writeb(qts, NPCM7XX_MMC_BA + SDHC_HOSTCTL, SDHC_CTRL_ADMA2_32);
+    qtest_writel(qts, NPCM7XX_MMC_BA + SDHC_ADMASYSADDR,
+                 NPCM7XX_ADMA_DESC_ADDR);
+    qtest_writew(qts, NPCM7XX_MMC_BA + SDHC_NORINTSTSEN, SDHC_NIS_TRSCMP);
+    qtest_writew(qts, NPCM7XX_MMC_BA + SDHC_NORINTSTS, SDHC_NIS_TRSCMP);
+
+    sdhci_cmd_regs(qts, NPCM7XX_MMC_BA, NPCM7XX_BLK_SIZE, NPCM7XX_ADMA_BLKCNT,
+                   0, SDHC_TRNS_DMA | SDHC_TRNS_BLK_CNT_EN | SDHC_TRNS_ACMD12 |
+                   SDHC_TRNS_MULTI | (read ? SDHC_TRNS_READ : SDHC_TRNS_WRITE),
+                   cmd | SDHC_CMD_DATA_PRESENT);
+
+    end = g_get_monotonic_time() + NPCM7XX_TIMEOUT_US;
+    while (!(qtest_readw(qts, NPCM7XX_MMC_BA + SDHC_NORINTSTS) &
+             SDHC_NIS_TRSCMP)) {
+        g_assert_cmpint(g_get_monotonic_time(), <, end);
+        g_usleep(10);
+    }
+    g_assert_cmphex(qtest_readw(qts, NPCM7XX_MMC_BA + SDHC_BLKCNT), ==, 0);
+}
+
+/* Check ADMA moves whole descriptor chains between memory and sd */
+static void test_adma(void)
+{
+    QTestState *qts = setup_sd_card();
+    g_autofree uint8_t *wbuf = g_malloc(NPCM7XX_ADMA_SIZE);
+    g_autofree uint8_t *rbuf = g_malloc(NPCM7XX_ADMA_SIZE);
+    int fd, ret, i;
+
+    for (i = 0; i < NPCM7XX_ADMA_SIZE; i++) {
+        wbuf[i] = i * 7;
+    }
+    qtest_memwrite(qts, NPCM7XX_ADMA_BUF_ADDR, wbuf, NPCM7XX_ADMA_SIZE);
+    adma_transfer(qts, false);
+
+    fd = open(sd_path, O_RDWR);
+    g_assert(fd >= 0);
+    ret = pread(fd, rbuf, NPCM7XX_ADMA_SIZE, 0);
+    g_assert_cmpint(ret, ==, NPCM7XX_ADMA_SIZE);
+    g_assert(!memcmp(rbuf, wbuf, NPCM7XX_ADMA_SIZE));
+
+    for (i = 0; i < NPCM7XX_ADMA_SIZE; i++) {
+        wbuf[i] = ~i;
+    }
+    ret = pwrite(fd, wbuf, NPCM7XX_ADMA_SIZE, 0);
+    g_assert_cmpint(ret, ==, NPCM7XX_ADMA_SIZE);
+    close(fd);
+
+    adma_transfer(qts, true);
+    qtest_memread(qts, NPCM7XX_ADMA_BUF_ADDR, rbuf, NPCM7XX_ADMA_SIZE);
+    g_assert(!memcmp(rbuf, wbuf, NPCM7XX_ADMA_SIZE));
+
+    qtest_quit(qts);
+}
+
 static void drive_destroy(void)
 {
     unlink(sd_path);
@@ -208,6 +290,7 @@ int main(int argc, char **argv)
     qtest_add_func("npcm7xx_sdhci/reset", test_reset);
     qtest_add_func("npcm7xx_sdhci/write_sd", test_write_sd);
     qtest_add_func("npcm7xx_sdhci/read_sd", test_read_sd);
+    qtest_add_func("npcm7xx_sdhci/adma", test_adma);
 
     ret = g_test_run();
     drive_destroy();
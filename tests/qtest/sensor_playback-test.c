@@ -0,0 +1,140 @@
+/*
+ * QTest testcase for the sensor value playback device
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/timer.h"
+#include "hw/sensor/sensor_playback.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define TEMP_PATH "/machine/peripheral/temp0"
+
+static char *write_tmp_file(const char *contents, size_t len)
+{
+    GError *error = NULL;
+    char *path;
+    int fd;
+
+    fd = g_file_open_tmp("sensor_playback_XXXXXX", &path, &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(write(fd, contents, len), ==, len);
+    close(fd);
+
+    return path;
+}
+
+static QTestState *sensor_playback_init(const char *props)
+{
+    return qtest_initf("-machine ast2600-evb "
+                       "-device tmp105,bus=aspeed.i2c.bus.0,address=0x4a,"
+                       "id=temp0 "
+                       "-device sensor-playback,%s", props);
+}
+
+static int64_t get_temperature(QTestState *qts)
+{
+    QDict *response;
+    int64_t value;
+
+    response = qtest_qmp(qts, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': %s, 'property': 'temperature' } }",
+                         TEMP_PATH);
+    g_assert(qdict_haskey(response, "return"));
+    value = qdict_get_int(response, "return");
+    qobject_unref(response);
+
+    return value;
+}
+
+static void test_file(void)
+{
+    const char *contents =
+        "# time(us) path property value\n"
+        "0    " TEMP_PATH " temperature 25000\n"
+        "1000 " TEMP_PATH " temperature 30000\n"
+        "2000 " TEMP_PATH " temperature 35000\n";
+    g_autofree char *path = write_tmp_file(contents, strlen(contents));
+    g_autofree char *props = g_strdup_printf("file=%s,loop=on,period-us=3000",
+                                             path);
+    QTestState *qts = sensor_playback_init(props);
+
+    qtest_clock_step(qts, 500 * SCALE_US);
+    g_assert_cmpint(get_temperature(qts), ==, 25000);
+    qtest_clock_step(qts, 1000 * SCALE_US);
+    g_assert_cmpint(get_temperature(qts), ==, 30000);
+    qtest_clock_step(qts, 1000 * SCALE_US);
+    g_assert_cmpint(get_temperature(qts), ==, 35000);
+
+    /* The file starts over after a period */
+    qtest_clock_step(qts, 1000 * SCALE_US);
+    g_assert_cmpint(get_temperature(qts), ==, 25000);
+    qtest_clock_step(qts, 1000 * SCALE_US);
+    g_assert_cmpint(get_temperature(qts), ==, 30000);
+
+    qtest_quit(qts);
+    unlink(path);
+}
+
+static void test_ring(void)
+{
+    const char *map = TEMP_PATH " temperature\n";
+    const size_t len = sizeof(SensorPlaybackRing) +
+        4 * sizeof(SensorPlaybackEntry);
+    g_autofree char *map_path = write_tmp_file(map, strlen(map));
+    g_autofree char *ring_path = NULL;
+    g_autofree char *props = NULL;
+    g_autofree SensorPlaybackRing *init = g_malloc0(len);
+    SensorPlaybackRing *ring;
+    QTestState *qts;
+    int fd, i;
+
+    init->magic = cpu_to_le32(SENSOR_PLAYBACK_RING_MAGIC);
+    init->size = cpu_to_le32(4);
+    ring_path = write_tmp_file((const char *)init, len);
+
+    fd = open(ring_path, O_RDWR);
+    g_assert(fd >= 0);
+    ring = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    g_assert(ring != MAP_FAILED);
+    close(fd);
+
+    props = g_strdup_printf("ring=%s,map=%s,interval-us=100",
+                            ring_path, map_path);
+    qts = sensor_playback_init(props);
+
+    /* Wrap around the ring, only the last value of a channel matters */
+    for (i = 0; i < 6; i++) {
+        SensorPlaybackEntry *e = &ring->entries[i % 4];
+
+        e->channel = cpu_to_le32(0);
+        e->value = cpu_to_le64(20000 + i * 1000);
+        qatomic_store_release(&ring->head, cpu_to_le32(i + 1));
+
+        qtest_clock_step(qts, 100 * SCALE_US);
+        g_assert_cmpint(le32_to_cpu(qatomic_load_acquire(&ring->tail)), ==,
+                        i + 1);
+        g_assert_cmpint(get_temperature(qts), ==, 20000 + i * 1000);
+    }
+
+    qtest_quit(qts);
+    munmap(ring, len);
+    unlink(ring_path);
+    unlink(map_path);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/sensor-playback/file", test_file);
+    qtest_add_func("/sensor-playback/ring", test_ring);
+
+    return g_test_run();
+}
@@ -187,6 +187,51 @@ static void test_hash_iov(void)
     }
 }
 
+/* Test with data added incrementally */
+static void test_hash_incremental(void)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(expected_outputs) ; i++) {
+        struct iovec iov[2] = {
+            { .iov_base = (char *)INPUT_TEXT2, .iov_len = strlen(INPUT_TEXT2) },
+            { .iov_base = (char *)INPUT_TEXT3, .iov_len = strlen(INPUT_TEXT3) },
+        };
+        g_autoptr(QCryptoHash) hash = NULL;
+        uint8_t *result = NULL;
+        size_t resultlen = 0;
+        int ret;
+        size_t j;
+
+        if (!qcrypto_hash_supports(i)) {
+            continue;
+        }
+
+        hash = qcrypto_hash_new(i, &error_fatal);
+        g_assert(hash != NULL);
+
+        ret = qcrypto_hash_update(hash,
+                                  INPUT_TEXT1,
+                                  strlen(INPUT_TEXT1),
+                                  &error_fatal);
+        g_assert(ret == 0);
+        ret = qcrypto_hash_updatev(hash, iov, 2, &error_fatal);
+        g_assert(ret == 0);
+
+        ret = qcrypto_hash_finalize_bytes(hash,
+                                          &result,
+                                          &resultlen,
+                                          &error_fatal);
+        g_assert(ret == 0);
+        g_assert(resultlen == expected_lens[i]);
+        for (j = 0; j < resultlen; j++) {
+            g_assert(expected_outputs[i][j * 2] == hex[(result[j] >> 4) & 0xf]);
+            g_assert(expected_outputs[i][j * 2 + 1] == hex[result[j] & 0xf]);
+        }
+        g_free(result);
+    }
+}
+
 
 /* Test with printable hashing */
 static void test_hash_digest(void)
@@ -248,6 +293,7 @@ int main(int argc, char **argv)
 
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/crypto/hash/iov", test_hash_iov);
+    g_test_add_func("/crypto/hash/incremental", test_hash_incremental);
     g_test_add_func("/crypto/hash/alloc", test_hash_alloc);
     g_test_add_func("/crypto/hash/prealloc", test_hash_prealloc);
     g_test_add_func("/crypto/hash/digest", test_hash_digest);
@@ -0,0 +1,95 @@
+/*
+ * Unit tests for the table file reader
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/table-file.h"
+
+static char *write_table(const char *contents)
+{
+    GError *gerr = NULL;
+    char *path;
+    int fd;
+
+    fd = g_file_open_tmp("test-table-file-XXXXXX", &path, &gerr);
+    g_assert_no_error(gerr);
+    g_assert_cmpint(write(fd, contents, strlen(contents)), ==,
+                    strlen(contents));
+    close(fd);
+
+    return path;
+}
+
+static bool collect_line(void *opaque, char **fields, Error **errp)
+{
+    GString *out = opaque;
+
+    if (!strcmp(fields[0], "bad")) {
+        error_setg(errp, "bad entry");
+        return false;
+    }
+
+    g_string_append_printf(out, "%s=%s;", fields[0], fields[1]);
+    return true;
+}
+
+static void test_table_file_load(void)
+{
+    g_autofree char *path = write_table("# header\n"
+                                        "a 1\n"
+                                        "\n"
+                                        "  b\t\t2   # trailing comment\n"
+                                        "   # indented comment\n"
+                                        "c 3");
+    g_autoptr(GString) out = g_string_new("");
+
+    g_assert_true(qemu_table_file_load(path, 2, collect_line, out,
+                                       &error_abort));
+    g_assert_cmpstr(out->str, ==, "a=1;b=2;c=3;");
+    unlink(path);
+}
+
+static void test_table_file_errors(void)
+{
+    g_autofree char *fields_path = write_table("a 1\nb 2 3\n");
+    g_autofree char *fn_path = write_table("a 1\n# comment\nbad 2\n");
+    g_autofree char *expected = NULL;
+    g_autoptr(GString) out = g_string_new("");
+    Error *err = NULL;
+
+    g_assert_false(qemu_table_file_load(fields_path, 2, collect_line, out,
+                                        &err));
+    expected = g_strdup_printf("%s:2: expected 2 fields", fields_path);
+    g_assert_cmpstr(error_get_pretty(err), ==, expected);
+    g_clear_pointer(&err, error_free);
+    g_free(expected);
+
+    g_assert_false(qemu_table_file_load(fn_path, 2, collect_line, out,
+                                        &err));
+    expected = g_strdup_printf("%s:3: bad entry", fn_path);
+    g_assert_cmpstr(error_get_pretty(err), ==, expected);
+    g_clear_pointer(&err, error_free);
+
+    g_assert_false(qemu_table_file_load("/nonexistent/table", 2,
+                                        collect_line, out, &err));
+    g_assert_nonnull(err);
+    error_free(err);
+
+    unlink(fields_path);
+    unlink(fn_path);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/table-file/load", test_table_file_load);
+    g_test_add_func("/table-file/errors", test_table_file_errors);
+
+    return g_test_run();
+}
@@ -593,6 +593,15 @@ void main_loop_wait(int nonblocking)
                                       timerlistgroup_deadline_ns(
                                           &main_loop_tlg));
 
+    /*
+     * Skip the idle time before polling: the deadline above is in virtual
+     * time, and a timer that re-arms itself without waking a vCPU would
+     * otherwise make every iteration wait for it in real time.
+     */
+    if (!icount_enabled() && cpu_clock_skip_idle && cpu_clock_warp_idle()) {
+        timeout_ns = 0;
+    }
+
     ret = os_host_main_loop_wait(timeout_ns);
     mlpoll.state = ret < 0 ? MAIN_LOOP_POLL_ERR : MAIN_LOOP_POLL_OK;
     notifier_list_notify(&main_loop_poll_notifiers, &mlpoll);
@@ -0,0 +1,72 @@
+/*
+ * Reading tables of whitespace separated fields from text files
+ *
+ * Copyright (c) Meta Platforms, Inc. and affiliates. (http://www.meta.com)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/table-file.h"
+
+/* Split @line on blanks, without the empty fields of repeated blanks */
+static char **table_file_split(char *line)
+{
+    char **fields = g_strsplit_set(g_strstrip(line), " \t", -1);
+    unsigned int i, n = 0;
+
+    for (i = 0; fields[i]; i++) {
+        if (*fields[i]) {
+            fields[n++] = fields[i];
+        } else {
+            g_free(fields[i]);
+        }
+    }
+    fields[n] = NULL;
+
+    return fields;
+}
+
+bool qemu_table_file_load(const char *path, unsigned int nr_fields,
+                          QemuTableLineFunc fn, void *opaque, Error **errp)
+{
+    g_autofree char *contents = NULL;
+    g_auto(GStrv) lines = NULL;
+    GError *gerr = NULL;
+    unsigned int i;
+
+    if (!g_file_get_contents(path, &contents, NULL, &gerr)) {
+        error_setg(errp, "cannot read '%s': %s", path, gerr->message);
+        g_error_free(gerr);
+        return false;
+    }
+
+    lines = g_strsplit(contents, "\n", -1);
+    for (i = 0; lines[i]; i++) {
+        g_auto(GStrv) fields = NULL;
+        char *comment = strchr(lines[i], '#');
+
+        if (comment) {
+            *comment = '\0';
+        }
+
+        fields = table_file_split(lines[i]);
+        if (!fields[0]) {
+            continue;
+        }
+
+        if (g_strv_length(fields) != nr_fields) {
+            error_setg(errp, "%s:%u: expected %u fields", path, i + 1,
+                       nr_fields);
+            return false;
+        }
+
+        if (!fn(opaque, fields, errp)) {
+            error_prepend(errp, "%s:%u: ", path, i + 1);
+            return false;
+        }
+    }
+
+    return true;
+}